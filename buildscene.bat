@@ -0,0 +1,17 @@
+@set OUT_DIR=build
+
+IF NOT EXIST %OUT_DIR%\ MKDIR %OUT_DIR% 
+
+::  ----------------- scenes
+:: exports scene descriptions into .scene files, see src/render/scene_format.h
+:: the renderer maps scene.scene from the working directory when it is there, buildscene.sh does the same on linux
+
+:: export tool
+@set SOURCE=src/tools/scene_export.cpp
+@set OUT_EXE=scene_export
+@set INCLUDES=/Isrc /Isrc\libs
+
+cl /nologo /std:c++20 /O2 %INCLUDES% %SOURCE% /Fe%OUT_DIR%/%OUT_EXE%.exe /Fo%OUT_DIR%/
+
+:: scene
+IF EXIST %OUT_DIR%\scene.txt %OUT_DIR%\%OUT_EXE%.exe %OUT_DIR%/scene.txt %OUT_DIR%/scene.scene
@@ -0,0 +1,16 @@
+#!/bin/sh
+# ----------------- scenes
+# exports scene descriptions into .scene files, see src/render/scene_format.h
+# the renderer maps scene.scene from the working directory when it is there
+# c++17 : libstdc++ puts std::lerp next to the one in types.h in c++20
+
+OUT_DIR=build
+mkdir -p $OUT_DIR
+
+# export tool
+g++ -std=c++17 -O2 -Isrc -Isrc/libs src/tools/scene_export.cpp -o $OUT_DIR/scene_export || exit 1
+
+# scene
+if [ -f $OUT_DIR/scene.txt ]; then
+	$OUT_DIR/scene_export $OUT_DIR/scene.txt $OUT_DIR/scene.scene
+fi
@@ -6,21 +6,21 @@
 
 @set OUT_DIR=build
 
-::  ----------------- add shader compiling here
+IF NOT EXIST %OUT_DIR%\ MKDIR %OUT_DIR% 
 
-:: TRIANGLE
-@set SOURCE=src/render/shader/triangle.hlsl
+::  ----------------- shader permutations
+:: every program listed in src/render/shader.h gets all its feature permutations compiled
+:: into a single cache file, add new programs there instead of here
 
-::ps
-@set OUT_FXC=triangle.ps.fxc
-@set ENTRY=ps
-@set PROFILE=ps_5_0
+:: bake tool
+@set SOURCE=src/tools/shader_bake.cpp
+@set OUT_EXE=shader_bake
+@set INCLUDES=/Isrc /Isrc\libs
 
-fxc /T %PROFILE% /E %ENTRY% /Fo %OUT_DIR%/%OUT_FXC% %SOURCE%
+cl /nologo /std:c++20 /O2 %INCLUDES% %SOURCE% /Fe%OUT_DIR%/%OUT_EXE%.exe /Fo%OUT_DIR%/
 
-::vs
-@set OUT_FXC=triangle.vs.fxc
-@set ENTRY=vs
-@set PROFILE=vs_5_0
+:: cache
+@set SHADER_DIR=src/render/shader
+@set OUT_CACHE=shaders.cache
 
-fxc /T %PROFILE% /E %ENTRY% /Fo %OUT_DIR%/%OUT_FXC% %SOURCE%
\ No newline at end of file
+%OUT_DIR%\%OUT_EXE%.exe %SHADER_DIR% %OUT_DIR%/%OUT_CACHE%
@@ -0,0 +1,17 @@
+@set OUT_DIR=build
+
+IF NOT EXIST %OUT_DIR%\ MKDIR %OUT_DIR% 
+
+::  ----------------- virtual textures
+:: cuts textures into tiles with all their mips, see src/render/virtual_texture.h
+:: the renderer opens them from the working directory, like the other textures
+
+:: bake tool
+@set SOURCE=src/tools/vt_bake.cpp
+@set OUT_EXE=vt_bake
+@set INCLUDES=/Isrc /Isrc\libs
+
+cl /nologo /std:c++20 /O2 %INCLUDES% %SOURCE% /Fe%OUT_DIR%/%OUT_EXE%.exe /Fo%OUT_DIR%/
+
+:: textures
+%OUT_DIR%\%OUT_EXE%.exe %OUT_DIR%/texture.png %OUT_DIR%/texture.vt
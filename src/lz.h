@@ -0,0 +1,156 @@
+/*  ----------------------------------- LZ
+	Our own LZ compression for the asset files that are not compressed already (virtual texture tiles).
+
+	Byte oriented, in the LZ4 way : no entropy coding, decoding is copies only and goes about as fast as
+	memory does. Assets are cut into chunks compressed on their own (a chunk is up to LZ_MAX_OFFSET
+	back-references apart), so any chunk can be read and decompressed on any thread straight into where
+	it ends up.
+
+	A chunk is a list of sequences :
+	- token : literal count in the high 4 bits, match length - LZ_MIN_MATCH in the low 4 bits, 15 means
+	  more follows as bytes of 255 until one that is not
+	- the literals
+	- match offset, 2 bytes little endian, back from the current position
+	The last sequence has literals only, it ends where the chunk ends.
+*/
+
+#ifndef _LZH_
+#define _LZH_
+
+#include <string.h>
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 12
+#define LZ_SKIP_SHIFT 6 // the longer nothing matches, the bigger the steps (incompressible data goes fast)
+#define LZ_BOUND(size) ((size) + (size) / 255 + 16) // worst case compressed size
+
+// ------------------------------- compression
+
+internal ui32 lz_hash(ui32 value) {
+	return (value * 2654435761u) >> (32 - LZ_HASH_BITS);
+};
+
+internal ui8* lz_write_length(ui8* out, ui32 length) {
+	while(length >= 255) {
+		*out++ = 255;
+		length -= 255;
+	};
+	*out++ = (ui8)length;
+	return out;
+};
+
+internal ui8* lz_write_literals(ui8* out, ui8* token, const ui8* literals, ui32 count) {
+	*token = (ui8)((count < 15 ? count : 15) << 4);
+	if(count >= 15) out = lz_write_length(out, count - 15);
+	memcpy(out, literals, count);
+	return out + count;
+};
+
+// compresses a chunk of size bytes into dst (LZ_BOUND(size) bytes), returns the compressed size
+ui32 lz_compress(void* dst, const void* src, ui32 size) {
+	const ui8* in = (const ui8*)src;
+	ui8* out = (ui8*)dst;
+
+	// last position each hash was seen at, + 1 (0 = never)
+	ui32 table[1 << LZ_HASH_BITS] = {};
+
+	ui32 anchor = 0;
+	ui32 pos = 0;
+	while(pos + LZ_MIN_MATCH <= size) {
+		ui32 value;
+		memcpy(&value, in + pos, 4);
+		ui32 hash = lz_hash(value);
+		ui32 candidate = table[hash];
+		table[hash] = pos + 1;
+
+		bool matched = candidate && pos - (candidate - 1) <= LZ_MAX_OFFSET;
+		if(matched) {
+			ui32 found;
+			memcpy(&found, in + candidate - 1, 4);
+			matched = found == value;
+		};
+		if(!matched) {
+			pos += 1 + ((pos - anchor) >> LZ_SKIP_SHIFT);
+			continue;
+		};
+		candidate--;
+
+		ui32 length = LZ_MIN_MATCH;
+		while(pos + length < size && in[candidate + length] == in[pos + length]) length++;
+
+		ui8* token = out++;
+		out = lz_write_literals(out, token, in + anchor, pos - anchor);
+
+		ui32 offset = pos - candidate;
+		*out++ = (ui8)offset;
+		*out++ = (ui8)(offset >> 8);
+
+		ui32 extra = length - LZ_MIN_MATCH;
+		*token |= (ui8)(extra < 15 ? extra : 15);
+		if(extra >= 15) out = lz_write_length(out, extra - 15);
+
+		pos += length;
+		anchor = pos;
+	};
+
+	ui8* token = out++;
+	out = lz_write_literals(out, token, in + anchor, size - anchor);
+	return (ui32)(out - (ui8*)dst);
+};
+
+// ------------------------------- decompression
+
+internal bool lz_read_length(const ui8** in, const ui8* in_end, ui32* length) {
+	ui8 byte;
+	do {
+		if(*in >= in_end) return false;
+		byte = *(*in)++;
+		*length += byte;
+	} while(byte == 255);
+	return true;
+};
+
+// decompresses a chunk into exactly dst_size bytes, false when the data is broken (never reads or writes out of bounds)
+bool lz_decompress(void* dst, ui32 dst_size, const void* src, ui32 src_size) {
+	const ui8* in = (const ui8*)src;
+	const ui8* in_end = in + src_size;
+	ui8* out = (ui8*)dst;
+	ui8* out_end = out + dst_size;
+
+	for(;;) {
+		if(in >= in_end) return false;
+		ui32 token = *in++;
+
+		ui32 literals = token >> 4;
+		if(literals == 15 && !lz_read_length(&in, in_end, &literals)) return false;
+		if(literals > (ui32)(in_end - in) || literals > (ui32)(out_end - out)) return false;
+		memcpy(out, in, literals);
+		out += literals;
+		in += literals;
+
+		// the last sequence has no match
+		if(in == in_end) return out == out_end;
+
+		if(in_end - in < 2) return false;
+		ui32 offset = in[0] | (in[1] << 8);
+		in += 2;
+		if(offset == 0 || offset > (ui32)(out - (ui8*)dst)) return false;
+
+		ui32 length = token & 15;
+		if(length == 15 && !lz_read_length(&in, in_end, &length)) return false;
+		length += LZ_MIN_MATCH;
+		if(length > (ui32)(out_end - out)) return false;
+
+		// a match closer than its length repeats itself, byte by byte
+		const ui8* match = out - offset;
+		if(offset >= length) {
+			memcpy(out, match, length);
+		} else {
+			for(ui32 i = 0; i < length; i++) out[i] = match[i];
+		};
+		out += length;
+	};
+};
+
+#endif /* _LZH_ */
@@ -73,9 +73,34 @@
 #include "types.h"
 #include "platform/platform.h"
 #include "platform/io.h"
+#include "platform/watcher.h"
+#include "platform/jobs.h"
+#include "platform/async_io.h"
 #include "parser.h"
+#include "lz.h"
+#include "render/shader.h"
+#include "render/pipeline.h"
+#include "render/fence.h"
+#include "render/ring.h"
+#include "render/texture_table.h"
+#include "render/virtual_texture.h"
+#include "render/lights.h"
+#include "render/cull.h"
+#include "render/occlusion.h"
+#include "render/shadows.h"
+#include "render/hiz.h"
+#include "render/gpu_cull.h"
+#include "render/post.h"
+#include "render/dynres.h"
+#include "render/record.h"
 #include "render/render.h"
+#include "render/scene_format.h"
+#include "render/scene.h"
+#include "render/texture.h"
+#include "render/atlas.h"
+#include "render/hotreload.h"
 #include "render/ui.h"
+#include "render/frame.h"
 
 // const f32 DEG_TO_RAD = PI / 180.0f;
 	
@@ -117,6 +142,182 @@ void camera_movement(Camera* camera, camera_settings* settings, POINT mouse_offs
 	camera->position.z = cam_pos.z;
 };
 
+// lights spread evenly on a sphere (fibonacci spiral) around the box, turning with time
+void lights_orbit(light_source* lights, ui32 count, f64 time){
+	f32 golden_angle = (f32)(M_PI * (3.0 - sqrt(5.0)));
+	
+	for(ui32 i = 0; i < count; i++) {
+		f32 y = 1.0f - 2.0f * (i + 0.5f) / count;
+		f32 ring = sqrtf(1.0f - y * y);
+		f32 angle = golden_angle * i + (f32)time * (0.2f + 0.3f * (i % 3));
+		f32 dist = 1.2f + 0.6f * sinf((f32)time + i);
+		
+		lights[i].pos = { cosf(angle) * ring * dist, y * dist, sinf(angle) * ring * dist };
+		lights[i].intensity = 0.25f;
+		lights[i].color = { 0.5f + 0.5f * cosf(i * 0.7f), 0.5f + 0.5f * cosf(i * 0.7f + 2.1f), 0.5f + 0.5f * cosf(i * 0.7f + 4.2f) };
+		lights[i].radius = 0.5f;
+	};
+};
+
+// what the render thread owns, the window thread does not touch any of it once the thread started
+struct render_thread {
+	HWND window;
+	render_context* rContext;
+	reload_context* reload;
+	frame_queue* frames;
+	
+	ui_draw_cache ui_draw;
+	viewport_size window_size;
+	ui32* visible; // max_meshes of the frame queue
+	ui32 clock_speed;
+	LARGE_INTEGER last_frame;
+};
+
+// draws a snapshot & presents it, what was measured goes back in the snapshot
+void render_frame(render_thread* thread, frame_snapshot* snapshot){
+	HRESULT hr;
+	render_context* rContext = thread->rContext;
+	viewport_size* window_size = &thread->window_size;
+	
+	LARGE_INTEGER c2;
+	QueryPerformanceCounter(&c2);
+	f32 frame_ms = (f32)((f64)(c2.QuadPart - thread->last_frame.QuadPart) * 1000.0 / thread->clock_speed);
+	thread->last_frame = c2;
+	
+	// picked in the ui
+	rContext->depth_prepass = snapshot->settings.depth_prepass;
+	rContext->occlusion_culling = snapshot->settings.occlusion_culling;
+	rContext->dynres.enabled = snapshot->settings.dynamic_resolution;
+	rContext->record.enabled = snapshot->settings.parallel_recording;
+	rContext->gpu_cull.enabled = snapshot->settings.gpu_culling;
+	rContext->occlusion.enabled = snapshot->settings.software_occlusion;
+	render_set_post_tier(rContext, snapshot->settings.post_tier);
+	
+	// swap in reloaded assets, nothing is bound for this frame yet
+	reload_update(thread->reload, rContext, snapshot->time);
+	
+	// reset frame and rendering data
+	render_reset_frame(rContext);
+	tracker_begin_frame(&rContext->tracker);
+	
+	// resize swap chain if needed + updates window_size too
+	render_resize_swapchain(thread->window, window_size, rContext);
+	
+	// can render only if window size is non-zero - we must have backbuffer & RenderTarget view created
+	if (rContext->rtView)
+	{
+		// tiles asked for by the feedback a few frames ago
+		render_update_virtual_textures(rContext);
+		
+		// the scene is drawn at render_size, stretched to the window at the end
+		render_update_resolution(rContext, window_size);
+		
+		// reset all our pipeline states and input assembler
+		render_pipeline_states(rContext, &rContext->render_size);
+		
+		// clear screen
+		f32 color[4] = { 0.2f, 0.2f, 0.2f, 1.f }; // black
+		render_clear_screen(rContext, color);
+		
+		// ----- upload stuff to the gpu before rendering
+		
+		// resize the camera and send it, the lights are binned for it
+		render_set_lights(rContext, snapshot->lights, snapshot->light_count);
+		render_upload_frame_buffer(rContext, &snapshot->camera, rContext->render_size);
+		
+		// ----- rendering
+		
+		mesh* scene = snapshot->meshes;
+		ui32* visible = thread->visible;
+		
+		// what the camera sees, the hidden meshes still cast shadows (with gpu culling, the compute pass runs here)
+		ui32 visible_count = render_cull_meshes(rContext, scene, snapshot->mesh_count, visible);
+		
+		// which virtual texture tiles the meshes need, read back a few frames later
+		if(render_begin_feedback(rContext)) {
+			render_draw_meshes(rContext, scene, visible, visible_count, &rContext->render_size);
+			render_end_feedback(rContext, &rContext->render_size);
+		};
+		
+		render_draw_shadows(rContext, scene, snapshot->mesh_count, &rContext->render_size);
+		
+		// depth first, the scene then shades every pixel once
+		if(render_begin_prepass(rContext)) {
+			render_draw_meshes(rContext, scene, visible, visible_count, &rContext->render_size);
+			render_draw_gpu_culled(rContext, &rContext->render_size);
+			render_end_prepass(rContext);
+		};
+		
+		// long lists are recorded on the workers, what the gpu culled is one indirect draw per batch
+		render_draw_meshes(rContext, scene, visible, visible_count, &rContext->render_size);
+		render_draw_gpu_culled(rContext, &rContext->render_size);
+		
+		// depth of this frame, what the meshes are tested against a few frames from now
+		render_build_hiz(rContext, &rContext->render_size);
+		
+		// hdr scene -> backbuffer, the ui goes on top
+		render_post_process(rContext, window_size);
+		
+		ui_render_draw_data(&thread->ui_draw, rContext, &snapshot->ui);
+	}
+	
+	// what the cpu spent on the frame, the resolution is only lowered when the gpu is the slow side
+	LARGE_INTEGER c3;
+	QueryPerformanceCounter(&c3);
+	dynres_set_cpu_time(&rContext->dynres, (f32)((f64)(c3.QuadPart - c2.QuadPart) * 1000.0 / thread->clock_speed));
+	
+	// change to FALSE to disable vsync
+	BOOL vsync = FALSE;
+	hr = rContext->swapChain->Present(vsync ? 1 : 0, 0);
+	tracker_unbind_targets(&rContext->tracker);
+	render_end_frame(rContext);
+	
+	frame_feedback* feedback = &snapshot->feedback;
+	feedback->frame = snapshot->frame;
+	feedback->stats = ui_collect_frame_stats(rContext, &thread->ui_draw, frame_ms);
+	feedback->render_size = rContext->render_size;
+	feedback->resolution_scale = rContext->dynres.scale;
+	feedback->msaa_samples = rContext->post.samples;
+	feedback->bloom_mips = rContext->post.bloom_mips;
+	feedback->reload_count = thread->reload->reload_count;
+	feedback->reload_failed = thread->reload->failed_count;
+	feedback->command_lists = rContext->record.lists;
+	feedback->gpu_objects = rContext->gpu_cull.object_count;
+	feedback->gpu_uploads = rContext->gpu_cull.uploaded;
+	
+	// debug code
+	hr = rContext->device->GetDeviceRemovedReason();
+	
+	if (hr == DXGI_STATUS_OCCLUDED)
+	{
+		// window is minimized, cannot vsync - instead sleep a bit
+		if (vsync)
+		{
+			Sleep(10);
+		}
+	}	
+	else if (FAILED(hr))
+	{
+		FatalError("Failed to present swap chain! Device lost?");
+	}
+};
+
+// draws the snapshots in the order they were published, until one says to stop
+DWORD WINAPI render_thread_main(LPVOID param){
+	render_thread* thread = (render_thread*)param;
+	QueryPerformanceCounter(&thread->last_frame);
+	
+	for(;;) {
+		frame_snapshot* snapshot = frame_queue_wait(thread->frames);
+		if(snapshot->quit) break;
+		
+		render_frame(thread, snapshot);
+		frame_queue_release(thread->frames);
+	};
+	
+	return 0;
+};
+
 int WINAPI WinMain(HINSTANCE instance, HINSTANCE previnstance, LPSTR cmdline, int cmdshow)
 {
 	HRESULT hr;
@@ -152,9 +353,27 @@ int WINAPI WinMain(HINSTANCE instance, HINSTANCE previnstance, LPSTR cmdline, in
 		.fps = 0,
 		.fps_display_delay = 0.05f, // in seconds
 	};
+	ui_telemetry_init(&uiContext.telemetry);
+	
+	// only rebuilt when what it shows changes
+	ui_panel test_panel = { .name = "test" };
+	
+	// worker threads for anything that splits into independent jobs
+	job_system jobs;
+	jobs_init(&jobs, 0);
+	rContext.jobs = &jobs;
+	
+	// file reads that do not block a thread, completions go to the jobs
+	async_io io;
+	async_io_init(&io, &jobs);
+	rContext.io = &io;
 	
 	// init rendering context
 	hr = render_init_d3d11(window, &rContext);
+	
+	// watch shaders & textures, changes get swapped in at the start of a frame
+	reload_context reloadContext = {0};
+	reload_init(&reloadContext, rContext.device);
 
 
     // show the window
@@ -222,18 +441,137 @@ int WINAPI WinMain(HINSTANCE instance, HINSTANCE previnstance, LPSTR cmdline, in
 		.vertices = vertice_data,
 		.index_count = 36,
 		.indices = indices,
+		.material = rContext.default_material,
+		.virtual_texture = rContext.default_virtual_texture,
+		.radius = 0.866f, // half diagonal
+		.dynamic = true,
+	};
+	
+	// something for the box to cast its shadow on
+	vertex floor_vertices[] =
+	{
+		{{-4.0f, 0.0f, -4.0f}, {0.0f, 0.0f}, {1.0f, 1.0f, 1.0f, 1.0f}},
+		{{ 4.0f, 0.0f,  4.0f}, {1.0f, 1.0f}, {1.0f, 1.0f, 1.0f, 1.0f}},
+		{{ 4.0f, 0.0f, -4.0f}, {1.0f, 0.0f}, {1.0f, 1.0f, 1.0f, 1.0f}},
+		{{-4.0f, 0.0f,  4.0f}, {0.0f, 1.0f}, {1.0f, 1.0f, 1.0f, 1.0f}},
+	};
+	ui16 floor_indices[] = { 0, 1, 2,  1, 0, 3 };
+	
+	// a second box with its own uvs, both get their texture from an atlas page
+	vertex crate_vertices[ARRAYSIZE(vertice_data)];
+	memcpy(crate_vertices, vertice_data, sizeof(vertice_data));
+	
+	// small sprites made here (rgba, little endian), packed together at load time
+	ui32 checker_pixels[64 * 64];
+	for(ui32 y = 0; y < 64; y++) {
+		for(ui32 x = 0; x < 64; x++) checker_pixels[y * 64 + x] = ((x / 8 + y / 8) & 1) ? 0xff808080 : 0xffd0d0d0;
+	};
+	ui32 crate_pixels[32 * 32];
+	for(ui32 y = 0; y < 32; y++) {
+		for(ui32 x = 0; x < 32; x++) {
+			bool border = x < 3 || y < 3 || x >= 29 || y >= 29 || x == y || x == 31 - y;
+			crate_pixels[y * 32 + x] = border ? 0xff1f3f6f : 0xff3f7fbf;
+		};
+	};
+	atlas_image sprite_images[] = {
+		{ .name = "floor", .width = 64, .height = 64, .pixels = checker_pixels },
+		{ .name = "crate", .width = 32, .height = 32, .pixels = crate_pixels },
 	};
 	
+	atlas_context* atlas = (atlas_context*)VirtualAlloc(0, sizeof(atlas_context), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	atlas_init(atlas, 256, 256, 2);
+	ui32 sprite_ids[ARRAYSIZE(sprite_images)];
+	atlas_add_images(atlas, sprite_images, ARRAYSIZE(sprite_images), sprite_ids);
+	atlas_upload(atlas, &rContext);
+	
+	ui32 floor_material = rContext.default_material;
+	ui32 crate_material = rContext.default_material;
+	if(sprite_ids[0] < ATLAS_MAX_SPRITES && atlas_sprite_material(atlas, sprite_ids[0]) != TEXTURE_INVALID) {
+		atlas_map_uvs(atlas, sprite_ids[0], floor_vertices, ARRAYSIZE(floor_vertices));
+		floor_material = atlas_sprite_material(atlas, sprite_ids[0]);
+	}
+	if(sprite_ids[1] < ATLAS_MAX_SPRITES && atlas_sprite_material(atlas, sprite_ids[1]) != TEXTURE_INVALID) {
+		atlas_map_uvs(atlas, sprite_ids[1], crate_vertices, ARRAYSIZE(crate_vertices));
+		crate_material = atlas_sprite_material(atlas, sprite_ids[1]);
+	}
+	
+	// static meshes, their shadows are drawn once and then come from the cascade cache
+	mesh scene[3 + 16 * 16] = {
+		mesh_data,
+		{
+			.pos = { 1.5f, -0.5f, 1.0f },
+			.vertex_count = 8,
+			.vertices = crate_vertices,
+			.index_count = 36,
+			.indices = indices,
+			.material = crate_material,
+			.radius = 0.866f,
+		},
+		{
+			.pos = { 0.0f, -1.0f, 0.0f },
+			.vertex_count = 4,
+			.vertices = floor_vertices,
+			.index_count = 6,
+			.indices = floor_indices,
+			.material = floor_material,
+			.radius = 5.66f,
+			.occluder = true,
+		},
+	};
+	
+	// a grid of boxes under the floor, in the frustum but hidden : the hi-z readback keeps them off the gpu
+	for(ui32 i = 3; i < ARRAYSIZE(scene); i++) {
+		scene[i] = scene[1];
+		scene[i].pos = { -3.5f + 0.5f * (f32)((i - 3) % 16), -2.0f, -3.5f + 0.5f * (f32)((i - 3) / 16) };
+	};
+	
+	// written by scene_export, drawn instead of the test scene when it is there
+	scene_data loadedScene;
+	mesh* scene_meshes = scene;
+	ui32 scene_mesh_count = ARRAYSIZE(scene);
+	char sceneLocation[] = "scene.scene";
+	if(scene_load(&rContext, &loadedScene, sceneLocation)) {
+		scene_meshes = loadedScene.meshes;
+		scene_mesh_count = loadedScene.mesh_count;
+	}
+	
+	// many small lights, only the ones touching a pixel's cluster are shaded there
+	light_source lights[1024];
+	
+	// what the ui can change, handed to the render thread with every frame
+	frame_settings settings = {
+		.depth_prepass = rContext.depth_prepass,
+		.occlusion_culling = rContext.occlusion_culling,
+		.dynamic_resolution = rContext.dynres.enabled,
+		.post_tier = rContext.post.requested_tier,
+		.parallel_recording = rContext.record.enabled,
+		.gpu_culling = rContext.gpu_cull.enabled,
+		.software_occlusion = rContext.occlusion.enabled,
+	};
+	
+	// last thing the render thread measured, a couple of frames old
+	frame_feedback feedback = {0};
+	
+	// the device context, the swap chain & the hot reload belong to the render thread from here on
+	frame_queue frames;
+	frame_queue_init(&frames, scene_mesh_count);
+	
+	render_thread renderThread = {
+		.window = window,
+		.rContext = &rContext,
+		.reload = &reloadContext,
+		.frames = &frames,
+		.visible = (ui32*)VirtualAlloc(0, sizeof(ui32) * scene_mesh_count, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE),
+		.clock_speed = platformClockSpeed,
+	};
+	HANDLE renderHandle = CreateThread(NULL, 0, render_thread_main, &renderThread, 0, NULL);
+	
 	//  ------------------------------------------- frame loop
 	
 	
 	
 	for (;;)
     {
-		// update states here
-		f64 new_time = platform_get_time(platformClockSpeed);
-		// window_size = platform_get_window_size(window);
-	
         // windows api message processing
         MSG msg;
         if (PeekMessageW(&msg, NULL, 0, 0, PM_REMOVE))
@@ -255,6 +593,16 @@ int WINAPI WinMain(HINSTANCE instance, HINSTANCE previnstance, LPSTR cmdline, in
             continue;
         }
 		
+		// the render thread has every slot, sleep until it gives one back or a message comes in
+		frame_snapshot* snapshot = frame_queue_acquire(&frames);
+		if (!snapshot)
+		{
+			MsgWaitForMultipleObjects(1, &frames.free, FALSE, INFINITE, QS_ALLINPUT);
+			continue;
+		}
+		
+		// update states here
+		f64 new_time = platform_get_time(platformClockSpeed);
 		
 		// handle camera movement with mouse input 
 		
@@ -291,84 +639,133 @@ int WINAPI WinMain(HINSTANCE instance, HINSTANCE previnstance, LPSTR cmdline, in
 			
 			// update fps
 			update_ui_context(&uiContext, 1.0f/delta, new_time);
+			
+		// what the render thread measured the last time it drew this slot
+		if (snapshot->feedback.frame)
+		{
+			feedback = snapshot->feedback;
+			ui_telemetry_record(&uiContext.telemetry, &feedback.stats);
+		}
 		
-		// --------------------------- RENDERING
-
-        // reset frame and rendering data
-		render_reset_frame(&rContext);
+		// --------------------------- SIMULATION
 		
-		// resize swap chain if needed + updates window_size too
-		render_resize_swapchain(window, &window_size, &rContext);
-
-        // can render only if window size is non-zero - we must have backbuffer & RenderTarget view created
-        if (rContext.rtView)
-        {
-            // reset all our pipeline states and input assembler
-			render_pipeline_states(&rContext, &window_size);
+		// the box bobs up & down, the only caster drawn in the cascades every frame
+		scene[0].pos.y = 0.25f * sinf((f32)new_time);
+		lights_orbit(lights, ARRAYSIZE(lights), new_time);
+		
+		// --------------------------- UI
+		
+		imgui_render();
+		
+		// everything the test panel displays
+		ui64 test_values = hash_fnv64(&uiContext.fps, sizeof(f32), 0);
+		test_values = hash_fnv64(&current_mouse_settings.mouse_pos, sizeof(POINT), test_values);
+		test_values = hash_fnv64(&current_mouse_settings.current_mouse_mode, sizeof(mouse_mode), test_values);
+		test_values = hash_fnv64(&camera.target, sizeof(v3), test_values);
+		test_values = hash_fnv64(&feedback.reload_count, sizeof(ui32), test_values);
+		test_values = hash_fnv64(&feedback.reload_failed, sizeof(ui32), test_values);
+		test_values = hash_fnv64(&settings.depth_prepass, sizeof(bool), test_values);
+		test_values = hash_fnv64(&settings.occlusion_culling, sizeof(bool), test_values);
+		test_values = hash_fnv64(&settings.post_tier, sizeof(ui32), test_values);
+		test_values = hash_fnv64(&feedback.msaa_samples, sizeof(ui32), test_values);
+		test_values = hash_fnv64(&feedback.bloom_mips, sizeof(ui32), test_values);
+		test_values = hash_fnv64(&settings.dynamic_resolution, sizeof(bool), test_values);
+		test_values = hash_fnv64(&feedback.render_size, sizeof(viewport_size), test_values);
+		test_values = hash_fnv64(&settings.parallel_recording, sizeof(bool), test_values);
+		test_values = hash_fnv64(&feedback.command_lists, sizeof(ui32), test_values);
+		test_values = hash_fnv64(&settings.gpu_culling, sizeof(bool), test_values);
+		test_values = hash_fnv64(&settings.software_occlusion, sizeof(bool), test_values);
+		test_values = hash_fnv64(&feedback.gpu_objects, sizeof(ui32), test_values);
+		test_values = hash_fnv64(&feedback.gpu_uploads, sizeof(ui32), test_values);
+		
+		if(ui_panel_begin(&test_panel, test_values)){
+			ImGui::Text("FPS : %f", uiContext.fps);
+			ImGui::Text("[Mouse coords] X: %d Y: %d", current_mouse_settings.mouse_pos.x, current_mouse_settings.mouse_pos.y);
+			ImGui::Text("[Camera target] X: %f Y: %f", camera.target.x, camera.target.y);
+			ImGui::Text("[Hot reload] reloaded: %u failed: %u", feedback.reload_count, feedback.reload_failed);
 			
-			// clear screen
-			f32 color[4] = { 0.2f, 0.2f, 0.2f, 1.f }; // black
-			render_clear_screen(&rContext, color);
+			if(ImGui::Button("camera mode")){
+				if(current_mouse_settings.current_mouse_mode == FREE) {
+					current_mouse_settings.current_mouse_mode = CAMERA;
+					ShowCursor(FALSE);
+				} else {
+					current_mouse_settings.current_mouse_mode = FREE;
+					ShowCursor(TRUE);
+				};
+			};
 			
-			// ----- upload stuff to the gpu before rendering
+			if(current_mouse_settings.current_mouse_mode == FREE) {
+				ImGui::Text("Mouse mode: FREE");
+			} else {
+				ImGui::Text("Mouse mode: CAMERA");
+			};
 			
-			// resize the camera and send it
-			render_upload_frame_buffer(&rContext, &camera, window_size);
+			ImGui::Checkbox("depth prepass", &settings.depth_prepass);
+			ImGui::Checkbox("hi-z occlusion culling", &settings.occlusion_culling);
+			ImGui::Checkbox("software occlusion culling", &settings.software_occlusion);
 			
+			// targets are made again at the start of the frame it reaches the render thread
+			if(ImGui::BeginCombo("quality", post_tiers[settings.post_tier].name)) {
+				for(ui32 i = 0; i < POST_TIER_COUNT; i++) {
+					if(ImGui::Selectable(post_tiers[i].name, i == settings.post_tier)) settings.post_tier = i;
+				};
+				ImGui::EndCombo();
+			};
+			ImGui::Text("[Post] msaa: %ux bloom mips: %u", feedback.msaa_samples, feedback.bloom_mips);
 			
-			// ----- rendering
-			render_draw_mesh(&rContext, mesh_data);
+			ImGui::Checkbox("dynamic resolution", &settings.dynamic_resolution);
+			ImGui::Text("[Resolution] %d x %d (%.0f%%)", feedback.render_size.width, feedback.render_size.height, feedback.resolution_scale * 100.0f);
 			
-			// IMGUI RENDER
-			imgui_render();
+			ImGui::Checkbox("parallel recording", &settings.parallel_recording);
+			ImGui::Text("[Recording] command lists: %u", feedback.command_lists);
 			
-			if(ImGui::Begin("test")){
-				ImGui::Text("FPS : %f", uiContext.fps);
-				ImGui::Text("[Mouse coords] X: %d Y: %d", current_mouse_settings.mouse_pos.x, current_mouse_settings.mouse_pos.y);
-				ImGui::Text("[Camera target] X: %f Y: %f", camera.target.x, camera.target.y);
-				
-				if(ImGui::Button("camera mode")){
-					if(current_mouse_settings.current_mouse_mode == FREE) {
-						current_mouse_settings.current_mouse_mode = CAMERA;
-						ShowCursor(FALSE);
-					} else {
-						current_mouse_settings.current_mouse_mode = FREE;
-						ShowCursor(TRUE);
-					};
-				};
-				
-				if(current_mouse_settings.current_mouse_mode == FREE) {
-					ImGui::Text("Mouse mode: FREE");
-				} else {
-					ImGui::Text("Mouse mode: CAMERA");
-				};
-				
-			} ImGui::End();
-
-			ImGui::Render();
-			ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData());
-        }
-
-        // change to FALSE to disable vsync
-        BOOL vsync = FALSE;
-        hr = rContext.swapChain->Present(vsync ? 1 : 0, 0);
+			ImGui::Checkbox("gpu culling", &settings.gpu_culling);
+			ImGui::Text("[GPU culling] objects: %u uploaded: %u", feedback.gpu_objects, feedback.gpu_uploads);
+			
+		} ui_panel_end(&test_panel);
 		
-		// debug code
-		hr = rContext.device->GetDeviceRemovedReason();
+		// bind stats, ui uploads and frame times, one row per frame
+		ui_telemetry_window(&uiContext);
 		
-        if (hr == DXGI_STATUS_OCCLUDED)
-        {
-            // window is minimized, cannot vsync - instead sleep a bit
-            if (vsync)
-            {
-                Sleep(10);
-            }
-        }	
-        else if (FAILED(hr))
-        {
-            FatalError("Failed to present swap chain! Device lost?");
-        }
+		ImGui::Render();
+		ui_panel_submit(&test_panel, ImGui::GetDrawData());
+		
+		// --------------------------- HAND OFF
+		
+		snapshot->time = new_time;
+		snapshot->camera = camera;
+		snapshot->settings = settings;
+		frame_snapshot_set_meshes(&frames, snapshot, scene_meshes, scene_mesh_count);
+		frame_snapshot_set_lights(snapshot, lights, ARRAYSIZE(lights));
+		frame_snapshot_set_ui(snapshot, ImGui::GetDrawData());
+		frame_queue_publish(&frames);
 		
 		currentTime = new_time;
     }
-}
\ No newline at end of file
+	
+	// the render thread draws what it already has and stops, Present may still need messages handled until it is gone
+	frame_snapshot* last;
+	while (!(last = frame_queue_acquire(&frames)))
+	{
+		MsgWaitForMultipleObjects(1, &frames.free, FALSE, INFINITE, QS_ALLINPUT);
+		platform_pump_messages();
+	}
+	last->quit = true;
+	frame_queue_publish(&frames);
+	while (MsgWaitForMultipleObjects(1, &renderHandle, FALSE, INFINITE, QS_ALLINPUT) != WAIT_OBJECT_0)
+	{
+		platform_pump_messages();
+	}
+	CloseHandle(renderHandle);
+	
+	frame_queue_destroy(&frames);
+	VirtualFree(renderThread.visible, 0, MEM_RELEASE);
+	reload_shutdown(&reloadContext);
+	
+	// the completion thread & the workers are stopped last, the renderer may still wait on them
+	render_shutdown(&rContext);
+	async_io_shutdown(&io);
+	jobs_shutdown(&jobs);
+	
+	return 0;
+}
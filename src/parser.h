@@ -14,13 +14,45 @@ typedef struct complete_img {
 	void *memory;
 } complete_img;
 
+// one image of a batch decoded on the job system
+typedef struct parse_img_job {
+	char *location; // NULL : nothing to do
+	complete_file file;
+	complete_img img;
+	
+	// where to decode, opened with parse_open_img. NULL : the file is read and the pixels allocated
+	void *dst;
+	ui32 row_pitch;
+	bool ok;
+} parse_img_job;
+
+#include "png.h"
+
 // ---------------------------- parsing time!
 
-// todo: finish this
+// files parse_decode_img reads (png with our decoder, the others with stb), by extension
+const char *parse_img_extensions[] = { ".png", ".jpg", ".jpeg", ".bmp", ".tga" };
+
+bool parse_is_img(char *filename) {
+	char *extension = strrchr(filename, '.');
+	if(!extension) return false;
+	
+	for(ui32 i = 0; i < ARRAYSIZE(parse_img_extensions); i++) {
+		if(_stricmp(extension, parse_img_extensions[i]) == 0) return true;
+	}
+	return false;
+}
+
+// always decodes to rgba, free the pixels with parse_free_img
 complete_img parse_decode_img(char *location, complete_file *file) {
 	complete_img img = {0};
 	
 	io_file_fullread(location, file);
+	if(!file->memory) return img;
+	
+	// our decoder handles the common pngs, stb does everything else (jpg, 16 bits, interlaced...)
+	if(png_decode(file->memory, file->size, &img)) return img;
+	
 	int x; 
 	int y;
 	int channels_in_file;
@@ -31,4 +63,69 @@ complete_img parse_decode_img(char *location, complete_file *file) {
 	return img;
 }
 
-#endif /* _PARSERH_ */
\ No newline at end of file
+// reads the file and the size of the image, nothing is decoded yet
+bool parse_open_img(char *location, complete_file *file, complete_img *img) {
+	io_file_fullread(location, file);
+	if(!file->memory) return false;
+	
+	if(png_get_info(file->memory, file->size, img)) return true;
+	
+	int x;
+	int y;
+	int channels_in_file;
+	if(!stbi_info_from_memory((stbi_uc*)file->memory, file->size, &x, &y, &channels_in_file)) return false;
+	img->x = (ui32)x;
+	img->y = (ui32)y;
+	img->channels_in_file = (ui32)channels_in_file;
+	return true;
+}
+
+// decodes an opened image as rgba straight into dst (mapped upload memory...), rows are row_pitch bytes apart
+bool parse_decode_img_to(complete_file *file, complete_img *img, void *dst, ui32 row_pitch) {
+	if(png_decode_to(file->memory, file->size, dst, row_pitch)) return true;
+	
+	// stb cannot write into our memory, the formats it handles pay one more copy
+	int x;
+	int y;
+	int channels_in_file;
+	stbi_uc *pixels = stbi_load_from_memory((stbi_uc*)file->memory, file->size, &x, &y, &channels_in_file, 4);
+	if(!pixels) return false;
+	
+	bool ok = (ui32)x == img->x && (ui32)y == img->y;
+	if(ok) {
+		for(ui32 row = 0; row < img->y; row++) {
+			memcpy((ui8*)dst + (size_t)row * row_pitch, pixels + (size_t)row * img->x * 4, img->x * 4);
+		}
+	}
+	stbi_image_free(pixels);
+	return ok;
+}
+
+// both decoders allocate with malloc (stb's default STBI_MALLOC)
+void parse_free_img(complete_img *img) {
+	free(img->memory);
+	img->memory = NULL;
+}
+
+internal void parse_decode_img_job(void *data) {
+	parse_img_job *batch = (parse_img_job*)data;
+	if(!batch->location) return;
+	
+	if(batch->dst) {
+		batch->ok = parse_decode_img_to(&batch->file, &batch->img, batch->dst, batch->row_pitch);
+	} else {
+		batch->img = parse_decode_img(batch->location, &batch->file);
+		batch->ok = batch->img.memory != NULL;
+	}
+}
+
+// decodes the images of a batch concurrently, the files stay loaded (io_file_fullfree them with the images)
+void parse_decode_imgs(job_system *jobs, parse_img_job *batch, ui32 count) {
+	volatile LONG counter = 0;
+	for(ui32 i = 0; i < count; i++) {
+		jobs_push(jobs, parse_decode_img_job, &batch[i], &counter);
+	}
+	jobs_wait(jobs, &counter);
+}
+
+#endif /* _PARSERH_ */
@@ -0,0 +1,243 @@
+/*  ----------------------------------- INFOS
+    This header file contains the asynchronous file reads : an I/O completion port and a pool of read buffers.
+
+	Reads are queued with async_io_read, then sent together by async_io_submit : the disk gets the whole
+	batch at once instead of one blocking read per job. Each read gets a buffer from the pool, aligned so
+	files opened unbuffered (FILE_FLAG_NO_BUFFERING, for big streamed files the os cache would only fill
+	up with) can be read into it. A completion thread waits on the port and hands every finished read to
+	the job system, its callback runs there. The buffer is the caller's until async_io_release.
+
+	Reads are counted on the counter given with them from async_io_read until their callback is done,
+	jobs_wait on it like on any job. Queue and submit from one thread, release from any.
+	Without a completion port (or when opening a file for it fails) reads are jobs doing a blocking read.
+
+*/
+
+// LOCAL DEPENDENCIES : io.h, jobs.h
+
+#ifndef _ASYNCIOH_
+#define _ASYNCIOH_
+
+#define ASYNC_IO_MAX_READS 64 // in flight, one pool buffer each
+#define ASYNC_IO_BLOCK_SIZE (128 * 1024) // of a pool buffer, a read must fit with its alignment
+#define ASYNC_IO_ALIGNMENT 4096 // unbuffered offsets & sizes, covers 512 and 4k sectors
+#define ASYNC_IO_COMPLETION_BATCH 32 // completions taken from the port at once
+
+//  ------------------------------------ STRUCTS
+
+typedef struct async_io_file {
+	HANDLE handle; // INVALID_HANDLE_VALUE when the file could not be opened
+	bool unbuffered;
+	bool overlapped; // associated with the port, false when reads fall back to jobs
+} async_io_file;
+
+typedef struct async_io_request async_io_request;
+typedef void async_io_callback(async_io_request *request);
+
+struct async_io_request {
+	OVERLAPPED overlapped; // first, the port gives it back
+	struct async_io *io;
+	async_io_file *file;
+	ui64 offset; // what the caller asked for
+	ui32 size;
+	ui32 skip; // from the start of the buffer to the bytes asked for (unbuffered reads start earlier)
+	ui32 read_size; // what is actually read
+
+	ui8 *buffer; // ASYNC_IO_BLOCK_SIZE, aligned
+	ui8 *data; // the bytes asked for, valid once ok
+	bool ok;
+
+	async_io_callback *callback; // NULL : nothing to run, only the counter
+	void *user;
+	volatile LONG *counter;
+};
+
+typedef struct async_io {
+	job_system *jobs;
+	HANDLE port; // NULL : every read falls back to the job system
+	HANDLE thread;
+
+	async_io_request requests[ASYNC_IO_MAX_READS];
+	void *pool;
+	ui32 free[ASYNC_IO_MAX_READS]; // requests not in use
+	ui32 free_count;
+	SRWLOCK lock;
+
+	async_io_request *pending[ASYNC_IO_MAX_READS]; // queued, not submitted yet
+	ui32 pending_count;
+
+	// stats
+	volatile LONG submitted;
+	volatile LONG completed;
+	volatile LONG failed;
+} async_io;
+
+//  ------------------------------------ FUNCTIONS
+
+internal void async_io_callback_job(void *data) {
+	async_io_request *request = (async_io_request*)data;
+	request->callback(request);
+}
+
+// the read is over (ok or not) : its callback goes to the job system, then the hold from async_io_read is let go
+internal void async_io_complete(async_io_request *request, DWORD bytes) {
+	async_io *io = request->io;
+	request->ok = bytes >= request->skip + request->size;
+	request->data = request->buffer + request->skip;
+
+	InterlockedIncrement(&io->completed);
+	if (!request->ok) InterlockedIncrement(&io->failed);
+
+	if (request->callback) jobs_push(io->jobs, async_io_callback_job, request, request->counter);
+	InterlockedDecrement(request->counter);
+}
+
+internal DWORD WINAPI async_io_completion_thread(LPVOID param) {
+	async_io *io = (async_io*)param;
+	OVERLAPPED_ENTRY entries[ASYNC_IO_COMPLETION_BATCH];
+
+	for (;;) {
+		ULONG count = 0;
+		if (!GetQueuedCompletionStatusEx(io->port, entries, ASYNC_IO_COMPLETION_BATCH, &count, INFINITE, FALSE)) continue;
+
+		for (ULONG i = 0; i < count; i++) {
+			// posted by async_io_shutdown
+			if (!entries[i].lpOverlapped) return 0;
+
+			async_io_complete((async_io_request*)entries[i].lpOverlapped, entries[i].dwNumberOfBytesTransferred);
+		}
+	}
+}
+
+// no port for this read, it blocks a worker instead
+internal void async_io_fallback_job(void *data) {
+	async_io_request *request = (async_io_request*)data;
+	bool ok = io_file_read_at(request->file->handle, request->offset, request->buffer, request->size);
+	async_io_complete(request, ok ? request->size : 0);
+}
+
+void async_io_init(async_io *io, job_system *jobs) {
+	memset(io, 0, sizeof(async_io));
+	InitializeSRWLock(&io->lock);
+	io->jobs = jobs;
+
+	// VirtualAlloc gives pages, the block size keeps every buffer aligned
+	io->pool = VirtualAlloc(0, (SIZE_T)ASYNC_IO_BLOCK_SIZE * ASYNC_IO_MAX_READS, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	for (ui32 i = 0; i < ASYNC_IO_MAX_READS; i++) {
+		io->requests[i].io = io;
+		io->requests[i].buffer = (ui8*)io->pool + (SIZE_T)ASYNC_IO_BLOCK_SIZE * i;
+		io->free[i] = ASYNC_IO_MAX_READS - 1 - i;
+	}
+	io->free_count = ASYNC_IO_MAX_READS;
+
+	// one thread waits on the port, the work itself is done on the job system
+	io->port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+	if (io->port) {
+		io->thread = CreateThread(NULL, 0, async_io_completion_thread, io, 0, NULL);
+		if (!io->thread) {
+			CloseHandle(io->port);
+			io->port = NULL;
+		}
+	}
+}
+
+// read only, unbuffered for big files read in large pieces (offsets no longer need to be aligned by the caller)
+async_io_file async_io_open(async_io *io, char *location, bool unbuffered) {
+	async_io_file file = {0};
+
+	if (io->port) {
+		DWORD flags = FILE_FLAG_OVERLAPPED | (unbuffered ? FILE_FLAG_NO_BUFFERING : 0);
+		file.handle = CreateFileA(location, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, flags, NULL);
+		if (file.handle != INVALID_HANDLE_VALUE) {
+			if (CreateIoCompletionPort(file.handle, io->port, 0, 0)) {
+				file.unbuffered = unbuffered;
+				file.overlapped = true;
+				return file;
+			}
+			CloseHandle(file.handle);
+		}
+	}
+
+	file.handle = io_create_handle(location);
+	return file;
+}
+
+void async_io_close(async_io_file *file) {
+	if (file->handle != INVALID_HANDLE_VALUE) CloseHandle(file->handle);
+	file->handle = INVALID_HANDLE_VALUE;
+}
+
+// queues a read of size bytes at offset, NULL when the pool is empty or the read does not fit a buffer
+async_io_request *async_io_read(async_io *io, async_io_file *file, ui64 offset, ui32 size, async_io_callback *callback, void *user, volatile LONG *counter) {
+	ui64 start = file->unbuffered ? offset & ~(ui64)(ASYNC_IO_ALIGNMENT - 1) : offset;
+	ui32 skip = (ui32)(offset - start);
+	ui32 read_size = file->unbuffered ? (skip + size + ASYNC_IO_ALIGNMENT - 1) & ~(ui32)(ASYNC_IO_ALIGNMENT - 1) : size;
+	if (read_size > ASYNC_IO_BLOCK_SIZE || io->pending_count == ASYNC_IO_MAX_READS) return NULL;
+
+	async_io_request *request = NULL;
+	AcquireSRWLockExclusive(&io->lock);
+	if (io->free_count) {
+		request = &io->requests[io->free[--io->free_count]];
+	}
+	ReleaseSRWLockExclusive(&io->lock);
+	if (!request) return NULL;
+
+	memset(&request->overlapped, 0, sizeof(OVERLAPPED));
+	request->overlapped.Offset = (DWORD)start;
+	request->overlapped.OffsetHigh = (DWORD)(start >> 32);
+	request->file = file;
+	request->offset = offset;
+	request->size = size;
+	request->skip = skip;
+	request->read_size = read_size;
+	request->data = NULL;
+	request->ok = false;
+	request->callback = callback;
+	request->user = user;
+	request->counter = counter;
+
+	// held until the read completes
+	InterlockedIncrement(counter);
+	io->pending[io->pending_count++] = request;
+	return request;
+}
+
+// sends every queued read
+void async_io_submit(async_io *io) {
+	for (ui32 i = 0; i < io->pending_count; i++) {
+		async_io_request *request = io->pending[i];
+		InterlockedIncrement(&io->submitted);
+
+		if (!request->file->overlapped) {
+			jobs_push(io->jobs, async_io_fallback_job, request, request->counter);
+			continue;
+		}
+
+		// finished right away or not, the completion goes through the port
+		if (!ReadFile(request->file->handle, request->buffer, request->read_size, NULL, &request->overlapped) && GetLastError() != ERROR_IO_PENDING) {
+			async_io_complete(request, 0);
+		}
+	}
+	io->pending_count = 0;
+}
+
+// gives the buffer back, once the data is not needed anymore
+void async_io_release(async_io *io, async_io_request *request) {
+	AcquireSRWLockExclusive(&io->lock);
+	io->free[io->free_count++] = (ui32)(request - io->requests);
+	ReleaseSRWLockExclusive(&io->lock);
+}
+
+// every read must be done (waited on its counter)
+void async_io_shutdown(async_io *io) {
+	if (io->port) {
+		PostQueuedCompletionStatus(io->port, 0, 0, NULL);
+		WaitForSingleObject(io->thread, INFINITE);
+		CloseHandle(io->thread);
+		CloseHandle(io->port);
+	}
+	VirtualFree(io->pool, 0, MEM_RELEASE);
+	memset(io, 0, sizeof(async_io));
+}
+
+#endif /* _ASYNCIOH_ */
@@ -79,19 +79,83 @@ void io_file_fullread(char *location, complete_file *file){
 	
 		ui32 fileSize32 = SafeTruncateUInt64(fileSize.QuadPart);
 		file->memory = VirtualAlloc(0, fileSize32, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
-		ReadFile(rawFile, file->memory, fileSize32, NULL, NULL);
+		DWORD bytesRead = 0;
+		ReadFile(rawFile, file->memory, fileSize32, &bytesRead, NULL);
 		file->size = fileSize32;
+		
+		CloseHandle(rawFile);
 	}
 
 }
 
+// reads size bytes at offset, the offset travels with the call so threads sharing the handle do not fight over the file pointer
+bool io_file_read_at(HANDLE file, ui64 offset, void *memory, ui32 size){
+	OVERLAPPED overlapped = {0};
+	overlapped.Offset = (DWORD)offset;
+	overlapped.OffsetHigh = (DWORD)(offset >> 32);
+
+	DWORD bytesRead = 0;
+	BOOL ok = ReadFile(file, memory, size, &bytesRead, &overlapped);
+
+	return ok && bytesRead == size;
+}
+
+bool io_file_fullwrite(char *location, void *memory, ui32 size){
+	HANDLE rawFile = CreateFileA(location, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	
+	if (rawFile == INVALID_HANDLE_VALUE)
+    {
+		OutputDebugStringA("FILE WRITING ERROR\n");
+		return false;
+	}
+	
+	DWORD written = 0;
+	BOOL ok = WriteFile(rawFile, memory, size, &written, NULL);
+	CloseHandle(rawFile);
+	
+	return ok && written == size;
+}
+
+// maps the file copy on write : read in place, pages written to become private copies (the file never changes)
+bool io_file_map(char *location, complete_file *file){
+	file->memory = NULL;
+	file->size = 0;
+	
+	HANDLE rawFile = io_create_handle(location);
+	if (rawFile == INVALID_HANDLE_VALUE) return false;
+	
+	LARGE_INTEGER fileSize;
+	GetFileSizeEx(rawFile, &fileSize);
+	
+	// an empty file cannot be mapped
+	HANDLE mapping = fileSize.QuadPart ? CreateFileMappingA(rawFile, NULL, PAGE_WRITECOPY, 0, 0, NULL) : NULL;
+	if (mapping) {
+		file->memory = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+		if (file->memory) file->size = SafeTruncateUInt64(fileSize.QuadPart);
+		
+		// the view keeps the mapping and the file alive
+		CloseHandle(mapping);
+	}
+	CloseHandle(rawFile);
+	
+	return file->memory != NULL;
+}
+
+void io_file_unmap(complete_file *file){
+	UnmapViewOfFile(file->memory);
+	file->memory = NULL;
+	file->size = 0;
+}
+
 void io_file_fullfree(complete_file *file){
 	// free the memory of the file
+	// MEM_RELEASE wants a size of 0, it frees the whole allocation
 	VirtualFree(
 	  file->memory,
-	  file->size,
+	  0,
 	  MEM_RELEASE
 	);
+	file->memory = NULL;
 }
 
 #endif /* _IOH_ */
\ No newline at end of file
@@ -0,0 +1,141 @@
+/*  ----------------------------------- INFOS
+    This header file contains the job system : a pool of worker threads running small independent jobs.
+
+	Jobs are pushed with a counter, the counter goes back to 0 once every job pushed with it is done.
+	A thread waiting on a counter runs queued jobs itself instead of sleeping.
+
+*/
+
+// LOCAL DEPENDENCIES : platform.h
+
+#ifndef _JOBSH_
+#define _JOBSH_
+
+#define JOBS_MAX_WORKERS 16
+#define JOBS_QUEUE_SIZE 1024 // must be a power of two
+
+//  ------------------------------------ STRUCTS
+
+typedef void job_function(void *data);
+
+typedef struct job {
+	job_function *function;
+	void *data;
+	volatile LONG *counter; // decremented once the job is done
+} job;
+
+typedef struct job_system {
+	job queue[JOBS_QUEUE_SIZE];
+	ui32 read;
+	ui32 write;
+	SRWLOCK lock;
+
+	HANDLE semaphore; // one count per queued job
+	HANDLE threads[JOBS_MAX_WORKERS];
+	ui32 worker_count;
+	volatile LONG quit;
+} job_system;
+
+//  ------------------------------------ FUNCTIONS
+
+internal bool jobs_pop(job_system *jobs, job *out) {
+	bool found = false;
+
+	AcquireSRWLockExclusive(&jobs->lock);
+	if (jobs->read != jobs->write) {
+		*out = jobs->queue[jobs->read & (JOBS_QUEUE_SIZE - 1)];
+		jobs->read++;
+		found = true;
+	}
+	ReleaseSRWLockExclusive(&jobs->lock);
+
+	return found;
+}
+
+internal void jobs_run(job *j) {
+	j->function(j->data);
+	InterlockedDecrement(j->counter);
+}
+
+internal DWORD WINAPI jobs_worker(LPVOID param) {
+	job_system *jobs = (job_system*)param;
+
+	for (;;) {
+		WaitForSingleObject(jobs->semaphore, INFINITE);
+		if (jobs->quit) break;
+
+		// the job may already have been taken by a waiting thread
+		job j;
+		if (jobs_pop(jobs, &j)) {
+			jobs_run(&j);
+		}
+	}
+
+	return 0;
+}
+
+// worker_count 0 means one worker per core, minus the main thread
+void jobs_init(job_system *jobs, ui32 worker_count) {
+	memset(jobs, 0, sizeof(job_system));
+	InitializeSRWLock(&jobs->lock);
+
+	if (worker_count == 0) {
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		worker_count = info.dwNumberOfProcessors > 1 ? info.dwNumberOfProcessors - 1 : 1;
+	}
+	if (worker_count > JOBS_MAX_WORKERS) worker_count = JOBS_MAX_WORKERS;
+
+	jobs->semaphore = CreateSemaphoreA(NULL, 0, JOBS_QUEUE_SIZE + JOBS_MAX_WORKERS, NULL);
+	for (ui32 i = 0; i < worker_count; i++) {
+		jobs->threads[i] = CreateThread(NULL, 0, jobs_worker, jobs, 0, NULL);
+	}
+	jobs->worker_count = worker_count;
+}
+
+void jobs_push(job_system *jobs, job_function *function, void *data, volatile LONG *counter) {
+	job j = { function, data, counter };
+	InterlockedIncrement(counter);
+
+	AcquireSRWLockExclusive(&jobs->lock);
+	bool full = jobs->write - jobs->read == JOBS_QUEUE_SIZE;
+	if (!full) {
+		jobs->queue[jobs->write & (JOBS_QUEUE_SIZE - 1)] = j;
+		jobs->write++;
+	}
+	ReleaseSRWLockExclusive(&jobs->lock);
+
+	if (full) {
+		// no room, do it now rather than block
+		jobs_run(&j);
+	} else {
+		ReleaseSemaphore(jobs->semaphore, 1, NULL);
+	}
+}
+
+// helps with the queue until every job pushed with counter is done
+void jobs_wait(job_system *jobs, volatile LONG *counter) {
+	while (*counter > 0) {
+		job j;
+		if (jobs_pop(jobs, &j)) {
+			jobs_run(&j);
+		} else {
+			// the last jobs are running on workers
+			YieldProcessor();
+		}
+	}
+}
+
+void jobs_shutdown(job_system *jobs) {
+	InterlockedExchange(&jobs->quit, 1);
+	ReleaseSemaphore(jobs->semaphore, jobs->worker_count, NULL);
+	WaitForMultipleObjects(jobs->worker_count, jobs->threads, TRUE, INFINITE);
+
+	for (ui32 i = 0; i < jobs->worker_count; i++) {
+		CloseHandle(jobs->threads[i]);
+	}
+	CloseHandle(jobs->semaphore);
+	jobs->worker_count = 0;
+}
+
+#endif /* _JOBSH_ */
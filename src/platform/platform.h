@@ -6,6 +6,8 @@
 #ifndef _PLATFORMH_
 #define _PLATFORMH_
 
+#include <intrin.h>
+
 // structs
 
 struct viewport_size {
@@ -134,4 +136,47 @@ viewport_size platform_get_window_size(HWND window) {
 	return newWindowSize;
 };
 
+// avx2 instructions & the os saving the ymm registers, code using them checks this first
+bool platform_has_avx2() {
+	/* doc:
+	https://learn.microsoft.com/en-us/cpp/intrinsics/cpuid-cpuidex */
+	
+	int info[4];
+	__cpuid(info, 0);
+	if(info[0] < 7) return false;
+	
+	// avx & osxsave, then xmm & ymm state enabled by the os
+	__cpuid(info, 1);
+	if((info[2] & (1 << 27 | 1 << 28)) != (1 << 27 | 1 << 28)) return false;
+	if((_xgetbv(0) & 6) != 6) return false;
+	
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+};
+
+// size of the monitor the window is on, what the window can grow to
+viewport_size platform_get_monitor_size(HWND window) {
+	/* doc:
+	https://learn.microsoft.com/en-us/windows/win32/api/winuser/nf-winuser-getmonitorinfow */
+	
+	MONITORINFO info = { .cbSize = sizeof(MONITORINFO) };
+	GetMonitorInfoW(MonitorFromWindow(window, MONITOR_DEFAULTTONEAREST), &info);
+	
+	viewport_size monitorSize = {
+	(i32)(info.rcMonitor.right - info.rcMonitor.left),
+	(i32)(info.rcMonitor.bottom - info.rcMonitor.top),
+	};
+	
+	return monitorSize;
+};
+
+// handles every message waiting, for the waits the render thread may need the window for (Present, ResizeBuffers)
+void platform_pump_messages() {
+	MSG msg;
+	while(PeekMessageW(&msg, NULL, 0, 0, PM_REMOVE)) {
+		TranslateMessage(&msg);
+		DispatchMessageW(&msg);
+	};
+};
+
 #endif /* _PLATFORMH_ */
\ No newline at end of file
@@ -0,0 +1,107 @@
+/*  ----------------------------------- INFOS
+    This header file contains the directory watcher (file change notifications from Windows).
+
+*/
+
+// LOCAL DEPENDENCIES : io.h
+
+#ifndef _WATCHERH_
+#define _WATCHERH_
+
+//  ------------------------------------ STRUCTS
+
+typedef void watcher_callback(void *user, char *filename);
+
+typedef struct dir_watcher {
+	HANDLE directory;
+	OVERLAPPED overlapped;
+	bool pending; // a ReadDirectoryChangesW call is in flight
+
+	// FILE_NOTIFY_INFORMATION must be DWORD aligned
+	DWORD buffer[4096];
+} dir_watcher;
+
+//  ------------------------------------ FUNCTIONS
+
+internal void platform_watcher_arm(dir_watcher *watcher) {
+	/* doc:
+	https://learn.microsoft.com/en-us/windows/win32/api/winbase/nf-winbase-readdirectorychangesw */
+
+	DWORD filter = FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE;
+	BOOL ok = ReadDirectoryChangesW(watcher->directory, watcher->buffer, sizeof(watcher->buffer), FALSE, filter, NULL, &watcher->overlapped, NULL);
+	watcher->pending = ok ? true : false;
+}
+
+bool platform_watch_directory(dir_watcher *watcher, char *location) {
+	watcher->directory = CreateFileA(location, FILE_LIST_DIRECTORY,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+		FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+
+	if (watcher->directory == INVALID_HANDLE_VALUE)
+    {
+		OutputDebugStringA("DIRECTORY WATCH ERROR\n");
+		watcher->directory = NULL;
+		return false;
+	}
+
+	watcher->overlapped.hEvent = CreateEventA(NULL, FALSE, FALSE, NULL);
+	platform_watcher_arm(watcher);
+
+	return watcher->pending;
+}
+
+// non blocking, calls back once per changed file name and returns how many notifications were read
+ui32 platform_poll_watcher(dir_watcher *watcher, watcher_callback *callback, void *user) {
+	if (!watcher->directory || !watcher->pending) {
+		return 0;
+	}
+
+	DWORD bytes = 0;
+	if (!GetOverlappedResult(watcher->directory, &watcher->overlapped, &bytes, FALSE)) {
+		// ERROR_IO_INCOMPLETE : nothing changed yet
+		return 0;
+	}
+
+	ui32 count = 0;
+
+	// bytes == 0 means the buffer overflowed, we lost the names so there is nothing to report
+	if (bytes > 0) {
+		ui8 *cursor = (ui8*)watcher->buffer;
+		for (;;) {
+			FILE_NOTIFY_INFORMATION *info = (FILE_NOTIFY_INFORMATION*)cursor;
+
+			char filename[MAX_PATH];
+			int length = WideCharToMultiByte(CP_UTF8, 0, info->FileName, info->FileNameLength / sizeof(WCHAR), filename, MAX_PATH - 1, NULL, NULL);
+			filename[length] = 0;
+
+			if (info->Action != FILE_ACTION_REMOVED && info->Action != FILE_ACTION_RENAMED_OLD_NAME) {
+				callback(user, filename);
+				count++;
+			}
+
+			if (info->NextEntryOffset == 0) break;
+			cursor += info->NextEntryOffset;
+		}
+	}
+
+	platform_watcher_arm(watcher);
+
+	return count;
+}
+
+void platform_unwatch_directory(dir_watcher *watcher) {
+	if (!watcher->directory) return;
+
+	// the read in flight writes into the buffer until it is cancelled for good
+	CancelIo(watcher->directory);
+	if (watcher->pending) {
+		DWORD bytes;
+		GetOverlappedResult(watcher->directory, &watcher->overlapped, &bytes, TRUE);
+	}
+	CloseHandle(watcher->overlapped.hEvent);
+	CloseHandle(watcher->directory);
+	watcher->directory = NULL;
+	watcher->pending = false;
+}
+
+#endif /* _WATCHERH_ */
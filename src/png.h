@@ -0,0 +1,741 @@
+/*  ----------------------------------- PNG
+	Our own PNG decoder, the fast path of parse_decode_img.
+
+	Only the common case is handled : 8 bits per channel, not interlaced (gray, gray + alpha, rgb, rgba
+	and palette). Anything else returns false and goes through stb_image instead.
+
+	- inflate decodes with a table of PNG_FAST_BITS bits, one lookup can give two literals at once
+	- unfiltering works one pixel per SSE register for sub / avg / paeth, 16 bytes at a time for up
+	- the output is always rgba, either allocated with malloc (free it with parse_free_img) or written
+	  straight into memory given by the caller (png_decode_to), with its own row pitch
+
+	doc:
+	https://www.w3.org/TR/png/
+	https://www.rfc-editor.org/rfc/rfc1951 (deflate)
+*/
+
+#ifndef _PNGH_
+#define _PNGH_
+
+#include <stdlib.h>
+#include <emmintrin.h>
+
+#define PNG_FAST_BITS 11
+#define PNG_FAST_SIZE (1 << PNG_FAST_BITS)
+#define PNG_FAST_MASK (PNG_FAST_SIZE - 1)
+
+// fast table entries : bits 0-7 are the bits consumed, 8-9 the kind, 16-31 the symbol (or two literals)
+#define PNG_ENTRY_SLOW 0 // code longer than PNG_FAST_BITS, or not a valid code
+#define PNG_ENTRY_LITERAL 1
+#define PNG_ENTRY_LITERAL2 2
+#define PNG_ENTRY_SYMBOL 3 // length, end of block, distance, code length
+
+// ------------------------------- structs
+
+struct png_huffman {
+	ui32 fast[PNG_FAST_SIZE];
+	ui32 maxcode[17]; // preshifted to 16 bits, for the slow path
+	ui16 firstcode[16];
+	ui16 firstsymbol[16];
+	ui8 size[288];
+	ui16 value[288];
+};
+
+struct png_inflate {
+	const ui8* in;
+	const ui8* in_end;
+	ui64 bits;
+	ui32 count; // valid bits in bits
+	ui32 zeros; // bytes of padding read past the end of the input
+
+	ui8* out_start;
+	ui8* out;
+	ui8* out_end; // the buffer has PNG_OUT_SLACK bytes more, wide copies may spill there
+
+	png_huffman litlen;
+	png_huffman dist;
+};
+
+#define PNG_OUT_SLACK 16
+
+// ------------------------------- huffman
+
+internal ui32 png_bit_reverse16(ui32 v) {
+	v = ((v & 0xAAAA) >> 1) | ((v & 0x5555) << 1);
+	v = ((v & 0xCCCC) >> 2) | ((v & 0x3333) << 2);
+	v = ((v & 0xF0F0) >> 4) | ((v & 0x0F0F) << 4);
+	v = ((v & 0xFF00) >> 8) | ((v & 0x00FF) << 8);
+	return v;
+}
+
+// canonical codes from code lengths, literals (< 256) are marked as such when literals is set
+internal bool png_build_huffman(png_huffman* h, const ui8* lengths, ui32 count, bool literals) {
+	ui32 sizes[17] = {0};
+	ui32 next_code[16];
+
+	memset(h->fast, 0, sizeof(h->fast));
+	for(ui32 i = 0; i < count; i++) sizes[lengths[i]]++;
+	sizes[0] = 0;
+	for(ui32 i = 1; i < 16; i++) {
+		if(sizes[i] > (1u << i)) return false;
+	};
+
+	ui32 code = 0;
+	ui32 k = 0;
+	for(ui32 i = 1; i < 16; i++) {
+		next_code[i] = code;
+		h->firstcode[i] = (ui16)code;
+		h->firstsymbol[i] = (ui16)k;
+		code += sizes[i];
+		if(sizes[i] && code - 1 >= (1u << i)) return false; // over subscribed
+		h->maxcode[i] = code << (16 - i);
+		code <<= 1;
+		k += sizes[i];
+	};
+	h->maxcode[16] = 0x10000;
+
+	for(ui32 i = 0; i < count; i++) {
+		ui32 s = lengths[i];
+		if(!s) continue;
+
+		ui32 c = next_code[s] - h->firstcode[s] + h->firstsymbol[s];
+		h->size[c] = (ui8)s;
+		h->value[c] = (ui16)i;
+
+		if(s <= PNG_FAST_BITS) {
+			ui32 kind = literals && i < 256 ? PNG_ENTRY_LITERAL : PNG_ENTRY_SYMBOL;
+			ui32 entry = s | (kind << 8) | (i << 16);
+			for(ui32 j = png_bit_reverse16(next_code[s]) >> (16 - s); j < PNG_FAST_SIZE; j += 1 << s) {
+				h->fast[j] = entry;
+			};
+		};
+		next_code[s]++;
+	};
+
+	if(literals) {
+		// a literal followed by another one that still fits in the table bits : both in one lookup.
+		// going down, fast[j >> s] is never an entry already merged (j >> s < j, except for j = 0)
+		for(i32 j = PNG_FAST_SIZE - 1; j >= 0; j--) {
+			ui32 first = h->fast[j];
+			if(((first >> 8) & 3) != PNG_ENTRY_LITERAL) continue;
+
+			ui32 s = first & 0xff;
+			ui32 second = h->fast[j >> s];
+			ui32 s2 = second & 0xff;
+			if(((second >> 8) & 3) != PNG_ENTRY_LITERAL || s + s2 > PNG_FAST_BITS) continue;
+
+			h->fast[j] = (s + s2) | (PNG_ENTRY_LITERAL2 << 8) | ((first >> 16) << 16) | ((second >> 16) << 24);
+		};
+	};
+
+	return true;
+}
+
+// ------------------------------- bits
+
+internal void png_refill(png_inflate* z) {
+	if(z->in_end - z->in >= 8) {
+		// reads 8 bytes, keeps the whole ones that fit. bits above count are re-read identically next time
+		ui64 word;
+		memcpy(&word, z->in, 8);
+		z->bits |= word << z->count;
+		z->in += (63 - z->count) >> 3;
+		z->count |= 56;
+		return;
+	};
+
+	while(z->count <= 56) {
+		ui64 byte = 0;
+		if(z->in < z->in_end) {
+			byte = *z->in++;
+		} else {
+			z->zeros++;
+		};
+		z->bits |= byte << z->count;
+		z->count += 8;
+	};
+}
+
+internal ui32 png_bits(png_inflate* z, ui32 n) {
+	ui32 v = (ui32)(z->bits & ((1ull << n) - 1));
+	z->bits >>= n;
+	z->count -= n;
+	return v;
+}
+
+// returns the symbol, or 0xffffffff on a bad code. needs at least 16 bits in the buffer
+internal ui32 png_decode_symbol(png_huffman* h, png_inflate* z) {
+	ui32 entry = h->fast[z->bits & PNG_FAST_MASK];
+	if(entry) {
+		png_bits(z, entry & 0xff);
+		return entry >> 16;
+	};
+
+	ui32 k = png_bit_reverse16((ui32)(z->bits & 0xffff));
+	ui32 s = PNG_FAST_BITS + 1;
+	while(s < 16 && k >= h->maxcode[s]) s++;
+	if(s == 16) return 0xffffffff;
+
+	ui32 b = (k >> (16 - s)) - h->firstcode[s] + h->firstsymbol[s];
+	if(b >= 288 || h->size[b] != s) return 0xffffffff;
+
+	png_bits(z, s);
+	return h->value[b];
+}
+
+// ------------------------------- inflate
+
+static const ui16 png_length_base[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const ui8 png_length_extra[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const ui16 png_dist_base[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const ui8 png_dist_extra[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+internal bool png_inflate_huffman_block(png_inflate* z) {
+	ui8* out = z->out;
+	ui8* out_end = z->out_end;
+
+	for(;;) {
+		png_refill(z);
+
+		ui32 entry = z->litlen.fast[z->bits & PNG_FAST_MASK];
+		ui32 kind = (entry >> 8) & 3;
+
+		if(kind == PNG_ENTRY_LITERAL2) {
+			if(out_end - out < 2) return false;
+			out[0] = (ui8)(entry >> 16);
+			out[1] = (ui8)(entry >> 24);
+			out += 2;
+			png_bits(z, entry & 0xff);
+			continue;
+		};
+
+		ui32 symbol;
+		if(kind != PNG_ENTRY_SLOW) {
+			symbol = entry >> 16;
+			png_bits(z, entry & 0xff);
+		} else {
+			symbol = png_decode_symbol(&z->litlen, z);
+			if(symbol == 0xffffffff) return false;
+		};
+
+		if(symbol < 256) {
+			if(out == out_end) return false;
+			*out++ = (ui8)symbol;
+			continue;
+		};
+		if(symbol == 256) break;
+
+		symbol -= 257;
+		if(symbol >= 29) return false;
+		ui32 length = png_length_base[symbol] + png_bits(z, png_length_extra[symbol]);
+
+		png_refill(z);
+		symbol = png_decode_symbol(&z->dist, z);
+		if(symbol >= 30) return false;
+		ui32 distance = png_dist_base[symbol] + png_bits(z, png_dist_extra[symbol]);
+
+		if(distance > (ui32)(out - z->out_start) || length > (ui32)(out_end - out)) return false;
+
+		ui8* src = out - distance;
+		if(distance >= 8) {
+			// 8 bytes at a time, may write up to 7 bytes past the match (into the slack)
+			ui8* dst = out;
+			ui8* end = out + length;
+			do {
+				memcpy(dst, src, 8);
+				dst += 8;
+				src += 8;
+			} while(dst < end);
+		} else if(distance == 1) {
+			memset(out, *src, length);
+		} else {
+			for(ui32 i = 0; i < length; i++) out[i] = src[i];
+		};
+		out += length;
+	};
+
+	z->out = out;
+	return true;
+}
+
+internal bool png_inflate_stored_block(png_inflate* z) {
+	// back to a byte boundary, then read straight from the input
+	png_bits(z, z->count & 7);
+	ui32 buffered = z->count >> 3;
+	if(buffered < z->zeros) return false; // the padding got consumed, truncated stream
+	z->in -= buffered - z->zeros;
+	z->bits = 0;
+	z->count = 0;
+	z->zeros = 0;
+
+	if(z->in_end - z->in < 4) return false;
+	ui32 length = z->in[0] | (z->in[1] << 8);
+	ui32 nlength = z->in[2] | (z->in[3] << 8);
+	z->in += 4;
+	if(length != (~nlength & 0xffff)) return false;
+	if(length > (ui32)(z->in_end - z->in) || length > (ui32)(z->out_end - z->out)) return false;
+
+	memcpy(z->out, z->in, length);
+	z->in += length;
+	z->out += length;
+	return true;
+}
+
+internal bool png_inflate_dynamic_header(png_inflate* z) {
+	static const ui8 order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+	png_refill(z);
+	ui32 hlit = png_bits(z, 5) + 257;
+	ui32 hdist = png_bits(z, 5) + 1;
+	ui32 hclen = png_bits(z, 4) + 4;
+	if(hlit > 286 || hdist > 30) return false;
+
+	ui8 codelength_sizes[19] = {0};
+	for(ui32 i = 0; i < hclen; i++) {
+		png_refill(z);
+		codelength_sizes[order[i]] = (ui8)png_bits(z, 3);
+	};
+
+	png_huffman* codelength = &z->dist; // borrowed, rebuilt right after
+	if(!png_build_huffman(codelength, codelength_sizes, 19, false)) return false;
+
+	ui8 lengths[286 + 30];
+	ui32 n = 0;
+	while(n < hlit + hdist) {
+		png_refill(z);
+		ui32 symbol = png_decode_symbol(codelength, z);
+		if(symbol >= 19) return false;
+
+		if(symbol < 16) {
+			lengths[n++] = (ui8)symbol;
+			continue;
+		};
+
+		ui8 fill = 0;
+		ui32 repeat;
+		if(symbol == 16) {
+			if(n == 0) return false;
+			fill = lengths[n - 1];
+			repeat = 3 + png_bits(z, 2);
+		} else if(symbol == 17) {
+			repeat = 3 + png_bits(z, 3);
+		} else {
+			repeat = 11 + png_bits(z, 7);
+		};
+		if(n + repeat > hlit + hdist) return false;
+		memset(lengths + n, fill, repeat);
+		n += repeat;
+	};
+
+	if(!png_build_huffman(&z->litlen, lengths, hlit, true)) return false;
+	if(!png_build_huffman(&z->dist, lengths + hlit, hdist, false)) return false;
+	return true;
+}
+
+internal bool png_inflate_fixed_header(png_inflate* z) {
+	ui8 lengths[288];
+	memset(lengths, 8, 144);
+	memset(lengths + 144, 9, 112);
+	memset(lengths + 256, 7, 24);
+	memset(lengths + 280, 8, 8);
+
+	ui8 distances[30];
+	memset(distances, 5, 30);
+
+	if(!png_build_huffman(&z->litlen, lengths, 288, true)) return false;
+	return png_build_huffman(&z->dist, distances, 30, false);
+}
+
+// zlib stream into out, which must be exactly the expected size (+ PNG_OUT_SLACK allocated)
+internal bool png_inflate_zlib(png_inflate* z, const ui8* in, ui32 in_size, ui8* out, ui32 out_size) {
+	if(in_size < 2) return false;
+	ui32 cmf = in[0];
+	ui32 flg = in[1];
+	if((cmf * 256 + flg) % 31 != 0 || (cmf & 15) != 8 || (flg & 32)) return false; // no preset dictionary in png
+
+	z->in = in + 2;
+	z->in_end = in + in_size;
+	z->bits = 0;
+	z->count = 0;
+	z->zeros = 0;
+	z->out_start = out;
+	z->out = out;
+	z->out_end = out + out_size;
+
+	bool final;
+	do {
+		png_refill(z);
+		final = png_bits(z, 1);
+		ui32 type = png_bits(z, 2);
+
+		bool ok;
+		if(type == 0) {
+			ok = png_inflate_stored_block(z);
+		} else if(type == 1) {
+			ok = png_inflate_fixed_header(z) && png_inflate_huffman_block(z);
+		} else if(type == 2) {
+			ok = png_inflate_dynamic_header(z) && png_inflate_huffman_block(z);
+		} else {
+			ok = false;
+		};
+
+		// consuming more padding than the buffer holds means the stream was truncated
+		if(!ok || z->zeros * 8 > z->count) return false;
+	} while(!final);
+
+	return z->out == z->out_end;
+}
+
+// ------------------------------- unfiltering
+
+internal __m128i png_load_pixel(const ui8* p, ui32 bpp) {
+	ui32 v = 0;
+	if(bpp == 4) {
+		memcpy(&v, p, 4);
+	} else {
+		memcpy(&v, p, 3);
+	};
+	return _mm_cvtsi32_si128((int)v);
+}
+
+internal void png_store_pixel(ui8* p, __m128i pixel, ui32 bpp) {
+	ui32 v = (ui32)_mm_cvtsi128_si32(pixel);
+	if(bpp == 4) {
+		memcpy(p, &v, 4);
+	} else {
+		memcpy(p, &v, 3);
+	};
+}
+
+internal void png_unfilter_sub(ui8* row, ui32 stride, ui32 bpp) {
+	if(bpp >= 3) {
+		__m128i a = _mm_setzero_si128();
+		for(ui32 i = 0; i < stride; i += bpp) {
+			a = _mm_add_epi8(a, png_load_pixel(row + i, bpp));
+			png_store_pixel(row + i, a, bpp);
+		};
+		return;
+	};
+
+	for(ui32 i = bpp; i < stride; i++) row[i] += row[i - bpp];
+}
+
+internal void png_unfilter_up(ui8* row, const ui8* prior, ui32 stride) {
+	ui32 i = 0;
+	for(; i + 16 <= stride; i += 16) {
+		__m128i d = _mm_loadu_si128((const __m128i*)(row + i));
+		__m128i b = _mm_loadu_si128((const __m128i*)(prior + i));
+		_mm_storeu_si128((__m128i*)(row + i), _mm_add_epi8(d, b));
+	};
+	for(; i < stride; i++) row[i] += prior[i];
+}
+
+internal void png_unfilter_avg(ui8* row, const ui8* prior, ui32 stride, ui32 bpp) {
+	if(bpp >= 3) {
+		// _mm_avg_epu8 rounds up, the filter rounds down : take the lost bit back
+		__m128i ones = _mm_set1_epi8(1);
+		__m128i a = _mm_setzero_si128();
+		for(ui32 i = 0; i < stride; i += bpp) {
+			__m128i b = png_load_pixel(prior + i, bpp);
+			__m128i avg = _mm_avg_epu8(a, b);
+			avg = _mm_sub_epi8(avg, _mm_and_si128(_mm_xor_si128(a, b), ones));
+			a = _mm_add_epi8(png_load_pixel(row + i, bpp), avg);
+			png_store_pixel(row + i, a, bpp);
+		};
+		return;
+	};
+
+	for(ui32 i = 0; i < bpp; i++) row[i] += prior[i] >> 1;
+	for(ui32 i = bpp; i < stride; i++) row[i] += (ui8)((row[i - bpp] + prior[i]) >> 1);
+}
+
+internal ui8 png_paeth(i32 a, i32 b, i32 c) {
+	i32 pa = abs(b - c);
+	i32 pb = abs(a - c);
+	i32 pc = abs(a + b - 2 * c);
+	if(pa <= pb && pa <= pc) return (ui8)a;
+	if(pb <= pc) return (ui8)b;
+	return (ui8)c;
+}
+
+internal __m128i png_abs_epi16(__m128i x) {
+	return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+}
+
+internal __m128i png_select(__m128i mask, __m128i a, __m128i b) {
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+internal void png_unfilter_paeth(ui8* row, const ui8* prior, ui32 stride, ui32 bpp) {
+	if(bpp >= 3) {
+		// left (a), up (b) and up left (c) widened to 16 bits, the distances need a sign
+		__m128i zero = _mm_setzero_si128();
+		__m128i a = zero;
+		__m128i c = zero;
+		for(ui32 i = 0; i < stride; i += bpp) {
+			__m128i b = _mm_unpacklo_epi8(png_load_pixel(prior + i, bpp), zero);
+
+			__m128i pa = _mm_sub_epi16(b, c);
+			__m128i pb = _mm_sub_epi16(a, c);
+			__m128i pc = _mm_add_epi16(pa, pb);
+			pa = png_abs_epi16(pa);
+			pb = png_abs_epi16(pb);
+			pc = png_abs_epi16(pc);
+			__m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+
+			__m128i nearest = png_select(_mm_cmpeq_epi16(pa, smallest), a,
+				png_select(_mm_cmpeq_epi16(pb, smallest), b, c));
+
+			__m128i d = _mm_add_epi8(png_load_pixel(row + i, bpp), _mm_packus_epi16(nearest, zero));
+			png_store_pixel(row + i, d, bpp);
+
+			a = _mm_unpacklo_epi8(d, zero);
+			c = b;
+		};
+		return;
+	};
+
+	for(ui32 i = 0; i < bpp; i++) row[i] += prior[i];
+	for(ui32 i = bpp; i < stride; i++) row[i] += png_paeth(row[i - bpp], prior[i], prior[i - bpp]);
+}
+
+// in place, raw is height rows of (filter byte + stride bytes)
+internal bool png_unfilter(ui8* raw, ui32 stride, ui32 height, ui32 bpp, const ui8* zero_row) {
+	const ui8* prior = zero_row;
+	for(ui32 y = 0; y < height; y++) {
+		ui8* line = raw + y * (stride + 1);
+		ui8* row = line + 1;
+
+		switch(line[0]) {
+			case 0: break;
+			case 1: png_unfilter_sub(row, stride, bpp); break;
+			case 2: png_unfilter_up(row, prior, stride); break;
+			case 3: png_unfilter_avg(row, prior, stride, bpp); break;
+			case 4: png_unfilter_paeth(row, prior, stride, bpp); break;
+			default: return false;
+		};
+		prior = row;
+	};
+	return true;
+}
+
+// ------------------------------- decoding
+
+// everything the chunks before the pixels tell us
+struct png_info {
+	ui32 width;
+	ui32 height;
+	ui32 color_type;
+	ui32 channels; // in the file
+	ui32 palette[256]; // rgba
+	ui32 palette_count;
+	bool has_alpha_palette;
+	bool has_key; // tRNS on gray / rgb : one color is transparent
+	ui8 key[3];
+	ui32 idat_size; // compressed bytes, all IDAT chunks together
+};
+
+internal ui32 png_read_u32(const ui8* p) {
+	return ((ui32)p[0] << 24) | ((ui32)p[1] << 16) | ((ui32)p[2] << 8) | (ui32)p[3];
+}
+
+bool png_is_png(const void* data, ui32 size) {
+	static const ui8 signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+	return size >= 8 && memcmp(data, signature, 8) == 0;
+}
+
+// walks the chunks, calling back on every IDAT. false at the first broken chunk
+typedef void png_idat_callback(void* user, const ui8* chunk, ui32 length);
+
+internal bool png_walk_chunks(const ui8* bytes, ui32 size, png_info* info, png_idat_callback* on_idat, void* user) {
+	ui32 cursor = 8;
+	while(cursor + 12 <= size) {
+		ui32 length = png_read_u32(bytes + cursor);
+		const ui8* type = bytes + cursor + 4;
+		const ui8* chunk = bytes + cursor + 8;
+		if(length > size - cursor - 12) return false;
+
+		if(info && memcmp(type, "IHDR", 4) == 0) {
+			if(length != 13) return false;
+			info->width = png_read_u32(chunk);
+			info->height = png_read_u32(chunk + 4);
+			ui32 depth = chunk[8];
+			info->color_type = chunk[9];
+			ui32 interlace = chunk[12];
+
+			if(depth != 8 || interlace != 0 || chunk[10] != 0 || chunk[11] != 0) return false;
+			switch(info->color_type) {
+				case 0: info->channels = 1; break;
+				case 2: info->channels = 3; break;
+				case 3: info->channels = 1; break;
+				case 4: info->channels = 2; break;
+				case 6: info->channels = 4; break;
+				default: return false;
+			};
+			if(info->width == 0 || info->height == 0 || info->width > (1 << 24) || info->height > (1 << 24)) return false;
+			if((ui64)info->width * info->height * 4 > 0x7fffffff) return false;
+		} else if(info && memcmp(type, "PLTE", 4) == 0) {
+			info->palette_count = length / 3;
+			if(info->palette_count > 256 || info->palette_count * 3 != length) return false;
+			for(ui32 i = 0; i < info->palette_count; i++) {
+				const ui8* rgb = chunk + i * 3;
+				info->palette[i] = rgb[0] | (rgb[1] << 8) | (rgb[2] << 16) | 0xff000000;
+			};
+		} else if(info && memcmp(type, "tRNS", 4) == 0) {
+			if(info->color_type == 3) {
+				if(length > info->palette_count) return false;
+				for(ui32 i = 0; i < length; i++) {
+					info->palette[i] = (info->palette[i] & 0x00ffffff) | ((ui32)chunk[i] << 24);
+				};
+				info->has_alpha_palette = true;
+			} else if(info->color_type == 0 && length == 2) {
+				info->key[0] = chunk[1];
+				info->has_key = true;
+			} else if(info->color_type == 2 && length == 6) {
+				info->key[0] = chunk[1];
+				info->key[1] = chunk[3];
+				info->key[2] = chunk[5];
+				info->has_key = true;
+			};
+		} else if(memcmp(type, "IDAT", 4) == 0) {
+			if(info) info->idat_size += length;
+			if(on_idat) on_idat(user, chunk, length);
+		} else if(memcmp(type, "IEND", 4) == 0) {
+			break;
+		};
+
+		cursor += length + 12;
+	};
+	return true;
+}
+
+internal bool png_read_info(const void* data, ui32 size, png_info* info) {
+	memset(info, 0, sizeof(png_info));
+	if(!png_is_png(data, size)) return false;
+	if(!png_walk_chunks((const ui8*)data, size, info, NULL, NULL)) return false;
+	return info->channels && info->idat_size && (info->color_type != 3 || info->palette_count);
+}
+
+// the channel count stb would report
+internal ui32 png_channels_in_file(png_info* info) {
+	if(info->color_type == 3) return info->has_alpha_palette ? 4 : 3;
+	return info->channels + (info->has_key ? 1 : 0);
+}
+
+struct png_idat_gather {
+	ui8* memory;
+	ui32 offset;
+};
+
+internal void png_gather_idat(void* user, const ui8* chunk, ui32 length) {
+	png_idat_gather* gather = (png_idat_gather*)user;
+	memcpy(gather->memory + gather->offset, chunk, length);
+	gather->offset += length;
+}
+
+// converts unfiltered rows to rgba, dst rows are row_pitch bytes apart
+internal void png_expand_rows(png_info* info, const ui8* raw, ui8* dst, ui32 row_pitch) {
+	ui32 width = info->width;
+	ui32 stride = width * info->channels;
+	const ui8* key = info->key;
+
+	for(ui32 y = 0; y < info->height; y++) {
+		const ui8* src = raw + y * (stride + 1) + 1;
+		ui32* out = (ui32*)(dst + (size_t)y * row_pitch);
+
+		switch(info->color_type) {
+			case 6: {
+				memcpy(out, src, width * 4);
+			} break;
+			case 2: {
+				for(ui32 x = 0; x < width; x++, src += 3) {
+					ui32 alpha = info->has_key && src[0] == key[0] && src[1] == key[1] && src[2] == key[2] ? 0 : 0xff000000;
+					out[x] = src[0] | (src[1] << 8) | (src[2] << 16) | alpha;
+				};
+			} break;
+			case 3: {
+				for(ui32 x = 0; x < width; x++) {
+					out[x] = src[x] < info->palette_count ? info->palette[src[x]] : 0xff000000;
+				};
+			} break;
+			case 4: {
+				for(ui32 x = 0; x < width; x++, src += 2) {
+					out[x] = src[0] | (src[0] << 8) | (src[0] << 16) | ((ui32)src[1] << 24);
+				};
+			} break;
+			case 0: {
+				for(ui32 x = 0; x < width; x++) {
+					ui32 alpha = info->has_key && src[x] == key[0] ? 0 : 0xff000000;
+					out[x] = src[x] | (src[x] << 8) | (src[x] << 16) | alpha;
+				};
+			} break;
+		};
+	};
+}
+
+// size of a png we can decode without decoding it, false if it goes through stb
+bool png_get_info(const void* data, ui32 size, complete_img* img) {
+	png_info info;
+	if(!png_read_info(data, size, &info)) return false;
+	img->x = info.width;
+	img->y = info.height;
+	img->channels_in_file = png_channels_in_file(&info);
+	return true;
+}
+
+/*
+	Decodes as rgba into memory owned by the caller (a mapped upload texture...), rows are row_pitch
+	bytes apart and the destination must hold the size given by png_get_info.
+	Nothing is written past width * 4 bytes on each row.
+*/
+bool png_decode_to(const void* data, ui32 size, void* dst, ui32 row_pitch) {
+	png_info info;
+	if(!png_read_info(data, size, &info)) return false;
+
+	ui32 stride = info.width * info.channels;
+	ui32 raw_size = (stride + 1) * info.height;
+
+	png_idat_gather gather = { (ui8*)malloc(info.idat_size), 0 };
+	ui8* raw = (ui8*)malloc(raw_size + PNG_OUT_SLACK);
+	ui8* zero_row = (ui8*)calloc(stride, 1);
+	png_inflate* z = (png_inflate*)malloc(sizeof(png_inflate));
+
+	bool ok = gather.memory && raw && zero_row && z;
+	ok = ok && png_walk_chunks((const ui8*)data, size, NULL, png_gather_idat, &gather);
+	ok = ok && png_inflate_zlib(z, gather.memory, gather.offset, raw, raw_size);
+	ok = ok && png_unfilter(raw, stride, info.height, info.channels, zero_row);
+	if(ok) png_expand_rows(&info, raw, (ui8*)dst, row_pitch);
+
+	free(z);
+	free(zero_row);
+	free(raw);
+	free(gather.memory);
+	return ok;
+}
+
+// false when the file is not a png we handle (or is broken), img is left untouched then
+bool png_decode(const void* data, ui32 size, complete_img* img) {
+	png_info info;
+	if(!png_read_info(data, size, &info)) return false;
+
+	void* pixels = malloc((size_t)info.width * info.height * 4);
+	if(!pixels) return false;
+	if(!png_decode_to(data, size, pixels, info.width * 4)) {
+		free(pixels);
+		return false;
+	};
+
+	img->x = info.width;
+	img->y = info.height;
+	img->channels_in_file = png_channels_in_file(&info);
+	img->memory = pixels;
+	return true;
+}
+
+#endif /* _PNGH_ */
@@ -0,0 +1,255 @@
+/*  ----------------------------------- ATLAS
+	This header file contains the texture atlas packer.
+
+	Small images (icons, decals, sprites) are packed into pages with the skyline packer from
+	imstb_rectpack.h. Pages can be filled all at once at load time or one image at a time at runtime,
+	a new page is opened when nothing fits anymore. Every sprite is surrounded by padding filled with
+	its own edge pixels (bleed) so filtering and mips do not pull in the neighbours.
+	All pages of an atlas have the same size, so they end up in the same texture table bucket and
+	draws using any of them share one binding.
+
+*/
+
+#ifndef _ATLASH_
+#define _ATLASH_
+
+#include "imstb_rectpack.h"
+
+#define ATLAS_MAX_PAGES 16
+#define ATLAS_MAX_SPRITES 4096
+
+// ------------------------------- structs
+
+struct atlas_sprite {
+	rtpAtlasSprite sprite;
+	ui32 page;
+	v2 uv_min;
+	v2 uv_max;
+};
+
+struct atlas_page {
+	stbrp_context packer;
+	stbrp_node* nodes; // one per pixel of width, the skyline needs that many to never run out
+	ui32* pixels; // rgba, kept on the cpu so the page can be re-uploaded when sprites are added
+	ui32 material; // texture table id, TEXTURE_INVALID until the first upload
+	bool dirty;
+};
+
+struct atlas_context {
+	ui32 page_width;
+	ui32 page_height;
+	ui32 padding; // pixels of bleed on each side of a sprite
+
+	atlas_page pages[ATLAS_MAX_PAGES];
+	ui32 page_count;
+
+	atlas_sprite sprites[ATLAS_MAX_SPRITES];
+	ui32 sprite_count;
+};
+
+// one image to pack, rgba
+struct atlas_image {
+	const char* name; // kept by the sprite, must outlive the atlas
+	ui32 width;
+	ui32 height;
+	ui32* pixels;
+};
+
+// ------------------------------- pages
+
+void atlas_init(atlas_context* atlas, ui32 page_width, ui32 page_height, ui32 padding) {
+	memset(atlas, 0, sizeof(atlas_context));
+	atlas->page_width = page_width;
+	atlas->page_height = page_height;
+	atlas->padding = padding;
+};
+
+internal atlas_page* atlas_open_page(atlas_context* atlas) {
+	if(atlas->page_count == ATLAS_MAX_PAGES) return NULL;
+
+	atlas_page* page = &atlas->pages[atlas->page_count++];
+	ui32 node_count = atlas->page_width;
+
+	page->nodes = (stbrp_node*)VirtualAlloc(0, sizeof(stbrp_node) * node_count, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	page->pixels = (ui32*)VirtualAlloc(0, sizeof(ui32) * atlas->page_width * atlas->page_height, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	page->material = TEXTURE_INVALID;
+	page->dirty = true;
+
+	stbrp_init_target(&page->packer, atlas->page_width, atlas->page_height, page->nodes, node_count);
+	stbrp_setup_heuristic(&page->packer, STBRP_HEURISTIC_Skyline_BL_sortHeight);
+
+	return page;
+};
+
+// copies an image at (x, y) and extrudes its borders into the padding around it
+internal void atlas_blit(atlas_context* atlas, atlas_page* page, atlas_image* image, ui32 x, ui32 y) {
+	ui32 pad = atlas->padding;
+	ui32 stride = atlas->page_width;
+
+	for(ui32 row = 0; row < image->height + pad * 2; row++) {
+		// rows in the padding repeat the first / last row of the image
+		i32 src_row = (i32)row - (i32)pad;
+		src_row = src_row < 0 ? 0 : (src_row >= (i32)image->height ? image->height - 1 : src_row);
+
+		ui32* src = image->pixels + src_row * image->width;
+		ui32* dst = page->pixels + (y - pad + row) * stride + (x - pad);
+
+		for(ui32 i = 0; i < pad; i++) dst[i] = src[0];
+		memcpy(dst + pad, src, image->width * sizeof(ui32));
+		for(ui32 i = 0; i < pad; i++) dst[pad + image->width + i] = src[image->width - 1];
+	};
+};
+
+// ------------------------------- packing
+
+/*
+	Packs images into the atlas, filling the open pages first and opening new ones when needed.
+	Packing a whole batch at once gives better results than one by one (the packer sorts by height).
+	sprite_ids receives the sprite id of each image (ATLAS_MAX_SPRITES when it could not be packed).
+	Returns how many images were packed.
+*/
+ui32 atlas_add_images(atlas_context* atlas, atlas_image* images, ui32 count, ui32* sprite_ids) {
+	ui32 pad = atlas->padding;
+	ui32 packed = 0;
+
+	stbrp_rect* rects = (stbrp_rect*)VirtualAlloc(0, sizeof(stbrp_rect) * count, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	ui32 rect_count = 0;
+
+	for(ui32 i = 0; i < count; i++) {
+		sprite_ids[i] = ATLAS_MAX_SPRITES;
+
+		ui32 w = images[i].width + pad * 2;
+		ui32 h = images[i].height + pad * 2;
+		if(w > atlas->page_width || h > atlas->page_height) continue; // would never fit
+
+		rects[rect_count++] = { .id = (int)i, .w = (stbrp_coord)w, .h = (stbrp_coord)h };
+	};
+
+	// try the existing pages (newest first, older ones are usually full), then open new pages
+	ui32 page_index = atlas->page_count ? atlas->page_count - 1 : 0;
+	while(rect_count > 0) {
+		atlas_page* page;
+		bool fresh = page_index >= atlas->page_count;
+		if(!fresh) {
+			page = &atlas->pages[page_index];
+		} else {
+			page = atlas_open_page(atlas);
+			if(!page) break;
+		};
+
+		stbrp_pack_rects(&page->packer, rects, rect_count);
+
+		ui32 remaining = 0;
+		for(ui32 i = 0; i < rect_count; i++) {
+			stbrp_rect* rect = &rects[i];
+			if(!rect->was_packed || atlas->sprite_count == ATLAS_MAX_SPRITES) {
+				rects[remaining++] = *rect;
+				continue;
+			};
+
+			atlas_image* image = &images[rect->id];
+			ui32 x = rect->x + pad;
+			ui32 y = rect->y + pad;
+			atlas_blit(atlas, page, image, x, y);
+
+			atlas_sprite* sprite = &atlas->sprites[atlas->sprite_count];
+			sprite->sprite = {
+				.nameId = image->name,
+				.positionX = (int)x,
+				.positionY = (int)y,
+				.sourceWidth = (int)image->width,
+				.sourceHeight = (int)image->height,
+				.padding = (int)pad,
+			};
+			sprite->page = (ui32)(page - atlas->pages);
+
+			v2 page_size = { (f32)atlas->page_width, (f32)atlas->page_height };
+			sprite->uv_min = texture_convertTexposMinToNDC(sprite->sprite, page_size);
+			sprite->uv_max = texture_convertTexposMaxToNDC(sprite->sprite, page_size);
+
+			sprite_ids[rect->id] = atlas->sprite_count++;
+			page->dirty = true;
+			packed++;
+		};
+
+		// an empty page that could not take anything means the remaining rects cannot fit at all
+		if(fresh && remaining == rect_count) {
+			break;
+		};
+
+		rect_count = remaining;
+		page_index++;
+	};
+
+	VirtualFree(rects, 0, MEM_RELEASE);
+	return packed;
+};
+
+// runtime path, one image at a time
+ui32 atlas_add_image(atlas_context* atlas, atlas_image* image) {
+	ui32 sprite_id;
+	atlas_add_images(atlas, image, 1, &sprite_id);
+	return sprite_id;
+};
+
+ui32 atlas_find_sprite(atlas_context* atlas, const char* name) {
+	for(ui32 i = 0; i < atlas->sprite_count; i++) {
+		if(strcmp(atlas->sprites[i].sprite.nameId, name) == 0) return i;
+	};
+	return ATLAS_MAX_SPRITES;
+};
+
+// ------------------------------- gpu
+
+// pushes the pages that changed into the texture table, call at a frame boundary
+void atlas_upload(atlas_context* atlas, render_context* rContext) {
+	for(ui32 i = 0; i < atlas->page_count; i++) {
+		atlas_page* page = &atlas->pages[i];
+		if(!page->dirty) continue;
+
+		complete_img img = {
+			.x = atlas->page_width,
+			.y = atlas->page_height,
+			.channels_in_file = 4,
+			.memory = page->pixels,
+		};
+
+		if(page->material == TEXTURE_INVALID) {
+			char name[MAX_PATH];
+			snprintf(name, MAX_PATH, "atlas page %u", i);
+			page->material = texture_table_add(&rContext->textures, rContext->device, rContext->context, &img, name);
+		} else {
+			texture_table_replace(&rContext->textures, rContext->device, rContext->context, page->material, &img);
+		};
+
+		page->dirty = false;
+	};
+};
+
+// material id to draw a sprite with
+ui32 atlas_sprite_material(atlas_context* atlas, ui32 sprite_id) {
+	Assert(sprite_id < atlas->sprite_count);
+	return atlas->pages[atlas->sprites[sprite_id].page].material;
+};
+
+// moves uvs in [0, 1] into the rect of a sprite, for a mesh drawn with atlas_sprite_material
+void atlas_map_uvs(atlas_context* atlas, ui32 sprite_id, vertex* vertices, ui32 vertex_count) {
+	Assert(sprite_id < atlas->sprite_count);
+	atlas_sprite* sprite = &atlas->sprites[sprite_id];
+	v2 size = { sprite->uv_max.x - sprite->uv_min.x, sprite->uv_max.y - sprite->uv_min.y };
+
+	for(ui32 i = 0; i < vertex_count; i++) {
+		v2 uv = vertices[i].uv;
+		vertices[i].uv = { sprite->uv_min.x + size.x * uv.x, sprite->uv_min.y + size.y * uv.y };
+	};
+};
+
+void atlas_release(atlas_context* atlas) {
+	for(ui32 i = 0; i < atlas->page_count; i++) {
+		VirtualFree(atlas->pages[i].nodes, 0, MEM_RELEASE);
+		VirtualFree(atlas->pages[i].pixels, 0, MEM_RELEASE);
+	};
+	memset(atlas, 0, sizeof(atlas_context));
+};
+
+#endif /* _ATLASH_ */
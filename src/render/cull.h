@@ -0,0 +1,71 @@
+/*  ----------------------------------- CULL
+	This header file contains the visibility tests done on the cpu before anything is drawn.
+
+	A frustum is the set of planes of a view projection matrix, objects are bounding spheres.
+	The same frustum code works for the camera and for the shadow cascades (their projections
+	are orthographic, the planes come out the same way).
+
+*/
+
+#ifndef _CULLH_
+#define _CULLH_
+
+// ------------------------------- structs
+
+enum cull_plane {
+	CULL_PLANE_LEFT,
+	CULL_PLANE_RIGHT,
+	CULL_PLANE_BOTTOM,
+	CULL_PLANE_TOP,
+	CULL_PLANE_FAR,
+	CULL_PLANE_NEAR, // last, so it can be dropped with plane_count
+
+	CULL_PLANE_COUNT,
+};
+
+// planes point inside : a point p is in front of a plane when dot(n, p) + d >= 0
+struct cull_frustum {
+	v4 planes[CULL_PLANE_COUNT]; // x, y, z = normal, w = d
+	ui32 plane_count;
+};
+
+// ------------------------------- functions
+
+internal v4 cull_normalize_plane(v4 plane) {
+	f32 length = sqrtf(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+	f32 inverse = length > 0.0f ? 1.0f / length : 0.0f;
+	return { plane.x * inverse, plane.y * inverse, plane.z * inverse, plane.w * inverse };
+};
+
+/*
+	Planes of the clip volume of a matrix (raylib layout, x' = m0 x + m4 y + m8 z + m12).
+	D3D clips depth to [0, w] : the near plane is z' >= 0, whatever the projection was made for.
+*/
+cull_frustum cull_frustum_from_matrix(const mx* m) {
+	v4 row0 = { m->m0, m->m4, m->m8, m->m12 };
+	v4 row1 = { m->m1, m->m5, m->m9, m->m13 };
+	v4 row2 = { m->m2, m->m6, m->m10, m->m14 };
+	v4 row3 = { m->m3, m->m7, m->m11, m->m15 };
+
+	cull_frustum frustum;
+	frustum.planes[CULL_PLANE_LEFT] = cull_normalize_plane(Vector4Add(row3, row0));
+	frustum.planes[CULL_PLANE_RIGHT] = cull_normalize_plane(Vector4Subtract(row3, row0));
+	frustum.planes[CULL_PLANE_BOTTOM] = cull_normalize_plane(Vector4Add(row3, row1));
+	frustum.planes[CULL_PLANE_TOP] = cull_normalize_plane(Vector4Subtract(row3, row1));
+	frustum.planes[CULL_PLANE_FAR] = cull_normalize_plane(Vector4Subtract(row3, row2));
+	frustum.planes[CULL_PLANE_NEAR] = cull_normalize_plane(row2);
+	frustum.plane_count = CULL_PLANE_COUNT;
+
+	return frustum;
+};
+
+// false only when the sphere is entirely behind one of the planes
+bool cull_sphere(const cull_frustum* frustum, v3 center, f32 radius) {
+	for(ui32 i = 0; i < frustum->plane_count; i++) {
+		const v4* plane = &frustum->planes[i];
+		if(plane->x * center.x + plane->y * center.y + plane->z * center.z + plane->w < -radius) return false;
+	};
+	return true;
+};
+
+#endif /* _CULLH_ */
@@ -0,0 +1,146 @@
+/*  ----------------------------------- DYNAMIC RESOLUTION
+	This header file contains the controller picking the resolution the scene is drawn at.
+
+	The gpu time of every frame is measured with timestamp queries, read back a few frames later without
+	waiting for them. The scene is drawn into the top left part of targets allocated at their largest size
+	and stretched to the backbuffer by the post processing, so a new resolution never allocates anything.
+
+	The gpu time follows the pixel count, so the scale (of each side) is nudged towards
+	scale * sqrt(target / measured), a little every frame so it does not oscillate. When the cpu is
+	slower than the gpu a lower resolution would not make the frame any faster, the scale is not lowered then.
+
+*/
+
+#ifndef _DYNRESH_
+#define _DYNRESH_
+
+#include <d3d11.h>
+
+#define DYNRES_LATENCY 4 // frames of queries in flight
+#define DYNRES_MIN_SCALE 0.5f
+#define DYNRES_HEADROOM 0.9f // aim under the target, what we measure is a few frames old
+#define DYNRES_SMOOTHING 0.1f // weight of a new sample in the running averages
+#define DYNRES_RATE 0.05f // part of the way to the wanted scale done each frame
+#define DYNRES_ALIGN 8 // pixels, below the window size
+
+// ------------------------------- structs
+
+struct dynres_system {
+	ID3D11Query* disjoint[DYNRES_LATENCY];
+	ID3D11Query* begin[DYNRES_LATENCY];
+	ID3D11Query* end[DYNRES_LATENCY];
+	ui64 issued; // frames measured
+	ui64 read; // frames read back
+	bool measuring;
+
+	// controller
+	bool enabled;
+	f32 target_ms;
+	f32 scale;
+	f32 gpu_ms; // running averages
+	f32 cpu_ms;
+};
+
+// ------------------------------- functions
+
+HRESULT dynres_init(dynres_system* dynres, ID3D11Device* device) {
+	HRESULT hr;
+	memset(dynres, 0, sizeof(dynres_system));
+
+	dynres->enabled = true;
+	dynres->target_ms = 1000.0f / 60.0f;
+	dynres->scale = 1.0f;
+
+	D3D11_QUERY_DESC disjoint = { .Query = D3D11_QUERY_TIMESTAMP_DISJOINT };
+	D3D11_QUERY_DESC timestamp = { .Query = D3D11_QUERY_TIMESTAMP };
+	for(ui32 i = 0; i < DYNRES_LATENCY; i++) {
+		hr = device->CreateQuery(&disjoint, &dynres->disjoint[i]);
+		if(FAILED(hr)) return hr;
+		hr = device->CreateQuery(&timestamp, &dynres->begin[i]);
+		if(FAILED(hr)) return hr;
+		hr = device->CreateQuery(&timestamp, &dynres->end[i]);
+		if(FAILED(hr)) return hr;
+	};
+
+	return hr;
+};
+
+// start of the gpu work of the frame, skipped when every query is still in flight
+void dynres_begin(dynres_system* dynres, ID3D11DeviceContext* context) {
+	if(!dynres->disjoint[0] || dynres->issued - dynres->read >= DYNRES_LATENCY) return;
+
+	ui32 slot = dynres->issued % DYNRES_LATENCY;
+	context->Begin(dynres->disjoint[slot]);
+	context->End(dynres->begin[slot]);
+	dynres->measuring = true;
+};
+
+void dynres_end(dynres_system* dynres, ID3D11DeviceContext* context) {
+	if(!dynres->measuring) return;
+
+	ui32 slot = dynres->issued % DYNRES_LATENCY;
+	context->End(dynres->end[slot]);
+	context->End(dynres->disjoint[slot]);
+	dynres->issued++;
+	dynres->measuring = false;
+};
+
+// picks up every frame the gpu is done with, oldest first
+void dynres_read(dynres_system* dynres, ID3D11DeviceContext* context) {
+	while(dynres->read < dynres->issued) {
+		ui32 slot = dynres->read % DYNRES_LATENCY;
+
+		D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint;
+		if(context->GetData(dynres->disjoint[slot], &disjoint, sizeof(disjoint), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK) break;
+
+		ui64 begin = 0, end = 0;
+		context->GetData(dynres->begin[slot], &begin, sizeof(ui64), D3D11_ASYNC_GETDATA_DONOTFLUSH);
+		context->GetData(dynres->end[slot], &end, sizeof(ui64), D3D11_ASYNC_GETDATA_DONOTFLUSH);
+		dynres->read++;
+
+		// the clock changed speed in the middle, the timestamps mean nothing
+		if(disjoint.Disjoint || end <= begin) continue;
+
+		f32 ms = (f32)((f64)(end - begin) * 1000.0 / (f64)disjoint.Frequency);
+		dynres->gpu_ms = dynres->gpu_ms > 0.0f ? dynres->gpu_ms + (ms - dynres->gpu_ms) * DYNRES_SMOOTHING : ms;
+	};
+};
+
+// time the cpu spent on the frame, without waiting on the gpu (present...)
+void dynres_set_cpu_time(dynres_system* dynres, f32 ms) {
+	dynres->cpu_ms = dynres->cpu_ms > 0.0f ? dynres->cpu_ms + (ms - dynres->cpu_ms) * DYNRES_SMOOTHING : ms;
+};
+
+// resolution of the next frame, never more than the window nor the targets (limit)
+viewport_size dynres_update(dynres_system* dynres, viewport_size window, viewport_size limit) {
+	if(!dynres->enabled) {
+		dynres->scale = 1.0f;
+	} else if(dynres->gpu_ms > 0.0f) {
+		f32 wanted = dynres->scale * sqrtf(dynres->target_ms * DYNRES_HEADROOM / dynres->gpu_ms);
+		if(wanted < dynres->scale && dynres->cpu_ms > dynres->gpu_ms) wanted = dynres->scale;
+		dynres->scale = clamp(dynres->scale + (wanted - dynres->scale) * DYNRES_RATE, DYNRES_MIN_SCALE, 1.0f);
+	};
+
+	viewport_size size = window;
+	if(dynres->scale < 1.0f) {
+		size.width = (i32)(window.width * dynres->scale) & ~(DYNRES_ALIGN - 1);
+		size.height = (i32)(window.height * dynres->scale) & ~(DYNRES_ALIGN - 1);
+	};
+	if(size.width > limit.width) size.width = limit.width;
+	if(size.height > limit.height) size.height = limit.height;
+	if(size.width < 1) size.width = 1;
+	if(size.height < 1) size.height = 1;
+
+	return size;
+};
+
+void dynres_release(dynres_system* dynres) {
+	for(ui32 i = 0; i < DYNRES_LATENCY; i++) {
+		if(dynres->disjoint[i]) dynres->disjoint[i]->Release();
+		if(dynres->begin[i]) dynres->begin[i]->Release();
+		if(dynres->end[i]) dynres->end[i]->Release();
+	};
+	memset(dynres, 0, sizeof(dynres_system));
+};
+
+#endif /* _DYNRESH_ */
@@ -0,0 +1,139 @@
+/*  ----------------------------------- FENCES
+	This header file contains the frames in flight : how far behind the cpu the gpu is, and what can be
+	reused or released because of it.
+
+	An event query is ended once a frame is submitted, it is signaled when the gpu went through every
+	command before it. No more than FRAMES_IN_FLIGHT frames are ever submitted and not done : the render
+	thread waits at the start of a frame rather than the driver blocking in some Map or Present, so how
+	much memory the driver keeps for us and how late a frame is both have a bound.
+	What the gpu may still read (the parts of the rings a frame wrote, its constants, replaced shaders...)
+	is tagged with the frame that last used it, it is reused or released once that frame is done.
+
+*/
+
+#ifndef _FENCEH_
+#define _FENCEH_
+
+#include <d3d11.h>
+
+#define FRAMES_IN_FLIGHT 3
+#define FENCE_MAX_RETIRED 256
+
+// ------------------------------- structs
+
+struct fence_retired {
+	ui64 frame; // last frame that may use it
+	IUnknown* object;
+};
+
+struct frame_fences {
+	ID3D11Query* events[FRAMES_IN_FLIGHT]; // frame n ends events[n % FRAMES_IN_FLIGHT]
+	ui64 submitted; // frames ended, the one being recorded is submitted + 1
+	ui64 completed; // frames the gpu is done with, in order
+
+	// released once the frame they were retired in is done
+	fence_retired retired[FENCE_MAX_RETIRED];
+	ui32 retired_count;
+
+	ui32 clock_speed;
+	f32 wait_ms; // stats, time the last frame waited for the gpu
+};
+
+// ------------------------------- functions
+
+HRESULT fences_init(frame_fences* fences, ID3D11Device* device) {
+	HRESULT hr;
+	memset(fences, 0, sizeof(frame_fences));
+	fences->clock_speed = platform_get_clock_speed();
+
+	D3D11_QUERY_DESC desc = { .Query = D3D11_QUERY_EVENT };
+	for(ui32 i = 0; i < FRAMES_IN_FLIGHT; i++) {
+		hr = device->CreateQuery(&desc, &fences->events[i]);
+		if(FAILED(hr)) return hr;
+	};
+
+	return hr;
+};
+
+// number of the frame being recorded
+ui64 fences_current(frame_fences* fences) {
+	return fences->submitted + 1;
+};
+
+// moves completed forward over every frame the gpu finished
+internal void fences_poll(frame_fences* fences, ID3D11DeviceContext* context) {
+	while(fences->completed < fences->submitted) {
+		ID3D11Query* event = fences->events[(fences->completed + 1) % FRAMES_IN_FLIGHT];
+		if(context->GetData(event, NULL, 0, D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK) break;
+		fences->completed++;
+	};
+};
+
+internal void fences_collect(frame_fences* fences) {
+	for(ui32 i = 0; i < fences->retired_count;) {
+		fence_retired* retired = &fences->retired[i];
+		if(retired->frame > fences->completed) {
+			i++;
+			continue;
+		};
+
+		retired->object->Release();
+		*retired = fences->retired[--fences->retired_count];
+	};
+};
+
+// call before recording a frame, waits while FRAMES_IN_FLIGHT frames are still on the gpu
+void fences_begin_frame(frame_fences* fences, ID3D11DeviceContext* context) {
+	fences_poll(fences, context);
+
+	fences->wait_ms = 0.0f;
+	if(fences->submitted - fences->completed >= FRAMES_IN_FLIGHT) {
+		LARGE_INTEGER start, end;
+		QueryPerformanceCounter(&start);
+
+		// flushing, the oldest frame may still be sitting in the command buffer
+		ID3D11Query* oldest = fences->events[(fences->completed + 1) % FRAMES_IN_FLIGHT];
+		while(context->GetData(oldest, NULL, 0, 0) != S_OK) {
+			YieldProcessor();
+		};
+		fences->completed++;
+
+		QueryPerformanceCounter(&end);
+		fences->wait_ms = (f32)((f64)(end.QuadPart - start.QuadPart) * 1000.0 / fences->clock_speed);
+		fences_poll(fences, context);
+	};
+
+	fences_collect(fences);
+};
+
+// call once everything of the frame is submitted (after Present)
+void fences_end_frame(frame_fences* fences, ID3D11DeviceContext* context) {
+	context->End(fences->events[fences_current(fences) % FRAMES_IN_FLIGHT]);
+	fences->submitted++;
+};
+
+// releases object once the frames that could have used it (up to the one being recorded) are done
+void fences_retire(frame_fences* fences, IUnknown* object) {
+	if(!object) return;
+
+	if(fences->retired_count == FENCE_MAX_RETIRED) {
+		// should never happen, but leaking is better than releasing something the gpu still reads
+		OutputDebugStringA("FENCE RETIRE QUEUE FULL\n");
+		return;
+	};
+
+	fences->retired[fences->retired_count++] = { fences_current(fences), object };
+};
+
+// the gpu must be idle, everything retired goes away
+void fences_release(frame_fences* fences) {
+	for(ui32 i = 0; i < fences->retired_count; i++) {
+		fences->retired[i].object->Release();
+	};
+	for(ui32 i = 0; i < FRAMES_IN_FLIGHT; i++) {
+		if(fences->events[i]) fences->events[i]->Release();
+	};
+	memset(fences, 0, sizeof(frame_fences));
+};
+
+#endif /* _FENCEH_ */
@@ -0,0 +1,186 @@
+/*  ----------------------------------- FRAME QUEUE
+	This header file contains the hand off between the simulation (window thread) and the render thread.
+
+	The simulation fills a frame snapshot : everything the render thread needs to draw one frame (camera,
+	meshes, lights, a copy of the ui draw lists, settings), then publishes it. The render thread draws
+	snapshots in order and gives each slot back once done, with what it measured (feedback) written in it.
+	There are FRAME_QUEUE_SIZE slots, so the simulation is never more than that many frames ahead, and
+	each side only ever writes its own counter (single producer, single consumer, no lock).
+
+	The window thread must keep pumping messages while it waits for a slot : Present & ResizeBuffers can
+	send messages to the window and would wait on it forever. frame_queue_acquire does not block, wait on
+	queue->free with MsgWaitForMultipleObjects.
+
+*/
+
+#ifndef _FRAMEH_
+#define _FRAMEH_
+
+#define FRAME_QUEUE_SIZE 2 // snapshots in flight between the two threads
+
+// ------------------------------- structs
+
+// what the simulation decides, applied by the render thread at the start of its frame
+struct frame_settings {
+	bool depth_prepass;
+	bool occlusion_culling;
+	bool dynamic_resolution;
+	ui32 post_tier;
+	bool parallel_recording;
+	bool gpu_culling;
+	bool software_occlusion;
+};
+
+// what the render thread measured while drawing a snapshot, read back when its slot is reused
+struct frame_feedback {
+	ui64 frame; // snapshot it was measured on, 0 = the slot was never drawn
+	ui_frame_stats stats;
+	viewport_size render_size;
+	f32 resolution_scale;
+	ui32 msaa_samples;
+	ui32 bloom_mips;
+	ui32 reload_count;
+	ui32 reload_failed;
+	ui32 command_lists; // recorded on the workers
+	ui32 gpu_objects; // culled by the compute pass
+	ui32 gpu_uploads; // of those, written to the gpu this frame
+};
+
+struct frame_snapshot {
+	ui64 frame;
+	bool quit; // the render thread stops here, nothing else in the snapshot is valid
+	f64 time;
+	Camera camera;
+	frame_settings settings;
+
+	// copies, the simulation is free to change its own arrays once published
+	mesh* meshes; // max_meshes of the queue
+	ui32 mesh_count;
+	light_source* lights; // LIGHTS_MAX
+	ui32 light_count;
+
+	// the ui draw data points to lists owned by the slot, they keep their memory from one frame to the next
+	ImDrawData ui;
+	ImVector<ImDrawList*> ui_lists;
+
+	frame_feedback feedback; // written by the render thread
+};
+
+struct frame_queue {
+	frame_snapshot slots[FRAME_QUEUE_SIZE];
+	ui32 max_meshes; // the scene drawn, every snapshot has room for all of it
+	volatile LONG64 written; // snapshots published by the simulation
+	volatile LONG64 read; // snapshots the render thread is done with
+
+	HANDLE ready; // set when a snapshot is published
+	HANDLE free; // set when a slot is given back
+};
+
+// ------------------------------- functions
+
+void frame_queue_init(frame_queue* queue, ui32 max_meshes) {
+	memset(queue, 0, sizeof(frame_queue));
+	queue->max_meshes = max_meshes;
+
+	for(ui32 i = 0; i < FRAME_QUEUE_SIZE; i++) {
+		frame_snapshot* snapshot = &queue->slots[i];
+		snapshot->meshes = (mesh*)VirtualAlloc(0, sizeof(mesh) * max_meshes, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+		snapshot->lights = (light_source*)VirtualAlloc(0, sizeof(light_source) * LIGHTS_MAX, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	};
+
+	// auto reset, the counters are what is waited for, the events only wake the other side up
+	queue->ready = CreateEventA(NULL, FALSE, FALSE, NULL);
+	queue->free = CreateEventA(NULL, FALSE, FALSE, NULL);
+};
+
+// ----------- simulation side
+
+// next slot to fill, NULL while the render thread still has every slot
+frame_snapshot* frame_queue_acquire(frame_queue* queue) {
+	if(queue->written - queue->read >= FRAME_QUEUE_SIZE) return NULL;
+
+	frame_snapshot* snapshot = &queue->slots[queue->written % FRAME_QUEUE_SIZE];
+	snapshot->frame = queue->written + 1;
+	snapshot->quit = false;
+	return snapshot;
+};
+
+// count up to the max_meshes the queue was made with
+void frame_snapshot_set_meshes(frame_queue* queue, frame_snapshot* snapshot, mesh* meshes, ui32 count) {
+	Assert(count <= queue->max_meshes);
+	snapshot->mesh_count = count < queue->max_meshes ? count : queue->max_meshes;
+	memcpy(snapshot->meshes, meshes, sizeof(mesh) * snapshot->mesh_count);
+};
+
+void frame_snapshot_set_lights(frame_snapshot* snapshot, light_source* lights, ui32 count) {
+	snapshot->light_count = count < LIGHTS_MAX ? count : LIGHTS_MAX;
+	memcpy(snapshot->lights, lights, sizeof(light_source) * snapshot->light_count);
+};
+
+// after ImGui::Render(), imgui reuses its own lists for the next frame
+void frame_snapshot_set_ui(frame_snapshot* snapshot, ImDrawData* draw_data) {
+	ImDrawData* ui = &snapshot->ui;
+	ui->Clear();
+
+	while(snapshot->ui_lists.Size < draw_data->CmdListsCount) {
+		snapshot->ui_lists.push_back(IM_NEW(ImDrawList)(NULL));
+	};
+
+	for(int n = 0; n < draw_data->CmdListsCount; n++) {
+		const ImDrawList* source = draw_data->CmdLists[n];
+		ImDrawList* list = snapshot->ui_lists[n];
+
+		// ImVector copies reuse the memory they already have
+		list->CmdBuffer = source->CmdBuffer;
+		list->IdxBuffer = source->IdxBuffer;
+		list->VtxBuffer = source->VtxBuffer;
+		list->Flags = source->Flags;
+		ui->CmdLists.push_back(list);
+	};
+
+	ui->Valid = draw_data->Valid;
+	ui->CmdListsCount = draw_data->CmdListsCount;
+	ui->TotalIdxCount = draw_data->TotalIdxCount;
+	ui->TotalVtxCount = draw_data->TotalVtxCount;
+	ui->DisplayPos = draw_data->DisplayPos;
+	ui->DisplaySize = draw_data->DisplaySize;
+	ui->FramebufferScale = draw_data->FramebufferScale;
+};
+
+// hands the slot from frame_queue_acquire to the render thread
+void frame_queue_publish(frame_queue* queue) {
+	InterlockedIncrement64(&queue->written);
+	SetEvent(queue->ready);
+};
+
+// ----------- render thread side
+
+// oldest snapshot not drawn yet, waits for one
+frame_snapshot* frame_queue_wait(frame_queue* queue) {
+	while(queue->read == queue->written) {
+		WaitForSingleObject(queue->ready, INFINITE);
+	};
+	return &queue->slots[queue->read % FRAME_QUEUE_SIZE];
+};
+
+// the snapshot from frame_queue_wait is done with, its feedback is filled in
+void frame_queue_release(frame_queue* queue) {
+	InterlockedIncrement64(&queue->read);
+	SetEvent(queue->free);
+};
+
+void frame_queue_destroy(frame_queue* queue) {
+	for(ui32 i = 0; i < FRAME_QUEUE_SIZE; i++) {
+		frame_snapshot* snapshot = &queue->slots[i];
+		for(int n = 0; n < snapshot->ui_lists.Size; n++) IM_DELETE(snapshot->ui_lists[n]);
+		snapshot->ui_lists.clear();
+		snapshot->ui.Clear();
+		VirtualFree(snapshot->meshes, 0, MEM_RELEASE);
+		VirtualFree(snapshot->lights, 0, MEM_RELEASE);
+	};
+	CloseHandle(queue->ready);
+	CloseHandle(queue->free);
+	memset(queue, 0, sizeof(frame_queue));
+};
+
+#endif /* _FRAMEH_ */
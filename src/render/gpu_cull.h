@@ -0,0 +1,362 @@
+/*  ----------------------------------- GPU CULL
+	This header file contains the gpu driven path : objects are culled by a compute pass and drawn with
+	indirect draws, the cpu never decides what is drawn.
+
+	Geometry is made resident the first time it is seen (the vertex & index arrays of a mesh are its
+	identity, they must not change once drawn). Objects sharing a geometry and a texture array form a
+	batch, each batch owns one indirect draw and a range of the instance buffer as big as its objects.
+	The bounds of every object live in a gpu buffer, only the ones that changed are written again.
+	Each frame the compute pass tests every object against the camera planes and the hi-z pyramid of
+	the last frame (on the gpu, no readback), and appends the survivors to their batch : the instance
+	count of its draw goes up by one and the instance data is written in the batch's range.
+	The draws then read their instance count from that buffer, a batch with nothing left draws nothing.
+
+*/
+
+#ifndef _GPUCULLH_
+#define _GPUCULLH_
+
+#include <d3d11.h>
+
+#define GPU_CULL_MAX_OBJECTS 4096
+#define GPU_CULL_MAX_GEOMETRIES 64
+#define GPU_CULL_MAX_BATCHES 64
+#define GPU_CULL_MAX_VERTICES 65536 // resident, all geometries together
+#define GPU_CULL_MAX_INDICES 262144
+#define GPU_CULL_GROUP_SIZE 64 // must match numthreads in cull.hlsl
+#define GPU_CULL_NONE 0xffffffff
+
+// ------------------------------- structs
+
+// t0 in cull.hlsl, must match cull_object
+struct gpu_cull_object {
+	v3 pos;
+	f32 radius; // 0 = never culled
+	ui32 batch;
+	ui32 material_slice;
+	ui32 pad[2];
+};
+
+// b0 in cull.hlsl, same rules as the other cbuffers
+struct gpu_cull_constants {
+	v4 planes[CULL_PLANE_COUNT];
+	mx depth_matrix; // view projection the pyramid was drawn with
+	v2 depth_screen; // part of the depth buffer it covers, in pixels
+	ui32 object_count;
+	ui32 occlusion; // 0 = frustum only
+	ui32 pyramid_mips;
+	ui32 pad[3];
+};
+
+// D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS, one per batch
+struct gpu_cull_args {
+	ui32 index_count;
+	ui32 instance_count; // written by the compute pass
+	ui32 first_index;
+	i32 base_vertex;
+	ui32 first_instance;
+};
+
+struct gpu_cull_geometry {
+	vertex* vertices;
+	ui16* indices;
+	ui32 index_count;
+	ui32 base_vertex; // in the resident buffers
+	ui32 first_index;
+};
+
+struct gpu_cull_batch {
+	ui32 geometry;
+	ui32 bucket; // of the texture table, the material slice is per instance
+	ui32 object_count;
+};
+
+struct gpu_cull_system {
+	// resident geometry
+	ID3D11Buffer* vertex_buffer;
+	ID3D11Buffer* index_buffer; // ui16, like the meshes
+	gpu_cull_geometry geometries[GPU_CULL_MAX_GEOMETRIES];
+	ui32 geometry_count;
+	ui32 vertex_count;
+	ui32 index_count;
+
+	gpu_cull_batch batches[GPU_CULL_MAX_BATCHES];
+	ui32 batch_count;
+	bool batches_changed; // their ranges of the instance buffer move, the draws are written again
+
+	// what the gpu has, the cpu keeps a copy to tell what changed
+	gpu_cull_object* objects; // GPU_CULL_MAX_OBJECTS
+	ui32 object_count;
+	ui32 dirty_first; // range to write, GPU_CULL_NONE when nothing changed
+	ui32 dirty_last;
+	ID3D11Buffer* object_buffer;
+	ID3D11ShaderResourceView* object_view;
+
+	// draws, reset from args_reset every frame before the compute pass counts the instances
+	ID3D11Buffer* args;
+	ID3D11Buffer* args_reset;
+	ID3D11UnorderedAccessView* args_view;
+
+	// vertex_instance of every object drawn, vertex buffer slot 1
+	ID3D11Buffer* instances;
+	ID3D11UnorderedAccessView* instance_view;
+
+	ID3D11Buffer* constants;
+	ID3D11ComputeShader* shader; // NULL when the shader cache has no cull program
+	bool enabled;
+
+	// stats, for the current frame
+	ui32 uploaded; // objects written
+};
+
+// ------------------------------- functions
+
+HRESULT gpu_cull_init(gpu_cull_system* cull, ID3D11Device* device) {
+	HRESULT hr;
+	memset(cull, 0, sizeof(gpu_cull_system));
+
+	cull->objects = (gpu_cull_object*)VirtualAlloc(0, sizeof(gpu_cull_object) * GPU_CULL_MAX_OBJECTS, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	cull->dirty_first = GPU_CULL_NONE;
+
+	D3D11_BUFFER_DESC desc =
+	{
+		.ByteWidth = sizeof(vertex) * GPU_CULL_MAX_VERTICES,
+		.Usage = D3D11_USAGE_DEFAULT,
+		.BindFlags = D3D11_BIND_VERTEX_BUFFER,
+	};
+	hr = device->CreateBuffer(&desc, NULL, &cull->vertex_buffer);
+	if(FAILED(hr)) return hr;
+
+	desc.ByteWidth = sizeof(ui16) * GPU_CULL_MAX_INDICES;
+	desc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	hr = device->CreateBuffer(&desc, NULL, &cull->index_buffer);
+	if(FAILED(hr)) return hr;
+
+	desc =
+	{
+		.ByteWidth = sizeof(gpu_cull_object) * GPU_CULL_MAX_OBJECTS,
+		.Usage = D3D11_USAGE_DEFAULT,
+		.BindFlags = D3D11_BIND_SHADER_RESOURCE,
+		.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED,
+		.StructureByteStride = sizeof(gpu_cull_object),
+	};
+	hr = device->CreateBuffer(&desc, NULL, &cull->object_buffer);
+	if(FAILED(hr)) return hr;
+	hr = device->CreateShaderResourceView((ID3D11Resource*)cull->object_buffer, NULL, &cull->object_view);
+	if(FAILED(hr)) return hr;
+
+	// the compute pass writes both as raw buffers
+	D3D11_UNORDERED_ACCESS_VIEW_DESC view = {};
+	view.Format = DXGI_FORMAT_R32_TYPELESS;
+	view.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+	view.Buffer.Flags = D3D11_BUFFER_UAV_FLAG_RAW;
+
+	desc =
+	{
+		.ByteWidth = sizeof(gpu_cull_args) * GPU_CULL_MAX_BATCHES,
+		.Usage = D3D11_USAGE_DEFAULT,
+		.BindFlags = D3D11_BIND_UNORDERED_ACCESS,
+		.MiscFlags = D3D11_RESOURCE_MISC_DRAWINDIRECT_ARGS | D3D11_RESOURCE_MISC_BUFFER_ALLOW_RAW_VIEWS,
+	};
+	hr = device->CreateBuffer(&desc, NULL, &cull->args);
+	if(FAILED(hr)) return hr;
+	hr = device->CreateBuffer(&desc, NULL, &cull->args_reset);
+	if(FAILED(hr)) return hr;
+	view.Buffer.NumElements = desc.ByteWidth / 4;
+	hr = device->CreateUnorderedAccessView((ID3D11Resource*)cull->args, &view, &cull->args_view);
+	if(FAILED(hr)) return hr;
+
+	desc =
+	{
+		.ByteWidth = sizeof(vertex_instance) * GPU_CULL_MAX_OBJECTS,
+		.Usage = D3D11_USAGE_DEFAULT,
+		.BindFlags = D3D11_BIND_VERTEX_BUFFER | D3D11_BIND_UNORDERED_ACCESS,
+		.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_ALLOW_RAW_VIEWS,
+	};
+	hr = device->CreateBuffer(&desc, NULL, &cull->instances);
+	if(FAILED(hr)) return hr;
+	view.Buffer.NumElements = desc.ByteWidth / 4;
+	hr = device->CreateUnorderedAccessView((ID3D11Resource*)cull->instances, &view, &cull->instance_view);
+	if(FAILED(hr)) return hr;
+
+	desc =
+	{
+		.ByteWidth = sizeof(gpu_cull_constants),
+		.Usage = D3D11_USAGE_DYNAMIC,
+		.BindFlags = D3D11_BIND_CONSTANT_BUFFER,
+		.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE,
+	};
+	hr = device->CreateBuffer(&desc, NULL, &cull->constants);
+
+	return hr;
+};
+
+// resident copy of a geometry, uploaded the first time it is asked for, GPU_CULL_NONE when there is no room
+ui32 gpu_cull_geometry(gpu_cull_system* cull, ID3D11DeviceContext* context, vertex* vertices, ui32 vertex_count, ui16* indices, ui32 index_count) {
+	for(ui32 i = 0; i < cull->geometry_count; i++) {
+		gpu_cull_geometry* geometry = &cull->geometries[i];
+		if(geometry->vertices == vertices && geometry->indices == indices) return i;
+	};
+
+	if(cull->geometry_count == GPU_CULL_MAX_GEOMETRIES) return GPU_CULL_NONE;
+	if(cull->vertex_count + vertex_count > GPU_CULL_MAX_VERTICES || cull->index_count + index_count > GPU_CULL_MAX_INDICES) return GPU_CULL_NONE;
+
+	gpu_cull_geometry* geometry = &cull->geometries[cull->geometry_count];
+	geometry->vertices = vertices;
+	geometry->indices = indices;
+	geometry->index_count = index_count;
+	geometry->base_vertex = cull->vertex_count;
+	geometry->first_index = cull->index_count;
+
+	D3D11_BOX box = { .left = sizeof(vertex) * cull->vertex_count, .top = 0, .front = 0, .right = sizeof(vertex) * (cull->vertex_count + vertex_count), .bottom = 1, .back = 1 };
+	context->UpdateSubresource((ID3D11Resource*)cull->vertex_buffer, 0, &box, vertices, 0, 0);
+
+	// the box of a buffer is in bytes, an odd count of ui16 still ends on a byte
+	box.left = sizeof(ui16) * cull->index_count;
+	box.right = sizeof(ui16) * (cull->index_count + index_count);
+	context->UpdateSubresource((ID3D11Resource*)cull->index_buffer, 0, &box, indices, 0, 0);
+
+	cull->vertex_count += vertex_count;
+	cull->index_count += index_count;
+	return cull->geometry_count++;
+};
+
+// batch of a geometry drawn with a texture bucket, GPU_CULL_NONE when there is no room
+ui32 gpu_cull_batch(gpu_cull_system* cull, ui32 geometry, ui32 bucket) {
+	for(ui32 i = 0; i < cull->batch_count; i++) {
+		gpu_cull_batch* batch = &cull->batches[i];
+		if(batch->geometry == geometry && batch->bucket == bucket) return i;
+	};
+
+	if(cull->batch_count == GPU_CULL_MAX_BATCHES) return GPU_CULL_NONE;
+
+	cull->batches[cull->batch_count] = { geometry, bucket, 0 };
+	cull->batches_changed = true;
+	return cull->batch_count++;
+};
+
+// object index of the frame, only written to the gpu when it is not what it already has
+void gpu_cull_set_object(gpu_cull_system* cull, ui32 index, gpu_cull_object* object) {
+	Assert(index < GPU_CULL_MAX_OBJECTS);
+	gpu_cull_object* old = &cull->objects[index];
+
+	if(index < cull->object_count) {
+		if(memcmp(old, object, sizeof(gpu_cull_object)) == 0) return;
+		if(old->batch != object->batch) {
+			cull->batches[old->batch].object_count--;
+			cull->batches[object->batch].object_count++;
+			cull->batches_changed = true;
+		};
+	} else {
+		// a new object, the count is set once they are all in
+		cull->batches[object->batch].object_count++;
+		cull->batches_changed = true;
+	};
+
+	*old = *object;
+	if(index < cull->dirty_first) cull->dirty_first = index;
+	if(index > cull->dirty_last) cull->dirty_last = index;
+};
+
+// objects past count are gone, call once every object of the frame is set
+void gpu_cull_set_count(gpu_cull_system* cull, ui32 count) {
+	for(ui32 i = count; i < cull->object_count; i++) {
+		cull->batches[cull->objects[i].batch].object_count--;
+		cull->batches_changed = true;
+	};
+	cull->object_count = count;
+};
+
+/*
+	Culls the objects & writes the draws, frustum from the camera of the frame. With occlusion, objects are
+	also tested against the pyramid in hiz (the depth of the last frame it was built on).
+	Nothing may have the instance buffer bound when this runs, the compute pass writes it.
+*/
+void gpu_cull_dispatch(gpu_cull_system* cull, ID3D11DeviceContext* context, cull_frustum* frustum, hiz_system* hiz, bool occlusion) {
+	if(!cull->shader) return;
+
+	// changed objects only, in one range
+	if(cull->dirty_first != GPU_CULL_NONE) {
+		if(cull->dirty_last >= cull->object_count) cull->dirty_last = cull->object_count - 1;
+		if(cull->dirty_first <= cull->dirty_last) {
+			D3D11_BOX box = { .left = sizeof(gpu_cull_object) * cull->dirty_first, .top = 0, .front = 0, .right = sizeof(gpu_cull_object) * (cull->dirty_last + 1), .bottom = 1, .back = 1 };
+			context->UpdateSubresource((ID3D11Resource*)cull->object_buffer, 0, &box, &cull->objects[cull->dirty_first], 0, 0);
+			cull->uploaded = cull->dirty_last + 1 - cull->dirty_first;
+		};
+		cull->dirty_first = GPU_CULL_NONE;
+		cull->dirty_last = 0;
+	};
+
+	// each batch gets a range of the instance buffer as big as its objects
+	if(cull->batches_changed) {
+		gpu_cull_args args[GPU_CULL_MAX_BATCHES];
+		ui32 first_instance = 0;
+		for(ui32 i = 0; i < cull->batch_count; i++) {
+			gpu_cull_batch* batch = &cull->batches[i];
+			gpu_cull_geometry* geometry = &cull->geometries[batch->geometry];
+			args[i] = {
+				.index_count = geometry->index_count,
+				.instance_count = 0,
+				.first_index = geometry->first_index,
+				.base_vertex = (i32)geometry->base_vertex,
+				.first_instance = first_instance,
+			};
+			first_instance += batch->object_count;
+		};
+		D3D11_BOX box = { .left = 0, .top = 0, .front = 0, .right = sizeof(gpu_cull_args) * cull->batch_count, .bottom = 1, .back = 1 };
+		if(cull->batch_count) context->UpdateSubresource((ID3D11Resource*)cull->args_reset, 0, &box, args, 0, 0);
+		cull->batches_changed = false;
+	};
+
+	context->CopyResource((ID3D11Resource*)cull->args, (ID3D11Resource*)cull->args_reset);
+	if(cull->object_count == 0) return;
+
+	gpu_cull_constants constants = {
+		.object_count = cull->object_count,
+	};
+	memcpy(constants.planes, frustum->planes, sizeof(constants.planes));
+
+	viewport_size screen;
+	if(occlusion && hiz_last_pyramid(hiz, &constants.depth_matrix, &screen)) {
+		constants.depth_screen = { (f32)screen.width, (f32)screen.height };
+		constants.occlusion = 1;
+		constants.pyramid_mips = hiz->mip_count;
+	};
+
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	context->Map((ID3D11Resource*)cull->constants, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+	memcpy(mapped.pData, &constants, sizeof(constants));
+	context->Unmap((ID3D11Resource*)cull->constants, 0);
+
+	ID3D11ShaderResourceView* views[2] = { cull->object_view, constants.occlusion ? hiz->view : NULL };
+	ID3D11UnorderedAccessView* uavs[2] = { cull->args_view, cull->instance_view };
+	context->CSSetShader(cull->shader, NULL, 0);
+	context->CSSetConstantBuffers(0, 1, &cull->constants);
+	context->CSSetShaderResources(0, 2, views);
+	context->CSSetUnorderedAccessViews(0, 2, uavs, NULL);
+
+	context->Dispatch((cull->object_count + GPU_CULL_GROUP_SIZE - 1) / GPU_CULL_GROUP_SIZE, 1, 1);
+
+	// the draws read both, the pyramid becomes a target again later in the frame
+	ID3D11ShaderResourceView* no_views[2] = {};
+	ID3D11UnorderedAccessView* no_uavs[2] = {};
+	context->CSSetShaderResources(0, 2, no_views);
+	context->CSSetUnorderedAccessViews(0, 2, no_uavs, NULL);
+};
+
+void gpu_cull_release(gpu_cull_system* cull) {
+	if(cull->vertex_buffer) cull->vertex_buffer->Release();
+	if(cull->index_buffer) cull->index_buffer->Release();
+	if(cull->object_view) cull->object_view->Release();
+	if(cull->object_buffer) cull->object_buffer->Release();
+	if(cull->args_view) cull->args_view->Release();
+	if(cull->args) cull->args->Release();
+	if(cull->args_reset) cull->args_reset->Release();
+	if(cull->instance_view) cull->instance_view->Release();
+	if(cull->instances) cull->instances->Release();
+	if(cull->constants) cull->constants->Release();
+	VirtualFree(cull->objects, 0, MEM_RELEASE);
+	memset(cull, 0, sizeof(gpu_cull_system));
+};
+
+#endif /* _GPUCULLH_ */
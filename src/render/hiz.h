@@ -0,0 +1,272 @@
+/*  ----------------------------------- HI-Z
+	This header file contains occlusion culling against a hierarchical depth buffer.
+
+	After the scene is drawn, its depth is reduced into a pyramid (every texel = farthest depth under it)
+	and one small mip of it is copied to the cpu, which reads it a few frames later like the virtual
+	texture feedback. Before drawing, the bounds of every object are projected with the matrix that depth
+	was drawn with : when everything under its rectangle is closer than its closest point, it is hidden
+	and never reaches the gpu.
+
+	The depth is a few frames old, an object coming out from behind something shows up that much later.
+	The scene may only cover the top left of the depth buffer (dynamic resolution), the pyramid is only
+	built over that part.
+
+*/
+
+#ifndef _HIZH_
+#define _HIZH_
+
+#include <d3d11.h>
+
+#define HIZ_LATENCY 3 // readback copies in flight
+#define HIZ_READBACK_WIDTH 128 // the cpu reads the first mip at most this wide
+#define HIZ_MAX_MIPS 16
+
+// ------------------------------- structs
+
+struct hiz_system {
+	// mip 0 is half the depth buffer, each mip halves the one before (the last row / column of odd sizes is folded in)
+	ID3D11Texture2D* pyramid;
+	ID3D11RenderTargetView* mip_targets[HIZ_MAX_MIPS];
+	ID3D11ShaderResourceView* mip_views[HIZ_MAX_MIPS];
+	ID3D11ShaderResourceView* view; // every mip, read by the gpu culling (see render/gpu_cull.h)
+	ui32 mip_count;
+	ui32 screen_width;
+	ui32 screen_height;
+
+	// copies of one mip for the cpu, with the view projection & the part of the depth buffer they were drawn with
+	ui32 readback_mip;
+	ui32 readback_width;
+	ui32 readback_height;
+	ID3D11Texture2D* readback[HIZ_LATENCY];
+	mx readback_matrix[HIZ_LATENCY];
+	viewport_size readback_screen[HIZ_LATENCY];
+	ui64 readback_written;
+
+	// last readback that came back, what objects are tested against
+	f32* depth;
+	mx depth_matrix;
+	viewport_size depth_screen;
+	bool depth_valid;
+
+	// stats, for the current frame
+	ui32 tested;
+	ui32 occluded;
+	ui32 late; // readbacks still not done after HIZ_LATENCY frames
+};
+
+// ------------------------------- functions
+
+internal void hiz_release_pyramid(hiz_system* hiz) {
+	if(hiz->pyramid) {
+		for(ui32 i = 0; i < hiz->mip_count; i++) {
+			hiz->mip_targets[i]->Release();
+			hiz->mip_views[i]->Release();
+		};
+		for(ui32 i = 0; i < HIZ_LATENCY; i++) {
+			hiz->readback[i]->Release();
+		};
+		hiz->view->Release();
+		hiz->pyramid->Release();
+		hiz->pyramid = NULL;
+	};
+	if(hiz->depth) VirtualFree(hiz->depth, 0, MEM_RELEASE);
+	hiz->depth = NULL;
+	hiz->depth_valid = false;
+	hiz->readback_written = 0;
+};
+
+// the pyramid follows the depth buffer size, what was in flight for the old size is dropped
+HRESULT hiz_resize(hiz_system* hiz, ID3D11Device* device, ui32 screen_width, ui32 screen_height) {
+	HRESULT hr;
+	hiz_release_pyramid(hiz);
+
+	hiz->screen_width = screen_width;
+	hiz->screen_height = screen_height;
+
+	ui32 width = screen_width / 2 > 0 ? screen_width / 2 : 1;
+	ui32 height = screen_height / 2 > 0 ? screen_height / 2 : 1;
+	hiz->mip_count = 0;
+	hiz->readback_width = 0;
+	for(ui32 w = width, h = height; hiz->mip_count < HIZ_MAX_MIPS;) {
+		// the first mip narrow enough is the one read back
+		if(hiz->readback_width == 0 && w <= HIZ_READBACK_WIDTH) {
+			hiz->readback_mip = hiz->mip_count;
+			hiz->readback_width = w;
+			hiz->readback_height = h;
+		};
+		hiz->mip_count++;
+
+		if(w == 1 && h == 1) break;
+		w = w / 2 > 0 ? w / 2 : 1;
+		h = h / 2 > 0 ? h / 2 : 1;
+	};
+
+	D3D11_TEXTURE2D_DESC desc =
+	{
+		.Width = width,
+		.Height = height,
+		.MipLevels = hiz->mip_count,
+		.ArraySize = 1,
+		.Format = DXGI_FORMAT_R32_FLOAT,
+		.SampleDesc = { 1, 0 },
+		.Usage = D3D11_USAGE_DEFAULT,
+		.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE,
+	};
+	hr = device->CreateTexture2D(&desc, NULL, &hiz->pyramid);
+	if(FAILED(hr)) return hr;
+
+	// each mip is drawn from the one above it, one view each
+	for(ui32 i = 0; i < hiz->mip_count; i++) {
+		D3D11_RENDER_TARGET_VIEW_DESC target = {};
+		target.Format = DXGI_FORMAT_R32_FLOAT;
+		target.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D;
+		target.Texture2D.MipSlice = i;
+		hr = device->CreateRenderTargetView((ID3D11Resource*)hiz->pyramid, &target, &hiz->mip_targets[i]);
+		if(FAILED(hr)) return hr;
+
+		D3D11_SHADER_RESOURCE_VIEW_DESC view = {};
+		view.Format = DXGI_FORMAT_R32_FLOAT;
+		view.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+		view.Texture2D.MostDetailedMip = i;
+		view.Texture2D.MipLevels = 1;
+		hr = device->CreateShaderResourceView((ID3D11Resource*)hiz->pyramid, &view, &hiz->mip_views[i]);
+		if(FAILED(hr)) return hr;
+	};
+
+	hr = device->CreateShaderResourceView((ID3D11Resource*)hiz->pyramid, NULL, &hiz->view);
+	if(FAILED(hr)) return hr;
+
+	// cpu copies, read a few frames later
+	desc.Width = hiz->readback_width;
+	desc.Height = hiz->readback_height;
+	desc.MipLevels = 1;
+	desc.Usage = D3D11_USAGE_STAGING;
+	desc.BindFlags = 0;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	for(ui32 i = 0; i < HIZ_LATENCY; i++) {
+		hr = device->CreateTexture2D(&desc, NULL, &hiz->readback[i]);
+		if(FAILED(hr)) return hr;
+	};
+
+	hiz->depth = (f32*)VirtualAlloc(0, sizeof(f32) * hiz->readback_width * hiz->readback_height, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+	return hr;
+};
+
+// call once the pyramid is built, matrix is the view projection the scene was drawn with, screen the part of the depth it covered
+void hiz_copy_readback(hiz_system* hiz, ID3D11DeviceContext* context, mx* matrix, viewport_size screen) {
+	ui32 slot = hiz->readback_written % HIZ_LATENCY;
+	context->CopySubresourceRegion((ID3D11Resource*)hiz->readback[slot], 0, 0, 0, 0, (ID3D11Resource*)hiz->pyramid, hiz->readback_mip, NULL);
+	hiz->readback_matrix[slot] = *matrix;
+	hiz->readback_screen[slot] = screen;
+	hiz->readback_written++;
+};
+
+// view projection & part of the depth buffer of the last pyramid built, false when there is none
+bool hiz_last_pyramid(hiz_system* hiz, mx* matrix, viewport_size* screen) {
+	if(!hiz->pyramid || hiz->readback_written == 0) return false;
+
+	ui32 slot = (hiz->readback_written - 1) % HIZ_LATENCY;
+	*matrix = hiz->readback_matrix[slot];
+	*screen = hiz->readback_screen[slot];
+	return true;
+};
+
+// picks up the oldest copy if the gpu is done with it, call once per frame before testing anything
+void hiz_read(hiz_system* hiz, ID3D11DeviceContext* context) {
+	hiz->tested = 0;
+	hiz->occluded = 0;
+	if(!hiz->pyramid || hiz->readback_written < HIZ_LATENCY) return;
+
+	// the copy written HIZ_LATENCY frames ago, overwritten next
+	ui32 slot = hiz->readback_written % HIZ_LATENCY;
+
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	HRESULT hr = context->Map((ID3D11Resource*)hiz->readback[slot], 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mapped);
+	if(hr == DXGI_ERROR_WAS_STILL_DRAWING) {
+		// keep testing against the one we have
+		hiz->late++;
+		return;
+	};
+	if(FAILED(hr)) return;
+
+	for(ui32 y = 0; y < hiz->readback_height; y++) {
+		memcpy(hiz->depth + y * hiz->readback_width, (ui8*)mapped.pData + y * mapped.RowPitch, sizeof(f32) * hiz->readback_width);
+	};
+	context->Unmap((ID3D11Resource*)hiz->readback[slot], 0);
+
+	hiz->depth_matrix = hiz->readback_matrix[slot];
+	hiz->depth_screen = hiz->readback_screen[slot];
+	hiz->depth_valid = true;
+};
+
+/*
+	false when the sphere was hidden in the depth read back. Its bounding box is projected, anything
+	crossing the camera plane or off the old screen is visible (nothing to compare it to).
+*/
+bool hiz_test_sphere(hiz_system* hiz, v3 center, f32 radius) {
+	if(!hiz->depth_valid) return true;
+	hiz->tested++;
+
+	mx* m = &hiz->depth_matrix;
+	f32 min_x = D3D11_FLOAT32_MAX, max_x = -D3D11_FLOAT32_MAX;
+	f32 min_y = D3D11_FLOAT32_MAX, max_y = -D3D11_FLOAT32_MAX;
+	f32 min_z = D3D11_FLOAT32_MAX;
+
+	for(ui32 i = 0; i < 8; i++) {
+		f32 x = center.x + (i & 1 ? radius : -radius);
+		f32 y = center.y + (i & 2 ? radius : -radius);
+		f32 z = center.z + (i & 4 ? radius : -radius);
+
+		f32 w = m->m3 * x + m->m7 * y + m->m11 * z + m->m15;
+		if(w <= 1e-5f) return true;
+
+		f32 inverse_w = 1.0f / w;
+		f32 px = (m->m0 * x + m->m4 * y + m->m8 * z + m->m12) * inverse_w;
+		f32 py = (m->m1 * x + m->m5 * y + m->m9 * z + m->m13) * inverse_w;
+		f32 pz = (m->m2 * x + m->m6 * y + m->m10 * z + m->m14) * inverse_w;
+
+		min_x = fminf(min_x, px);
+		max_x = fmaxf(max_x, px);
+		min_y = fminf(min_y, py);
+		max_y = fmaxf(max_y, py);
+		min_z = fminf(min_z, pz);
+	};
+
+	// d3d clips below 0, the part in front of that was never in the depth buffer
+	if(min_z < 0.0f) return true;
+	if(max_x < -1.0f || min_x > 1.0f || max_y < -1.0f || min_y > 1.0f) return true;
+
+	// ndc -> readback texels, screen y goes down
+	f32 texel_pixels = (f32)(2u << hiz->readback_mip);
+	f32 clamped_min_x = fmaxf(min_x, -1.0f), clamped_max_x = fminf(max_x, 1.0f);
+	f32 clamped_min_y = fmaxf(min_y, -1.0f), clamped_max_y = fminf(max_y, 1.0f);
+	f32 screen_width = (f32)hiz->depth_screen.width, screen_height = (f32)hiz->depth_screen.height;
+	ui32 x0 = (ui32)((clamped_min_x * 0.5f + 0.5f) * screen_width / texel_pixels);
+	ui32 x1 = (ui32)((clamped_max_x * 0.5f + 0.5f) * screen_width / texel_pixels);
+	ui32 y0 = (ui32)((0.5f - clamped_max_y * 0.5f) * screen_height / texel_pixels);
+	ui32 y1 = (ui32)((0.5f - clamped_min_y * 0.5f) * screen_height / texel_pixels);
+	if(x1 >= hiz->readback_width) x1 = hiz->readback_width - 1;
+	if(y1 >= hiz->readback_height) y1 = hiz->readback_height - 1;
+	if(x0 > x1) x0 = x1;
+	if(y0 > y1) y0 = y1;
+
+	// one texel farther than the closest point of the bounds is enough to see it
+	for(ui32 y = y0; y <= y1; y++) {
+		f32* row = hiz->depth + y * hiz->readback_width;
+		for(ui32 x = x0; x <= x1; x++) {
+			if(row[x] >= min_z) return true;
+		};
+	};
+
+	hiz->occluded++;
+	return false;
+};
+
+void hiz_release(hiz_system* hiz) {
+	hiz_release_pyramid(hiz);
+	memset(hiz, 0, sizeof(hiz_system));
+};
+
+#endif /* _HIZH_ */
@@ -0,0 +1,361 @@
+/*  ----------------------------------- HOT RELOAD
+	This header file contains hot reloading of shaders and textures.
+
+	The shader source directory and the asset directory are watched for changes. A changed file
+	waits a bit (editors tend to write the same file several times in a row), then goes into the
+	request queue. A worker thread recompiles it and creates the new shaders, or decodes it, then
+	pushes the result back. The main thread swaps the results into the render_context at the
+	start of a frame, old shaders are only released once the frames that used them are done.
+	Textures are uploaded into their texture table slice, the driver keeps the old content alive
+	for the frames already submitted.
+
+*/
+
+#ifndef _HOTRELOADH_
+#define _HOTRELOADH_
+
+// relative to the working directory (build/)
+#define RELOAD_SHADER_DIR "..\\src\\render\\shader"
+#define RELOAD_ASSET_DIR "."
+
+#define RELOAD_QUEUE_SIZE 16 // must be a power of two
+#define RELOAD_MAX_PENDING 16
+#define RELOAD_DEBOUNCE 0.1 // in seconds
+
+// ----------------------- STRUCTS
+
+enum reload_type { RELOAD_SHADER, RELOAD_TEXTURE };
+
+struct reload_request {
+	reload_type type;
+	ui32 program;
+	ui64 live_mask; // permutations of the program that exist right now, the others stay lazy
+	char path[MAX_PATH];
+	char filename[MAX_PATH];
+};
+
+struct reload_result {
+	reload_type type;
+	bool ok;
+	ui32 program;
+	ui64 live_mask;
+	shader_program programs[SHADER_PERMUTATION_COUNT];
+	complete_img image; // decoded, uploaded by the main thread
+	char filename[MAX_PATH];
+};
+
+struct reload_pending {
+	reload_request request;
+	f64 last_change;
+};
+
+struct reload_context {
+	ID3D11Device* device;
+	dir_watcher shader_watcher;
+	dir_watcher asset_watcher;
+
+	// changes waiting for the debounce delay
+	reload_pending pending[RELOAD_MAX_PENDING];
+	ui32 pending_count;
+
+	// main thread -> worker (single producer, single consumer)
+	reload_request requests[RELOAD_QUEUE_SIZE];
+	volatile LONG request_write;
+	volatile LONG request_read;
+	HANDLE semaphore;
+	HANDLE thread;
+	volatile bool quit; // set by reload_shutdown, the worker stops at its next request
+
+	// worker -> main thread (single producer, single consumer)
+	reload_result results[RELOAD_QUEUE_SIZE];
+	volatile LONG result_write;
+	volatile LONG result_read;
+
+	ui32 reload_count;
+	ui32 failed_count;
+};
+
+// ----------------------- WORKER
+
+internal void reload_compile_shader(reload_context* reload, reload_request* request, reload_result* result) {
+	complete_file source = {0};
+	io_file_fullread(request->path, &source);
+	if(!source.memory) return;
+
+	result->ok = true;
+
+	for(ui32 features = 0; features < SHADER_PERMUTATION_COUNT && result->ok; features++) {
+		if(!(request->live_mask & (1ull << features))) continue;
+
+		ui32 stages = shader_program_stages[request->program];
+		ID3DBlob* code[SHADER_STAGE_COUNT] = {};
+		for(ui32 stage = 0; stage < SHADER_STAGE_COUNT; stage++) {
+			if(!(stages & (1 << stage))) continue;
+
+			ID3DBlob* errors = NULL;
+			HRESULT hr = shader_compile_variant(source.memory, source.size, request->path, features, stage, &code[stage], &errors);
+			if(errors) {
+				// keep the old shader on errors, the artist sees what is wrong in the debugger output
+				OutputDebugStringA((char*)errors->GetBufferPointer());
+				errors->Release();
+			};
+			if(FAILED(hr)) {
+				result->ok = false;
+			};
+		};
+
+		if(result->ok && stages == SHADER_STAGES_COMPUTE) {
+			ID3DBlob* cs = code[SHADER_STAGE_CS];
+			HRESULT hr = reload->device->CreateComputeShader(cs->GetBufferPointer(), cs->GetBufferSize(), NULL, &result->programs[features].cshader);
+			if(FAILED(hr)) result->ok = false;
+		} else if(result->ok) {
+			shader_program* program = &result->programs[features];
+			ID3DBlob* vs = code[SHADER_STAGE_VS];
+			ID3DBlob* ps = code[SHADER_STAGE_PS];
+
+			D3D11_INPUT_ELEMENT_DESC desc[16];
+			ui32 desc_count = shader_build_layout(features, desc);
+
+			HRESULT hr = reload->device->CreateVertexShader(vs->GetBufferPointer(), vs->GetBufferSize(), NULL, &program->vshader);
+			if(SUCCEEDED(hr)) hr = reload->device->CreatePixelShader(ps->GetBufferPointer(), ps->GetBufferSize(), NULL, &program->pshader);
+			if(SUCCEEDED(hr)) hr = reload->device->CreateInputLayout(desc, desc_count, vs->GetBufferPointer(), vs->GetBufferSize(), &program->layout);
+			if(FAILED(hr)) result->ok = false;
+		};
+
+		for(ui32 stage = 0; stage < SHADER_STAGE_COUNT; stage++) {
+			if(code[stage]) code[stage]->Release();
+		};
+	};
+
+	if(!result->ok) {
+		// all or nothing, a half reloaded program would mix old and new code
+		for(ui32 features = 0; features < SHADER_PERMUTATION_COUNT; features++) {
+			shader_program* program = &result->programs[features];
+			if(program->vshader) program->vshader->Release();
+			if(program->pshader) program->pshader->Release();
+			if(program->layout) program->layout->Release();
+			if(program->cshader) program->cshader->Release();
+		};
+		memset(result->programs, 0, sizeof(result->programs));
+	};
+
+	io_file_fullfree(&source);
+};
+
+internal DWORD WINAPI reload_worker(LPVOID param) {
+	reload_context* reload = (reload_context*)param;
+
+	for(;;) {
+		WaitForSingleObject(reload->semaphore, INFINITE);
+		if(reload->quit) return 0;
+
+		LONG read = reload->request_read;
+		if(read == reload->request_write) continue;
+
+		reload_request request = reload->requests[read & (RELOAD_QUEUE_SIZE - 1)];
+		InterlockedExchange(&reload->request_read, read + 1);
+
+		// wait for the main thread to drain results if it is behind
+		while(reload->result_write - reload->result_read >= RELOAD_QUEUE_SIZE) {
+			if(reload->quit) return 0;
+			Sleep(1);
+		};
+
+		reload_result* result = &reload->results[reload->result_write & (RELOAD_QUEUE_SIZE - 1)];
+		memset(result, 0, sizeof(reload_result));
+		result->type = request.type;
+		result->program = request.program;
+		result->live_mask = request.live_mask;
+		strcpy(result->filename, request.filename);
+
+		if(request.type == RELOAD_SHADER) {
+			reload_compile_shader(reload, &request, result);
+		} else {
+			complete_file file = {0};
+			result->image = parse_decode_img(request.path, &file);
+			result->ok = result->image.memory != NULL;
+			if(file.memory) io_file_fullfree(&file);
+		};
+
+		// publish, the result is fully written before the index moves
+		InterlockedIncrement(&reload->result_write);
+	};
+
+	return 0;
+};
+
+// ----------------------- MAIN THREAD
+
+internal void reload_on_change(void* user, char* filename, reload_type type) {
+	reload_context* reload = (reload_context*)user;
+	reload_request request = {0};
+	request.type = type;
+	strncpy(request.filename, filename, MAX_PATH - 1);
+
+	if(type == RELOAD_SHADER) {
+		bool found = false;
+		for(ui32 program = 0; program < SHADER_PROGRAM_COUNT; program++) {
+			if(_stricmp(filename, shader_program_sources[program]) == 0) {
+				request.program = program;
+				found = true;
+			};
+		};
+		if(!found) return;
+		snprintf(request.path, MAX_PATH, "%s\\%s", RELOAD_SHADER_DIR, filename);
+	} else {
+		// only textures we know how to decode
+		if(!parse_is_img(filename)) return;
+		snprintf(request.path, MAX_PATH, "%s\\%s", RELOAD_ASSET_DIR, filename);
+	};
+
+	// already waiting ? then just push its deadline back
+	for(ui32 i = 0; i < reload->pending_count; i++) {
+		if(strcmp(reload->pending[i].request.path, request.path) == 0) {
+			reload->pending[i].last_change = -1.0;
+			return;
+		};
+	};
+
+	if(reload->pending_count < RELOAD_MAX_PENDING) {
+		reload_pending* pending = &reload->pending[reload->pending_count++];
+		pending->request = request;
+		pending->last_change = -1.0; // stamped with the current time in reload_update
+	};
+};
+
+internal void reload_on_shader_change(void* user, char* filename) {
+	reload_on_change(user, filename, RELOAD_SHADER);
+};
+
+internal void reload_on_asset_change(void* user, char* filename) {
+	reload_on_change(user, filename, RELOAD_TEXTURE);
+};
+
+internal void reload_apply(reload_context* reload, render_context* rContext, reload_result* result) {
+	if(!result->ok) {
+		reload->failed_count++;
+		return;
+	};
+
+	if(result->type == RELOAD_TEXTURE) {
+		ui32 material = texture_table_find(&rContext->textures, result->filename);
+		bool replaced = false;
+		if(material != TEXTURE_INVALID) {
+			replaced = texture_table_replace(&rContext->textures, rContext->device, rContext->context, material, &result->image);
+		};
+		parse_free_img(&result->image);
+		
+		// not a texture we use (or no room for its new size)
+		if(!replaced) return;
+	} else {
+		shader_library* library = &rContext->shaders;
+
+		for(ui32 features = 0; features < SHADER_PERMUTATION_COUNT; features++) {
+			if(!(result->live_mask & (1ull << features))) continue;
+
+			shader_program* live = &library->programs[result->program][features];
+			shader_program* fresh = &result->programs[features];
+
+			// released once no frame in flight can use them anymore
+			pipeline_evict_shaders(&rContext->psoCache, live->vshader, live->pshader);
+			fences_retire(&rContext->fences, live->vshader);
+			fences_retire(&rContext->fences, live->pshader);
+			fences_retire(&rContext->fences, live->layout);
+			fences_retire(&rContext->fences, live->cshader);
+			*live = *fresh;
+		};
+
+		// pipelines were built from the old shaders
+		render_select_shaders(rContext);
+		render_init_pipeline(rContext);
+	};
+
+	// the tracker may point to evicted pipelines, everything gets bound again this frame
+	tracker_reset(&rContext->tracker);
+	reload->reload_count++;
+};
+
+void reload_init(reload_context* reload, ID3D11Device* device) {
+	reload->device = device;
+
+	char shaderDir[] = RELOAD_SHADER_DIR;
+	char assetDir[] = RELOAD_ASSET_DIR;
+	platform_watch_directory(&reload->shader_watcher, shaderDir);
+	platform_watch_directory(&reload->asset_watcher, assetDir);
+
+	reload->semaphore = CreateSemaphoreA(NULL, 0, RELOAD_QUEUE_SIZE, NULL);
+	reload->thread = CreateThread(NULL, 0, reload_worker, reload, 0, NULL);
+};
+
+// stops the worker and the watchers, results not swapped in yet are dropped. Call before the device goes away
+void reload_shutdown(reload_context* reload) {
+	reload->quit = true;
+	ReleaseSemaphore(reload->semaphore, 1, NULL);
+	WaitForSingleObject(reload->thread, INFINITE);
+	CloseHandle(reload->thread);
+	CloseHandle(reload->semaphore);
+
+	platform_unwatch_directory(&reload->shader_watcher);
+	platform_unwatch_directory(&reload->asset_watcher);
+
+	while(reload->result_read != reload->result_write) {
+		reload_result* result = &reload->results[reload->result_read & (RELOAD_QUEUE_SIZE - 1)];
+		for(ui32 features = 0; features < SHADER_PERMUTATION_COUNT; features++) {
+			shader_program* program = &result->programs[features];
+			if(program->vshader) program->vshader->Release();
+			if(program->pshader) program->pshader->Release();
+			if(program->layout) program->layout->Release();
+			if(program->cshader) program->cshader->Release();
+		};
+		if(result->image.memory) parse_free_img(&result->image);
+		reload->result_read++;
+	};
+
+	memset(reload, 0, sizeof(reload_context));
+};
+
+// call once per frame, at the frame boundary (before anything is bound)
+void reload_update(reload_context* reload, render_context* rContext, f64 time) {
+	// 1. file changes -> pending
+	platform_poll_watcher(&reload->shader_watcher, reload_on_shader_change, reload);
+	platform_poll_watcher(&reload->asset_watcher, reload_on_asset_change, reload);
+
+	// 2. pending that stopped changing -> worker
+	for(ui32 i = 0; i < reload->pending_count;) {
+		reload_pending* pending = &reload->pending[i];
+		if(pending->last_change < 0) pending->last_change = time;
+
+		bool queue_full = reload->request_write - reload->request_read >= RELOAD_QUEUE_SIZE;
+		if(time - pending->last_change < RELOAD_DEBOUNCE || queue_full) {
+			i++;
+			continue;
+		};
+
+		reload_request* request = &reload->requests[reload->request_write & (RELOAD_QUEUE_SIZE - 1)];
+		*request = pending->request;
+
+		if(request->type == RELOAD_SHADER) {
+			request->live_mask = 0;
+			for(ui32 features = 0; features < SHADER_PERMUTATION_COUNT; features++) {
+				shader_program* live = &rContext->shaders.programs[request->program][features];
+				if(live->vshader || live->cshader) {
+					request->live_mask |= 1ull << features;
+				};
+			};
+		};
+
+		InterlockedIncrement(&reload->request_write);
+		ReleaseSemaphore(reload->semaphore, 1, NULL);
+
+		*pending = reload->pending[--reload->pending_count];
+	};
+
+	// 3. finished work -> swapped into the live context
+	while(reload->result_read != reload->result_write) {
+		reload_result* result = &reload->results[reload->result_read & (RELOAD_QUEUE_SIZE - 1)];
+		reload_apply(reload, rContext, result);
+		InterlockedIncrement(&reload->result_read);
+	};
+};
+
+#endif /* _HOTRELOADH_ */
@@ -0,0 +1,394 @@
+/*  ----------------------------------- LIGHTS
+	This header file contains point lights and how they are culled (clustered forward lighting).
+
+	The view frustum is cut into clusters : CLUSTER_TILES_X * CLUSTER_TILES_Y screen tiles times
+	CLUSTER_SLICES depth slices (exponential, the close ones are thin). Every frame the lights are
+	binned into the clusters they touch on the job system : first the cluster range of each light,
+	4 lights at a time with SSE, then one job per depth slice filling the light lists of its clusters.
+	The pixel shader finds its cluster from its screen position and depth and only loops over the
+	lights listed there, so the cost follows how many lights overlap each pixel, not how many exist.
+
+*/
+
+#ifndef _LIGHTSH_
+#define _LIGHTSH_
+
+#include <d3d11.h>
+#include <emmintrin.h>
+
+#define LIGHTS_MAX 4096 // light indices are ui16 on the gpu
+
+#define CLUSTER_TILES_X 16
+#define CLUSTER_TILES_Y 9
+#define CLUSTER_SLICES 24
+#define CLUSTER_TILES (CLUSTER_TILES_X * CLUSTER_TILES_Y)
+#define CLUSTER_COUNT (CLUSTER_TILES * CLUSTER_SLICES)
+#define CLUSTER_MAX_LIGHTS 256 // per cluster, the extra ones are dropped
+#define CLUSTER_MAX_INDICES (256 * 1024) // light lists of every cluster, back to back
+#define CLUSTER_NEAR 1.0f // end of the first slice, in view units (the first slice goes from the camera to here)
+#define CLUSTER_FAR 1000.0f // CAMERA_CULL_DISTANCE_FAR
+#define CLUSTER_JOB_LIGHTS 512 // lights per range job
+
+// ------------------------------- structs
+
+// StructuredBuffer element in the shaders, positions and radius in world units
+struct light_source {
+	v3 pos;
+	f32 intensity;
+	v3 color;
+	f32 radius; // no light past this distance
+};
+
+// clusters a light touches, inclusive, z0 > z1 when it is off screen
+struct light_range {
+	ui8 x0, x1;
+	ui8 y0, y1;
+	ui8 z0, z1;
+};
+
+struct light_clusters {
+	light_source* lights; // owned by the caller, read by lights_build
+	ui32 light_count;
+
+	// camera of the frame being binned
+	mx view;
+	f32 view_scale; // world units -> view units
+	f32 proj_x; // projection m0 & m5
+	f32 proj_y;
+	f32 slice_starts[CLUSTER_SLICES]; // view depth where each slice starts
+
+	// job outputs
+	light_range* ranges; // one per light
+	ui16* slice_indices; // CLUSTER_TILES * CLUSTER_MAX_LIGHTS per slice, packed at the front by its job
+	ui32* slice_grid; // offset in the slice lists & count, per cluster
+	ui32 slice_counts[CLUSTER_SLICES];
+	ui32 slice_dropped[CLUSTER_SLICES];
+
+	// gpu side : t3 lights, t4 offset & count per cluster, t5 light indices
+	ID3D11Buffer* light_buffer;
+	ID3D11ShaderResourceView* light_view;
+	ID3D11Buffer* grid_buffer;
+	ID3D11ShaderResourceView* grid_view;
+	ID3D11Buffer* index_buffer;
+	ID3D11ShaderResourceView* index_view;
+
+	// stats
+	ui32 visible;
+	ui32 index_count;
+	ui32 dropped;
+};
+
+struct light_job {
+	light_clusters* clusters;
+	ui32 first; // first light, or the slice
+	ui32 count;
+};
+
+// ------------------------------- binning
+
+internal __m128 lights_select(__m128 mask, __m128 a, __m128 b) {
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+};
+
+// ndc -> tile, clamped to the grid
+internal __m128i lights_to_tile(__m128 ndc, f32 tiles, bool flip) {
+	__m128 half = _mm_set1_ps(0.5f);
+	__m128 t = flip ? _mm_sub_ps(half, _mm_mul_ps(ndc, half)) : _mm_add_ps(_mm_mul_ps(ndc, half), half);
+	t = _mm_mul_ps(t, _mm_set1_ps(tiles));
+	t = _mm_min_ps(_mm_max_ps(t, _mm_setzero_ps()), _mm_set1_ps(tiles - 1.0f));
+	return _mm_cvttps_epi32(t);
+};
+
+/*
+	Screen tiles & slices covered by each light, 4 at a time.
+	The sphere is bounded by a box in view space : the smallest x / depth is the left edge over the closest
+	depth when it is negative, over the farthest one otherwise (same for the other edges).
+*/
+internal void lights_range_job(void* data) {
+	light_job* job = (light_job*)data;
+	light_clusters* clusters = job->clusters;
+	mx* m = &clusters->view;
+
+	__m128 m0 = _mm_set1_ps(m->m0), m4 = _mm_set1_ps(m->m4), m8 = _mm_set1_ps(m->m8), m12 = _mm_set1_ps(m->m12);
+	__m128 m1 = _mm_set1_ps(m->m1), m5 = _mm_set1_ps(m->m5), m9 = _mm_set1_ps(m->m9), m13 = _mm_set1_ps(m->m13);
+	__m128 m2 = _mm_set1_ps(m->m2), m6 = _mm_set1_ps(m->m6), m10 = _mm_set1_ps(m->m10), m14 = _mm_set1_ps(m->m14);
+	__m128 scale = _mm_set1_ps(clusters->view_scale);
+	__m128 proj_x = _mm_set1_ps(clusters->proj_x);
+	__m128 proj_y = _mm_set1_ps(clusters->proj_y);
+	__m128 near_plane = _mm_set1_ps((f32)CAMERA_CULL_DISTANCE_NEAR);
+	__m128 far_plane = _mm_set1_ps(CLUSTER_FAR);
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 minus_one = _mm_set1_ps(-1.0f);
+
+	for(ui32 i = 0; i < job->count; i += 4) {
+		// the last group repeats its last light
+		light_source* l[4];
+		for(ui32 lane = 0; lane < 4; lane++) {
+			ui32 index = i + lane < job->count ? i + lane : job->count - 1;
+			l[lane] = &clusters->lights[job->first + index];
+		};
+
+		__m128 x = _mm_setr_ps(l[0]->pos.x, l[1]->pos.x, l[2]->pos.x, l[3]->pos.x);
+		__m128 y = _mm_setr_ps(l[0]->pos.y, l[1]->pos.y, l[2]->pos.y, l[3]->pos.y);
+		__m128 z = _mm_setr_ps(l[0]->pos.z, l[1]->pos.z, l[2]->pos.z, l[3]->pos.z);
+		__m128 r = _mm_mul_ps(_mm_setr_ps(l[0]->radius, l[1]->radius, l[2]->radius, l[3]->radius), scale);
+
+		// to view space, the camera looks down -z
+		__m128 vx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m0, x), _mm_mul_ps(m4, y)), _mm_add_ps(_mm_mul_ps(m8, z), m12));
+		__m128 vy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m1, x), _mm_mul_ps(m5, y)), _mm_add_ps(_mm_mul_ps(m9, z), m13));
+		__m128 vz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m2, x), _mm_mul_ps(m6, y)), _mm_add_ps(_mm_mul_ps(m10, z), m14));
+		__m128 depth = _mm_sub_ps(zero, vz);
+
+		__m128 depth_min = _mm_max_ps(_mm_sub_ps(depth, r), near_plane);
+		__m128 depth_max = _mm_add_ps(depth, r);
+		__m128 visible = _mm_and_ps(_mm_cmpgt_ps(depth_max, near_plane), _mm_cmplt_ps(_mm_sub_ps(depth, r), far_plane));
+
+		__m128 left = _mm_sub_ps(vx, r);
+		__m128 right = _mm_add_ps(vx, r);
+		__m128 bottom = _mm_sub_ps(vy, r);
+		__m128 top = _mm_add_ps(vy, r);
+		__m128 x_min = _mm_div_ps(_mm_mul_ps(proj_x, left), lights_select(_mm_cmplt_ps(left, zero), depth_min, depth_max));
+		__m128 x_max = _mm_div_ps(_mm_mul_ps(proj_x, right), lights_select(_mm_cmpgt_ps(right, zero), depth_min, depth_max));
+		__m128 y_min = _mm_div_ps(_mm_mul_ps(proj_y, bottom), lights_select(_mm_cmplt_ps(bottom, zero), depth_min, depth_max));
+		__m128 y_max = _mm_div_ps(_mm_mul_ps(proj_y, top), lights_select(_mm_cmpgt_ps(top, zero), depth_min, depth_max));
+
+		visible = _mm_and_ps(visible, _mm_and_ps(_mm_cmpgt_ps(x_max, minus_one), _mm_cmplt_ps(x_min, one)));
+		visible = _mm_and_ps(visible, _mm_and_ps(_mm_cmpgt_ps(y_max, minus_one), _mm_cmplt_ps(y_min, one)));
+
+		// screen y goes down
+		__m128i tx0 = lights_to_tile(x_min, CLUSTER_TILES_X, false);
+		__m128i tx1 = lights_to_tile(x_max, CLUSTER_TILES_X, false);
+		__m128i ty0 = lights_to_tile(y_max, CLUSTER_TILES_Y, true);
+		__m128i ty1 = lights_to_tile(y_min, CLUSTER_TILES_Y, true);
+
+		// slice = how many slice starts are at or before the depth (compares give -1)
+		__m128i tz0 = _mm_setzero_si128();
+		__m128i tz1 = _mm_setzero_si128();
+		for(ui32 s = 1; s < CLUSTER_SLICES; s++) {
+			__m128 start = _mm_set1_ps(clusters->slice_starts[s]);
+			tz0 = _mm_sub_epi32(tz0, _mm_castps_si128(_mm_cmple_ps(start, depth_min)));
+			tz1 = _mm_sub_epi32(tz1, _mm_castps_si128(_mm_cmple_ps(start, depth_max)));
+		};
+
+		i32 out[6][4];
+		i32 on_screen = _mm_movemask_ps(visible);
+		_mm_storeu_si128((__m128i*)out[0], tx0);
+		_mm_storeu_si128((__m128i*)out[1], tx1);
+		_mm_storeu_si128((__m128i*)out[2], ty0);
+		_mm_storeu_si128((__m128i*)out[3], ty1);
+		_mm_storeu_si128((__m128i*)out[4], tz0);
+		_mm_storeu_si128((__m128i*)out[5], tz1);
+
+		for(ui32 lane = 0; lane < 4 && i + lane < job->count; lane++) {
+			light_range* range = &clusters->ranges[job->first + i + lane];
+			*range = {
+				(ui8)out[0][lane], (ui8)out[1][lane],
+				(ui8)out[2][lane], (ui8)out[3][lane],
+				(ui8)out[4][lane], (ui8)out[5][lane],
+			};
+			if(!(on_screen & (1 << lane))) {
+				range->z0 = CLUSTER_SLICES;
+				range->z1 = 0;
+			};
+		};
+	};
+};
+
+// fills the light lists of every cluster of one slice, then packs them at the front of the slice storage
+internal void lights_slice_job(void* data) {
+	light_job* job = (light_job*)data;
+	light_clusters* clusters = job->clusters;
+	ui32 slice = job->first;
+
+	ui16* indices = clusters->slice_indices + slice * CLUSTER_TILES * CLUSTER_MAX_LIGHTS;
+	ui32* grid = clusters->slice_grid + slice * CLUSTER_TILES * 2;
+	ui32 counts[CLUSTER_TILES] = {};
+	ui32 dropped = 0;
+
+	for(ui32 i = 0; i < clusters->light_count; i++) {
+		light_range range = clusters->ranges[i];
+		if(slice < range.z0 || slice > range.z1) continue;
+
+		for(ui32 y = range.y0; y <= range.y1; y++) {
+			for(ui32 x = range.x0; x <= range.x1; x++) {
+				ui32 tile = y * CLUSTER_TILES_X + x;
+				if(counts[tile] == CLUSTER_MAX_LIGHTS) {
+					dropped++;
+					continue;
+				};
+				indices[tile * CLUSTER_MAX_LIGHTS + counts[tile]++] = (ui16)i;
+			};
+		};
+	};
+
+	// lists only move towards the front, memmove is enough
+	ui32 offset = 0;
+	for(ui32 tile = 0; tile < CLUSTER_TILES; tile++) {
+		memmove(indices + offset, indices + tile * CLUSTER_MAX_LIGHTS, sizeof(ui16) * counts[tile]);
+		grid[tile * 2] = offset;
+		grid[tile * 2 + 1] = counts[tile];
+		offset += counts[tile];
+	};
+
+	clusters->slice_counts[slice] = offset;
+	clusters->slice_dropped[slice] = dropped;
+};
+
+// ------------------------------- functions
+
+HRESULT lights_init(light_clusters* clusters, ID3D11Device* device) {
+	HRESULT hr;
+	memset(clusters, 0, sizeof(light_clusters));
+
+	// exponential slices after the first one, each starts CLUSTER_FAR / CLUSTER_NEAR ^ (1 / (CLUSTER_SLICES - 1)) times farther
+	clusters->slice_starts[0] = 0.0f;
+	for(ui32 s = 1; s < CLUSTER_SLICES; s++) {
+		clusters->slice_starts[s] = CLUSTER_NEAR * powf(CLUSTER_FAR / CLUSTER_NEAR, (f32)(s - 1) / (f32)(CLUSTER_SLICES - 1));
+	};
+
+	clusters->ranges = (light_range*)VirtualAlloc(0, sizeof(light_range) * LIGHTS_MAX, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	clusters->slice_indices = (ui16*)VirtualAlloc(0, sizeof(ui16) * CLUSTER_COUNT * CLUSTER_MAX_LIGHTS, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	clusters->slice_grid = (ui32*)VirtualAlloc(0, sizeof(ui32) * 2 * CLUSTER_COUNT, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+	D3D11_BUFFER_DESC desc =
+	{
+		.ByteWidth = sizeof(light_source) * LIGHTS_MAX,
+		.Usage = D3D11_USAGE_DYNAMIC,
+		.BindFlags = D3D11_BIND_SHADER_RESOURCE,
+		.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE,
+		.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED,
+		.StructureByteStride = sizeof(light_source),
+	};
+	D3D11_SHADER_RESOURCE_VIEW_DESC view = {};
+	view.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+
+	hr = device->CreateBuffer(&desc, NULL, &clusters->light_buffer);
+	if(FAILED(hr)) return hr;
+	view.Format = DXGI_FORMAT_UNKNOWN;
+	view.Buffer.NumElements = LIGHTS_MAX;
+	hr = device->CreateShaderResourceView((ID3D11Resource*)clusters->light_buffer, &view, &clusters->light_view);
+	if(FAILED(hr)) return hr;
+
+	// typed buffers for the grid and the lists
+	desc.MiscFlags = 0;
+	desc.StructureByteStride = 0;
+
+	desc.ByteWidth = sizeof(ui32) * 2 * CLUSTER_COUNT;
+	hr = device->CreateBuffer(&desc, NULL, &clusters->grid_buffer);
+	if(FAILED(hr)) return hr;
+	view.Format = DXGI_FORMAT_R32G32_UINT;
+	view.Buffer.NumElements = CLUSTER_COUNT;
+	hr = device->CreateShaderResourceView((ID3D11Resource*)clusters->grid_buffer, &view, &clusters->grid_view);
+	if(FAILED(hr)) return hr;
+
+	desc.ByteWidth = sizeof(ui16) * CLUSTER_MAX_INDICES;
+	hr = device->CreateBuffer(&desc, NULL, &clusters->index_buffer);
+	if(FAILED(hr)) return hr;
+	view.Format = DXGI_FORMAT_R16_UINT;
+	view.Buffer.NumElements = CLUSTER_MAX_INDICES;
+	hr = device->CreateShaderResourceView((ID3D11Resource*)clusters->index_buffer, &view, &clusters->index_view);
+
+	return hr;
+};
+
+// lights to bin from the next lights_build on, the array must stay alive until then
+void lights_set(light_clusters* clusters, light_source* lights, ui32 count) {
+	clusters->lights = lights;
+	clusters->light_count = count < LIGHTS_MAX ? count : LIGHTS_MAX;
+};
+
+// bins the lights for a camera, view must be the same matrix the shaders use to get the view depth
+void lights_build(light_clusters* clusters, job_system* jobs, mx* view, mx* projection) {
+	clusters->view = *view;
+	clusters->view_scale = Vector3Length({ view->m0, view->m1, view->m2 });
+	clusters->proj_x = projection->m0;
+	clusters->proj_y = projection->m5;
+
+	light_job job_data[LIGHTS_MAX / CLUSTER_JOB_LIGHTS + CLUSTER_SLICES];
+	ui32 job_count = 0;
+	volatile LONG counter = 0;
+
+	// 1. clusters touched by each light
+	for(ui32 first = 0; first < clusters->light_count; first += CLUSTER_JOB_LIGHTS) {
+		light_job* job = &job_data[job_count++];
+		job->clusters = clusters;
+		job->first = first;
+		job->count = clusters->light_count - first < CLUSTER_JOB_LIGHTS ? clusters->light_count - first : CLUSTER_JOB_LIGHTS;
+		jobs_push(jobs, lights_range_job, job, &counter);
+	};
+	jobs_wait(jobs, &counter);
+
+	// 2. light lists, one slice per job
+	for(ui32 slice = 0; slice < CLUSTER_SLICES; slice++) {
+		light_job* job = &job_data[job_count++];
+		job->clusters = clusters;
+		job->first = slice;
+		job->count = 0;
+		jobs_push(jobs, lights_slice_job, job, &counter);
+	};
+	jobs_wait(jobs, &counter);
+
+	clusters->visible = 0;
+	for(ui32 i = 0; i < clusters->light_count; i++) {
+		if(clusters->ranges[i].z0 <= clusters->ranges[i].z1) clusters->visible++;
+	};
+};
+
+// the slices go one after the other in the index buffer, lists past CLUSTER_MAX_INDICES are cut
+void lights_upload(light_clusters* clusters, ID3D11DeviceContext* context) {
+	D3D11_MAPPED_SUBRESOURCE mapped;
+
+	if(clusters->light_count) {
+		context->Map((ID3D11Resource*)clusters->light_buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+		memcpy(mapped.pData, clusters->lights, sizeof(light_source) * clusters->light_count);
+		context->Unmap((ID3D11Resource*)clusters->light_buffer, 0);
+	};
+
+	D3D11_MAPPED_SUBRESOURCE mapped_indices;
+	context->Map((ID3D11Resource*)clusters->grid_buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+	context->Map((ID3D11Resource*)clusters->index_buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped_indices);
+	ui32* grid = (ui32*)mapped.pData;
+	ui16* indices = (ui16*)mapped_indices.pData;
+
+	ui32 base = 0;
+	clusters->dropped = 0;
+	for(ui32 slice = 0; slice < CLUSTER_SLICES; slice++) {
+		ui32 count = clusters->slice_counts[slice];
+		if(count > CLUSTER_MAX_INDICES - base) count = CLUSTER_MAX_INDICES - base;
+		memcpy(indices + base, clusters->slice_indices + slice * CLUSTER_TILES * CLUSTER_MAX_LIGHTS, sizeof(ui16) * count);
+
+		ui32* slice_grid = clusters->slice_grid + slice * CLUSTER_TILES * 2;
+		for(ui32 tile = 0; tile < CLUSTER_TILES; tile++) {
+			ui32 offset = slice_grid[tile * 2];
+			ui32 lights = slice_grid[tile * 2 + 1];
+			if(offset + lights > count) lights = offset < count ? count - offset : 0;
+
+			grid[(slice * CLUSTER_TILES + tile) * 2] = base + offset;
+			grid[(slice * CLUSTER_TILES + tile) * 2 + 1] = lights;
+		};
+
+		clusters->dropped += clusters->slice_dropped[slice] + clusters->slice_counts[slice] - count;
+		base += count;
+	};
+	clusters->index_count = base;
+
+	context->Unmap((ID3D11Resource*)clusters->index_buffer, 0);
+	context->Unmap((ID3D11Resource*)clusters->grid_buffer, 0);
+};
+
+void lights_release(light_clusters* clusters) {
+	if(clusters->light_view) clusters->light_view->Release();
+	if(clusters->light_buffer) clusters->light_buffer->Release();
+	if(clusters->grid_view) clusters->grid_view->Release();
+	if(clusters->grid_buffer) clusters->grid_buffer->Release();
+	if(clusters->index_view) clusters->index_view->Release();
+	if(clusters->index_buffer) clusters->index_buffer->Release();
+
+	VirtualFree(clusters->ranges, 0, MEM_RELEASE);
+	VirtualFree(clusters->slice_indices, 0, MEM_RELEASE);
+	VirtualFree(clusters->slice_grid, 0, MEM_RELEASE);
+	memset(clusters, 0, sizeof(light_clusters));
+};
+
+#endif /* _LIGHTSH_ */
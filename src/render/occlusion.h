@@ -0,0 +1,351 @@
+/*  ----------------------------------- OCCLUSION
+	This header file contains the software occlusion culling : a small depth buffer drawn on the cpu from
+	the occluders of the frame, what is behind them is never drawn.
+
+	Meshes flagged as occluders are rasterized with the camera of this frame into OCCLUSION_WIDTH x
+	OCCLUSION_HEIGHT pixels, cut into 8x4 tiles. A tile keeps no depth per pixel (masked occlusion
+	culling) : z_far is how far its occluders reach once it is fully covered, the pixels covered since
+	are a 32 bit mask with the farthest depth among them in z_layer. When the mask is full the layer
+	becomes the new z_far. Coverage is conservative : only pixels entirely inside a triangle are set and
+	the depth kept is the farthest the triangle reaches over the tile, an object is never hidden by
+	something that does not cover it.
+	The screen is cut into bins of tile rows, one job each, a row of 8 pixels is one AVX2 compare per
+	edge. Most tiles of a big occluder never get there : a tile the triangle cannot be in front of, one
+	outside of an edge or one inside all of them is decided from its corners alone.
+	Bounds are then tested 8 tiles at a time, no gpu involved and no frame of latency.
+
+	Without AVX2 the culler stays off. Triangles crossing the camera plane are skipped (less occlusion,
+	never wrong).
+
+*/
+
+#ifndef _OCCLUSIONH_
+#define _OCCLUSIONH_
+
+#include <immintrin.h>
+
+#define OCCLUSION_WIDTH 256
+#define OCCLUSION_HEIGHT 128
+#define OCCLUSION_TILE_WIDTH 8 // one avx2 register of pixels
+#define OCCLUSION_TILE_HEIGHT 4 // 8x4 = the 32 bits of a mask
+#define OCCLUSION_TILES_X (OCCLUSION_WIDTH / OCCLUSION_TILE_WIDTH)
+#define OCCLUSION_TILES_Y (OCCLUSION_HEIGHT / OCCLUSION_TILE_HEIGHT)
+#define OCCLUSION_TILE_COUNT (OCCLUSION_TILES_X * OCCLUSION_TILES_Y)
+#define OCCLUSION_BINS 8 // jobs, each one a band of tile rows
+#define OCCLUSION_MAX_TRIANGLES 8192
+#define OCCLUSION_MAX_VERTICES 16384 // per occluder
+
+// ------------------------------- structs
+
+// ready to rasterize, winding made counter clockwise on screen
+struct occlusion_triangle {
+	v3 v[3]; // x, y in pixels (y down), z = depth
+	ui16 tile_x0, tile_x1; // tiles its bounds touch
+	ui16 tile_y0, tile_y1;
+};
+
+struct occlusion_system {
+	// tiles, row by row (8 floats of padding at the end, tests read 8 tiles at once)
+	f32* tile_far;
+	f32* tile_layer;
+	ui32* tile_mask;
+
+	occlusion_triangle* triangles; // OCCLUSION_MAX_TRIANGLES
+	ui32 triangle_count;
+	v4* projected; // OCCLUSION_MAX_VERTICES, clip space of the occluder being added
+	mx matrix; // view projection of the frame
+
+	bool supported; // avx2
+	bool enabled;
+
+	// stats, for the current frame
+	ui32 occluders;
+	ui32 tested;
+	ui32 occluded;
+};
+
+struct occlusion_job {
+	occlusion_system* occlusion;
+	ui32 tile_y0; // rows of the bin
+	ui32 tile_y1;
+};
+
+// ------------------------------- functions
+
+void occlusion_init(occlusion_system* occlusion) {
+	memset(occlusion, 0, sizeof(occlusion_system));
+
+	ui32 tiles = OCCLUSION_TILE_COUNT + 8;
+	occlusion->tile_far = (f32*)VirtualAlloc(0, (sizeof(f32) * 2 + sizeof(ui32)) * tiles, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	occlusion->tile_layer = occlusion->tile_far + tiles;
+	occlusion->tile_mask = (ui32*)(occlusion->tile_layer + tiles);
+	occlusion->triangles = (occlusion_triangle*)VirtualAlloc(0, sizeof(occlusion_triangle) * OCCLUSION_MAX_TRIANGLES, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	occlusion->projected = (v4*)VirtualAlloc(0, sizeof(v4) * OCCLUSION_MAX_VERTICES, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+	occlusion->supported = platform_has_avx2();
+	occlusion->enabled = occlusion->supported;
+};
+
+// call once per frame before adding the occluders, matrix is the camera of the frame
+void occlusion_begin(occlusion_system* occlusion, mx* view_projection) {
+	occlusion->matrix = *view_projection;
+	occlusion->triangle_count = 0;
+	occlusion->occluders = 0;
+	occlusion->tested = 0;
+	occlusion->occluded = 0;
+};
+
+// projects the triangles of an occluder, false when they do not all fit
+bool occlusion_add_mesh(occlusion_system* occlusion, v3 pos, vertex* vertices, ui32 vertex_count, ui16* indices, ui32 index_count) {
+	if(vertex_count > OCCLUSION_MAX_VERTICES) return false;
+	occlusion->occluders++;
+
+	mx* m = &occlusion->matrix;
+	for(ui32 i = 0; i < vertex_count; i++) {
+		f32 x = vertices[i].pos.x + pos.x;
+		f32 y = vertices[i].pos.y + pos.y;
+		f32 z = vertices[i].pos.z + pos.z;
+		occlusion->projected[i] = {
+			m->m0 * x + m->m4 * y + m->m8 * z + m->m12,
+			m->m1 * x + m->m5 * y + m->m9 * z + m->m13,
+			m->m2 * x + m->m6 * y + m->m10 * z + m->m14,
+			m->m3 * x + m->m7 * y + m->m11 * z + m->m15,
+		};
+	};
+
+	for(ui32 i = 0; i + 2 < index_count; i += 3) {
+		if(occlusion->triangle_count == OCCLUSION_MAX_TRIANGLES) return false;
+
+		// a broken index would read past the vertices projected, the triangle is left out
+		if(indices[i] >= vertex_count || indices[i + 1] >= vertex_count || indices[i + 2] >= vertex_count) continue;
+
+		v3 v[3];
+		bool behind = false;
+		for(ui32 corner = 0; corner < 3; corner++) {
+			v4 clip = occlusion->projected[indices[i + corner]];
+			if(clip.w <= 1e-5f) behind = true;
+
+			// ndc -> pixels, screen y goes down
+			f32 inverse_w = 1.0f / clip.w;
+			v[corner] = {
+				(clip.x * inverse_w * 0.5f + 0.5f) * OCCLUSION_WIDTH,
+				(0.5f - clip.y * inverse_w * 0.5f) * OCCLUSION_HEIGHT,
+				clip.z * inverse_w,
+			};
+		};
+		if(behind) continue;
+
+		// occluders are seen from both sides, edges are made to face inside
+		f32 area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[1].y - v[0].y) * (v[2].x - v[0].x);
+		if(fabsf(area) < 1e-3f) continue;
+		if(area < 0) {
+			v3 swap = v[1];
+			v[1] = v[2];
+			v[2] = swap;
+		};
+
+		f32 min_x = fminf(v[0].x, fminf(v[1].x, v[2].x)), max_x = fmaxf(v[0].x, fmaxf(v[1].x, v[2].x));
+		f32 min_y = fminf(v[0].y, fminf(v[1].y, v[2].y)), max_y = fmaxf(v[0].y, fmaxf(v[1].y, v[2].y));
+		if(max_x < 0 || min_x >= OCCLUSION_WIDTH || max_y < 0 || min_y >= OCCLUSION_HEIGHT) continue;
+
+		occlusion_triangle* triangle = &occlusion->triangles[occlusion->triangle_count++];
+		triangle->v[0] = v[0];
+		triangle->v[1] = v[1];
+		triangle->v[2] = v[2];
+		triangle->tile_x0 = (ui16)(fmaxf(min_x, 0.0f) / OCCLUSION_TILE_WIDTH);
+		triangle->tile_x1 = (ui16)(fminf(max_x, OCCLUSION_WIDTH - 1.0f) / OCCLUSION_TILE_WIDTH);
+		triangle->tile_y0 = (ui16)(fmaxf(min_y, 0.0f) / OCCLUSION_TILE_HEIGHT);
+		triangle->tile_y1 = (ui16)(fminf(max_y, OCCLUSION_HEIGHT - 1.0f) / OCCLUSION_TILE_HEIGHT);
+	};
+
+	return true;
+};
+
+// pixels of the tile inside the 3 edges, px = left of the tile, py = center of its first row
+internal ui32 occlusion_tile_mask(f32 px, f32 py, f32* a, f32* b, f32* c) {
+	__m256 lane_x = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+	__m256 zero = _mm256_setzero_ps();
+	__m256 x = _mm256_add_ps(_mm256_set1_ps(px), lane_x);
+
+	// first row of the tile, then one step down per row
+	__m256 e0 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(a[0]), x), _mm256_set1_ps(b[0] * py + c[0]));
+	__m256 e1 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(a[1]), x), _mm256_set1_ps(b[1] * py + c[1]));
+	__m256 e2 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(a[2]), x), _mm256_set1_ps(b[2] * py + c[2]));
+	__m256 step0 = _mm256_set1_ps(b[0]), step1 = _mm256_set1_ps(b[1]), step2 = _mm256_set1_ps(b[2]);
+
+	ui32 mask = 0;
+	for(ui32 row = 0; row < OCCLUSION_TILE_HEIGHT; row++) {
+		__m256 inside = _mm256_and_ps(_mm256_cmp_ps(e0, zero, _CMP_GE_OQ), _mm256_and_ps(_mm256_cmp_ps(e1, zero, _CMP_GE_OQ), _mm256_cmp_ps(e2, zero, _CMP_GE_OQ)));
+		mask |= (ui32)_mm256_movemask_ps(inside) << (row * OCCLUSION_TILE_WIDTH);
+		e0 = _mm256_add_ps(e0, step0);
+		e1 = _mm256_add_ps(e1, step1);
+		e2 = _mm256_add_ps(e2, step2);
+	};
+	return mask;
+};
+
+// every triangle into the tiles of one bin, runs on any thread
+internal void occlusion_bin_job(void* data) {
+	occlusion_job* job = (occlusion_job*)data;
+	occlusion_system* occlusion = job->occlusion;
+
+	for(ui32 t = job->tile_y0 * OCCLUSION_TILES_X; t < job->tile_y1 * OCCLUSION_TILES_X; t++) {
+		occlusion->tile_far[t] = 1.0f;
+		occlusion->tile_layer[t] = 0.0f;
+		occlusion->tile_mask[t] = 0;
+	};
+
+	for(ui32 i = 0; i < occlusion->triangle_count; i++) {
+		occlusion_triangle* triangle = &occlusion->triangles[i];
+		if(triangle->tile_y1 < job->tile_y0 || triangle->tile_y0 >= job->tile_y1) continue;
+		v3* v = triangle->v;
+
+		// edge e(p) = a x + b y + c >= 0 inside, moved in by half a pixel's extent : the whole pixel is inside
+		f32 a[3], b[3], c[3];
+		for(ui32 e = 0; e < 3; e++) {
+			v3 p0 = v[e];
+			v3 p1 = v[(e + 1) % 3];
+			a[e] = p0.y - p1.y;
+			b[e] = p1.x - p0.x;
+			c[e] = -(a[e] * p0.x + b[e] * p0.y) - 0.5f * (fabsf(a[e]) + fabsf(b[e]));
+		};
+
+		// depth plane z = zx x + zy y + z0
+		f32 x1 = v[1].x - v[0].x, y1 = v[1].y - v[0].y, z1 = v[1].z - v[0].z;
+		f32 x2 = v[2].x - v[0].x, y2 = v[2].y - v[0].y, z2 = v[2].z - v[0].z;
+		f32 inverse_area = 1.0f / (x1 * y2 - x2 * y1);
+		f32 zx = (z1 * y2 - z2 * y1) * inverse_area;
+		f32 zy = (z2 * x1 - z1 * x2) * inverse_area;
+		f32 z0 = v[0].z - zx * v[0].x - zy * v[0].y;
+		f32 z_max = fmaxf(v[0].z, fmaxf(v[1].z, v[2].z));
+
+		ui32 y_begin = triangle->tile_y0 > job->tile_y0 ? triangle->tile_y0 : job->tile_y0;
+		ui32 y_end = triangle->tile_y1 + 1u < job->tile_y1 ? triangle->tile_y1 + 1u : job->tile_y1;
+		for(ui32 ty = y_begin; ty < y_end; ty++) {
+			f32 py = (f32)(ty * OCCLUSION_TILE_HEIGHT) + 0.5f;
+
+			for(ui32 tx = triangle->tile_x0; tx <= triangle->tile_x1; tx++) {
+				f32 px = (f32)(tx * OCCLUSION_TILE_WIDTH);
+				ui32 t = ty * OCCLUSION_TILES_X + tx;
+
+				// farthest the triangle gets over the tile, at the corner the plane goes away to
+				f32 corner_x = zx > 0 ? px + OCCLUSION_TILE_WIDTH : px;
+				f32 corner_y = zy > 0 ? py - 0.5f + OCCLUSION_TILE_HEIGHT : py - 0.5f;
+				f32 z = fminf(zx * corner_x + zy * corner_y + z0, z_max);
+				if(z >= occlusion->tile_far[t]) continue;
+
+				// edges at the pixel centers closest to & farthest from their inside
+				bool outside = false;
+				bool inside = true;
+				for(ui32 e = 0; e < 3; e++) {
+					f32 low = a[e] * (a[e] > 0 ? px + 0.5f : px + OCCLUSION_TILE_WIDTH - 0.5f) + b[e] * (b[e] > 0 ? py : py + OCCLUSION_TILE_HEIGHT - 1) + c[e];
+					f32 high = a[e] * (a[e] > 0 ? px + OCCLUSION_TILE_WIDTH - 0.5f : px + 0.5f) + b[e] * (b[e] > 0 ? py + OCCLUSION_TILE_HEIGHT - 1 : py) + c[e];
+					if(high < 0) outside = true;
+					if(low < 0) inside = false;
+				};
+				if(outside) continue;
+
+				ui32 mask = 0xffffffff;
+				if(!inside) {
+					mask = occlusion_tile_mask(px, py, a, b, c);
+					if(!mask) continue;
+				};
+
+				occlusion->tile_mask[t] |= mask;
+				occlusion->tile_layer[t] = fmaxf(occlusion->tile_layer[t], z);
+				if(occlusion->tile_mask[t] == 0xffffffff) {
+					occlusion->tile_far[t] = occlusion->tile_layer[t];
+					occlusion->tile_layer[t] = 0.0f;
+					occlusion->tile_mask[t] = 0;
+				};
+			};
+		};
+	};
+};
+
+// draws the occluders added since occlusion_begin, one job per bin
+void occlusion_rasterize(occlusion_system* occlusion, job_system* jobs) {
+	if(occlusion->triangle_count == 0) return;
+
+	occlusion_job bins[OCCLUSION_BINS];
+	volatile LONG counter = 0;
+	for(ui32 i = 0; i < OCCLUSION_BINS; i++) {
+		bins[i] = {
+			.occlusion = occlusion,
+			.tile_y0 = OCCLUSION_TILES_Y * i / OCCLUSION_BINS,
+			.tile_y1 = OCCLUSION_TILES_Y * (i + 1) / OCCLUSION_BINS,
+		};
+		if(jobs) {
+			jobs_push(jobs, occlusion_bin_job, &bins[i], &counter);
+		} else {
+			occlusion_bin_job(&bins[i]);
+		};
+	};
+	if(jobs) jobs_wait(jobs, &counter);
+};
+
+/*
+	false when the sphere is behind the occluders. Its bounding box is projected like hiz_test_sphere,
+	hidden when its closest point is farther than z_far in every tile under it.
+*/
+bool occlusion_test_sphere(occlusion_system* occlusion, v3 center, f32 radius) {
+	if(occlusion->triangle_count == 0) return true;
+	occlusion->tested++;
+
+	mx* m = &occlusion->matrix;
+	f32 min_x = D3D11_FLOAT32_MAX, max_x = -D3D11_FLOAT32_MAX;
+	f32 min_y = D3D11_FLOAT32_MAX, max_y = -D3D11_FLOAT32_MAX;
+	f32 min_z = D3D11_FLOAT32_MAX;
+
+	for(ui32 i = 0; i < 8; i++) {
+		f32 x = center.x + (i & 1 ? radius : -radius);
+		f32 y = center.y + (i & 2 ? radius : -radius);
+		f32 z = center.z + (i & 4 ? radius : -radius);
+
+		f32 w = m->m3 * x + m->m7 * y + m->m11 * z + m->m15;
+		if(w <= 1e-5f) return true;
+
+		f32 inverse_w = 1.0f / w;
+		f32 px = (m->m0 * x + m->m4 * y + m->m8 * z + m->m12) * inverse_w;
+		f32 py = (m->m1 * x + m->m5 * y + m->m9 * z + m->m13) * inverse_w;
+		f32 pz = (m->m2 * x + m->m6 * y + m->m10 * z + m->m14) * inverse_w;
+
+		min_x = fminf(min_x, px);
+		max_x = fmaxf(max_x, px);
+		min_y = fminf(min_y, py);
+		max_y = fmaxf(max_y, py);
+		min_z = fminf(min_z, pz);
+	};
+
+	if(min_z < 0.0f) return true;
+	if(max_x < -1.0f || min_x > 1.0f || max_y < -1.0f || min_y > 1.0f) return true;
+
+	// ndc -> tiles, screen y goes down
+	ui32 tx0 = (ui32)((fmaxf(min_x, -1.0f) * 0.5f + 0.5f) * (OCCLUSION_TILES_X - 0.001f));
+	ui32 tx1 = (ui32)((fminf(max_x, 1.0f) * 0.5f + 0.5f) * (OCCLUSION_TILES_X - 0.001f));
+	ui32 ty0 = (ui32)((0.5f - fminf(max_y, 1.0f) * 0.5f) * (OCCLUSION_TILES_Y - 0.001f));
+	ui32 ty1 = (ui32)((0.5f - fmaxf(min_y, -1.0f) * 0.5f) * (OCCLUSION_TILES_Y - 0.001f));
+
+	// 8 tiles of a row per compare, the lanes past tx1 are masked out
+	__m256 depth = _mm256_set1_ps(min_z);
+	for(ui32 ty = ty0; ty <= ty1; ty++) {
+		f32* row = occlusion->tile_far + ty * OCCLUSION_TILES_X;
+		for(ui32 tx = tx0; tx <= tx1; tx += 8) {
+			ui32 lanes = tx1 - tx + 1 < 8 ? tx1 - tx + 1 : 8;
+			i32 closer = _mm256_movemask_ps(_mm256_cmp_ps(depth, _mm256_loadu_ps(row + tx), _CMP_LT_OQ));
+			if(closer & ((1 << lanes) - 1)) return true;
+		};
+	};
+
+	occlusion->occluded++;
+	return false;
+};
+
+void occlusion_release(occlusion_system* occlusion) {
+	VirtualFree(occlusion->tile_far, 0, MEM_RELEASE);
+	VirtualFree(occlusion->triangles, 0, MEM_RELEASE);
+	VirtualFree(occlusion->projected, 0, MEM_RELEASE);
+	memset(occlusion, 0, sizeof(occlusion_system));
+};
+
+#endif /* _OCCLUSIONH_ */
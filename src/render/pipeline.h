@@ -0,0 +1,305 @@
+/*  ----------------------------------- PIPELINE
+	This header file contains the pipeline state object cache and the state tracker.
+
+	A pipeline state is immutable : it is described once by a pipeline_desc, hashed, created
+	and then kept in the cache for the whole lifetime of the program. The state tracker mirrors
+	what is currently bound on the device context and drops any bind that would not change anything.
+
+*/
+
+#ifndef _PIPELINEH_
+#define _PIPELINEH_
+
+#include <d3d11.h>
+
+// ------------------------------- structs
+
+#define PIPELINE_CACHE_SIZE 64 // must be a power of two
+#define PIPELINE_EMPTY 0
+#define PIPELINE_TOMBSTONE 1 // evicted slot, lookups keep probing past it
+#define TRACKER_MAX_VERTEX_BUFFERS 4
+#define TRACKER_MAX_CBUFFERS 4
+#define TRACKER_MAX_SAMPLERS 4
+#define TRACKER_MAX_SRVS 8
+
+// everything that makes a pipeline, must be zero initialized before being filled (padding is hashed too)
+struct pipeline_desc {
+	ID3D11VertexShader* vshader;
+	ID3D11PixelShader* pshader;
+	ID3D11InputLayout* layout;
+	D3D11_PRIMITIVE_TOPOLOGY topology;
+	D3D11_RASTERIZER_DESC rasterizer;
+	D3D11_DEPTH_STENCIL_DESC depth_stencil;
+	D3D11_BLEND_DESC blend;
+};
+
+struct pipeline_state {
+	ui64 hash;
+	pipeline_desc desc;
+
+	// created once from desc, never changed after that
+	ID3D11RasterizerState* rasterizerState;
+	ID3D11DepthStencilState* depthState;
+	ID3D11BlendState* blendState;
+};
+
+struct pipeline_cache {
+	ui32 count;
+	pipeline_state states[PIPELINE_CACHE_SIZE]; // open addressing, indexed by hash
+};
+
+// what is bound on the context right now (as far as we know)
+struct state_tracker {
+	const pipeline_state* pipeline;
+
+	// input assembler
+	ID3D11Buffer* vertex_buffers[TRACKER_MAX_VERTEX_BUFFERS];
+	UINT vertex_strides[TRACKER_MAX_VERTEX_BUFFERS];
+	UINT vertex_offsets[TRACKER_MAX_VERTEX_BUFFERS];
+	ID3D11Buffer* index_buffer;
+	DXGI_FORMAT index_format;
+	UINT index_offset;
+
+	// resources
+	ID3D11Buffer* vs_cbuffers[TRACKER_MAX_CBUFFERS];
+	ID3D11Buffer* ps_cbuffers[TRACKER_MAX_CBUFFERS];
+	ID3D11SamplerState* samplers[TRACKER_MAX_SAMPLERS];
+	ID3D11ShaderResourceView* srvs[TRACKER_MAX_SRVS];
+
+	// rasterizer & output merger
+	D3D11_VIEWPORT viewport;
+	ID3D11RenderTargetView* rtView;
+	ID3D11DepthStencilView* dsView;
+
+	// stats, reset every frame
+	ui32 binds_issued;
+	ui32 binds_filtered;
+};
+
+// ------------------------------- pipeline cache
+
+HRESULT pipeline_create(ID3D11Device* device, pipeline_state* pso) {
+	HRESULT hr;
+
+	hr = device->CreateRasterizerState(&pso->desc.rasterizer, &pso->rasterizerState);
+	if(FAILED(hr)) return hr;
+
+	hr = device->CreateDepthStencilState(&pso->desc.depth_stencil, &pso->depthState);
+	if(FAILED(hr)) return hr;
+
+	hr = device->CreateBlendState(&pso->desc.blend, &pso->blendState);
+
+	return hr;
+};
+
+// returns the cached pipeline matching desc, creating it the first time it is asked for
+const pipeline_state* pipeline_get(pipeline_cache* cache, ID3D11Device* device, const pipeline_desc* desc) {
+	ui64 hash = hash_fnv64(desc, sizeof(pipeline_desc), 0);
+	if(hash <= PIPELINE_TOMBSTONE) hash += 2; // reserved values
+	ui32 mask = PIPELINE_CACHE_SIZE - 1;
+	
+	pipeline_state* free_slot = NULL;
+
+	for(ui32 probe = 0; probe < PIPELINE_CACHE_SIZE; probe++) {
+		pipeline_state* slot = &cache->states[(hash + probe) & mask];
+
+		if(slot->hash == hash && memcmp(&slot->desc, desc, sizeof(pipeline_desc)) == 0) {
+			return slot;
+		};
+
+		if(slot->hash == PIPELINE_TOMBSTONE && !free_slot) {
+			free_slot = slot;
+		};
+
+		if(slot->hash == PIPELINE_EMPTY) {
+			// not in the cache yet
+			if(!free_slot) free_slot = slot;
+			break;
+		};
+	};
+
+	if(!free_slot) {
+		// cache is full, PIPELINE_CACHE_SIZE needs to go up
+		Assert(!"pipeline cache full");
+		return NULL;
+	};
+
+	free_slot->hash = hash;
+	free_slot->desc = *desc;
+	HRESULT hr = pipeline_create(device, free_slot);
+	AssertHR(hr);
+	cache->count++;
+	return free_slot;
+};
+
+internal void pipeline_release_slot(pipeline_state* slot) {
+	if(slot->rasterizerState) slot->rasterizerState->Release();
+	if(slot->depthState) slot->depthState->Release();
+	if(slot->blendState) slot->blendState->Release();
+	memset(slot, 0, sizeof(pipeline_state));
+};
+
+// drops every pipeline using one of these shaders (when they get replaced), returns how many were evicted
+// anything holding a pointer to an evicted pipeline (including the tracker) must ask for it again
+ui32 pipeline_evict_shaders(pipeline_cache* cache, ID3D11VertexShader* vshader, ID3D11PixelShader* pshader) {
+	ui32 evicted = 0;
+	for(ui32 i = 0; i < PIPELINE_CACHE_SIZE; i++) {
+		pipeline_state* slot = &cache->states[i];
+		if(slot->hash <= PIPELINE_TOMBSTONE) continue;
+
+		if((vshader && slot->desc.vshader == vshader) || (pshader && slot->desc.pshader == pshader)) {
+			pipeline_release_slot(slot);
+			slot->hash = PIPELINE_TOMBSTONE;
+			cache->count--;
+			evicted++;
+		};
+	};
+	return evicted;
+};
+
+void pipeline_cache_release(pipeline_cache* cache) {
+	for(ui32 i = 0; i < PIPELINE_CACHE_SIZE; i++) {
+		pipeline_state* slot = &cache->states[i];
+		if(slot->hash <= PIPELINE_TOMBSTONE) continue;
+
+		pipeline_release_slot(slot);
+	};
+	memset(cache, 0, sizeof(pipeline_cache));
+};
+
+// ------------------------------- state tracker
+
+// forget everything we know, needed after ClearState() or anything touching the context behind our back
+void tracker_reset(state_tracker* tracker) {
+	ui32 binds_issued = tracker->binds_issued;
+	ui32 binds_filtered = tracker->binds_filtered;
+	memset(tracker, 0, sizeof(state_tracker));
+	tracker->binds_issued = binds_issued;
+	tracker->binds_filtered = binds_filtered;
+};
+
+void tracker_begin_frame(state_tracker* tracker) {
+	tracker->binds_issued = 0;
+	tracker->binds_filtered = 0;
+};
+
+// returns true when the bind must reach the context
+internal bool tracker_count(state_tracker* tracker, bool changed) {
+	if(changed) {
+		tracker->binds_issued++;
+	} else {
+		tracker->binds_filtered++;
+	};
+	return changed;
+};
+
+void tracker_bind_pipeline(state_tracker* tracker, ID3D11DeviceContext* context, const pipeline_state* pso) {
+	const pipeline_state* old = tracker->pipeline;
+	const pipeline_desc* desc = &pso->desc;
+
+	// a pipeline is several binds on D3D11, we filter them one by one so two pipelines sharing shaders only rebind the difference
+	if(tracker_count(tracker, !old || old->desc.layout != desc->layout)) {
+		context->IASetInputLayout(desc->layout);
+	};
+	if(tracker_count(tracker, !old || old->desc.topology != desc->topology)) {
+		context->IASetPrimitiveTopology(desc->topology);
+	};
+	if(tracker_count(tracker, !old || old->desc.vshader != desc->vshader)) {
+		context->VSSetShader(desc->vshader, NULL, 0);
+	};
+	if(tracker_count(tracker, !old || old->desc.pshader != desc->pshader)) {
+		context->PSSetShader(desc->pshader, NULL, 0);
+	};
+	if(tracker_count(tracker, !old || old->rasterizerState != pso->rasterizerState)) {
+		context->RSSetState(pso->rasterizerState);
+	};
+	if(tracker_count(tracker, !old || old->depthState != pso->depthState)) {
+		context->OMSetDepthStencilState(pso->depthState, 0);
+	};
+	if(tracker_count(tracker, !old || old->blendState != pso->blendState)) {
+		context->OMSetBlendState(pso->blendState, NULL, 0xffffffff);
+	};
+
+	tracker->pipeline = pso;
+};
+
+void tracker_bind_vertex_buffer(state_tracker* tracker, ID3D11DeviceContext* context, ui32 slot, ID3D11Buffer* buffer, UINT stride, UINT offset) {
+	Assert(slot < TRACKER_MAX_VERTEX_BUFFERS);
+
+	bool changed = tracker->vertex_buffers[slot] != buffer || tracker->vertex_strides[slot] != stride || tracker->vertex_offsets[slot] != offset;
+	if(tracker_count(tracker, changed)) {
+		context->IASetVertexBuffers(slot, 1, &buffer, &stride, &offset);
+		tracker->vertex_buffers[slot] = buffer;
+		tracker->vertex_strides[slot] = stride;
+		tracker->vertex_offsets[slot] = offset;
+	};
+};
+
+void tracker_bind_index_buffer(state_tracker* tracker, ID3D11DeviceContext* context, ID3D11Buffer* buffer, DXGI_FORMAT format, UINT offset) {
+	bool changed = tracker->index_buffer != buffer || tracker->index_format != format || tracker->index_offset != offset;
+	if(tracker_count(tracker, changed)) {
+		context->IASetIndexBuffer(buffer, format, offset);
+		tracker->index_buffer = buffer;
+		tracker->index_format = format;
+		tracker->index_offset = offset;
+	};
+};
+
+void tracker_bind_vs_cbuffer(state_tracker* tracker, ID3D11DeviceContext* context, ui32 slot, ID3D11Buffer* buffer) {
+	Assert(slot < TRACKER_MAX_CBUFFERS);
+
+	if(tracker_count(tracker, tracker->vs_cbuffers[slot] != buffer)) {
+		context->VSSetConstantBuffers(slot, 1, &buffer);
+		tracker->vs_cbuffers[slot] = buffer;
+	};
+};
+
+void tracker_bind_ps_cbuffer(state_tracker* tracker, ID3D11DeviceContext* context, ui32 slot, ID3D11Buffer* buffer) {
+	Assert(slot < TRACKER_MAX_CBUFFERS);
+
+	if(tracker_count(tracker, tracker->ps_cbuffers[slot] != buffer)) {
+		context->PSSetConstantBuffers(slot, 1, &buffer);
+		tracker->ps_cbuffers[slot] = buffer;
+	};
+};
+
+void tracker_bind_sampler(state_tracker* tracker, ID3D11DeviceContext* context, ui32 slot, ID3D11SamplerState* sampler) {
+	Assert(slot < TRACKER_MAX_SAMPLERS);
+
+	if(tracker_count(tracker, tracker->samplers[slot] != sampler)) {
+		context->PSSetSamplers(slot, 1, &sampler);
+		tracker->samplers[slot] = sampler;
+	};
+};
+
+void tracker_bind_srv(state_tracker* tracker, ID3D11DeviceContext* context, ui32 slot, ID3D11ShaderResourceView* srv) {
+	Assert(slot < TRACKER_MAX_SRVS);
+
+	if(tracker_count(tracker, tracker->srvs[slot] != srv)) {
+		context->PSSetShaderResources(slot, 1, &srv);
+		tracker->srvs[slot] = srv;
+	};
+};
+
+void tracker_bind_viewport(state_tracker* tracker, ID3D11DeviceContext* context, const D3D11_VIEWPORT* viewport) {
+	if(tracker_count(tracker, memcmp(&tracker->viewport, viewport, sizeof(D3D11_VIEWPORT)) != 0)) {
+		context->RSSetViewports(1, viewport);
+		tracker->viewport = *viewport;
+	};
+};
+
+void tracker_bind_targets(state_tracker* tracker, ID3D11DeviceContext* context, ID3D11RenderTargetView* rtView, ID3D11DepthStencilView* dsView) {
+	if(tracker_count(tracker, tracker->rtView != rtView || tracker->dsView != dsView)) {
+		context->OMSetRenderTargets(rtView ? 1 : 0, &rtView, dsView);
+		tracker->rtView = rtView;
+		tracker->dsView = dsView;
+	};
+};
+
+// FLIP swap chains unbind the backbuffer from the output merger on Present
+void tracker_unbind_targets(state_tracker* tracker) {
+	tracker->rtView = NULL;
+	tracker->dsView = NULL;
+};
+
+#endif /* _PIPELINEH_ */
@@ -0,0 +1,308 @@
+/*  ----------------------------------- POST
+	This header file contains the offscreen hdr target of the scene and the passes that bring it to the screen.
+
+	FLIP swap chains cannot be multisampled, so the scene is drawn into its own float target (optionally
+	multisampled) and only reaches the backbuffer at the end of the frame :
+
+		resolve   : msaa only, done by the hardware (ResolveSubresource), no shader pass
+		bloom     : the bright part of the image is downsampled into a pyramid at half resolution and below,
+		            the threshold is folded into the first downsample. Going back up, each mip is blended
+		            additively into the one above it, no extra targets
+		tonemap   : scene + bloom, exposure & curve, luma in alpha for fxaa, in one pass. Writes the backbuffer
+		            directly when fxaa is off
+		fxaa      : ldr target -> backbuffer
+
+	The targets are allocated at the largest size the window can have, the scene only covers their top left
+	part (see render/dynres.h). Every pass maps its pixels to the part of its source that was drawn this frame
+	and clamps its taps to it. The last pass (tonemap or fxaa) also stretches the image to the backbuffer.
+
+	Everything below the scene target is R11G11B10 or 8 bit, passes read and write as few bytes as they can.
+	The quality tier picks the formats, the msaa sample count and which passes run.
+
+*/
+
+#ifndef _POSTH_
+#define _POSTH_
+
+#include <d3d11.h>
+
+#define POST_MAX_BLOOM_MIPS 8
+#define POST_BLOOM_MIN_SIZE 8 // pixels, the pyramid stops before a mip gets this small
+
+// ------------------------------- quality tiers
+
+enum post_tier_id {
+	POST_TIER_LOW,
+	POST_TIER_MEDIUM,
+	POST_TIER_HIGH,
+
+	POST_TIER_COUNT,
+};
+
+struct post_tier {
+	const char* name;
+	DXGI_FORMAT scene_format;
+	DXGI_FORMAT backbuffer_format;
+	ui32 samples; // msaa, 1 = off (lowered when the device does not have it)
+	ui32 bloom_mips; // 0 = no bloom
+	bool fxaa;
+};
+
+const post_tier post_tiers[POST_TIER_COUNT] = {
+	{ "low",    DXGI_FORMAT_R11G11B10_FLOAT,    DXGI_FORMAT_R8G8B8A8_UNORM,    1, 0, false },
+	{ "medium", DXGI_FORMAT_R11G11B10_FLOAT,    DXGI_FORMAT_R8G8B8A8_UNORM,    1, 5, true },
+	{ "high",   DXGI_FORMAT_R16G16B16A16_FLOAT, DXGI_FORMAT_R10G10B10A2_UNORM, 4, 6, false }, // msaa instead of fxaa
+};
+
+// ------------------------------- structs
+
+// cbuffer0 of the post shaders, must stay a multiple of 16 bytes
+struct post_constants {
+	v2 uv_scale; // target pixel -> source uv
+	v2 uv_max; // last texel center of the source drawn this frame, past it are older frames
+	v2 bloom_uv_max; // same for the first bloom mip
+	f32 exposure;
+	f32 bloom_intensity; // already divided by the mip count, every mip adds up in the first one
+	f32 bloom_threshold;
+	f32 bloom_knee;
+	ui32 prefilter; // first downsample only
+	ui32 bloom;
+};
+
+struct post_system {
+	ui32 tier; // what the targets were made for
+	ui32 requested_tier; // applied with the next resize
+	ui32 samples;
+	ui32 width;
+	ui32 height;
+
+	// what the scene draws into, and its single sampled copy (the same texture without msaa)
+	ID3D11Texture2D* scene;
+	ID3D11RenderTargetView* scene_target;
+	ID3D11Texture2D* resolved;
+	ID3D11ShaderResourceView* resolved_view;
+
+	// mip 0 is half the scene, sizes are the ones of the texture
+	ID3D11Texture2D* bloom;
+	ID3D11RenderTargetView* bloom_targets[POST_MAX_BLOOM_MIPS];
+	ID3D11ShaderResourceView* bloom_views[POST_MAX_BLOOM_MIPS];
+	ui32 bloom_widths[POST_MAX_BLOOM_MIPS];
+	ui32 bloom_heights[POST_MAX_BLOOM_MIPS];
+	ui32 bloom_mips;
+
+	// tonemapped, only with fxaa
+	ID3D11Texture2D* ldr;
+	ID3D11RenderTargetView* ldr_target;
+	ID3D11ShaderResourceView* ldr_view;
+
+	ID3D11Buffer* buffer;
+	ID3D11SamplerState* sampler; // linear clamp
+
+	// settings
+	f32 exposure;
+	f32 bloom_intensity;
+	f32 bloom_threshold;
+	f32 bloom_knee;
+};
+
+// ------------------------------- functions
+
+HRESULT post_init(post_system* post, ID3D11Device* device) {
+	HRESULT hr;
+	memset(post, 0, sizeof(post_system));
+
+	post->tier = POST_TIER_MEDIUM;
+	post->requested_tier = POST_TIER_MEDIUM;
+	post->exposure = 1.0f;
+	post->bloom_intensity = 0.3f;
+	post->bloom_threshold = 1.0f;
+	post->bloom_knee = 0.5f;
+
+	D3D11_BUFFER_DESC buffer =
+	{
+		.ByteWidth = sizeof(post_constants),
+		.Usage = D3D11_USAGE_DYNAMIC,
+		.BindFlags = D3D11_BIND_CONSTANT_BUFFER,
+		.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE,
+	};
+	hr = device->CreateBuffer(&buffer, NULL, &post->buffer);
+	if(FAILED(hr)) return hr;
+
+	D3D11_SAMPLER_DESC sampler =
+	{
+		.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR,
+		.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP,
+		.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP,
+		.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP,
+		.MaxAnisotropy = 1,
+		.MaxLOD = D3D11_FLOAT32_MAX,
+	};
+	hr = device->CreateSamplerState(&sampler, &post->sampler);
+
+	return hr;
+};
+
+void post_release_targets(post_system* post) {
+	if(post->scene_target) post->scene_target->Release();
+	if(post->scene) post->scene->Release();
+	if(post->resolved_view) post->resolved_view->Release();
+	if(post->resolved) post->resolved->Release();
+	for(ui32 i = 0; i < post->bloom_mips; i++) {
+		post->bloom_targets[i]->Release();
+		post->bloom_views[i]->Release();
+	};
+	if(post->bloom) post->bloom->Release();
+	if(post->ldr_target) post->ldr_target->Release();
+	if(post->ldr_view) post->ldr_view->Release();
+	if(post->ldr) post->ldr->Release();
+
+	post->scene = NULL;
+	post->scene_target = NULL;
+	post->resolved = NULL;
+	post->resolved_view = NULL;
+	post->bloom = NULL;
+	post->bloom_mips = 0;
+	post->ldr = NULL;
+	post->ldr_target = NULL;
+	post->ldr_view = NULL;
+};
+
+// msaa sample count of the tier, or the closest the device has for its format
+ui32 post_tier_samples(ID3D11Device* device, ui32 tier) {
+	ui32 samples = post_tiers[tier].samples;
+	while(samples > 1) {
+		UINT levels = 0;
+		device->CheckMultisampleQualityLevels(post_tiers[tier].scene_format, samples, &levels);
+		if(levels > 0) break;
+		samples /= 2;
+	};
+	return samples;
+};
+
+// targets for the current tier, the depth buffer must be made with post->samples
+// sizes divisible by 2 for every bloom mip keep the mips lined up with the scene
+HRESULT post_resize(post_system* post, ID3D11Device* device, ui32 width, ui32 height) {
+	HRESULT hr;
+	post_release_targets(post);
+
+	const post_tier* tier = &post_tiers[post->tier];
+	post->samples = post_tier_samples(device, post->tier);
+	post->width = width;
+	post->height = height;
+
+	D3D11_TEXTURE2D_DESC desc =
+	{
+		.Width = width,
+		.Height = height,
+		.MipLevels = 1,
+		.ArraySize = 1,
+		.Format = tier->scene_format,
+		.SampleDesc = { post->samples, 0 },
+		.Usage = D3D11_USAGE_DEFAULT,
+		.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE,
+	};
+	hr = device->CreateTexture2D(&desc, NULL, &post->scene);
+	if(FAILED(hr)) return hr;
+	hr = device->CreateRenderTargetView((ID3D11Resource*)post->scene, NULL, &post->scene_target);
+	if(FAILED(hr)) return hr;
+
+	// without msaa the passes read the scene itself
+	if(post->samples > 1) {
+		desc.SampleDesc = { 1, 0 };
+		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		hr = device->CreateTexture2D(&desc, NULL, &post->resolved);
+		if(FAILED(hr)) return hr;
+	} else {
+		post->resolved = post->scene;
+		post->resolved->AddRef();
+	};
+	hr = device->CreateShaderResourceView((ID3D11Resource*)post->resolved, NULL, &post->resolved_view);
+	if(FAILED(hr)) return hr;
+
+	// bloom pyramid, as many mips as the tier wants while they are not too small to matter
+	ui32 bloom_width = width / 2, bloom_height = height / 2;
+	ui32 bloom_mips = 0;
+	while(bloom_mips < tier->bloom_mips && bloom_mips < POST_MAX_BLOOM_MIPS && bloom_width >= POST_BLOOM_MIN_SIZE && bloom_height >= POST_BLOOM_MIN_SIZE) {
+		post->bloom_widths[bloom_mips] = bloom_width;
+		post->bloom_heights[bloom_mips] = bloom_height;
+		bloom_mips++;
+		bloom_width /= 2;
+		bloom_height /= 2;
+	};
+
+	if(bloom_mips) {
+		desc.Width = post->bloom_widths[0];
+		desc.Height = post->bloom_heights[0];
+		desc.MipLevels = bloom_mips;
+		desc.Format = DXGI_FORMAT_R11G11B10_FLOAT;
+		desc.SampleDesc = { 1, 0 };
+		desc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+		hr = device->CreateTexture2D(&desc, NULL, &post->bloom);
+		if(FAILED(hr)) return hr;
+
+		// one view per mip, each pass reads one and writes its neighbour
+		for(ui32 i = 0; i < bloom_mips; i++) {
+			D3D11_RENDER_TARGET_VIEW_DESC target = {};
+			target.Format = DXGI_FORMAT_R11G11B10_FLOAT;
+			target.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D;
+			target.Texture2D.MipSlice = i;
+			hr = device->CreateRenderTargetView((ID3D11Resource*)post->bloom, &target, &post->bloom_targets[i]);
+			if(FAILED(hr)) return hr;
+
+			D3D11_SHADER_RESOURCE_VIEW_DESC view = {};
+			view.Format = DXGI_FORMAT_R11G11B10_FLOAT;
+			view.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+			view.Texture2D.MostDetailedMip = i;
+			view.Texture2D.MipLevels = 1;
+			hr = device->CreateShaderResourceView((ID3D11Resource*)post->bloom, &view, &post->bloom_views[i]);
+			if(FAILED(hr)) return hr;
+
+			post->bloom_mips++;
+		};
+	};
+
+	if(tier->fxaa) {
+		desc.Width = width;
+		desc.Height = height;
+		desc.MipLevels = 1;
+		desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		desc.SampleDesc = { 1, 0 };
+		desc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+		hr = device->CreateTexture2D(&desc, NULL, &post->ldr);
+		if(FAILED(hr)) return hr;
+		hr = device->CreateRenderTargetView((ID3D11Resource*)post->ldr, NULL, &post->ldr_target);
+		if(FAILED(hr)) return hr;
+		hr = device->CreateShaderResourceView((ID3D11Resource*)post->ldr, NULL, &post->ldr_view);
+	};
+
+	return hr;
+};
+
+// settings of the frame, bloom is false when the pyramid is not drawn. The passes fill in the uvs
+post_constants post_frame_constants(post_system* post, bool bloom) {
+	post_constants constants = {
+		.exposure = post->exposure,
+		.bloom_intensity = bloom ? post->bloom_intensity / post->bloom_mips : 0.0f,
+		.bloom_threshold = post->bloom_threshold,
+		.bloom_knee = post->bloom_knee,
+		.bloom = bloom,
+	};
+	return constants;
+};
+
+// once per pass, the buffer is small enough for the driver to rename it
+void post_upload(post_system* post, ID3D11DeviceContext* context, post_constants* constants) {
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	context->Map((ID3D11Resource*)post->buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+	memcpy(mapped.pData, constants, sizeof(post_constants));
+	context->Unmap((ID3D11Resource*)post->buffer, 0);
+};
+
+void post_release(post_system* post) {
+	post_release_targets(post);
+	if(post->buffer) post->buffer->Release();
+	if(post->sampler) post->sampler->Release();
+	memset(post, 0, sizeof(post_system));
+};
+
+#endif /* _POSTH_ */
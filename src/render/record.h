@@ -0,0 +1,110 @@
+/*  ----------------------------------- RECORD
+	This header file contains the deferred contexts long lists of draws are recorded on, from the job system.
+
+	The list is cut into slices, each one recorded by a job (on a worker, or on the render thread while
+	it waits) into its own deferred context and finished into a command list. The render thread then
+	runs the lists in slice order : the frame comes out the same whatever thread recorded what.
+	Nothing is shared while recording. Each slice has its own state tracker and object buffer, and the
+	meshes are written into the part of the rings their draw was given before the jobs started (one map
+	for the whole list, split with a prefix sum), so there is no lock anywhere.
+	A deferred context starts without any state and the immediate context loses its own when it runs a
+	list, both sides bind everything again.
+
+*/
+
+#ifndef _RECORDH_
+#define _RECORDH_
+
+#include <d3d11.h>
+
+#define RECORD_MAX_SLICES 16
+#define RECORD_MAX_DRAWS 4096 // per list, longer ones are drawn on the render thread
+#define RECORD_MIN_SLICE_DRAWS 128 // a slice with less costs more than it saves
+
+// ------------------------------- structs
+
+struct record_slice {
+	ID3D11DeviceContext* context; // deferred
+	ID3D11CommandList* list; // NULL until the slice is recorded
+	state_tracker tracker;
+	ID3D11Buffer* object_buffer; // cbuffer1, its own so a map does not wait on another slice
+	ui32 first; // draws of the slice
+	ui32 count;
+};
+
+// where the mesh of a draw goes, relative to the start of the list in the rings
+struct record_draw {
+	ui32 mesh;
+	ui32 vertex_start;
+	ui32 index_start;
+};
+
+struct record_system {
+	record_slice slices[RECORD_MAX_SLICES];
+	ui32 slice_count;
+	record_draw* draws; // RECORD_MAX_DRAWS
+	bool enabled;
+
+	ui32 lists; // stats, command lists run this frame
+};
+
+// ------------------------------- functions
+
+// one slice per thread that can record (workers + the one waiting), object_size the size of cbuffer1
+HRESULT record_init(record_system* record, ID3D11Device* device, ui32 slice_count, ui32 object_size) {
+	HRESULT hr;
+	memset(record, 0, sizeof(record_system));
+
+	record->draws = (record_draw*)VirtualAlloc(0, sizeof(record_draw) * RECORD_MAX_DRAWS, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	record->enabled = true;
+
+	D3D11_BUFFER_DESC desc =
+	{
+		.ByteWidth = object_size,
+		.Usage = D3D11_USAGE_DYNAMIC,
+		.BindFlags = D3D11_BIND_CONSTANT_BUFFER,
+		.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE,
+	};
+
+	if(slice_count > RECORD_MAX_SLICES) slice_count = RECORD_MAX_SLICES;
+	for(ui32 i = 0; i < slice_count; i++) {
+		record_slice* slice = &record->slices[i];
+		hr = device->CreateDeferredContext(0, &slice->context);
+		if(FAILED(hr)) return hr;
+		hr = device->CreateBuffer(&desc, NULL, &slice->object_buffer);
+		if(FAILED(hr)) return hr;
+		record->slice_count++;
+	};
+
+	return hr;
+};
+
+// runs the lists recorded in the first slice_count slices, in order, the context has no state left after
+void record_execute(record_system* record, ID3D11DeviceContext* context, state_tracker* tracker, ui32 slice_count) {
+	for(ui32 i = 0; i < slice_count; i++) {
+		record_slice* slice = &record->slices[i];
+		if(!slice->list) continue;
+
+		context->ExecuteCommandList(slice->list, FALSE);
+		slice->list->Release();
+		slice->list = NULL;
+		record->lists++;
+
+		tracker->binds_issued += slice->tracker.binds_issued;
+		tracker->binds_filtered += slice->tracker.binds_filtered;
+	};
+	tracker_reset(tracker);
+};
+
+void record_release(record_system* record) {
+	for(ui32 i = 0; i < record->slice_count; i++) {
+		record_slice* slice = &record->slices[i];
+		if(slice->list) slice->list->Release();
+		slice->object_buffer->Release();
+		slice->context->Release();
+	};
+	VirtualFree(record->draws, 0, MEM_RELEASE);
+	memset(record, 0, sizeof(record_system));
+};
+
+#endif /* _RECORDH_ */
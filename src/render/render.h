@@ -21,13 +21,6 @@
 
 // structs
 
-struct vertex
-{
-    v3 pos;
-    v2 uv;
-    v4 color;
-};
-
 // mesh?
 
 struct mesh
@@ -37,44 +30,137 @@ struct mesh
 	vertex* vertices;
 	ui16 index_count;
 	ui16* indices;
+	ui32 material; // texture table id
+	ui32 virtual_texture; // VT_NONE to sample the material instead
+	f32 radius; // bounding sphere around pos, 0 = never culled
+	bool dynamic; // moves every frame, drawn in the shadow cascades each frame instead of being cached
+	bool occluder; // big & simple, drawn into the software occlusion buffer (see render/occlusion.h)
 };
 
-struct light_source {
-	v3 pos;
-	f32 intensity;
+// cbuffer1 in the shaders, must stay a multiple of 16 bytes
+struct object_constants {
+	mx world;
+	ui32 material_slice;
+	ui32 vt_id;
+	ui32 vt_tiles;
+	ui32 vt_mips;
+	v2 vt_uv_scale;
+	ui32 pad[2];
+};
+
+// cbuffer0 in the shaders, same rules
+struct frame_constants {
+	mx view_projection;
+	mx view;
+	v3 camera_pos;
+	f32 cluster_depth_scale;
+	v2 cluster_tile_scale;
+	f32 cluster_depth_bias;
+	ui32 light_count;
+	v3 ambient;
+	f32 pad0;
+	mx shadow_matrices[SHADOW_CASCADES];
+	f32 cascade_splits[SHADOW_CASCADES];
+	v3 sun_direction;
+	f32 shadow_texel;
+	v3 sun_color;
+	f32 pad1;
 };
 
 // this will change depending on what we need
 struct render_context {
+	// shared with the rest of the program (decoding, ...)
+	job_system* jobs;
+	async_io* io; // streaming reads, NULL reads on the jobs
+	
 	// basic device stuff
 	ID3D11Device* device;
 	ID3D11DeviceContext* context;
 	IDXGISwapChain1* swapChain;
 	
 	// states
-	ID3D11RenderTargetView* rtView;
+	ID3D11RenderTargetView* rtView; // backbuffer
+	ID3D11RenderTargetView* sceneView; // what the scene draws into : the hdr target, or the backbuffer without post processing
 	ID3D11DepthStencilView* dsView; 
+	ID3D11ShaderResourceView* depthView; // same depth, read to build the hi-z pyramid
+	ui32 depth_samples; // msaa of the scene target
+	viewport_size backbuffer_size;
+	viewport_size target_size; // of the depth & post targets, only allocated again when the window outgrows them
+	
+	// what the scene is drawn at this frame, the top left part of the targets
+	viewport_size render_size;
+	dynres_system dynres;
+	
+	// how far behind the gpu is, what it may still read is only reused / released once it caught up
+	frame_fences fences;
+	
+	// long lists of draws are recorded on the workers
+	record_system record;
+	
+	// or culled & drawn by the gpu (indirect draws), the meshes that can be
+	gpu_cull_system gpu_cull;
+	const pipeline_state* instanced_pipeline; // NULL when the shader cache does not have the instanced variants
+	const pipeline_state* instanced_prepass_pipeline;
 	ID3D11InputLayout* layout;
-	ID3D11RasterizerState* rasterizerState;
 	
-
-	ID3D11ShaderResourceView* textureView;
-	ID3D11DepthStencilState* depthState;
-	ID3D11BlendState* blendState;
+	texture_table textures;
+	ui32 fallback_material; // 1x1 white, what a mesh without a valid material draws with
+	ui32 default_material;
 	ID3D11SamplerState* sampler;
 	
+	// streamed textures, their feedback pass draws into the vt target instead of the screen
+	vt_system vt;
+	ui32 default_virtual_texture;
+	bool feedback_pass;
+	
+	// pipelines (immutable, owned by the cache) and what is currently bound
+	pipeline_cache psoCache;
+	state_tracker tracker;
+	const pipeline_state* pipeline;
+	const pipeline_state* vt_pipeline; // NULL when the shader cache has no virtual texture variants
+	const pipeline_state* feedback_pipeline;
+	
+	// lights of the frame, binned per cluster when the camera is uploaded
+	light_clusters clusters;
+	v3 ambient;
+	
+	// the sun & its shadow cascades
+	shadow_system shadows;
+	v3 sun_direction; // where the light goes, normalized
+	v3 sun_color;
+	const pipeline_state* shadow_pipeline; // NULL when the shader cache has no shadow program
+	
+	// camera of the frame, meshes outside of it or hidden in the hi-z readback are not drawn
+	mx view_projection;
+	cull_frustum frustum;
+	hiz_system hiz;
+	bool occlusion_culling;
+	occlusion_system occlusion; // same frame, on the cpu, from the meshes flagged as occluders
+	
+	// depth only pass before the scene, the scene then only shades the closest surface
+	bool depth_prepass;
+	bool prepass_active;
+	const pipeline_state* prepass_pipeline; // both NULL when the shader cache does not have their programs
+	const pipeline_state* hiz_pipeline;
+	const pipeline_state* hiz_msaa_pipeline; // first mip when the depth is multisampled
+	
+	// offscreen hdr target & the passes bringing it to the backbuffer
+	post_system post;
+	const pipeline_state* tonemap_pipeline; // NULL when the shader cache does not have it, the scene then draws to the backbuffer
+	const pipeline_state* bloom_down_pipeline;
+	const pipeline_state* bloom_up_pipeline;
+	const pipeline_state* fxaa_pipeline;
+	
 	// shaders
+	shader_library shaders;
 	ID3D11VertexShader* vshader;
     ID3D11PixelShader* pshader;
 	
 	// buffers
-	int vCount;
-	int indexCount;
-	vertex vQueue[16384];
-	ui32 indexQueue[16384];
-	ID3D11Buffer* vertex_buffer; // vertex buffer
-	ID3D11Buffer* index_buffer; // index buffer
-	ID3D11Buffer* frame_buffer; // buffer static to the frame
+	render_ring vertex_ring; // every vertex streamed this frame, scene and ui
+	render_ring index_ring; // same for indices (ui32 for meshes, ui16 for the ui)
+	ID3D11Buffer* frame_buffer; // buffer static to the frame, one of frame_buffers
+	ID3D11Buffer* frame_buffers[FRAMES_IN_FLIGHT]; // by frame number, so the one written is never read by a frame in flight
 	ID3D11Buffer* object_buffer; // updated for each object drawn (inefficient)
 	
 };
@@ -85,21 +171,72 @@ struct render_context {
 
 // ----------- dx pipeline stuff
 
-void render_queue_vertex(render_context* rContext, mesh mesh_data) {
-	for(int i=0; i < mesh_data.index_count; i++) {
-		rContext->indexQueue[rContext->indexCount] = mesh_data.indices[i];
-		rContext->indexCount++;
+// depth & post targets, big enough for any resolution up to target_size (the scene draws into a part of them)
+void render_create_targets(render_context* rContext, viewport_size target_size) {
+	if (rContext->dsView)
+	{
+		rContext->dsView->Release();
+		rContext->depthView->Release();
+		rContext->dsView = NULL;
+		rContext->depthView = NULL;
+	}
+	
+	// divisible by 2 down to the smallest bloom mip, so every mip lines up with the scene
+	target_size.width = (target_size.width + 127) & ~127;
+	target_size.height = (target_size.height + 127) & ~127;
+	rContext->target_size = target_size;
+	
+	// the scene goes offscreen when it can be brought back, the depth has to match its msaa
+	post_system* post = &rContext->post;
+	post->tier = post->requested_tier;
+	rContext->sceneView = rContext->rtView;
+	rContext->depth_samples = 1;
+	if (rContext->tonemap_pipeline && SUCCEEDED(post_resize(post, rContext->device, target_size.width, target_size.height)))
+	{
+		rContext->sceneView = post->scene_target;
+		rContext->depth_samples = post->samples;
+	}
+	else
+	{
+		// straight to the backbuffer, only as big as it is
+		post_release_targets(post);
+		rContext->target_size = rContext->backbuffer_size;
+	}
+	
+	D3D11_TEXTURE2D_DESC depthDesc = 
+	{
+		.Width = int_to_ui32(rContext->target_size.width),
+		.Height = int_to_ui32(rContext->target_size.height),
+		.MipLevels = 1,
+		.ArraySize = 1,
+		.Format = DXGI_FORMAT_R32_TYPELESS, // depth target & texture, no stencil (use R32G8X24_TYPELESS if you need one)
+		.SampleDesc = { rContext->depth_samples, 0 },
+		.Usage = D3D11_USAGE_DEFAULT,
+		.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE,
 	};
-};
 
-void render_queue_index(render_context* rContext, mesh mesh_data) {
-	for(int i=0; i < mesh_data.vertex_count; i++) {
-		rContext->vQueue[rContext->vCount] = mesh_data.vertices[i];
-		rContext->vCount++;
-	};
+	// create new depth stencil texture & DepthStencil view
+	D3D11_DEPTH_STENCIL_VIEW_DESC dvd = {};
+	
+		dvd.Format = DXGI_FORMAT_D32_FLOAT;
+		dvd.ViewDimension = rContext->depth_samples > 1 ? D3D11_DSV_DIMENSION_TEXTURE2DMS : D3D11_DSV_DIMENSION_TEXTURE2D;
+		dvd.Texture2D.MipSlice = 0;
+	
+	ID3D11Texture2D* depth;
+	rContext->device->CreateTexture2D(&depthDesc, NULL, &depth);
+	rContext->device->CreateDepthStencilView(depth, &dvd, &rContext->dsView);
+	
+	D3D11_SHADER_RESOURCE_VIEW_DESC depth_view = {};
+	depth_view.Format = DXGI_FORMAT_R32_FLOAT;
+	depth_view.ViewDimension = rContext->depth_samples > 1 ? D3D11_SRV_DIMENSION_TEXTURE2DMS : D3D11_SRV_DIMENSION_TEXTURE2D;
+	depth_view.Texture2D.MipLevels = 1;
+	rContext->device->CreateShaderResourceView(depth, &depth_view, &rContext->depthView);
+	depth->Release();
+	
+	// so does the hi-z pyramid (the depth read back for the old size is dropped)
+	hiz_resize(&rContext->hiz, rContext->device, rContext->target_size.width, rContext->target_size.height);
 };
 
-
 void render_resize_swapchain(HWND window, viewport_size* window_size, render_context* rContext) {
 	
 		HRESULT hr;
@@ -108,20 +245,23 @@ void render_resize_swapchain(HWND window, viewport_size* window_size, render_con
 		viewport_size new_window_size = platform_get_window_size(window);
 		
 		
-	    if (rContext->rtView == NULL || new_window_size.width != window_size->width || new_window_size.height != window_size->height) {
+		// a new quality tier can change every target, the backbuffer format included
+		bool tier_changed = rContext->post.tier != rContext->post.requested_tier;
+		
+	    if (rContext->rtView == NULL || new_window_size.width != window_size->width || new_window_size.height != window_size->height || tier_changed) {
             if (rContext->rtView)
             {
                 // release old swap chain buffers
                 rContext->context->ClearState();
+                tracker_reset(&rContext->tracker);
                 rContext->rtView->Release();
-                rContext->dsView->Release();
                 rContext->rtView = NULL;
             }
 
             // resize to new size for non-zero size
             if (new_window_size.width != 0 && new_window_size.height != 0)
             {
-                hr = rContext->swapChain->ResizeBuffers(0, new_window_size.width, new_window_size.height, DXGI_FORMAT_UNKNOWN, 0);
+                hr = rContext->swapChain->ResizeBuffers(0, new_window_size.width, new_window_size.height, post_tiers[rContext->post.requested_tier].backbuffer_format, 0);
                 if (FAILED(hr))
                 {
                     FatalError("Failed to resize swap chain!");
@@ -133,30 +273,21 @@ void render_resize_swapchain(HWND window, viewport_size* window_size, render_con
 				// rContext->swapChain->GetBuffer(0, IID_PPV_ARGS(&backbuffer));
                 hr = rContext->device->CreateRenderTargetView(backbuffer, NULL, &rContext->rtView);
                 backbuffer->Release();
-
-                D3D11_TEXTURE2D_DESC depthDesc = 
+                rContext->backbuffer_size = new_window_size;
+                
+                // the other targets are made for the whole monitor, a window smaller than them only draws into a part
+                // (without post processing the depth goes with the backbuffer, it is made again every time)
+                bool outgrown = new_window_size.width > rContext->target_size.width || new_window_size.height > rContext->target_size.height;
+                if (!rContext->dsView || !rContext->post.scene_target || outgrown || tier_changed)
                 {
-                    .Width = int_to_ui32(new_window_size.width),
-                    .Height = int_to_ui32(new_window_size.height),
-                    .MipLevels = 1,
-                    .ArraySize = 1,
-                    .Format = DXGI_FORMAT_D24_UNORM_S8_UINT, // or use DXGI_FORMAT_D32_FLOAT_S8X24_UINT if you need stencil
-                    .SampleDesc = { 1, 0 },
-                    .Usage = D3D11_USAGE_DEFAULT,
-                    .BindFlags = D3D11_BIND_DEPTH_STENCIL,
-                };
-
-                // create new depth stencil texture & DepthStencil view
-				D3D11_DEPTH_STENCIL_VIEW_DESC dvd = {};
-				
-					dvd.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
-					dvd.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
-					dvd.Texture2D.MipSlice = 0;
+                    viewport_size target_size = platform_get_monitor_size(window);
+                    if (target_size.width < new_window_size.width) target_size.width = new_window_size.width;
+                    if (target_size.height < new_window_size.height) target_size.height = new_window_size.height;
+                    render_create_targets(rContext, target_size);
+                }
 				
-                ID3D11Texture2D* depth;
-                rContext->device->CreateTexture2D(&depthDesc, NULL, &depth);
-                rContext->device->CreateDepthStencilView(depth, &dvd, &rContext->dsView);
-                depth->Release();
+				// feedback target follows the screen
+				vt_resize_feedback(&rContext->vt, rContext->device, new_window_size.width, new_window_size.height);
             }
 
 			window_size->width = new_window_size.width;
@@ -164,7 +295,23 @@ void render_resize_swapchain(HWND window, viewport_size* window_size, render_con
         }
 };
 
-void render_pipeline_states(render_context* rContext, viewport_size* vpSize){
+/*
+	Resolution of the scene this frame (render_size), from the gpu time measured a few frames ago.
+	Call once the swap chain is resized, the gpu time of the frame is measured from here to the end of render_post_process.
+*/
+void render_update_resolution(render_context* rContext, viewport_size* window_size){
+	dynres_system* dynres = &rContext->dynres;
+	dynres_read(dynres, rContext->context);
+	
+	// without post processing nothing stretches the scene, it is the backbuffer
+	if(!rContext->post.scene_target) dynres->enabled = false;
+	rContext->render_size = dynres_update(dynres, *window_size, rContext->target_size);
+	
+	dynres_begin(dynres, rContext->context);
+};
+
+// everything the scene draws need, on any context (the deferred ones bind their own object buffer)
+internal void render_bind_scene_states(render_context* rContext, state_tracker* tracker, ID3D11DeviceContext* context, ID3D11Buffer* object_buffer, viewport_size* vpSize){
 
 	D3D11_VIEWPORT viewport =
 	{
@@ -177,68 +324,150 @@ void render_pipeline_states(render_context* rContext, viewport_size* vpSize){
 	};
 
 	{
-		// Input Assembler
-		rContext->context->IASetInputLayout(rContext->layout);
-		rContext->context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-		UINT stride = sizeof(struct vertex);
-		UINT offset = 0;
+		// Input Assembler, shaders, rasterizer state, depth & blend states
+		tracker_bind_pipeline(tracker, context, rContext->pipeline);
 		
-		// Vertex Buffer
-		rContext->context->IASetVertexBuffers(0, 1, &rContext->vertex_buffer, &stride, &offset);
+		// Vertex Buffer (rings stay bound at 0, draws pick their range with base vertex / first index)
+		tracker_bind_vertex_buffer(tracker, context, 0, rContext->vertex_ring.buffer, sizeof(struct vertex), 0);
 
 		// Index Buffer
-		rContext->context->IASetIndexBuffer(rContext->index_buffer, DXGI_FORMAT_R32_UINT, 0);
-
-		// Vertex Shader 
-		rContext->context->VSSetShader(rContext->vshader, NULL, 0);
+		tracker_bind_index_buffer(tracker, context, rContext->index_ring.buffer, DXGI_FORMAT_R32_UINT, 0);
 		
 		// Bind buffers
-		ID3D11Buffer* constant_buffers[] = {rContext->frame_buffer, rContext->object_buffer};
-		rContext->context->VSSetConstantBuffers(0, 2, constant_buffers); // 2 buffers for now
+		tracker_bind_vs_cbuffer(tracker, context, 0, rContext->frame_buffer);
+		tracker_bind_vs_cbuffer(tracker, context, 1, object_buffer);
+		tracker_bind_ps_cbuffer(tracker, context, 0, rContext->frame_buffer); // camera & clusters
+		tracker_bind_ps_cbuffer(tracker, context, 1, object_buffer); // virtual texture constants
 
 		// Rasterizer Stage
-		rContext->context->RSSetViewports(1, &viewport);
-		rContext->context->RSSetState(rContext->rasterizerState);
+		tracker_bind_viewport(tracker, context, &viewport);
 
 		// Pixel Shader
-		rContext->context->PSSetSamplers(0, 1, &rContext->sampler);
-		rContext->context->PSSetShaderResources(0, 1, &rContext->textureView);
-		rContext->context->PSSetShader(rContext->pshader, NULL, 0);
+		tracker_bind_sampler(tracker, context, 0, rContext->sampler);
+
+		// lights & their clusters
+		tracker_bind_srv(tracker, context, 3, rContext->clusters.light_view);
+		tracker_bind_srv(tracker, context, 4, rContext->clusters.grid_view);
+		tracker_bind_srv(tracker, context, 5, rContext->clusters.index_view);
+		
+		// sun shadows
+		tracker_bind_srv(tracker, context, 6, rContext->shadows.live_view);
+		tracker_bind_sampler(tracker, context, 1, rContext->shadows.sampler);
 
 		// Output Merger
-		rContext->context->OMSetBlendState(rContext->blendState, NULL, 0xffffffff);
-		rContext->context->OMSetDepthStencilState(rContext->depthState, 0);
-		rContext->context->OMSetRenderTargets(1, &rContext->rtView, rContext->dsView);
+		tracker_bind_targets(tracker, context, rContext->sceneView, rContext->dsView);
 	};
 };
 
+void render_pipeline_states(render_context* rContext, viewport_size* vpSize){
+	// texture arrays are bound per draw, a grown bucket means a new view we may confuse with an old pointer
+	if(rContext->textures.views_changed) {
+		rContext->tracker.srvs[0] = NULL;
+		rContext->textures.views_changed = false;
+	};
+	
+	render_bind_scene_states(rContext, &rContext->tracker, rContext->context, rContext->object_buffer, vpSize);
+};
+
 void render_clear_screen(render_context* rContext, f32 color[4]){
-        rContext->context->ClearRenderTargetView(rContext->rtView, color);
-        rContext->context->ClearDepthStencilView(rContext->dsView, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.f, 0);
+        rContext->context->ClearRenderTargetView(rContext->sceneView, color);
+        rContext->context->ClearDepthStencilView(rContext->dsView, D3D11_CLEAR_DEPTH, 1.f, 0);
 };
 
 void render_reset_frame(render_context* rContext){
-	rContext->vCount = 0;
-	rContext->indexCount = 0;
+	// waits when the gpu is FRAMES_IN_FLIGHT frames behind, what the frames it finished used is free again
+	frame_fences* fences = &rContext->fences;
+	fences_begin_frame(fences, rContext->context);
+	
+	// the rings keep going from where the last frame stopped
+	ring_begin_frame(&rContext->vertex_ring, fences);
+	ring_begin_frame(&rContext->index_ring, fences);
+	rContext->frame_buffer = rContext->frame_buffers[fences_current(fences) % FRAMES_IN_FLIGHT];
+	rContext->record.lists = 0;
+	rContext->gpu_cull.uploaded = 0;
+	
+	// depth from a few frames ago, what this frame's objects are tested against
+	hiz_read(&rContext->hiz, rContext->context);
 };
 
-// ----------- calls to the gpu
+// call once everything of the frame is submitted (after Present)
+void render_end_frame(render_context* rContext){
+	frame_fences* fences = &rContext->fences;
+	ring_end_frame(&rContext->vertex_ring, fences);
+	ring_end_frame(&rContext->index_ring, fences);
+	fences_end_frame(fences, rContext->context);
+};
 
-void render_upload_vertex_buffer(render_context* rContext){
-	D3D11_MAPPED_SUBRESOURCE mapped;
+// targets of the tier are made at the start of the next frame
+void render_set_post_tier(render_context* rContext, ui32 tier){
+	if(tier < POST_TIER_COUNT) rContext->post.requested_tier = tier;
+};
+
+// lights drawn from the next frame buffer upload on, the array must stay alive until then
+void render_set_lights(render_context* rContext, light_source* lights, ui32 count){
+	lights_set(&rContext->clusters, lights, count);
+};
+
+// streams in the tiles the feedback asked for, call once per frame before the feedback pass
+void render_update_virtual_textures(render_context* rContext){
+	vt_update(&rContext->vt, rContext->context, rContext->jobs);
+};
+
+// the meshes drawn between begin & end go to the feedback target, returns false when there is nothing to do
+bool render_begin_feedback(render_context* rContext){
+	vt_system* vt = &rContext->vt;
+	if(vt->texture_count == 0 || !vt->feedback || !rContext->feedback_pipeline) return false;
+	
+	// 0 = no tile asked
+	f32 nothing[4] = { 0, 0, 0, 0 };
+	rContext->context->ClearRenderTargetView(vt->feedback_view, nothing);
+	rContext->context->ClearDepthStencilView(vt->feedback_depth, D3D11_CLEAR_DEPTH, 1.f, 0);
+	
+	D3D11_VIEWPORT viewport =
+	{
+		.TopLeftX = 0,
+		.TopLeftY = 0,
+		.Width = (FLOAT)vt->feedback_width,
+		.Height = (FLOAT)vt->feedback_height,
+		.MinDepth = 0,
+		.MaxDepth = 1,
+	};
+	tracker_bind_viewport(&rContext->tracker, rContext->context, &viewport);
+	tracker_bind_targets(&rContext->tracker, rContext->context, vt->feedback_view, vt->feedback_depth);
+	
+	rContext->feedback_pass = true;
+	return true;
+};
+
+void render_end_feedback(render_context* rContext, viewport_size* vpSize){
+	rContext->feedback_pass = false;
+	vt_copy_feedback(&rContext->vt, rContext->context);
 	
-	rContext->context->Map((ID3D11Resource*)rContext->vertex_buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
-	memcpy(mapped.pData, rContext->vQueue, sizeof(vertex)*rContext->vCount);
-	rContext->context->Unmap((ID3D11Resource*)rContext->vertex_buffer, 0);
+	// back to the screen
+	render_pipeline_states(rContext, vpSize);
 };
 
+// ----------- calls to the gpu
 
-void render_upload_index_buffer(render_context* rContext){
-	D3D11_MAPPED_SUBRESOURCE mapped;
+// copies a mesh into the rings, returns false if it is bigger than a ring
+bool render_stream_mesh(render_context* rContext, mesh* mesh_data, ui32* first_index, ui32* base_vertex){
+	ring_alloc vertices;
+	ring_alloc indices;
+	
+	if(!ring_map(&rContext->vertex_ring, rContext->context, sizeof(vertex) * mesh_data->vertex_count, sizeof(vertex), &vertices)) return false;
+	memcpy(vertices.memory, mesh_data->vertices, sizeof(vertex) * mesh_data->vertex_count);
+	ring_unmap(&rContext->vertex_ring, rContext->context);
 	
-	rContext->context->Map((ID3D11Resource*)rContext->index_buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
-	memcpy(mapped.pData, rContext->indexQueue, sizeof(ui32)*rContext->indexCount);
-	rContext->context->Unmap((ID3D11Resource*)rContext->index_buffer, 0);
+	if(!ring_map(&rContext->index_ring, rContext->context, sizeof(ui32) * mesh_data->index_count, sizeof(ui32), &indices)) return false;
+	ui32* dst = (ui32*)indices.memory;
+	for(ui32 i = 0; i < mesh_data->index_count; i++) {
+		dst[i] = mesh_data->indices[i];
+	};
+	ring_unmap(&rContext->index_ring, rContext->context);
+	
+	*base_vertex = vertices.offset / sizeof(vertex);
+	*first_index = indices.offset / sizeof(ui32);
+	return true;
 };
 
 void render_upload_frame_buffer(render_context *rContext, Camera* camera, viewport_size vp){	
@@ -253,52 +482,623 @@ void render_upload_frame_buffer(render_context *rContext, Camera* camera, viewpo
 	mx matrix_scaled = MatrixScale(10, 10, 10);
 	matrix = MatrixMultiply(matrix_scaled, matrix);
 	
-	matrix = MatrixMultiply(matrix, proj_matrix);
-	
-
+	// lights are binned in the same view space the shaders compute their depth in
+	light_clusters* clusters = &rContext->clusters;
+	lights_build(clusters, rContext->jobs, &matrix, &proj_matrix);
+	lights_upload(clusters, rContext->context);
+	
+	// cascades follow the camera, their cbuffers are only written when they move
+	shadows_update(&rContext->shadows, rContext->context, &matrix, &proj_matrix, rContext->sun_direction);
+	
+	mx view_projection = MatrixMultiply(matrix, proj_matrix);
+	rContext->view_projection = view_projection;
+	rContext->frustum = cull_frustum_from_matrix(&view_projection);
+	
+	f32 depth_scale = (CLUSTER_SLICES - 1) / log2f(CLUSTER_FAR / CLUSTER_NEAR);
+	frame_constants constants = {
+		.view_projection = view_projection,
+		.view = matrix,
+		.camera_pos = Vector3Transform({ 0, 0, 0 }, MatrixInvert(matrix)),
+		.cluster_depth_scale = depth_scale,
+		.cluster_tile_scale = { CLUSTER_TILES_X / width, CLUSTER_TILES_Y / height },
+		.cluster_depth_bias = -log2f(CLUSTER_NEAR) * depth_scale,
+		.light_count = clusters->light_count,
+		.ambient = rContext->ambient,
+		.sun_direction = rContext->sun_direction,
+		.shadow_texel = 1.0f / SHADOW_MAP_SIZE,
+		.sun_color = rContext->sun_color,
+	};
+	for(ui32 i = 0; i < SHADOW_CASCADES; i++) {
+		constants.shadow_matrices[i] = rContext->shadows.cascades[i].view_projection;
+		constants.cascade_splits[i] = rContext->shadows.cascades[i].split_far;
+	};
 	
 	D3D11_MAPPED_SUBRESOURCE mapped;
 	
+	// discard is the only way to map a constant buffer, no frame in flight reads this one so the driver has nothing to rename
 	rContext->context->Map(rContext->frame_buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
-	memcpy(mapped.pData, &matrix, sizeof(matrix));
+	memcpy(mapped.pData, &constants, sizeof(constants));
 	rContext->context->Unmap(rContext->frame_buffer, 0);
 };
 
+// the material a mesh draws with, the fallback when its own is TEXTURE_INVALID (missing or broken texture)
+internal ui32 render_mesh_material(render_context* rContext, mesh* mesh_data){
+	return mesh_data->material < rContext->textures.entry_count ? mesh_data->material : rContext->fallback_material;
+};
+
+internal void render_write_object_buffer(render_context* rContext, ID3D11DeviceContext* context, ID3D11Buffer* buffer, mesh* mesh_data){
+	object_constants constants = {
+		.world = MatrixTranslate(mesh_data->pos.x, mesh_data->pos.y, mesh_data->pos.z),
+		.material_slice = texture_table_slice(&rContext->textures, render_mesh_material(rContext, mesh_data)),
+	};
+	
+	if(mesh_data->virtual_texture != VT_NONE) {
+		constants.vt_id = mesh_data->virtual_texture;
+		vt_texture_constants(&rContext->vt, mesh_data->virtual_texture, &constants.vt_tiles, &constants.vt_mips, &constants.vt_uv_scale);
+	};
+	
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	
+	context->Map(buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+	memcpy(mapped.pData, &constants, sizeof(constants));
+	context->Unmap(buffer, 0);
+};
+
+void render_upload_object_buffer(render_context* rContext, mesh* mesh_data){
+	render_write_object_buffer(rContext, rContext->context, rContext->object_buffer, mesh_data);
+};
+
+// pipeline & textures of a mesh for the current pass
+internal void render_bind_mesh(render_context* rContext, state_tracker* tracker, ID3D11DeviceContext* context, mesh* mesh_data){
+	if(rContext->prepass_active) {
+		// depth only, no textures
+		tracker_bind_pipeline(tracker, context, rContext->prepass_pipeline);
+	} else if(mesh_data->virtual_texture != VT_NONE) {
+		tracker_bind_pipeline(tracker, context, rContext->feedback_pass ? rContext->feedback_pipeline : rContext->vt_pipeline);
+		tracker_bind_srv(tracker, context, 1, rContext->vt.textures[mesh_data->virtual_texture].indirection_view);
+		tracker_bind_srv(tracker, context, 2, rContext->vt.cache_view);
+	} else {
+		tracker_bind_pipeline(tracker, context, rContext->pipeline);
+		
+		// only switches texture array when the material lives in another bucket
+		tracker_bind_srv(tracker, context, 0, texture_table_view(&rContext->textures, render_mesh_material(rContext, mesh_data)));
+	};
+};
+
 void render_draw_mesh(render_context* rContext,mesh mesh_data){
-	render_queue_vertex(rContext, mesh_data);
-	render_queue_index(rContext, mesh_data);
-	render_upload_index_buffer(rContext);
-	render_upload_vertex_buffer(rContext);
-	rContext->context->DrawIndexed(rContext->indexCount, 0, 0);
+	// without the shaders for it, a virtual textured mesh falls back to its material
+	if(!rContext->vt_pipeline) mesh_data.virtual_texture = VT_NONE;
+	bool virtual_textured = mesh_data.virtual_texture != VT_NONE;
+	
+	// the feedback pass only cares about the meshes asking for tiles
+	if(rContext->feedback_pass && !virtual_textured) return;
+	
+	ui32 first_index;
+	ui32 base_vertex;
+	if(!render_stream_mesh(rContext, &mesh_data, &first_index, &base_vertex)) return;
+	render_upload_object_buffer(rContext, &mesh_data);
+	
+	render_bind_mesh(rContext, &rContext->tracker, rContext->context, &mesh_data);
+	rContext->context->DrawIndexed(mesh_data.index_count, first_index, base_vertex);
 };
 
-// ----------- init stuff
+// ----------- parallel recording
 
-// --- buffers
+struct render_record_job {
+	render_context* rContext;
+	record_slice* slice;
+	mesh* meshes;
+	viewport_size* vpSize;
+	
+	// the list's part of the rings, mapped on the immediate context
+	vertex* vertices;
+	ui32* indices;
+	ui32 base_vertex;
+	ui32 first_index;
+};
 
-HRESULT render_create_mesh_buffer(render_context *rContext, int vertex_buffer_size, int index_buffer_size) {
-	HRESULT hr;
+// one slice of the list into its deferred context, runs on any thread
+internal void render_record_slice(void* data){
+	render_record_job* job = (render_record_job*)data;
+	render_context* rContext = job->rContext;
+	record_slice* slice = job->slice;
+	state_tracker* tracker = &slice->tracker;
+	ID3D11DeviceContext* context = slice->context;
+	
+	tracker_reset(tracker);
+	tracker_begin_frame(tracker);
+	render_bind_scene_states(rContext, tracker, context, slice->object_buffer, job->vpSize);
+	
+	for(ui32 i = slice->first; i < slice->first + slice->count; i++) {
+		record_draw* draw = &rContext->record.draws[i];
+		mesh mesh_data = job->meshes[draw->mesh];
+		if(!rContext->vt_pipeline) mesh_data.virtual_texture = VT_NONE;
+		
+		memcpy(job->vertices + draw->vertex_start, mesh_data.vertices, sizeof(vertex) * mesh_data.vertex_count);
+		ui32* indices = job->indices + draw->index_start;
+		for(ui32 j = 0; j < mesh_data.index_count; j++) {
+			indices[j] = mesh_data.indices[j];
+		};
+		
+		render_write_object_buffer(rContext, context, slice->object_buffer, &mesh_data);
+		render_bind_mesh(rContext, tracker, context, &mesh_data);
+		context->DrawIndexed(mesh_data.index_count, job->first_index + draw->index_start, job->base_vertex + draw->vertex_start);
+	};
+	
+	context->FinishCommandList(FALSE, &slice->list);
+};
 
-	D3D11_BUFFER_DESC vertex_desc =
-    {
-        .ByteWidth = sizeof(vertex) * vertex_buffer_size,
-		.Usage = D3D11_USAGE_DYNAMIC,
-		.BindFlags = D3D11_BIND_VERTEX_BUFFER,
-		.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE,
+/*
+	Draws meshes[visible[i]] for the current pass. Long lists are recorded on the job system (record.h),
+	short ones and the feedback pass (its own targets) go through render_draw_mesh on this thread.
+	Leaves the screen bound like render_pipeline_states.
+*/
+void render_draw_meshes(render_context* rContext, mesh* meshes, ui32* visible, ui32 count, viewport_size* vpSize){
+	record_system* record = &rContext->record;
+	
+	ui32 slice_count = count / RECORD_MIN_SLICE_DRAWS;
+	if(slice_count > record->slice_count) slice_count = record->slice_count;
+	
+	bool parallel = record->enabled && !rContext->feedback_pass && slice_count > 1 && count <= RECORD_MAX_DRAWS;
+	
+	// where every draw goes in the rings, the slices then never touch the same bytes
+	ui32 vertex_total = 0;
+	ui32 index_total = 0;
+	if(parallel) {
+		for(ui32 i = 0; i < count; i++) {
+			mesh* mesh_data = &meshes[visible[i]];
+			record->draws[i] = { visible[i], vertex_total, index_total };
+			vertex_total += mesh_data->vertex_count;
+			index_total += mesh_data->index_count;
+		};
 	};
 	
+	ring_alloc vertices;
+	ring_alloc indices;
+	if(parallel && ring_map(&rContext->vertex_ring, rContext->context, sizeof(vertex) * vertex_total, sizeof(vertex), &vertices)) {
+		if(!ring_map(&rContext->index_ring, rContext->context, sizeof(ui32) * index_total, sizeof(ui32), &indices)) {
+			ring_unmap(&rContext->vertex_ring, rContext->context);
+			parallel = false;
+		};
+	} else {
+		parallel = false;
+	};
 	
-	D3D11_BUFFER_DESC index_desc =
-    {
-        .ByteWidth = sizeof(ui16) * index_buffer_size,
-		.Usage = D3D11_USAGE_DYNAMIC,
-		.BindFlags = D3D11_BIND_INDEX_BUFFER,
-		.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE,
+	if(!parallel) {
+		for(ui32 i = 0; i < count; i++) render_draw_mesh(rContext, meshes[visible[i]]);
+		return;
+	};
+	
+	render_record_job record_jobs[RECORD_MAX_SLICES];
+	volatile LONG counter = 0;
+	for(ui32 i = 0; i < slice_count; i++) {
+		record_slice* slice = &record->slices[i];
+		slice->first = count * i / slice_count;
+		slice->count = count * (i + 1) / slice_count - slice->first;
+		
+		record_jobs[i] = {
+			.rContext = rContext,
+			.slice = slice,
+			.meshes = meshes,
+			.vpSize = vpSize,
+			.vertices = (vertex*)vertices.memory,
+			.indices = (ui32*)indices.memory,
+			.base_vertex = vertices.offset / (ui32)sizeof(vertex),
+			.first_index = indices.offset / (ui32)sizeof(ui32),
+		};
+		jobs_push(rContext->jobs, render_record_slice, &record_jobs[i], &counter);
+	};
+	jobs_wait(rContext->jobs, &counter);
+	
+	ring_unmap(&rContext->vertex_ring, rContext->context);
+	ring_unmap(&rContext->index_ring, rContext->context);
+	
+	// in slice order, whoever recorded them
+	record_execute(record, rContext->context, &rContext->tracker, slice_count);
+	render_pipeline_states(rContext, vpSize);
+};
+
+// ----------- gpu culling
+
+// hands a mesh to the gpu culling as its object index, false when it has to stay on the cpu path
+internal bool render_gpu_cull_mesh(render_context* rContext, mesh* mesh_data, ui32 index){
+	gpu_cull_system* gpu = &rContext->gpu_cull;
+	
+	// the feedback pass & the streamed textures are drawn one by one
+	if(mesh_data->virtual_texture != VT_NONE && rContext->vt_pipeline) return false;
+	if(index >= GPU_CULL_MAX_OBJECTS) return false;
+	
+	ui32 geometry = gpu_cull_geometry(gpu, rContext->context, mesh_data->vertices, mesh_data->vertex_count, mesh_data->indices, mesh_data->index_count);
+	if(geometry == GPU_CULL_NONE) return false;
+	ui32 batch = gpu_cull_batch(gpu, geometry, texture_table_bucket(&rContext->textures, render_mesh_material(rContext, mesh_data)));
+	if(batch == GPU_CULL_NONE) return false;
+	
+	gpu_cull_object object = {
+		.pos = mesh_data->pos,
+		.radius = mesh_data->radius,
+		.batch = batch,
+		.material_slice = texture_table_slice(&rContext->textures, render_mesh_material(rContext, mesh_data)),
+	};
+	gpu_cull_set_object(gpu, index, &object);
+	return true;
+};
+
+/*
+	Draws what the gpu culled this frame, one indirect draw per batch, in the main pass or the prepass.
+	Leaves the screen bound like render_pipeline_states.
+*/
+void render_draw_gpu_culled(render_context* rContext, viewport_size* vpSize){
+	gpu_cull_system* gpu = &rContext->gpu_cull;
+	const pipeline_state* pipeline = rContext->prepass_active ? rContext->instanced_prepass_pipeline : rContext->instanced_pipeline;
+	if(gpu->object_count == 0 || rContext->feedback_pass || !pipeline) return;
+	
+	state_tracker* tracker = &rContext->tracker;
+	ID3D11DeviceContext* context = rContext->context;
+	
+	tracker_bind_pipeline(tracker, context, pipeline);
+	tracker_bind_vertex_buffer(tracker, context, 0, gpu->vertex_buffer, sizeof(struct vertex), 0);
+	tracker_bind_vertex_buffer(tracker, context, 1, gpu->instances, sizeof(vertex_instance), 0);
+	tracker_bind_index_buffer(tracker, context, gpu->index_buffer, DXGI_FORMAT_R16_UINT, 0);
+	
+	for(ui32 i = 0; i < gpu->batch_count; i++) {
+		gpu_cull_batch* batch = &gpu->batches[i];
+		if(batch->object_count == 0) continue;
+		
+		if(!rContext->prepass_active) tracker_bind_srv(tracker, context, 0, rContext->textures.buckets[batch->bucket].view);
+		context->DrawIndexedInstancedIndirect(gpu->args, sizeof(gpu_cull_args) * i);
+	};
+	
+	render_pipeline_states(rContext, vpSize);
+};
+
+// the occluders in the frustum into the software occlusion buffer, on the job system
+internal void render_draw_occluders(render_context* rContext, mesh* meshes, ui32 count){
+	occlusion_system* occlusion = &rContext->occlusion;
+	occlusion_begin(occlusion, &rContext->view_projection);
+	if(!occlusion->enabled || !occlusion->supported) return;
+	
+	for(ui32 i = 0; i < count; i++) {
+		mesh* mesh_data = &meshes[i];
+		if(!mesh_data->occluder) continue;
+		if(mesh_data->radius > 0 && !cull_sphere(&rContext->frustum, mesh_data->pos, mesh_data->radius)) continue;
+		occlusion_add_mesh(occlusion, mesh_data->pos, mesh_data->vertices, mesh_data->vertex_count, mesh_data->indices, mesh_data->index_count);
+	};
+	
+	occlusion_rasterize(occlusion, rContext->jobs);
+};
+
+/*
+	Meshes the camera sees this frame, their indices go in visible (count of them at most).
+	Bounds are tested against the frustum, then against the occluders of this frame and the depth of a
+	few frames ago.
+	With gpu culling on, the meshes it can take are culled by the gpu instead and never end up in visible,
+	render_draw_gpu_culled draws them.
+*/
+ui32 render_cull_meshes(render_context* rContext, mesh* meshes, ui32 count, ui32* visible){
+	gpu_cull_system* gpu = &rContext->gpu_cull;
+	bool gpu_driven = gpu->enabled && gpu->shader && rContext->instanced_pipeline;
+	ui32 gpu_count = 0;
+	ui32 visible_count = 0;
+	
+	render_draw_occluders(rContext, meshes, count);
+	
+	for(ui32 i = 0; i < count; i++) {
+		mesh* mesh_data = &meshes[i];
+		if(gpu_driven && render_gpu_cull_mesh(rContext, mesh_data, gpu_count)) {
+			gpu_count++;
+			continue;
+		};
+		
+		if(mesh_data->radius > 0) {
+			if(!cull_sphere(&rContext->frustum, mesh_data->pos, mesh_data->radius)) continue;
+			if(!mesh_data->occluder && !occlusion_test_sphere(&rContext->occlusion, mesh_data->pos, mesh_data->radius)) continue;
+			if(rContext->occlusion_culling && !hiz_test_sphere(&rContext->hiz, mesh_data->pos, mesh_data->radius)) continue;
+		};
+		visible[visible_count++] = i;
+	};
+	
+	gpu_cull_set_count(gpu, gpu_count);
+	if(gpu_driven) {
+		// the compute pass writes the instance stream the last frame drew with
+		tracker_bind_vertex_buffer(&rContext->tracker, rContext->context, 1, NULL, 0, 0);
+		gpu_cull_dispatch(gpu, rContext->context, &rContext->frustum, &rContext->hiz, rContext->occlusion_culling);
+	};
+	
+	return visible_count;
+};
+
+// the meshes drawn between begin & end only write depth, returns false when the prepass is off
+bool render_begin_prepass(render_context* rContext){
+	if(!rContext->depth_prepass || !rContext->prepass_pipeline) return false;
+	
+	rContext->prepass_active = true;
+	return true;
+};
+
+void render_end_prepass(render_context* rContext){
+	rContext->prepass_active = false;
+};
+
+/*
+	Reduces the depth of the frame into the hi-z pyramid and copies the mip the cpu reads, call once the scene is drawn.
+	Leaves the screen bound like render_pipeline_states.
+*/
+void render_build_hiz(render_context* rContext, viewport_size* vpSize){
+	hiz_system* hiz = &rContext->hiz;
+	
+	// a multisampled depth buffer needs its own shader to be read
+	const pipeline_state* first_pipeline = rContext->depth_samples > 1 ? rContext->hiz_msaa_pipeline : rContext->hiz_pipeline;
+	if(!rContext->occlusion_culling || !first_pipeline || !rContext->hiz_pipeline || !hiz->pyramid) return;
+	
+	state_tracker* tracker = &rContext->tracker;
+	ID3D11DeviceContext* context = rContext->context;
+	
+	// only the part of the depth the scene covered, rounded up so the last pixels are in it too
+	ui32 width = (vpSize->width + 1) / 2;
+	ui32 height = (vpSize->height + 1) / 2;
+	for(ui32 mip = 0; mip < hiz->mip_count; mip++) {
+		D3D11_VIEWPORT viewport =
+		{
+			.TopLeftX = 0,
+			.TopLeftY = 0,
+			.Width = (FLOAT)width,
+			.Height = (FLOAT)height,
+			.MinDepth = 0,
+			.MaxDepth = 1,
+		};
+		tracker_bind_viewport(tracker, context, &viewport);
+		tracker_bind_pipeline(tracker, context, mip == 0 ? first_pipeline : rContext->hiz_pipeline);
+		
+		// the depth buffer stops being a target here, each mip reads the one above it
+		tracker_bind_targets(tracker, context, hiz->mip_targets[mip], NULL);
+		tracker_bind_srv(tracker, context, 0, mip == 0 ? rContext->depthView : hiz->mip_views[mip - 1]);
+		context->Draw(3, 0);
+		
+		width = (width + 1) / 2;
+		height = (height + 1) / 2;
+	};
+	
+	// the depth & the pyramid go back to being targets next frame
+	tracker_bind_srv(tracker, context, 0, NULL);
+	hiz_copy_readback(hiz, context, &rContext->view_projection, *vpSize);
+	
+	render_pipeline_states(rContext, vpSize);
+};
+
+// ----------- post processing
+
+/*
+	One fullscreen triangle from source into the top left width x height of target.
+	source_width / height are the size of the source texture, region_width / height the part of it drawn this frame
+	and step how many source pixels there are per target pixel.
+*/
+internal void render_post_pass(render_context* rContext, post_constants* constants, ID3D11RenderTargetView* target, ui32 width, ui32 height,
+                               ID3D11ShaderResourceView* source, ui32 source_width, ui32 source_height, ui32 region_width, ui32 region_height, v2 step){
+	state_tracker* tracker = &rContext->tracker;
+	ID3D11DeviceContext* context = rContext->context;
+	
+	// taps stay on this side of the last texel centers of the region
+	constants->uv_scale = { step.x / source_width, step.y / source_height };
+	constants->uv_max = { (region_width - 0.5f) / source_width, (region_height - 0.5f) / source_height };
+	post_upload(&rContext->post, context, constants);
+	
+	D3D11_VIEWPORT viewport =
+	{
+		.TopLeftX = 0,
+		.TopLeftY = 0,
+		.Width = (FLOAT)width,
+		.Height = (FLOAT)height,
+		.MinDepth = 0,
+		.MaxDepth = 1,
+	};
+	tracker_bind_viewport(tracker, context, &viewport);
+	
+	// the last target is often this pass' source, and the other way around
+	tracker_bind_srv(tracker, context, 0, NULL);
+	tracker_bind_targets(tracker, context, target, NULL);
+	tracker_bind_srv(tracker, context, 0, source);
+	context->Draw(3, 0);
+};
+
+/*
+	Brings the hdr scene to the backbuffer (resolve, bloom, tone mapping, fxaa) and stretches it from the render size
+	to the window size. Call once everything reading the scene depth is done.
+	Leaves the backbuffer bound without depth, for the ui.
+*/
+void render_post_process(render_context* rContext, viewport_size* window_size){
+	post_system* post = &rContext->post;
+	state_tracker* tracker = &rContext->tracker;
+	ID3D11DeviceContext* context = rContext->context;
+	
+	// the rest does not depend on the resolution
+	dynres_end(&rContext->dynres, context);
+	if(!post->scene_target || rContext->sceneView != post->scene_target) return; // the scene is already on the backbuffer
+	
+	// the whole texture, there is no resolve of a part of it
+	if(post->samples > 1) {
+		context->ResolveSubresource((ID3D11Resource*)post->resolved, 0, (ID3D11Resource*)post->scene, 0, post_tiers[post->tier].scene_format);
+	};
+	
+	tracker_bind_ps_cbuffer(tracker, context, 0, post->buffer);
+	tracker_bind_sampler(tracker, context, 0, post->sampler);
+	
+	ui32 render_width = rContext->render_size.width;
+	ui32 render_height = rContext->render_size.height;
+	
+	// what every bloom mip covers this frame, rounded up like the scene into the first one
+	ui32 region_widths[POST_MAX_BLOOM_MIPS];
+	ui32 region_heights[POST_MAX_BLOOM_MIPS];
+	for(ui32 mip = 0; mip < post->bloom_mips; mip++) {
+		region_widths[mip] = ((mip == 0 ? render_width : region_widths[mip - 1]) + 1) / 2;
+		region_heights[mip] = ((mip == 0 ? render_height : region_heights[mip - 1]) + 1) / 2;
+	};
+	
+	// down the pyramid keeping the bright part, then back up adding every mip to the one above it
+	bool bloom = post->bloom_mips && rContext->bloom_down_pipeline && rContext->bloom_up_pipeline;
+	post_constants constants = post_frame_constants(post, bloom);
+	if(bloom) {
+		tracker_bind_pipeline(tracker, context, rContext->bloom_down_pipeline);
+		for(ui32 mip = 0; mip < post->bloom_mips; mip++) {
+			// only the first one is thresholded
+			constants.prefilter = mip == 0;
+			if(mip == 0) {
+				render_post_pass(rContext, &constants, post->bloom_targets[0], region_widths[0], region_heights[0],
+				                 post->resolved_view, post->width, post->height, render_width, render_height, { 2, 2 });
+			} else {
+				render_post_pass(rContext, &constants, post->bloom_targets[mip], region_widths[mip], region_heights[mip],
+				                 post->bloom_views[mip - 1], post->bloom_widths[mip - 1], post->bloom_heights[mip - 1], region_widths[mip - 1], region_heights[mip - 1], { 2, 2 });
+			};
+		};
+		constants.prefilter = false;
+		
+		tracker_bind_pipeline(tracker, context, rContext->bloom_up_pipeline);
+		for(ui32 mip = post->bloom_mips - 1; mip > 0; mip--) {
+			render_post_pass(rContext, &constants, post->bloom_targets[mip - 1], region_widths[mip - 1], region_heights[mip - 1],
+			                 post->bloom_views[mip], post->bloom_widths[mip], post->bloom_heights[mip], region_widths[mip], region_heights[mip], { 0.5f, 0.5f });
+		};
+		
+		constants.bloom_uv_max = { (region_widths[0] - 0.5f) / post->bloom_widths[0], (region_heights[0] - 0.5f) / post->bloom_heights[0] };
+	};
+	
+	// the last pass stretches to the window : the tonemap when there is no fxaa after it
+	bool fxaa = post->ldr_target && rContext->fxaa_pipeline;
+	v2 stretch = { (f32)render_width / window_size->width, (f32)render_height / window_size->height };
+	tracker_bind_pipeline(tracker, context, rContext->tonemap_pipeline);
+	tracker_bind_srv(tracker, context, 1, bloom ? post->bloom_views[0] : NULL);
+	if(fxaa) {
+		render_post_pass(rContext, &constants, post->ldr_target, render_width, render_height,
+		                 post->resolved_view, post->width, post->height, render_width, render_height, { 1, 1 });
+		
+		tracker_bind_pipeline(tracker, context, rContext->fxaa_pipeline);
+		render_post_pass(rContext, &constants, rContext->rtView, window_size->width, window_size->height,
+		                 post->ldr_view, post->width, post->height, render_width, render_height, stretch);
+	} else {
+		render_post_pass(rContext, &constants, rContext->rtView, window_size->width, window_size->height,
+		                 post->resolved_view, post->width, post->height, render_width, render_height, stretch);
+	};
+	
+	// they are targets again next frame
+	tracker_bind_srv(tracker, context, 0, NULL);
+	tracker_bind_srv(tracker, context, 1, NULL);
+};
+
+// ----------- shadows
+
+internal void render_draw_shadow_caster(render_context* rContext, mesh* mesh_data){
+	ui32 first_index;
+	ui32 base_vertex;
+	if(!render_stream_mesh(rContext, mesh_data, &first_index, &base_vertex)) return;
+	render_upload_object_buffer(rContext, mesh_data);
+	
+	rContext->context->DrawIndexed(mesh_data->index_count, first_index, base_vertex);
+	rContext->shadows.caster_draws++;
+};
+
+// indices of the meshes of one kind inside a cascade, hashes what the cache depends on for the static ones
+internal ui32 render_gather_casters(shadow_system* shadows, shadow_cascade* cascade, mesh* meshes, ui32 count, bool dynamic, ui64* hash){
+	ui32 caster_count = 0;
+	
+	for(ui32 i = 0; i < count && caster_count < SHADOW_MAX_CASTERS; i++) {
+		mesh* mesh_data = &meshes[i];
+		if(mesh_data->dynamic != dynamic) continue;
+		if(mesh_data->radius > 0 && !cull_sphere(&cascade->frustum, mesh_data->pos, mesh_data->radius)) continue;
+		
+		if(hash) {
+			*hash = hash_fnv64(&mesh_data->pos, sizeof(v3), *hash);
+			*hash = hash_fnv64(&mesh_data->vertices, sizeof(vertex*), *hash);
+			*hash = hash_fnv64(&mesh_data->indices, sizeof(ui16*), *hash);
+			*hash = hash_fnv64(&mesh_data->index_count, sizeof(ui16), *hash);
+		};
+		shadows->casters[caster_count++] = i;
+	};
+	
+	return caster_count;
+};
+
+/*
+	Draws the shadow casters of the frame into every cascade, call after render_upload_frame_buffer.
+	The static ones only go into the cache when it is out of date, the cache is then copied to the live
+	maps (only when they differ) and the dynamic casters are drawn over it. Leaves the screen bound.
+*/
+void render_draw_shadows(render_context* rContext, mesh* meshes, ui32 count, viewport_size* vpSize){
+	shadow_system* shadows = &rContext->shadows;
+	shadows->static_redraws = 0;
+	shadows->cached = 0;
+	shadows->caster_draws = 0;
+	if(!rContext->shadow_pipeline || !shadows->casters) return;
+	
+	state_tracker* tracker = &rContext->tracker;
+	ID3D11DeviceContext* context = rContext->context;
+	
+	D3D11_VIEWPORT viewport =
+	{
+		.TopLeftX = 0,
+		.TopLeftY = 0,
+		.Width = (FLOAT)SHADOW_MAP_SIZE,
+		.Height = (FLOAT)SHADOW_MAP_SIZE,
+		.MinDepth = 0,
+		.MaxDepth = 1,
+	};
+	
+	// the live maps are about to be depth targets, they cannot stay bound as a texture
+	tracker_bind_srv(tracker, context, 6, NULL);
+	tracker_bind_pipeline(tracker, context, rContext->shadow_pipeline);
+	tracker_bind_viewport(tracker, context, &viewport);
+	
+	for(ui32 i = 0; i < SHADOW_CASCADES; i++) {
+		shadow_cascade* cascade = &shadows->cascades[i];
+		tracker_bind_vs_cbuffer(tracker, context, 0, cascade->buffer);
+		
+		// anything moving the cascade or its static casters changes the hash
+		ui64 hash = hash_fnv64(&cascade->view_projection, sizeof(mx), shadows->static_version);
+		ui32 static_count = render_gather_casters(shadows, cascade, meshes, count, false, &hash);
+		
+		bool redraw = !cascade->cache_valid || cascade->static_hash != hash;
+		if(redraw) {
+			context->ClearDepthStencilView(cascade->cache_view, D3D11_CLEAR_DEPTH, 1.f, 0);
+			tracker_bind_targets(tracker, context, NULL, cascade->cache_view);
+			for(ui32 j = 0; j < static_count; j++) {
+				render_draw_shadow_caster(rContext, &meshes[shadows->casters[j]]);
+			};
+			
+			cascade->static_hash = hash;
+			cascade->cache_valid = true;
+			shadows->static_redraws++;
+		};
+		
+		ui32 dynamic_count = render_gather_casters(shadows, cascade, meshes, count, true, NULL);
+		
+		// the live slice is already a copy of the cache unless dynamic casters were drawn over it
+		if(redraw || cascade->live_has_dynamic) {
+			context->CopySubresourceRegion((ID3D11Resource*)shadows->live, i, 0, 0, 0, (ID3D11Resource*)shadows->cache, i, NULL);
+		} else if(dynamic_count == 0) {
+			shadows->cached++;
+		};
+		
+		if(dynamic_count) {
+			tracker_bind_targets(tracker, context, NULL, cascade->live_view);
+			for(ui32 j = 0; j < dynamic_count; j++) {
+				render_draw_shadow_caster(rContext, &meshes[shadows->casters[j]]);
+			};
+		};
+		cascade->live_has_dynamic = dynamic_count > 0;
 	};
+	
+	// back to the screen
+	render_pipeline_states(rContext, vpSize);
+};
+
+// ----------- init stuff
+
+// --- buffers
 
-	D3D11_SUBRESOURCE_DATA initial = { .pSysMem = rContext->vQueue };
-    hr = rContext->device->CreateBuffer(&vertex_desc, NULL, &rContext->vertex_buffer);
-	hr = rContext->device->CreateBuffer(&index_desc, NULL, &rContext->index_buffer);
+// sizes are in bytes, shared by every vertex / index format streamed
+HRESULT render_create_mesh_buffer(render_context *rContext, ui32 vertex_ring_size, ui32 index_ring_size) {
+	HRESULT hr;
+
+	hr = ring_create(&rContext->vertex_ring, rContext->device, vertex_ring_size, D3D11_BIND_VERTEX_BUFFER);
+	if(FAILED(hr)) return hr;
+	hr = ring_create(&rContext->index_ring, rContext->device, index_ring_size, D3D11_BIND_INDEX_BUFFER);
 	
 	return hr;
 }
@@ -306,16 +1106,19 @@ HRESULT render_create_mesh_buffer(render_context *rContext, int vertex_buffer_si
 HRESULT render_create_frame_buffer(render_context* rContext) {
 	HRESULT hr;
 	
-	// todo: fix this
 	D3D11_BUFFER_DESC desc =
     {
-        .ByteWidth = sizeof(mx) * 2,
+        .ByteWidth = sizeof(frame_constants),
 		.Usage = D3D11_USAGE_DYNAMIC,
 		.BindFlags = D3D11_BIND_CONSTANT_BUFFER,
 		.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE,
 	};
 
-    hr = rContext->device->CreateBuffer(&desc, NULL, &rContext->frame_buffer); 
+	for(ui32 i = 0; i < FRAMES_IN_FLIGHT; i++) {
+		hr = rContext->device->CreateBuffer(&desc, NULL, &rContext->frame_buffers[i]);
+		if(FAILED(hr)) return hr;
+	};
+	rContext->frame_buffer = rContext->frame_buffers[0];
 	
 	return hr;
 };
@@ -323,10 +1126,9 @@ HRESULT render_create_frame_buffer(render_context* rContext) {
 HRESULT render_create_object_buffer(render_context* rContext) {
 	HRESULT hr;
 	
-	// todo: fix this
 	D3D11_BUFFER_DESC desc =
     {
-        .ByteWidth = sizeof(mx) * 2,
+        .ByteWidth = sizeof(object_constants),
 		.Usage = D3D11_USAGE_DYNAMIC,
 		.BindFlags = D3D11_BIND_CONSTANT_BUFFER,
 		.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE,
@@ -339,44 +1141,84 @@ HRESULT render_create_object_buffer(render_context* rContext) {
 
 // --- assets (textures, shaders...)
 
-HRESULT render_load_shaders(render_context* rContext) {
-	HRESULT hr;
-	
-	
-	// IA decs
-	// these must match vertex shader input layout (VS_INPUT in vertex shader source below)
-	D3D11_INPUT_ELEMENT_DESC desc[] =
-	{
-		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT,    0, offsetof(vertex, pos), D3D11_INPUT_PER_VERTEX_DATA, 0 },
-		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT,    0, offsetof(vertex, uv),       D3D11_INPUT_PER_VERTEX_DATA, 0 },
-		{ "COLOR",    0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, offsetof(vertex, color),    D3D11_INPUT_PER_VERTEX_DATA, 0 },
-	};
+// picks the shaders the scene draws with (they are created on first use)
+HRESULT render_select_shaders(render_context* rContext) {
+	// todo: this should come from the material once we have those
+	ui32 features = SHADER_FEATURE_TEXTURED | SHADER_FEATURE_VERTEX_COLOR | SHADER_FEATURE_LIT;
+	shader_program* program = shader_get_program(&rContext->shaders, rContext->device, SHADER_PROGRAM_TRIANGLE, features);
+	if(!program) {
+		return E_FAIL;
+	}
 	
-	char vsLocation[] = "triangle.vs.fxc";
-	char psLocation[] = "triangle.ps.fxc";
+	rContext->vshader = program->vshader;
+	rContext->pshader = program->pshader;
+	rContext->layout = program->layout;
 	
-	complete_file vblob = {0};
-	complete_file pblob = {0};
+	return S_OK;
+};
+
+HRESULT render_load_shaders(render_context* rContext) {
+	HRESULT hr;
 	
-	io_file_fullread(vsLocation, &vblob);
-	io_file_fullread(psLocation, &pblob);
+	// every variant lives in the cache built by buildshader.bat, only the ones we ask for get created
+	char cacheLocation[] = "shaders.cache";
+	hr = shader_library_load(&rContext->shaders, cacheLocation);
+	if(FAILED(hr)) {
+		FatalError("Failed to load shader cache! Run buildshader.bat");
+	}
 	
+	hr = render_select_shaders(rContext);
 	
-	hr = rContext->device->CreateVertexShader(vblob.memory, vblob.size, NULL, &rContext->vshader);
-	hr = rContext->device->CreatePixelShader(pblob.memory, pblob.size, NULL, &rContext->pshader);
-	hr = rContext->device->CreateInputLayout(desc, ARRAYSIZE(desc), vblob.memory, vblob.size, &rContext->layout);
+	return hr;
+};
 
-	io_file_fullfree(&vblob);
-	io_file_fullfree(&pblob);
+/*
+	Loads textures into the table, materials receives their ids (TEXTURE_INVALID on failure).
+	Files are opened and upload memory mapped here, then the decoders write the pixels straight into
+	that memory on the job system. Map / Unmap / copies stay on this thread, the immediate context is not thread safe.
+*/
+HRESULT render_load_textures(render_context* rContext, char (*locations)[MAX_PATH], ui32 count, ui32* materials) {
+	HRESULT hr = S_OK;
+	texture_table* table = &rContext->textures;
+	
+	// as many at once as there are staging textures
+	for(ui32 first = 0; first < count; first += TEXTURE_TABLE_MAX_STAGING) {
+		ui32 batch_count = count - first < TEXTURE_TABLE_MAX_STAGING ? count - first : TEXTURE_TABLE_MAX_STAGING;
+		parse_img_job batch[TEXTURE_TABLE_MAX_STAGING] = {};
+		texture_upload uploads[TEXTURE_TABLE_MAX_STAGING];
+		
+		for(ui32 i = 0; i < batch_count; i++) {
+			parse_img_job* job = &batch[i];
+			job->location = locations[first + i];
+			
+			if(parse_open_img(job->location, &job->file, &job->img) &&
+			   texture_table_begin_add(table, rContext->device, rContext->context, job->img.x, job->img.y, &uploads[i])) {
+				job->dst = uploads[i].memory;
+				job->row_pitch = uploads[i].row_pitch;
+			} else {
+				job->location = NULL;
+			}
+		}
+		
+		parse_decode_imgs(rContext->jobs, batch, batch_count);
+		
+		for(ui32 i = 0; i < batch_count; i++) {
+			parse_img_job* job = &batch[i];
+			ui32 material = TEXTURE_INVALID;
+			if(job->dst) {
+				material = texture_table_end_upload(table, rContext->context, &uploads[i], locations[first + i], job->ok);
+			}
+			if(material == TEXTURE_INVALID) hr = E_FAIL;
+			materials[first + i] = material;
+			
+			if(job->file.memory) io_file_fullfree(&job->file);
+		}
+	}
 	
 	return hr;
 };
 
 HRESULT render_init_textures(render_context* rContext) {
-	HRESULT hr;
-	
-	// todo: rewrite all of this (it sucks)
-		
 	// todo: asset pipeline for textures
 		
 	// for testing
@@ -385,35 +1227,26 @@ HRESULT render_init_textures(render_context* rContext) {
         // 0x80000000, 0xffffffff,
         // 0xffffffff, 0x80000000,
     // };
-		
-	// open and decode the texture
-	char location[] = "texture.png";
-	complete_file texture_file = {0};
-	complete_img tex = parse_decode_img(location, &texture_file);
-
-    D3D11_TEXTURE2D_DESC desc =
-    {
-        .Width = tex.x,
-        .Height = tex.y,
-        .MipLevels = 1,
-        .ArraySize = 1,
-        .Format = DXGI_FORMAT_R8G8B8A8_UNORM,
-        .SampleDesc = { 1, 0 },
-        .Usage = D3D11_USAGE_IMMUTABLE,
-        .BindFlags = D3D11_BIND_SHADER_RESOURCE,
-    };
-
-    D3D11_SUBRESOURCE_DATA data =
-    {
-		.pSysMem = tex.memory,
-		.SysMemPitch = tex.x * tex.channels_in_file,
-    };
-
-    ID3D11Texture2D* texture;
-    hr = rContext->device->CreateTexture2D(&desc, &data, &texture);
-    hr = rContext->device->CreateShaderResourceView((ID3D11Resource*)texture, NULL, &rContext->textureView);
-    texture->Release();
-	io_file_fullfree(&texture_file);
+	
+	// first in the table, every material that could not be loaded draws with it
+	ui32 white = 0xffffffff;
+	complete_img fallback = { .x = 1, .y = 1, .channels_in_file = 4, .memory = &white };
+	char fallbackName[] = "fallback";
+	rContext->fallback_material = texture_table_add(&rContext->textures, rContext->device, rContext->context, &fallback, fallbackName);
+	if(rContext->fallback_material == TEXTURE_INVALID) OutputDebugStringA("FALLBACK TEXTURE ERROR\n");
+	
+	// the material id is what draws refer to
+	char locations[][MAX_PATH] = { "texture.png" };
+	ui32 materials[ARRAYSIZE(locations)];
+	HRESULT hr = render_load_textures(rContext, locations, ARRAYSIZE(locations), materials);
+	if(rContext->fallback_material == TEXTURE_INVALID) hr = E_FAIL;
+	rContext->default_material = materials[0] != TEXTURE_INVALID ? materials[0] : rContext->fallback_material;
+	
+	// baked by vt_bake.exe, optional : meshes keep their material when it is not there
+	char virtualLocation[] = "texture.vt";
+	if(SUCCEEDED(vt_init(&rContext->vt, rContext->device, rContext->io))) {
+		rContext->default_virtual_texture = vt_open(&rContext->vt, rContext->device, rContext->context, virtualLocation);
+	}
 	
 	return hr;
 };
@@ -444,59 +1277,158 @@ HRESULT render_init_sampler(render_context* rContext) {
 	return hr;
 };
 
-HRESULT render_init_ds(render_context* rContext){
-	HRESULT hr;
-	
-	// todo: disabled depth & stencil test for now, will be enabled later
-	D3D11_DEPTH_STENCIL_DESC desc =
-	{
-		.DepthEnable = TRUE,
-		.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL,
-		.DepthFunc = D3D11_COMPARISON_LESS,
-		.StencilEnable = TRUE,
-		.StencilReadMask = D3D11_DEFAULT_STENCIL_READ_MASK,
-		.StencilWriteMask = D3D11_DEFAULT_STENCIL_WRITE_MASK,
-		
-		// Front face
-		
-		// .BackFace = ...
-    };
-	desc.FrontFace.StencilFailOp = D3D11_STENCIL_OP_KEEP;
-    desc.FrontFace.StencilDepthFailOp = D3D11_STENCIL_OP_INCR;
-    desc.FrontFace.StencilPassOp = D3D11_STENCIL_OP_KEEP;
-    desc.FrontFace.StencilFunc = D3D11_COMPARISON_ALWAYS;
-	
-	desc.BackFace.StencilFailOp = D3D11_STENCIL_OP_KEEP;
-    desc.BackFace.StencilDepthFailOp = D3D11_STENCIL_OP_DECR;
-    desc.BackFace.StencilPassOp = D3D11_STENCIL_OP_KEEP;
-    desc.BackFace.StencilFunc = D3D11_COMPARISON_ALWAYS;
-	
-	
-	
-	hr = rContext->device->CreateDepthStencilState(&desc, &rContext->depthState);
-	
-	return hr;
+void render_init_ds(D3D11_DEPTH_STENCIL_DESC* desc){
+	// less or equal : after the depth prepass the scene passes exactly where it is the closest surface
+	// no stencil, the depth buffer does not have one
+	// memset & fields, not an initializer : the padding is hashed with the pipeline_desc
+	memset(desc, 0, sizeof(D3D11_DEPTH_STENCIL_DESC));
+	desc->DepthEnable = TRUE;
+	desc->DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
+	desc->DepthFunc = D3D11_COMPARISON_LESS_EQUAL;
+	desc->StencilEnable = FALSE;
 };
 
-HRESULT render_init_rasterizer(render_context* rContext){
-	HRESULT hr;
-	
+void render_init_rasterizer(D3D11_RASTERIZER_DESC* desc){
 	// todo: disabled culling for now, check if we enable it later
 	// more info: https://github.com/ssloy/tinyrenderer/wiki/Lesson-2:-Triangle-rasterization-and-back-face-culling
 	/* doc:
 	https://learn.microsoft.com/en-us/windows/win32/api/d3d11/ns-d3d11-d3d11_rasterizer_desc
 	(concept) https://www.khronos.org/opengl/wiki/Face_Culling */
 		
-	D3D11_RASTERIZER_DESC desc =
+	*desc =
     {
 		.FillMode = D3D11_FILL_SOLID,
 		.CullMode = D3D11_CULL_BACK,
 		.FrontCounterClockwise = TRUE,
 		.DepthClipEnable = TRUE,
 	};
-    hr = rContext->device->CreateRasterizerState(&desc, &rContext->rasterizerState);
+};
+
+void render_init_blend(D3D11_BLEND_DESC* desc){
+	/* doc:
+	https://learn.microsoft.com/en-us/windows/win32/api/d3d11/ns-d3d11-d3d11_blend_desc */
+	
+	// opaque geometry, blending off
+	memset(desc, 0, sizeof(D3D11_BLEND_DESC));
+	desc->RenderTarget[0].BlendEnable = FALSE;
+	desc->RenderTarget[0].SrcBlend = D3D11_BLEND_ONE;
+	desc->RenderTarget[0].DestBlend = D3D11_BLEND_ZERO;
+	desc->RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD;
+	desc->RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ONE;
+	desc->RenderTarget[0].DestBlendAlpha = D3D11_BLEND_ZERO;
+	desc->RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
+	desc->RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+};
+
+// states of desc with the shaders of a program, NULL when the shader cache does not have it
+const pipeline_state* render_init_fullscreen_pipeline(render_context* rContext, pipeline_desc* desc, ui32 program_id){
+	shader_program* program = shader_get_program(&rContext->shaders, rContext->device, program_id, 0);
+	if(!program) return NULL;
 	
-	return hr;
+	desc->vshader = program->vshader;
+	desc->pshader = program->pshader;
+	desc->layout = program->layout;
+	return pipeline_get(&rContext->psoCache, rContext->device, desc);
+};
+
+HRESULT render_init_pipeline(render_context* rContext){
+	// shaders must be loaded before this
+	pipeline_desc desc;
+	memset(&desc, 0, sizeof(desc));
+	
+	desc.vshader = rContext->vshader;
+	desc.pshader = rContext->pshader;
+	desc.layout = rContext->layout;
+	desc.topology = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	render_init_rasterizer(&desc.rasterizer);
+	render_init_ds(&desc.depth_stencil);
+	render_init_blend(&desc.blend);
+	
+	rContext->pipeline = pipeline_get(&rContext->psoCache, rContext->device, &desc);
+	
+	// same states for virtual textured meshes and their feedback pass
+	ui32 features = SHADER_FEATURE_VIRTUAL | SHADER_FEATURE_VERTEX_COLOR | SHADER_FEATURE_LIT;
+	shader_program* virtual_program = shader_get_program(&rContext->shaders, rContext->device, SHADER_PROGRAM_TRIANGLE, features);
+	shader_program* feedback_program = shader_get_program(&rContext->shaders, rContext->device, SHADER_PROGRAM_VT_FEEDBACK, features);
+	rContext->vt_pipeline = NULL;
+	rContext->feedback_pipeline = NULL;
+	
+	if(virtual_program && feedback_program) {
+		desc.vshader = virtual_program->vshader;
+		desc.pshader = virtual_program->pshader;
+		desc.layout = virtual_program->layout;
+		rContext->vt_pipeline = pipeline_get(&rContext->psoCache, rContext->device, &desc);
+		
+		desc.vshader = feedback_program->vshader;
+		desc.pshader = feedback_program->pshader;
+		desc.layout = feedback_program->layout;
+		rContext->feedback_pipeline = pipeline_get(&rContext->psoCache, rContext->device, &desc);
+	};
+	
+	// depth only, biased against acne, depth is clamped instead of clipped so casters in front of a cascade still cast
+	shader_program* shadow_program = shader_get_program(&rContext->shaders, rContext->device, SHADER_PROGRAM_SHADOW, 0);
+	rContext->shadow_pipeline = NULL;
+	rContext->prepass_pipeline = NULL;
+	
+	if(shadow_program) {
+		desc.vshader = shadow_program->vshader;
+		desc.pshader = NULL;
+		desc.layout = shadow_program->layout;
+		desc.rasterizer.CullMode = D3D11_CULL_NONE;
+		desc.rasterizer.DepthClipEnable = FALSE;
+		desc.rasterizer.DepthBias = 1000;
+		desc.rasterizer.SlopeScaledDepthBias = 2.0f;
+		rContext->shadow_pipeline = pipeline_get(&rContext->psoCache, rContext->device, &desc);
+		
+		// same vertex shader for the depth prepass, with the scene's rasterizer & depth states
+		render_init_rasterizer(&desc.rasterizer);
+		render_init_ds(&desc.depth_stencil);
+		rContext->prepass_pipeline = pipeline_get(&rContext->psoCache, rContext->device, &desc);
+	};
+	
+	// what the gpu culled, world & material come from the instance stream
+	ui32 instanced_features = SHADER_FEATURE_TEXTURED | SHADER_FEATURE_VERTEX_COLOR | SHADER_FEATURE_LIT | SHADER_FEATURE_INSTANCED;
+	shader_program* instanced_program = shader_get_program(&rContext->shaders, rContext->device, SHADER_PROGRAM_TRIANGLE, instanced_features);
+	shader_program* instanced_prepass_program = shader_get_program(&rContext->shaders, rContext->device, SHADER_PROGRAM_SHADOW, SHADER_FEATURE_INSTANCED);
+	shader_program* cull_program = shader_get_program(&rContext->shaders, rContext->device, SHADER_PROGRAM_CULL, 0);
+	rContext->instanced_pipeline = NULL;
+	rContext->instanced_prepass_pipeline = NULL;
+	rContext->gpu_cull.shader = cull_program ? cull_program->cshader : NULL;
+	
+	render_init_rasterizer(&desc.rasterizer);
+	render_init_ds(&desc.depth_stencil);
+	if(instanced_program) {
+		desc.vshader = instanced_program->vshader;
+		desc.pshader = instanced_program->pshader;
+		desc.layout = instanced_program->layout;
+		rContext->instanced_pipeline = pipeline_get(&rContext->psoCache, rContext->device, &desc);
+	};
+	if(instanced_prepass_program) {
+		desc.vshader = instanced_prepass_program->vshader;
+		desc.pshader = NULL;
+		desc.layout = instanced_prepass_program->layout;
+		rContext->instanced_prepass_pipeline = pipeline_get(&rContext->psoCache, rContext->device, &desc);
+	};
+	
+	// fullscreen triangles, no depth
+	render_init_rasterizer(&desc.rasterizer);
+	render_init_ds(&desc.depth_stencil);
+	desc.rasterizer.CullMode = D3D11_CULL_NONE;
+	desc.depth_stencil.DepthEnable = FALSE;
+	desc.depth_stencil.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+	
+	rContext->hiz_pipeline = render_init_fullscreen_pipeline(rContext, &desc, SHADER_PROGRAM_HIZ);
+	rContext->hiz_msaa_pipeline = render_init_fullscreen_pipeline(rContext, &desc, SHADER_PROGRAM_HIZ_MSAA);
+	rContext->bloom_down_pipeline = render_init_fullscreen_pipeline(rContext, &desc, SHADER_PROGRAM_BLOOM_DOWN);
+	rContext->tonemap_pipeline = render_init_fullscreen_pipeline(rContext, &desc, SHADER_PROGRAM_TONEMAP);
+	rContext->fxaa_pipeline = render_init_fullscreen_pipeline(rContext, &desc, SHADER_PROGRAM_FXAA);
+	
+	// the upsample adds to what the downsample left in its target
+	desc.blend.RenderTarget[0].BlendEnable = TRUE;
+	desc.blend.RenderTarget[0].DestBlend = D3D11_BLEND_ONE;
+	rContext->bloom_up_pipeline = render_init_fullscreen_pipeline(rContext, &desc, SHADER_PROGRAM_BLOOM_UP);
+	
+	return rContext->pipeline ? S_OK : E_FAIL;
 };
 
 // --- instances
@@ -580,12 +1512,11 @@ HRESULT render_init_swapchain(render_context* rContext, HWND window) {
         //.Width = 0,
         //.Height = 0,
 
-        // or use DXGI_FORMAT_R8G8B8A8_UNORM_SRGB for storing sRGB
+        // replaced by the format of the quality tier on the first resize (see render/post.h)
         .Format = DXGI_FORMAT_R8G8B8A8_UNORM,
 
         // FLIP presentation model does not allow MSAA framebuffer
-        // if you want MSAA then you'll need to render offscreen and manually
-        // resolve to non-MSAA framebuffer
+        // the scene is drawn offscreen with MSAA and resolved in render_post_process
 		// more info: https://all500234765.github.io/graphics/2019/10/28/msaa-dx11/
         .SampleDesc = { 1, 0 },
 
@@ -632,23 +1563,51 @@ HRESULT render_init_d3d11(HWND window, render_context* rContext) {
 	// create DXGI swap chain
 	hr = render_init_swapchain(rContext, window);
 	
+	// frames in flight, everything written per frame waits on them
+	hr = fences_init(&rContext->fences, rContext->device);
+	
 	// init needed buffers 
-	hr = render_create_mesh_buffer(rContext, 16384, 16384);
+	hr = render_create_mesh_buffer(rContext, 4 * 1024 * 1024, 2 * 1024 * 1024);
 	hr = render_create_frame_buffer(rContext);
 	hr = render_create_object_buffer(rContext);
 	
-	// sampler
-	hr = render_init_sampler(rContext);
+	// a deferred context for every thread of the job system, the one waiting on them included
+	hr = record_init(&rContext->record, rContext->device, rContext->jobs ? rContext->jobs->worker_count + 1 : 1, sizeof(object_constants));
+	
+	// objects & draws in gpu buffers, off until the ui turns it on
+	hr = gpu_cull_init(&rContext->gpu_cull, rContext->device);
+	
+	// occluders rasterized on the cpu, on when the cpu has avx2
+	occlusion_init(&rContext->occlusion);
 	
-	// rasterizer 
-	hr = render_init_rasterizer(rContext);
+	// lights, none until render_set_lights
+	hr = lights_init(&rContext->clusters, rContext->device);
+	rContext->ambient = { 0.15f, 0.15f, 0.15f };
 	
-	// depth stencil
-	hr = render_init_ds(rContext);
+	// sun, its shadows are cached as long as it does not move
+	hr = shadows_init(&rContext->shadows, rContext->device);
+	rContext->sun_direction = Vector3Normalize({ -0.4f, -1.0f, -0.3f });
+	rContext->sun_color = { 0.7f, 0.65f, 0.6f };
+	
+	// offscreen target, made with the swap chain buffers
+	hr = post_init(&rContext->post, rContext->device);
+	
+	// the scene resolution follows the gpu time
+	hr = dynres_init(&rContext->dynres, rContext->device);
+	
+	// both can be switched at runtime
+	rContext->depth_prepass = true;
+	rContext->occlusion_culling = true;
+	
+	// sampler
+	hr = render_init_sampler(rContext);
 	
 	// init shaders
 	hr = render_load_shaders(rContext);
 	
+	// pipeline (rasterizer, depth stencil, blend)
+	hr = render_init_pipeline(rContext);
+	
 	// textures
 	hr = render_init_textures(rContext);
 	
@@ -657,11 +1616,21 @@ HRESULT render_init_d3d11(HWND window, render_context* rContext) {
 	// set rt/ds view on rcontext (to zero)
 	// more info: https://learn.microsoft.com/en-us/windows/win32/api/d3d11/nn-d3d11-id3d11view
     rContext->rtView = NULL;
+    rContext->sceneView = NULL;
     rContext->dsView = NULL;
+    rContext->depthView = NULL;
 
 	return hr;
 }
 
+// once the render thread has joined, before the async io & the job system are shut down
+void render_shutdown(render_context* rContext){
+	// waits for the tile reads in flight, they complete through the async io
+	vt_release(&rContext->vt, rContext->jobs);
+	gpu_cull_release(&rContext->gpu_cull);
+	occlusion_release(&rContext->occlusion);
+};
+
 
 
 #endif /* _RENDERH_ */
@@ -0,0 +1,142 @@
+/*  ----------------------------------- RING
+	This header file contains the ring buffers the renderer streams per frame data through.
+
+	A ring is one big dynamic buffer. Allocations are appended with MAP_NO_OVERWRITE, the driver
+	does not have to care about what the gpu is reading since we never touch a range already
+	handed out. Once the end is reached it goes on from 0, over what the frames already done with
+	(the fences) wrote. Each frame remembers where it started, the ring never gets further than one
+	buffer size ahead of the oldest frame still in flight.
+	Only when the gpu is that far behind is the ring mapped with MAP_DISCARD : the driver hands us a
+	fresh copy and the old one lives until the gpu is done with it. Each time that happens the
+	generation goes up, so a caller keeping an allocation around across frames can tell if its data
+	is still there.
+
+*/
+
+#ifndef _RINGH_
+#define _RINGH_
+
+#include <d3d11.h>
+
+// ------------------------------- structs
+
+struct render_ring {
+	ID3D11Buffer* buffer;
+	ui32 size;
+	ui64 head; // bytes handed out since the start (wasted ends of the buffer included), offset = head % size
+	ui32 generation; // bumped on every discard
+
+	// positions a frame may still read from, head never gets more than size past them
+	ui64 frame_begin[FRAMES_IN_FLIGHT]; // by frame number
+	ui64 current_begin; // the frame being recorded
+	ui64 tail; // oldest of the frames in flight
+
+	ui32 discards; // stats, since the start
+};
+
+struct ring_alloc {
+	void* memory; // mapped, valid until ring_unmap
+	ui32 offset; // in bytes, a multiple of the alignment asked for
+	ui32 generation;
+	ui64 position; // head where it starts
+};
+
+// ------------------------------- functions
+
+HRESULT ring_create(render_ring* ring, ID3D11Device* device, ui32 size, UINT bind_flags) {
+	D3D11_BUFFER_DESC desc =
+	{
+		.ByteWidth = size,
+		.Usage = D3D11_USAGE_DYNAMIC,
+		.BindFlags = bind_flags,
+		.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE,
+	};
+
+	memset(ring, 0, sizeof(render_ring));
+	ring->size = size;
+	return device->CreateBuffer(&desc, NULL, &ring->buffer);
+};
+
+// call once the fences of the frame are waited for, what the frames done with wrote can be written over
+void ring_begin_frame(render_ring* ring, frame_fences* fences) {
+	ring->current_begin = ring->head;
+	ring->tail = ring->head;
+	for(ui64 frame = fences->completed + 1; frame <= fences->submitted; frame++) {
+		ui64 begin = ring->frame_begin[frame % FRAMES_IN_FLIGHT];
+		if(begin < ring->tail) ring->tail = begin;
+	};
+};
+
+// call before fences_end_frame
+void ring_end_frame(render_ring* ring, frame_fences* fences) {
+	ring->frame_begin[fences_current(fences) % FRAMES_IN_FLIGHT] = ring->current_begin;
+};
+
+/*
+	Maps size bytes of the ring, the offset is rounded up to a multiple of alignment.
+	Alignment does not need to be a power of two : aligning to a vertex stride lets draws use
+	BaseVertexLocation / StartIndexLocation with the ring bound once at offset 0.
+	Returns false if size does not fit in the ring at all.
+*/
+bool ring_map(render_ring* ring, ID3D11DeviceContext* context, ui32 size, ui32 alignment, ring_alloc* alloc) {
+	if(size > ring->size) return false;
+
+	ui64 lap = ring->head - ring->head % ring->size;
+	ui32 offset = (ui32)(((ring->head % ring->size + alignment - 1) / alignment) * alignment);
+	if(offset + size > ring->size) {
+		// does not fit before the end, start over at 0
+		lap += ring->size;
+		offset = 0;
+	};
+
+	ui64 position = lap + offset;
+	ui64 tail = ring->tail < ring->current_begin ? ring->tail : ring->current_begin;
+	D3D11_MAP map_type = D3D11_MAP_WRITE_NO_OVERWRITE;
+
+	if(position + size - tail > ring->size) {
+		// would write over what a frame in flight reads, the driver renames the buffer instead
+		position = lap + (offset ? ring->size : 0);
+		offset = 0;
+		map_type = D3D11_MAP_WRITE_DISCARD;
+		ring->generation++;
+		ring->discards++;
+
+		// nothing before is in this copy of the buffer
+		ring->current_begin = position;
+		ring->tail = position;
+		for(ui32 i = 0; i < FRAMES_IN_FLIGHT; i++) ring->frame_begin[i] = position;
+	};
+
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	HRESULT hr = context->Map(ring->buffer, 0, map_type, 0, &mapped);
+	if(FAILED(hr)) return false;
+
+	ring->head = position + size;
+
+	alloc->memory = (ui8*)mapped.pData + offset;
+	alloc->offset = offset;
+	alloc->generation = ring->generation;
+	alloc->position = position;
+	return true;
+};
+
+void ring_unmap(render_ring* ring, ID3D11DeviceContext* context) {
+	context->Unmap(ring->buffer, 0);
+};
+
+// true while what was written in alloc is still in the buffer the gpu will read
+bool ring_alloc_alive(render_ring* ring, ring_alloc* alloc) {
+	return alloc->generation == ring->generation && alloc->position + ring->size >= ring->head;
+};
+
+// an alive allocation drawn again this frame, it is not written over before the frame is done
+void ring_keep(render_ring* ring, ring_alloc* alloc) {
+	if(alloc->position < ring->current_begin) ring->current_begin = alloc->position;
+};
+
+void ring_release(render_ring* ring) {
+	if(ring->buffer) ring->buffer->Release();
+	memset(ring, 0, sizeof(render_ring));
+};
+
+#endif /* _RINGH_ */
@@ -0,0 +1,177 @@
+/*  ----------------------------------- SCENE
+	This header file contains the loading of .scene files (layout in render/scene_format.h).
+
+	The file is mapped copy on write and used where it is : the ranges are checked against the file and
+	must not overlap (in the order of the format), then one pass over the meshes turns their offsets into
+	pointers into the mapping and their material indices into texture ids. Only the pages of the mesh
+	array get a private copy, the vertices & indices stay pages of the file until the meshes are drawn. The file is not trusted : every index is checked
+	against the vertices of its mesh, once per distinct geometry (objects sharing an .obj share it).
+
+*/
+
+#ifndef _SCENEH_
+#define _SCENEH_
+
+// the fixup writes pointers over the offsets, both layouts must stay the same
+static_assert(sizeof(scene_file_vertex) == sizeof(vertex), "scene_file_vertex must match struct vertex");
+static_assert(sizeof(scene_file_mesh) == sizeof(mesh), "scene_file_mesh must match struct mesh");
+static_assert(offsetof(scene_file_mesh, vertices) == offsetof(mesh, vertices), "scene_file_mesh must match struct mesh");
+static_assert(offsetof(scene_file_mesh, index_count) == offsetof(mesh, index_count), "scene_file_mesh must match struct mesh");
+static_assert(offsetof(scene_file_mesh, indices) == offsetof(mesh, indices), "scene_file_mesh must match struct mesh");
+static_assert(offsetof(scene_file_mesh, material) == offsetof(mesh, material), "scene_file_mesh must match struct mesh");
+static_assert(offsetof(scene_file_mesh, radius) == offsetof(mesh, radius), "scene_file_mesh must match struct mesh");
+static_assert(offsetof(scene_file_mesh, dynamic) == offsetof(mesh, dynamic), "scene_file_mesh must match struct mesh");
+static_assert(offsetof(scene_file_mesh, occluder) == offsetof(mesh, occluder), "scene_file_mesh must match struct mesh");
+static_assert(SCENE_MATERIAL_PATH == MAX_PATH, "the material table is read as MAX_PATH strings");
+
+// ------------------------------- structs
+
+// a geometry whose indices were checked, indices == 0 for a free slot (the header is at 0)
+struct scene_checked {
+	ui64 indices;
+	ui32 index_count;
+	ui32 vertex_count;
+};
+
+struct scene_data {
+	complete_file file; // the mapping, the meshes point into it
+	mesh* meshes;
+	ui32 mesh_count;
+};
+
+// ------------------------------- functions
+
+// an array of count elements of size bytes at offset, inside the file and aligned
+internal bool scene_check_range(scene_file_header* header, ui64 offset, ui64 count, ui64 size) {
+	if(offset % SCENE_FILE_ALIGNMENT) return false;
+	if(offset > header->file_size) return false;
+	return count <= (header->file_size - offset) / size;
+};
+
+// the range a mesh points to, inside the vertex or index data and on an element
+internal bool scene_check_data(ui64 first, ui64 bytes, ui64 offset, ui64 count, ui64 size) {
+	if(offset < first || (offset - first) % size) return false;
+	return count <= (first + bytes - offset) / size;
+};
+
+// every index of the mesh inside its vertices, geometries already in checked (slot_count, a power of two) pass right away
+internal bool scene_check_indices(scene_checked* checked, ui32 slot_count, ui8* base, scene_file_mesh* file_mesh) {
+	scene_checked key = { file_mesh->indices, file_mesh->index_count, file_mesh->vertex_count };
+	ui32 slot = (ui32)hash_fnv64(&key, sizeof(key), 0) & (slot_count - 1);
+	while(checked[slot].indices) {
+		if(memcmp(&checked[slot], &key, sizeof(key)) == 0) return true;
+		slot = (slot + 1) & (slot_count - 1);
+	};
+
+	ui16* indices = (ui16*)(base + file_mesh->indices);
+	for(ui32 i = 0; i < file_mesh->index_count; i++) {
+		if(indices[i] >= file_mesh->vertex_count) return false;
+	};
+	checked[slot] = key;
+	return true;
+};
+
+/*
+	Maps a .scene file and makes its meshes ready to draw, false when it is not there or not valid.
+	Textures that could not be loaded get the fallback material. Call before the render thread
+	starts, textures are loaded on the immediate context.
+*/
+bool scene_load(render_context* rContext, scene_data* scene, char* location) {
+	memset(scene, 0, sizeof(scene_data));
+	if(!io_file_map(location, &scene->file)) return false;
+
+	ui8* base = (ui8*)scene->file.memory;
+	scene_file_header* header = (scene_file_header*)base;
+
+	bool ok = scene->file.size >= sizeof(scene_file_header);
+	ok = ok && header->magic == SCENE_FILE_MAGIC && header->version == SCENE_FILE_VERSION;
+	if(!ok) {
+		OutputDebugStringA("SCENE VERSION MISMATCH\n");
+		io_file_unmap(&scene->file);
+		return false;
+	};
+
+	ok = header->file_size == scene->file.size;
+	ok = ok && scene_check_range(header, header->mesh_offset, header->mesh_count, sizeof(scene_file_mesh));
+	ok = ok && scene_check_range(header, header->material_offset, header->material_count, sizeof(scene_file_material));
+	ok = ok && scene_check_range(header, header->vertex_offset, header->vertex_bytes, 1);
+	ok = ok && scene_check_range(header, header->index_offset, header->index_bytes, 1);
+
+	// in the order of the format and apart : the fixup writes over the meshes, nothing checked may be there
+	ok = ok && header->mesh_offset >= sizeof(scene_file_header);
+	ok = ok && header->material_offset >= header->mesh_offset + sizeof(scene_file_mesh) * (ui64)header->mesh_count;
+	ok = ok && header->vertex_offset >= header->material_offset + sizeof(scene_file_material) * (ui64)header->material_count;
+	ok = ok && header->index_offset >= header->vertex_offset + header->vertex_bytes;
+
+	// the paths go to the texture loader as c strings
+	scene_file_material* file_materials = (scene_file_material*)(base + header->material_offset);
+	for(ui32 i = 0; ok && i < header->material_count; i++) {
+		ok = memchr(file_materials[i].path, 0, SCENE_MATERIAL_PATH) != NULL;
+	};
+	if(!ok) {
+		OutputDebugStringA("SCENE LAYOUT ERROR\n");
+		io_file_unmap(&scene->file);
+		return false;
+	};
+
+	ui32 slot_count = 1;
+	while(slot_count < header->mesh_count * 2) slot_count *= 2;
+	scene_checked* checked = (scene_checked*)VirtualAlloc(0, sizeof(scene_checked) * slot_count, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	if(!checked) {
+		io_file_unmap(&scene->file);
+		return false;
+	};
+
+	scene_file_mesh* file_meshes = (scene_file_mesh*)(base + header->mesh_offset);
+	for(ui32 i = 0; ok && i < header->mesh_count; i++) {
+		scene_file_mesh* file_mesh = &file_meshes[i];
+		ok = scene_check_data(header->vertex_offset, header->vertex_bytes, file_mesh->vertices, file_mesh->vertex_count, sizeof(scene_file_vertex));
+		ok = ok && scene_check_data(header->index_offset, header->index_bytes, file_mesh->indices, file_mesh->index_count, sizeof(ui16));
+		ok = ok && file_mesh->index_count % 3 == 0 && file_mesh->material < header->material_count;
+		ok = ok && scene_check_indices(checked, slot_count, base, file_mesh);
+	};
+	VirtualFree(checked, 0, MEM_RELEASE);
+	if(!ok) {
+		OutputDebugStringA("SCENE DATA ERROR\n");
+		io_file_unmap(&scene->file);
+		return false;
+	};
+
+	// the paths are MAX_PATH strings already, the loader reads them from the mapping
+	ui32* materials = (ui32*)VirtualAlloc(0, sizeof(ui32) * (header->material_count + 1), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	if(!materials) {
+		io_file_unmap(&scene->file);
+		return false;
+	};
+	if(header->material_count) {
+		char (*paths)[MAX_PATH] = (char (*)[MAX_PATH])(base + header->material_offset);
+		render_load_textures(rContext, paths, header->material_count, materials);
+	};
+
+	// offsets -> pointers, in place
+	for(ui32 i = 0; i < header->mesh_count; i++) {
+		scene_file_mesh* file_mesh = &file_meshes[i];
+		ui64 vertices = file_mesh->vertices;
+		ui64 indices = file_mesh->indices;
+		ui32 material = materials[file_mesh->material];
+
+		mesh* m = (mesh*)file_mesh;
+		m->vertices = (vertex*)(base + vertices);
+		m->indices = (ui16*)(base + indices);
+		m->material = material != TEXTURE_INVALID ? material : rContext->fallback_material;
+		m->virtual_texture = VT_NONE;
+	};
+	VirtualFree(materials, 0, MEM_RELEASE);
+
+	scene->meshes = (mesh*)file_meshes;
+	scene->mesh_count = header->mesh_count;
+	return true;
+};
+
+// the meshes point into the mapping, nothing may draw them anymore
+void scene_release(scene_data* scene) {
+	if(scene->file.memory) io_file_unmap(&scene->file);
+	memset(scene, 0, sizeof(scene_data));
+};
+
+#endif /* _SCENEH_ */
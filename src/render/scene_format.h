@@ -0,0 +1,73 @@
+/*  ----------------------------------- SCENE FORMAT
+	This header file contains the layout of the .scene files : a scene the renderer maps and uses in
+	place, written by tools/scene_export.cpp. Nothing here needs windows or d3d, the exporter builds
+	anywhere (see render/scene.h for the loading).
+
+	scene_file_header
+	scene_file_mesh meshes[mesh_count]
+	scene_file_material materials[material_count]
+	vertices (scene_file_vertex)
+	indices (ui16)
+
+	Offsets are from the start of the file, every array starts on SCENE_FILE_ALIGNMENT. A mesh is laid
+	out like struct mesh with file offsets where it has pointers and an index in the material table
+	where it has a texture id : loading is one pass over the meshes, the vertices & indices are not
+	copied at load time (only their indices are read, to check them). They are copied when a mesh is
+	drawn, like any other mesh. Meshes using the same geometry point to the same data.
+*/
+
+#ifndef _SCENEFORMATH_
+#define _SCENEFORMATH_
+
+#define SCENE_FILE_MAGIC 0x314e4353 // "SCN1"
+#define SCENE_FILE_VERSION 1
+#define SCENE_FILE_ALIGNMENT 16
+#define SCENE_MATERIAL_PATH 260 // MAX_PATH, the table is handed to the texture loader as it is
+
+struct scene_file_header {
+	ui32 magic;
+	ui32 version;
+	ui32 mesh_count;
+	ui32 material_count;
+	ui64 mesh_offset;
+	ui64 material_offset;
+	ui64 vertex_offset;
+	ui64 vertex_bytes;
+	ui64 index_offset;
+	ui64 index_bytes;
+	ui64 file_size; // a truncated file is not loaded
+	ui64 pad;
+};
+
+// struct vertex
+struct scene_file_vertex {
+	v3 pos;
+	v2 uv;
+	v4 color;
+};
+
+// struct mesh, field for field (64 bits pointers)
+struct scene_file_mesh {
+	v3 pos;
+	ui32 vertex_count;
+	ui64 vertices; // offset of the first vertex
+	ui16 index_count;
+	ui16 pad0[3];
+	ui64 indices; // offset of the first index
+	ui32 material; // in the material table
+	ui32 virtual_texture; // VT_NONE, virtual textures are not exported
+	f32 radius;
+	ui8 dynamic;
+	ui8 occluder;
+	ui16 pad1;
+};
+
+struct scene_file_material {
+	char path[SCENE_MATERIAL_PATH]; // texture, from the working directory
+};
+
+internal ui64 scene_file_align(ui64 offset) {
+	return (offset + SCENE_FILE_ALIGNMENT - 1) & ~(ui64)(SCENE_FILE_ALIGNMENT - 1);
+};
+
+#endif /* _SCENEFORMATH_ */
@@ -0,0 +1,371 @@
+/*  ----------------------------------- SHADERS
+	This header file contains the shader permutation system.
+
+	Every shader program is compiled offline once per combination of feature defines (a permutation)
+	by tools/shader_bake.cpp. All the variants end up in a single cache file where identical bytecode
+	is stored only once. At runtime the cache is read in one go, and the D3D11 objects for a variant
+	are only created the first time something asks for it.
+
+*/
+
+#ifndef _SHADERH_
+#define _SHADERH_
+
+#include <d3d11.h>
+#include <d3dcompiler.h>
+
+// ------------------------------- permutations
+
+// feature bits, one define each in the hlsl source
+enum shader_feature {
+	SHADER_FEATURE_TEXTURED     = 1 << 0,
+	SHADER_FEATURE_VERTEX_COLOR = 1 << 1,
+	SHADER_FEATURE_INSTANCED    = 1 << 2,
+	SHADER_FEATURE_SKINNED      = 1 << 3,
+	SHADER_FEATURE_VIRTUAL      = 1 << 4,
+	SHADER_FEATURE_LIT          = 1 << 5,
+};
+
+#define SHADER_FEATURE_COUNT 6
+#define SHADER_PERMUTATION_COUNT (1 << SHADER_FEATURE_COUNT)
+#define SHADER_MAX_BONES 64
+
+// must match the order of the bits above
+const char* shader_feature_defines[SHADER_FEATURE_COUNT] = {
+	"FEATURE_TEXTURED",
+	"FEATURE_VERTEX_COLOR",
+	"FEATURE_INSTANCED",
+	"FEATURE_SKINNED",
+	"FEATURE_VIRTUAL",
+	"FEATURE_LIT",
+};
+
+enum shader_stage {
+	SHADER_STAGE_VS,
+	SHADER_STAGE_PS,
+	SHADER_STAGE_CS,
+
+	SHADER_STAGE_COUNT,
+};
+
+const char* shader_stage_entries[SHADER_STAGE_COUNT] = { "vs", "ps", "cs" };
+const char* shader_stage_profiles[SHADER_STAGE_COUNT] = { "vs_5_0", "ps_5_0", "cs_5_0" };
+
+#define SHADER_STAGES_GRAPHICS ((1 << SHADER_STAGE_VS) | (1 << SHADER_STAGE_PS))
+#define SHADER_STAGES_COMPUTE (1 << SHADER_STAGE_CS)
+
+// ------- programs
+// a program is one hlsl source file with a vs and a ps entry point, or a single cs entry point
+
+enum shader_program_id {
+	SHADER_PROGRAM_TRIANGLE,
+	SHADER_PROGRAM_VT_FEEDBACK, // see render/virtual_texture.h
+	SHADER_PROGRAM_SHADOW, // see render/shadows.h, also the depth prepass
+	SHADER_PROGRAM_HIZ, // see render/hiz.h
+	SHADER_PROGRAM_HIZ_MSAA,
+	SHADER_PROGRAM_BLOOM_DOWN, // see render/post.h
+	SHADER_PROGRAM_BLOOM_UP,
+	SHADER_PROGRAM_TONEMAP,
+	SHADER_PROGRAM_FXAA,
+	SHADER_PROGRAM_CULL, // see render/gpu_cull.h
+
+	SHADER_PROGRAM_COUNT,
+};
+
+const char* shader_program_sources[SHADER_PROGRAM_COUNT] = {
+	"triangle.hlsl",
+	"vt_feedback.hlsl",
+	"shadow.hlsl",
+	"hiz.hlsl",
+	"hiz_msaa.hlsl",
+	"bloom_down.hlsl",
+	"bloom_up.hlsl",
+	"tonemap.hlsl",
+	"fxaa.hlsl",
+	"cull.hlsl",
+};
+
+// stages compiled for each program
+ui32 shader_program_stages[SHADER_PROGRAM_COUNT] = {
+	SHADER_STAGES_GRAPHICS,
+	SHADER_STAGES_GRAPHICS,
+	SHADER_STAGES_GRAPHICS,
+	SHADER_STAGES_GRAPHICS,
+	SHADER_STAGES_GRAPHICS,
+	SHADER_STAGES_GRAPHICS,
+	SHADER_STAGES_GRAPHICS,
+	SHADER_STAGES_GRAPHICS,
+	SHADER_STAGES_GRAPHICS,
+	SHADER_STAGES_COMPUTE,
+};
+
+// features each program reads, the others give the same code and are neither baked nor asked for
+ui32 shader_program_features[SHADER_PROGRAM_COUNT] = {
+	SHADER_PERMUTATION_COUNT - 1,
+	SHADER_FEATURE_INSTANCED | SHADER_FEATURE_SKINNED,
+	SHADER_FEATURE_INSTANCED | SHADER_FEATURE_SKINNED,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+};
+
+// ------------------------------- cache file format
+/*
+	shader_cache_header
+	shader_cache_entry[entry_count]
+	shader_cache_blob[blob_count]
+	bytecode (blobs point in there)
+*/
+
+#define SHADER_CACHE_MAGIC 0x43444853 // "SHDC"
+#define SHADER_CACHE_VERSION 1
+
+struct shader_cache_header {
+	ui32 magic;
+	ui32 version;
+	ui32 entry_count;
+	ui32 blob_count;
+};
+
+struct shader_cache_entry {
+	ui64 key; // hash of source + defines + entry point + profile
+	ui32 program;
+	ui32 features;
+	ui32 stage;
+	ui32 blob;
+};
+
+struct shader_cache_blob {
+	ui32 offset; // from the start of the bytecode section
+	ui32 size;
+};
+
+// key of a variant, the offline step uses it to skip recompiling variants that did not change
+ui64 shader_variant_key(const void* source, size_t source_size, ui32 features, ui32 stage) {
+	ui64 key = hash_fnv64(source, source_size, 0);
+	for(ui32 i = 0; i < SHADER_FEATURE_COUNT; i++) {
+		if(features & (1 << i)) {
+			key = hash_fnv64(shader_feature_defines[i], strlen(shader_feature_defines[i]), key);
+		};
+	};
+	key = hash_fnv64(shader_stage_entries[stage], strlen(shader_stage_entries[stage]), key);
+	key = hash_fnv64(shader_stage_profiles[stage], strlen(shader_stage_profiles[stage]), key);
+	return key;
+};
+
+// compiles one variant, shared by the offline step and by hot reload
+HRESULT shader_compile_variant(const void* source, size_t source_size, const char* path, ui32 features, ui32 stage, ID3DBlob** code, ID3DBlob** errors) {
+	D3D_SHADER_MACRO defines[SHADER_FEATURE_COUNT + 1] = {};
+	ui32 define_count = 0;
+	for(ui32 i = 0; i < SHADER_FEATURE_COUNT; i++) {
+		if(features & (1 << i)) {
+			defines[define_count++] = { shader_feature_defines[i], "1" };
+		};
+	};
+
+	UINT flags = D3DCOMPILE_PACK_MATRIX_COLUMN_MAJOR | D3DCOMPILE_ENABLE_STRICTNESS | D3DCOMPILE_OPTIMIZATION_LEVEL3;
+
+	return D3DCompile(source, source_size, path, defines, D3D_COMPILE_STANDARD_FILE_INCLUDE,
+		shader_stage_entries[stage], shader_stage_profiles[stage], flags, 0, code, errors);
+};
+
+// ------------------------------- vertex streams
+
+// slot 0, per vertex (always bound)
+struct vertex
+{
+    v3 pos;
+    v2 uv;
+    v4 color;
+};
+
+// slot 1, per instance
+struct vertex_instance {
+	mx world;
+	ui32 material_slice; // slice in the texture array of the material (see texture_table.h)
+};
+
+// slot 2, per vertex
+struct vertex_skin {
+	ui8 bone_indices[4];
+	v4 bone_weights;
+};
+
+// ------------------------------- runtime library
+
+struct shader_program {
+	ID3D11VertexShader* vshader;
+	ID3D11PixelShader* pshader;
+	ID3D11InputLayout* layout;
+	ID3D11ComputeShader* cshader; // compute programs only have this one
+};
+
+struct shader_library {
+	complete_file file; // the whole cache file, blobs are read straight from it
+	shader_cache_blob* blobs;
+	ui8* bytecode;
+
+	// O(1) lookup : blob index of each variant, -1 if the cache does not have it
+	i32 lookup[SHADER_PROGRAM_COUNT][SHADER_PERMUTATION_COUNT][SHADER_STAGE_COUNT];
+
+	// created on first use only
+	shader_program programs[SHADER_PROGRAM_COUNT][SHADER_PERMUTATION_COUNT];
+	ui32 created_count;
+};
+
+// the tables and every blob they point to are inside the file (header already checked), a truncated or stale cache is not read past its end
+bool shader_cache_check(complete_file* file) {
+	shader_cache_header* header = (shader_cache_header*)file->memory;
+	ui64 tables = sizeof(shader_cache_header) + (ui64)sizeof(shader_cache_entry) * header->entry_count + (ui64)sizeof(shader_cache_blob) * header->blob_count;
+	if(tables > file->size) return false;
+
+	shader_cache_entry* entries = (shader_cache_entry*)((ui8*)file->memory + sizeof(shader_cache_header));
+	for(ui32 i = 0; i < header->entry_count; i++) {
+		if(entries[i].blob >= header->blob_count) return false;
+	};
+
+	shader_cache_blob* blobs = (shader_cache_blob*)(entries + header->entry_count);
+	ui64 bytecode_size = file->size - tables;
+	for(ui32 i = 0; i < header->blob_count; i++) {
+		if((ui64)blobs[i].offset + blobs[i].size > bytecode_size) return false;
+	};
+	return true;
+};
+
+HRESULT shader_library_load(shader_library* library, char* location) {
+	memset(library->lookup, 0xff, sizeof(library->lookup));
+
+	io_file_fullread(location, &library->file);
+	if(!library->file.memory || library->file.size < sizeof(shader_cache_header)) {
+		OutputDebugStringA("SHADER CACHE MISSING\n");
+		return E_FAIL;
+	};
+
+	ui8* cursor = (ui8*)library->file.memory;
+	shader_cache_header* header = (shader_cache_header*)cursor;
+	if(header->magic != SHADER_CACHE_MAGIC || header->version != SHADER_CACHE_VERSION) {
+		OutputDebugStringA("SHADER CACHE VERSION MISMATCH\n");
+		return E_FAIL;
+	};
+	if(!shader_cache_check(&library->file)) {
+		OutputDebugStringA("SHADER CACHE LAYOUT ERROR\n");
+		return E_FAIL;
+	};
+	cursor += sizeof(shader_cache_header);
+
+	shader_cache_entry* entries = (shader_cache_entry*)cursor;
+	cursor += sizeof(shader_cache_entry) * header->entry_count;
+
+	library->blobs = (shader_cache_blob*)cursor;
+	cursor += sizeof(shader_cache_blob) * header->blob_count;
+
+	library->bytecode = cursor;
+
+	for(ui32 i = 0; i < header->entry_count; i++) {
+		shader_cache_entry* entry = &entries[i];
+		if(entry->program >= SHADER_PROGRAM_COUNT || entry->features >= SHADER_PERMUTATION_COUNT || entry->stage >= SHADER_STAGE_COUNT) {
+			continue;
+		};
+		library->lookup[entry->program][entry->features][entry->stage] = (i32)entry->blob;
+	};
+
+	return S_OK;
+};
+
+// input layout matching the vertex streams a permutation reads
+ui32 shader_build_layout(ui32 features, D3D11_INPUT_ELEMENT_DESC* desc) {
+	ui32 count = 0;
+
+	// these must match VS_INPUT in the hlsl source
+	desc[count++] = { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT,    0, offsetof(vertex, pos),   D3D11_INPUT_PER_VERTEX_DATA, 0 };
+	desc[count++] = { "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT,       0, offsetof(vertex, uv),    D3D11_INPUT_PER_VERTEX_DATA, 0 };
+	desc[count++] = { "COLOR",    0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, offsetof(vertex, color), D3D11_INPUT_PER_VERTEX_DATA, 0 };
+
+	if(features & SHADER_FEATURE_INSTANCED) {
+		for(ui32 row = 0; row < 4; row++) {
+			desc[count++] = { "WORLD", row, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, (UINT)(offsetof(vertex_instance, world) + sizeof(v4) * row), D3D11_INPUT_PER_INSTANCE_DATA, 1 };
+		};
+		desc[count++] = { "MATERIAL", 0, DXGI_FORMAT_R32_UINT, 1, offsetof(vertex_instance, material_slice), D3D11_INPUT_PER_INSTANCE_DATA, 1 };
+	};
+
+	if(features & SHADER_FEATURE_SKINNED) {
+		desc[count++] = { "BLENDINDICES", 0, DXGI_FORMAT_R8G8B8A8_UINT,      2, offsetof(vertex_skin, bone_indices), D3D11_INPUT_PER_VERTEX_DATA, 0 };
+		desc[count++] = { "BLENDWEIGHT",  0, DXGI_FORMAT_R32G32B32A32_FLOAT, 2, offsetof(vertex_skin, bone_weights), D3D11_INPUT_PER_VERTEX_DATA, 0 };
+	};
+
+	return count;
+};
+
+// returns the program for a permutation, creating its shaders the first time
+shader_program* shader_get_program(shader_library* library, ID3D11Device* device, shader_program_id id, ui32 features) {
+	Assert(features < SHADER_PERMUTATION_COUNT);
+	features &= shader_program_features[id];
+	shader_program* program = &library->programs[id][features];
+
+	if((program->vshader && program->pshader) || program->cshader) {
+		return program;
+	};
+
+	HRESULT hr;
+	if(shader_program_stages[id] == SHADER_STAGES_COMPUTE) {
+		i32 cs_blob = library->lookup[id][features][SHADER_STAGE_CS];
+		if(cs_blob < 0) {
+			OutputDebugStringA("SHADER VARIANT NOT IN CACHE\n");
+			return NULL;
+		};
+
+		shader_cache_blob cs = library->blobs[cs_blob];
+		hr = device->CreateComputeShader(library->bytecode + cs.offset, cs.size, NULL, &program->cshader);
+		AssertHR(hr);
+
+		library->created_count++;
+		return program;
+	};
+
+	i32 vs_blob = library->lookup[id][features][SHADER_STAGE_VS];
+	i32 ps_blob = library->lookup[id][features][SHADER_STAGE_PS];
+	if(vs_blob < 0 || ps_blob < 0) {
+		OutputDebugStringA("SHADER VARIANT NOT IN CACHE\n");
+		return NULL;
+	};
+
+	shader_cache_blob vs = library->blobs[vs_blob];
+	shader_cache_blob ps = library->blobs[ps_blob];
+
+	hr = device->CreateVertexShader(library->bytecode + vs.offset, vs.size, NULL, &program->vshader);
+	AssertHR(hr);
+	hr = device->CreatePixelShader(library->bytecode + ps.offset, ps.size, NULL, &program->pshader);
+	AssertHR(hr);
+
+	D3D11_INPUT_ELEMENT_DESC desc[16];
+	ui32 desc_count = shader_build_layout(features, desc);
+	hr = device->CreateInputLayout(desc, desc_count, library->bytecode + vs.offset, vs.size, &program->layout);
+	AssertHR(hr);
+
+	library->created_count++;
+
+	return program;
+};
+
+void shader_library_release(shader_library* library) {
+	for(ui32 id = 0; id < SHADER_PROGRAM_COUNT; id++) {
+		for(ui32 features = 0; features < SHADER_PERMUTATION_COUNT; features++) {
+			shader_program* program = &library->programs[id][features];
+			if(program->vshader) program->vshader->Release();
+			if(program->pshader) program->pshader->Release();
+			if(program->layout) program->layout->Release();
+			if(program->cshader) program->cshader->Release();
+		};
+	};
+
+	if(library->file.memory) {
+		io_file_fullfree(&library->file);
+	};
+	memset(library, 0, sizeof(shader_library));
+};
+
+#endif /* _SHADERH_ */
@@ -0,0 +1,51 @@
+// ------- bloom downsample
+// one mip of the bloom pyramid from the one above it (or the scene for the first one), see render/post.h
+// 4 bilinear taps on the corners + the center : a 4x4 footprint for 5 fetches
+// the first pass also keeps only what is brighter than the threshold
+
+// t0 = the mip above
+Texture2D<float3> source : register(t0);
+SamplerState linear_clamp : register(s0);
+
+cbuffer cbuffer0 : register(b0) {
+	float2 uv_scale; // target pixel -> source uv
+	float2 uv_max; // the source was only drawn up to here
+	float2 bloom_uv_max;
+	float exposure;
+	float bloom_intensity;
+	float bloom_threshold;
+	float bloom_knee;
+	uint prefilter;
+	uint bloom;
+}
+
+float4 vs(uint id : SV_VertexID) : SV_POSITION {
+	float2 uv = float2((id << 1) & 2, id & 2);
+	return float4(uv * float2(2, -2) + float2(-1, 1), 0, 1);
+}
+
+// soft threshold, quadratic around the knee so the cut does not show
+float3 threshold_color(float3 color) {
+	float brightness = max(color.r, max(color.g, color.b));
+	float soft = clamp(brightness - bloom_threshold + bloom_knee, 0, 2 * bloom_knee);
+	soft = soft * soft / (4 * bloom_knee + 1e-5);
+	return color * (max(soft, brightness - bloom_threshold) / max(brightness, 1e-5));
+}
+
+float4 ps(float4 pos : SV_POSITION) : SV_TARGET {
+	float width, height;
+	source.GetDimensions(width, height);
+	float2 texel = 1 / float2(width, height);
+
+	// this pixel covers 2x2 source texels, their shared corner is the center
+	float2 uv = pos.xy * uv_scale;
+	float3 color = source.SampleLevel(linear_clamp, min(uv, uv_max), 0) * 4;
+	color += source.SampleLevel(linear_clamp, min(uv + float2(-texel.x, -texel.y), uv_max), 0);
+	color += source.SampleLevel(linear_clamp, min(uv + float2( texel.x, -texel.y), uv_max), 0);
+	color += source.SampleLevel(linear_clamp, min(uv + float2(-texel.x,  texel.y), uv_max), 0);
+	color += source.SampleLevel(linear_clamp, min(uv + float2( texel.x,  texel.y), uv_max), 0);
+	color *= 1.0 / 8;
+
+	if(prefilter) color = threshold_color(color);
+	return float4(color, 1);
+}
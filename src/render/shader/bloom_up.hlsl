@@ -0,0 +1,44 @@
+// ------- bloom upsample
+// one mip of the bloom pyramid blended (additive) into the one above it, see render/post.h
+// 3x3 tent filter, the pipeline does the add so nothing is read back from the target
+
+// t0 = the mip below
+Texture2D<float3> source : register(t0);
+SamplerState linear_clamp : register(s0);
+
+cbuffer cbuffer0 : register(b0) {
+	float2 uv_scale; // target pixel -> source uv
+	float2 uv_max; // the source was only drawn up to here
+	float2 bloom_uv_max;
+	float exposure;
+	float bloom_intensity;
+	float bloom_threshold;
+	float bloom_knee;
+	uint prefilter;
+	uint bloom;
+}
+
+float4 vs(uint id : SV_VertexID) : SV_POSITION {
+	float2 uv = float2((id << 1) & 2, id & 2);
+	return float4(uv * float2(2, -2) + float2(-1, 1), 0, 1);
+}
+
+float4 ps(float4 pos : SV_POSITION) : SV_TARGET {
+	float width, height;
+	source.GetDimensions(width, height);
+	float2 texel = 1 / float2(width, height);
+
+	// the target is twice the size of the source
+	float2 uv = pos.xy * uv_scale;
+	float3 color = source.SampleLevel(linear_clamp, min(uv, uv_max), 0) * 4;
+	color += source.SampleLevel(linear_clamp, min(uv + float2(-texel.x, 0), uv_max), 0) * 2;
+	color += source.SampleLevel(linear_clamp, min(uv + float2( texel.x, 0), uv_max), 0) * 2;
+	color += source.SampleLevel(linear_clamp, min(uv + float2(0, -texel.y), uv_max), 0) * 2;
+	color += source.SampleLevel(linear_clamp, min(uv + float2(0,  texel.y), uv_max), 0) * 2;
+	color += source.SampleLevel(linear_clamp, min(uv + float2(-texel.x, -texel.y), uv_max), 0);
+	color += source.SampleLevel(linear_clamp, min(uv + float2( texel.x, -texel.y), uv_max), 0);
+	color += source.SampleLevel(linear_clamp, min(uv + float2(-texel.x,  texel.y), uv_max), 0);
+	color += source.SampleLevel(linear_clamp, min(uv + float2( texel.x,  texel.y), uv_max), 0);
+
+	return float4(color * (1.0 / 16), 1);
+}
@@ -0,0 +1,111 @@
+// ------- gpu culling
+// one thread per object : tested against the camera planes & the hi-z pyramid of the last frame, the
+// ones left are appended to the indirect draw of their batch (see render/gpu_cull.h)
+
+#define GROUP_SIZE 64 // GPU_CULL_GROUP_SIZE
+#define ARGS_SIZE 20 // gpu_cull_args
+#define INSTANCE_SIZE 68 // vertex_instance
+
+// must match gpu_cull_object
+struct cull_object {
+	float3 pos;
+	float radius; // 0 = never culled
+	uint batch;
+	uint material_slice;
+	uint2 pad;
+};
+
+// b0 = gpu_cull_constants
+cbuffer cbuffer0 : register(b0)	{
+	float4 planes[6]; // point inside, dot(n, p) + d >= 0
+	float4x4 depth_matrix; // view projection the pyramid was drawn with
+	float2 depth_screen; // pixels of the depth buffer it covers
+	uint object_count;
+	uint occlusion; // 0 = frustum only
+	uint pyramid_mips;
+}
+
+// t0 = every object, t1 = hi-z pyramid (farthest depth of the texels under each one)
+StructuredBuffer<cull_object> objects : register(t0);
+Texture2D<float> pyramid : register(t1);
+
+// u0 = one D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS per batch, u1 = instance stream (slot 1 of the draws)
+RWByteAddressBuffer args : register(u0);
+RWByteAddressBuffer instances : register(u1);
+
+bool in_frustum(float3 center, float radius) {
+	[unroll] for(uint i = 0; i < 6; i++) {
+		if(dot(planes[i].xyz, center) + planes[i].w < -radius) return false;
+	}
+	return true;
+}
+
+// same test as hiz_test_sphere, on the whole pyramid : the mip where the bounds cover 2x2 texels or less
+bool hiz_visible(float3 center, float radius) {
+	float2 min_ndc = 1e30;
+	float2 max_ndc = -1e30;
+	float min_z = 1e30;
+
+	[unroll] for(uint i = 0; i < 8; i++) {
+		float3 corner = center + float3(i & 1 ? radius : -radius, i & 2 ? radius : -radius, i & 4 ? radius : -radius);
+		float4 clip = mul(float4(corner, 1), depth_matrix);
+		if(clip.w <= 1e-5) return true;
+
+		float3 ndc = clip.xyz / clip.w;
+		min_ndc = min(min_ndc, ndc.xy);
+		max_ndc = max(max_ndc, ndc.xy);
+		min_z = min(min_z, ndc.z);
+	}
+
+	// in front of the near plane or off the old screen, nothing to compare to
+	if(min_z < 0) return true;
+	if(any(max_ndc < -1) || any(min_ndc > 1)) return true;
+
+	// ndc -> pixels of the old depth, y goes down
+	min_ndc = clamp(min_ndc, -1, 1);
+	max_ndc = clamp(max_ndc, -1, 1);
+	float2 min_pixel = float2(min_ndc.x * 0.5 + 0.5, 0.5 - max_ndc.y * 0.5) * depth_screen;
+	float2 max_pixel = float2(max_ndc.x * 0.5 + 0.5, 0.5 - min_ndc.y * 0.5) * depth_screen;
+
+	// a texel of mip m covers 2 << m pixels
+	float2 size = max_pixel - min_pixel;
+	uint mip = (uint)clamp(ceil(log2(max(max(size.x, size.y), 1) / 4)), 0, (float)(pyramid_mips - 1));
+
+	uint width, height, mips;
+	pyramid.GetDimensions(mip, width, height, mips);
+	float texel = (float)(2u << mip);
+	uint2 first = min((uint2)(min_pixel / texel), uint2(width, height) - 1);
+	uint2 last = min((uint2)(max_pixel / texel), uint2(width, height) - 1);
+
+	// one texel farther than the closest point of the bounds is enough to see it
+	for(uint y = first.y; y <= last.y; y++) {
+		for(uint x = first.x; x <= last.x; x++) {
+			if(pyramid.Load(int3(x, y, mip)) >= min_z) return true;
+		}
+	}
+	return false;
+}
+
+[numthreads(GROUP_SIZE, 1, 1)]
+void cs(uint3 id : SV_DispatchThreadID) {
+	if(id.x >= object_count) return;
+
+	cull_object object = objects[id.x];
+	if(object.radius > 0) {
+		if(!in_frustum(object.pos, object.radius)) return;
+		if(occlusion && !hiz_visible(object.pos, object.radius)) return;
+	}
+
+	// one more instance for the draw, its slot in the batch's range
+	uint draw = object.batch * ARGS_SIZE;
+	uint slot;
+	args.InterlockedAdd(draw + 4, 1, slot);
+	uint instance = (args.Load(draw + 16) + slot) * INSTANCE_SIZE;
+
+	// world rows laid out like raylib's Matrix, objects are only translated
+	instances.Store4(instance, asuint(float4(1, 0, 0, object.pos.x)));
+	instances.Store4(instance + 16, asuint(float4(0, 1, 0, object.pos.y)));
+	instances.Store4(instance + 32, asuint(float4(0, 0, 1, object.pos.z)));
+	instances.Store4(instance + 48, asuint(float4(0, 0, 0, 1)));
+	instances.Store(instance + 64, object.material_slice);
+}
@@ -0,0 +1,119 @@
+// ------- fxaa
+// ldr (luma in alpha) -> backbuffer, see render/post.h
+// finds the direction of the edge through the pixel, walks along it to both ends and blends the pixel
+// with its neighbour across the edge depending on how close it is to an end
+// also stretches the image to the backbuffer, the edge is found around the source point of every pixel
+
+// t0 = tonemapped scene
+Texture2D<float4> source : register(t0);
+SamplerState linear_clamp : register(s0);
+
+cbuffer cbuffer0 : register(b0) {
+	float2 uv_scale; // target pixel -> source uv
+	float2 uv_max; // the source was only drawn up to here
+	float2 bloom_uv_max;
+	float exposure;
+	float bloom_intensity;
+	float bloom_threshold;
+	float bloom_knee;
+	uint prefilter;
+	uint bloom;
+}
+
+#define FXAA_EDGE_THRESHOLD 0.125 // of the local max luma
+#define FXAA_EDGE_THRESHOLD_MIN 0.0312 // dark areas are left alone
+#define FXAA_SEARCH_STEPS 8
+#define FXAA_SUBPIXEL 0.75
+
+static const float search_steps[FXAA_SEARCH_STEPS] = { 1, 1, 1, 1, 1.5, 2, 4, 8 };
+
+float4 vs(uint id : SV_VertexID) : SV_POSITION {
+	float2 uv = float2((id << 1) & 2, id & 2);
+	return float4(uv * float2(2, -2) + float2(-1, 1), 0, 1);
+}
+
+float luma(float2 uv) {
+	return source.SampleLevel(linear_clamp, uv, 0).a;
+}
+
+float4 ps(float4 pos : SV_POSITION) : SV_TARGET {
+	float width, height;
+	source.GetDimensions(width, height);
+	float2 texel = 1 / float2(width, height);
+	float2 uv = min(pos.xy * uv_scale, uv_max);
+
+	float4 center = source.SampleLevel(linear_clamp, uv, 0);
+	float luma_m = center.a;
+	float luma_n = source.SampleLevel(linear_clamp, uv, 0, int2( 0, -1)).a;
+	float luma_s = source.SampleLevel(linear_clamp, uv, 0, int2( 0,  1)).a;
+	float luma_w = source.SampleLevel(linear_clamp, uv, 0, int2(-1,  0)).a;
+	float luma_e = source.SampleLevel(linear_clamp, uv, 0, int2( 1,  0)).a;
+
+	float luma_min = min(luma_m, min(min(luma_n, luma_s), min(luma_w, luma_e)));
+	float luma_max = max(luma_m, max(max(luma_n, luma_s), max(luma_w, luma_e)));
+	float range = luma_max - luma_min;
+	if(range < max(FXAA_EDGE_THRESHOLD_MIN, luma_max * FXAA_EDGE_THRESHOLD)) return center;
+
+	float luma_nw = source.SampleLevel(linear_clamp, uv, 0, int2(-1, -1)).a;
+	float luma_ne = source.SampleLevel(linear_clamp, uv, 0, int2( 1, -1)).a;
+	float luma_sw = source.SampleLevel(linear_clamp, uv, 0, int2(-1,  1)).a;
+	float luma_se = source.SampleLevel(linear_clamp, uv, 0, int2( 1,  1)).a;
+
+	// horizontal edge : luma changes from top to bottom
+	float edge_horizontal = abs(luma_nw + luma_sw - 2 * luma_w) + 2 * abs(luma_n + luma_s - 2 * luma_m) + abs(luma_ne + luma_se - 2 * luma_e);
+	float edge_vertical = abs(luma_nw + luma_ne - 2 * luma_n) + 2 * abs(luma_w + luma_e - 2 * luma_m) + abs(luma_sw + luma_se - 2 * luma_s);
+	bool horizontal = edge_horizontal >= edge_vertical;
+
+	// which side of the pixel the edge is on
+	float luma_1 = horizontal ? luma_n : luma_w;
+	float luma_2 = horizontal ? luma_s : luma_e;
+	float gradient_1 = abs(luma_1 - luma_m);
+	float gradient_2 = abs(luma_2 - luma_m);
+	bool side_1 = gradient_1 >= gradient_2;
+
+	float step_length = horizontal ? texel.y : texel.x;
+	float luma_local = 0.5 * ((side_1 ? luma_1 : luma_2) + luma_m);
+	float gradient = 0.25 * max(gradient_1, gradient_2);
+	if(side_1) step_length = -step_length;
+
+	// walk along the edge, half a pixel towards it
+	float2 edge_uv = uv + (horizontal ? float2(0, step_length * 0.5) : float2(step_length * 0.5, 0));
+	float2 offset = horizontal ? float2(texel.x, 0) : float2(0, texel.y);
+	float2 uv_1 = edge_uv - offset;
+	float2 uv_2 = edge_uv + offset;
+	float end_1 = luma(uv_1) - luma_local;
+	float end_2 = luma(uv_2) - luma_local;
+	bool done_1 = abs(end_1) >= gradient;
+	bool done_2 = abs(end_2) >= gradient;
+
+	[loop] for(uint i = 0; i < FXAA_SEARCH_STEPS && !(done_1 && done_2); i++) {
+		if(!done_1) {
+			uv_1 -= offset * search_steps[i];
+			end_1 = luma(uv_1) - luma_local;
+			done_1 = abs(end_1) >= gradient;
+		}
+		if(!done_2) {
+			uv_2 += offset * search_steps[i];
+			end_2 = luma(uv_2) - luma_local;
+			done_2 = abs(end_2) >= gradient;
+		}
+	}
+
+	// closest end, only blend when the edge there goes the way this pixel does
+	float distance_1 = horizontal ? uv.x - uv_1.x : uv.y - uv_1.y;
+	float distance_2 = horizontal ? uv_2.x - uv.x : uv_2.y - uv.y;
+	bool closer_1 = distance_1 < distance_2;
+	float edge_length = distance_1 + distance_2;
+	float pixel_offset = 0.5 - min(distance_1, distance_2) / edge_length;
+	bool correct = ((closer_1 ? end_1 : end_2) < 0) != (luma_m < luma_local);
+	float final_offset = correct ? pixel_offset : 0;
+
+	// thin features the edge walk does not see
+	float luma_average = (2 * (luma_n + luma_s + luma_w + luma_e) + luma_nw + luma_ne + luma_sw + luma_se) / 12;
+	float subpixel = saturate(abs(luma_average - luma_m) / range);
+	subpixel = (-2 * subpixel + 3) * subpixel * subpixel;
+	final_offset = max(final_offset, subpixel * subpixel * FXAA_SUBPIXEL);
+
+	float2 final_uv = uv + (horizontal ? float2(0, final_offset * step_length) : float2(final_offset * step_length, 0));
+	return float4(source.SampleLevel(linear_clamp, final_uv, 0).rgb, 1);
+}
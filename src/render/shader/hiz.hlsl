@@ -0,0 +1,36 @@
+// ------- hi-z pyramid
+// one fullscreen triangle per mip, every texel keeps the farthest depth of the 2x2 texels above it
+// (see render/hiz.h). No vertex buffer is read, the triangle comes from the vertex id
+
+// t0 = the mip above (or the depth buffer for mip 0)
+Texture2D<float> source : register(t0);
+
+float4 vs(uint id : SV_VertexID) : SV_POSITION {
+	float2 uv = float2((id << 1) & 2, id & 2);
+	return float4(uv * float2(2, -2) + float2(-1, 1), 0, 1);
+}
+
+float ps(float4 pos : SV_POSITION) : SV_TARGET {
+	uint width, height;
+	source.GetDimensions(width, height);
+	
+	// out of bounds loads return 0, which never wins
+	int2 src = (int2)pos.xy * 2;
+	float depth = max(max(source.Load(int3(src, 0)), source.Load(int3(src + int2(1, 0), 0))),
+	                  max(source.Load(int3(src + int2(0, 1), 0)), source.Load(int3(src + int2(1, 1), 0))));
+	
+	// odd sizes : the last texel also covers the column / row nobody else does
+	bool extra_x = (width & 1) && (uint)src.x + 3 == width;
+	bool extra_y = (height & 1) && (uint)src.y + 3 == height;
+	if(extra_x) {
+		depth = max(depth, max(source.Load(int3(src + int2(2, 0), 0)), source.Load(int3(src + int2(2, 1), 0))));
+	}
+	if(extra_y) {
+		depth = max(depth, max(source.Load(int3(src + int2(0, 2), 0)), source.Load(int3(src + int2(1, 2), 0))));
+	}
+	if(extra_x && extra_y) {
+		depth = max(depth, source.Load(int3(src + int2(2, 2), 0)));
+	}
+	
+	return depth;
+}
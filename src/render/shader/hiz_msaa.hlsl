@@ -0,0 +1,43 @@
+// ------- hi-z pyramid, first mip from a multisampled depth buffer
+// same as hiz.hlsl for mip 0 when the scene has msaa, every sample of the 2x2 pixels is looked at
+
+// t0 = the depth buffer
+Texture2DMS<float> source : register(t0);
+
+float4 vs(uint id : SV_VertexID) : SV_POSITION {
+	float2 uv = float2((id << 1) & 2, id & 2);
+	return float4(uv * float2(2, -2) + float2(-1, 1), 0, 1);
+}
+
+float farthest(int2 pixel, uint samples) {
+	float depth = 0;
+	for(uint i = 0; i < samples; i++) {
+		depth = max(depth, source.Load(pixel, i));
+	}
+	return depth;
+}
+
+float ps(float4 pos : SV_POSITION) : SV_TARGET {
+	uint width, height, samples;
+	source.GetDimensions(width, height, samples);
+	
+	// out of bounds loads return 0, which never wins
+	int2 src = (int2)pos.xy * 2;
+	float depth = max(max(farthest(src, samples), farthest(src + int2(1, 0), samples)),
+	                  max(farthest(src + int2(0, 1), samples), farthest(src + int2(1, 1), samples)));
+	
+	// odd sizes : the last texel also covers the column / row nobody else does
+	bool extra_x = (width & 1) && (uint)src.x + 3 == width;
+	bool extra_y = (height & 1) && (uint)src.y + 3 == height;
+	if(extra_x) {
+		depth = max(depth, max(farthest(src + int2(2, 0), samples), farthest(src + int2(2, 1), samples)));
+	}
+	if(extra_y) {
+		depth = max(depth, max(farthest(src + int2(0, 2), samples), farthest(src + int2(1, 2), samples)));
+	}
+	if(extra_x && extra_y) {
+		depth = max(depth, farthest(src + int2(2, 2), samples));
+	}
+	
+	return depth;
+}
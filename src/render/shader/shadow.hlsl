@@ -0,0 +1,60 @@
+// ------- shadow casters
+// depth only, drawn into one cascade of the sun's shadow map (see render/shadows.h)
+// the pipeline has no pixel shader, ps is only there because every program has one
+// also the depth prepass of the scene : cbuffer0 is then the frame buffer, which starts with the camera matrix
+
+struct VS_INPUT {
+	float3 pos   : POSITION;
+    float2 uv    : TEXCOORD;
+    float4 color : COLOR;
+#if FEATURE_INSTANCED
+	float4 world0 : WORLD0;
+	float4 world1 : WORLD1;
+	float4 world2 : WORLD2;
+	float4 world3 : WORLD3;
+	uint material_slice : MATERIAL;
+#endif
+#if FEATURE_SKINNED
+	uint4 bone_indices  : BLENDINDICES;
+	float4 bone_weights : BLENDWEIGHT;
+#endif
+};
+
+cbuffer cbuffer0 : register(b0)	{
+	float4x4 cascade_view_projection;
+}
+
+cbuffer cbuffer1 : register(b1)	{
+	float4x4 world;
+}
+
+#if FEATURE_SKINNED
+cbuffer cbuffer2 : register(b2)	{
+	float4x4 bones[64]; // SHADER_MAX_BONES
+}
+#endif
+
+float4 vs(VS_INPUT input) : SV_POSITION {
+	// same operations as triangle.hlsl, precise so the prepass depth matches the scene exactly
+	precise float4 pos = float4(input.pos, 1);
+
+#if FEATURE_SKINNED
+	float4 skinned = 0;
+	[unroll] for(uint i = 0; i < 4; i++) {
+		skinned += mul(pos, bones[input.bone_indices[i]]) * input.bone_weights[i];
+	}
+	pos = float4(skinned.xyz, 1);
+#endif
+
+#if FEATURE_INSTANCED
+	pos = float4(dot(pos, input.world0), dot(pos, input.world1), dot(pos, input.world2), dot(pos, input.world3));
+#else
+	pos = mul(pos, world);
+#endif
+
+	precise float4 clip = mul(pos, cascade_view_projection);
+	return clip;
+}
+
+void ps() {
+}
@@ -0,0 +1,44 @@
+// ------- tone mapping
+// hdr scene + bloom -> ldr, see render/post.h
+// the luma goes in alpha for fxaa, so it does not have to compute it for every tap
+// when it is the last pass, it also stretches the scene to the backbuffer
+
+// t0 = the scene (resolved), t1 = the first bloom mip
+Texture2D<float3> scene : register(t0);
+Texture2D<float3> bloom_texture : register(t1);
+SamplerState linear_clamp : register(s0);
+
+cbuffer cbuffer0 : register(b0) {
+	float2 uv_scale; // target pixel -> source uv
+	float2 uv_max; // the source was only drawn up to here
+	float2 bloom_uv_max;
+	float exposure;
+	float bloom_intensity;
+	float bloom_threshold;
+	float bloom_knee;
+	uint prefilter;
+	uint bloom;
+}
+
+float4 vs(uint id : SV_VertexID) : SV_POSITION {
+	float2 uv = float2((id << 1) & 2, id & 2);
+	return float4(uv * float2(2, -2) + float2(-1, 1), 0, 1);
+}
+
+// fitted aces curve (Narkowicz)
+float3 aces(float3 color) {
+	return saturate((color * (2.51 * color + 0.03)) / (color * (2.43 * color + 0.59) + 0.14));
+}
+
+float4 ps(float4 pos : SV_POSITION) : SV_TARGET {
+	// the bloom mips line up with the scene, same uv
+	float2 uv = pos.xy * uv_scale;
+	float3 color = scene.SampleLevel(linear_clamp, min(uv, uv_max), 0);
+
+	if(bloom) {
+		color += bloom_texture.SampleLevel(linear_clamp, min(uv, bloom_uv_max), 0) * bloom_intensity;
+	}
+
+	color = aces(color * exposure);
+	return float4(color, dot(color, float3(0.299, 0.587, 0.114)));
+}
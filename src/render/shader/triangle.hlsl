@@ -1,13 +1,38 @@
+// ------- features
+// set by the permutation system (see render/shader.h), every combination is compiled offline
+// FEATURE_TEXTURED     : sample texture0
+// FEATURE_VERTEX_COLOR : multiply by the vertex color
+// FEATURE_INSTANCED    : world matrix & material come from the per instance stream (slot 1)
+// FEATURE_SKINNED      : 4 bones per vertex from the skin stream (slot 2)
+// FEATURE_VIRTUAL      : sample the virtual texture of the object (see render/virtual_texture.h)
+// FEATURE_LIT          : point lights from the cluster of the pixel (see render/lights.h) & the shadowed sun (see render/shadows.h)
+
 struct VS_INPUT {
 	float3 pos   : POSITION;		// these names must match D3D11_INPUT_ELEMENT_DESC array
     float2 uv    : TEXCOORD;
     float4 color : COLOR;
+#if FEATURE_INSTANCED
+	float4 world0 : WORLD0;
+	float4 world1 : WORLD1;
+	float4 world2 : WORLD2;
+	float4 world3 : WORLD3;
+	uint material_slice : MATERIAL;
+#endif
+#if FEATURE_SKINNED
+	uint4 bone_indices  : BLENDINDICES;
+	float4 bone_weights : BLENDWEIGHT;
+#endif
 };
 
 struct PS_INPUT {
 	float4 pos   : SV_POSITION; 	// these names do not matter, except SV_... ones
     float2 uv    : TEXCOORD;
     float4 color : COLOR;
+	nointerpolation uint slice : MATERIAL; // slice of texture0 to sample
+#if FEATURE_LIT
+	float3 world_pos : WORLDPOS;
+	float view_depth : VIEWDEPTH;
+#endif
 };
 
 
@@ -15,12 +40,36 @@ struct PS_INPUT {
 // b0 = constant buffer bound to slot 0 
 cbuffer cbuffer0 : register(b0)	{
 	float4x4 view_projection;
+	float4x4 view;
+	float3 camera_pos; // world space
+	float cluster_depth_scale; // view depth -> slice, see cluster_index
+	float2 cluster_tile_scale; // pixel -> screen tile
+	float cluster_depth_bias;
+	uint light_count;
+	float3 ambient;
+	float4x4 shadow_matrices[4]; // SHADOW_CASCADES, world -> cascade
+	float4 cascade_splits; // view depth where each cascade ends
+	float3 sun_direction; // where the light goes
+	float shadow_texel;
+	float3 sun_color;
 }
 
 // ------- object buffer
 cbuffer cbuffer1 : register(b1)	{
 	float4x4 world;
+	uint material_slice; // ignored when instanced
+	uint vt_id;
+	uint vt_tiles; // tiles per side at mip 0
+	uint vt_mips;
+	float2 vt_uv_scale; // source image uvs -> padded virtual texture uvs
+}
+
+// ------- bones buffer
+#if FEATURE_SKINNED
+cbuffer cbuffer2 : register(b2)	{
+	float4x4 bones[64]; // SHADER_MAX_BONES
 }
+#endif
 
 // ------- View matrix buffer
 
@@ -28,13 +77,161 @@ cbuffer cbuffer1 : register(b1)	{
 sampler sampler0 : register(s0);	
 
 // t0 = shader resource bound to slot 0
-Texture2D<float4> texture0 : register(t0); 
+// every texture of the same size lives in the same array, the material picks the slice
+Texture2DArray<float4> texture0 : register(t0); 
+
+#if FEATURE_VIRTUAL
+// must match render/virtual_texture.h
+#define VT_TILE_SIZE 128
+#define VT_TILE_BORDER 4
+#define VT_TILE_PADDED 136
+#define VT_CACHE_SIZE 2176
+
+// t1 = indirection, one texel per tile : r,g = page in the cache, b = mip of the tile that page holds
+// t2 = page cache, every resident tile of every virtual texture
+Texture2D<uint4> vt_indirection : register(t1);
+Texture2D<float4> vt_cache : register(t2);
+
+float4 vt_sample(float2 uv) {
+	uv = saturate(uv * vt_uv_scale);
+	
+	// same mip as the feedback pass asks for
+	float2 texel = uv * (vt_tiles * VT_TILE_SIZE);
+	float2 dx = ddx(texel);
+	float2 dy = ddy(texel);
+	float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy)));
+	uint mip = (uint)clamp(floor(lod), 0.0, (float)(vt_mips - 1));
+	
+	uint tiles = vt_tiles >> mip;
+	uint2 tile = min((uint2)(uv * tiles), tiles - 1);
+	
+	// the page can hold a coarser tile than the one asked for (still streaming)
+	uint4 entry = vt_indirection.Load(int3(tile, mip));
+	float page_tiles = (float)(vt_tiles >> entry.b);
+	float2 in_tile = uv * page_tiles - min(floor(uv * page_tiles), page_tiles - 1);
+	
+	float2 cache_texel = entry.rg * VT_TILE_PADDED + VT_TILE_BORDER + in_tile * VT_TILE_SIZE;
+	return vt_cache.SampleLevel(sampler0, cache_texel / VT_CACHE_SIZE, 0);
+}
+#endif
+
+#if FEATURE_LIT
+// must match render/lights.h
+#define CLUSTER_TILES_X 16
+#define CLUSTER_TILES_Y 9
+#define CLUSTER_SLICES 24
+#define CLUSTER_NEAR 1.0
+
+struct light_source {
+	float3 pos;
+	float intensity;
+	float3 color;
+	float radius;
+};
+
+// t3 = every light of the frame
+// t4 = per cluster : first index in t5 & light count
+// t5 = light lists of the clusters, back to back
+StructuredBuffer<light_source> lights : register(t3);
+Buffer<uint2> clusters : register(t4);
+Buffer<uint> cluster_lights : register(t5);
+
+// t6 = one depth map per cascade, s1 = depth comparison
+#define SHADOW_CASCADES 4
+Texture2DArray<float> shadow_map : register(t6);
+SamplerComparisonState shadow_sampler : register(s1);
+
+// 0 = in the shadow, 1 = lit
+float sun_shadow(float3 world_pos, float view_depth) {
+	if(view_depth > cascade_splits[SHADOW_CASCADES - 1]) return 1;
+	
+	uint cascade = 0;
+	[unroll] for(uint i = 0; i < SHADOW_CASCADES - 1; i++) {
+		cascade += view_depth > cascade_splits[i] ? 1 : 0;
+	}
+	
+	float4 pos = mul(float4(world_pos, 1), shadow_matrices[cascade]);
+	float2 uv = float2(pos.x * 0.5 + 0.5, 0.5 - pos.y * 0.5);
+	
+	// 3x3 taps on top of the 2x2 of the comparison sampler
+	float lit = 0;
+	[unroll] for(int y = -1; y <= 1; y++) {
+		[unroll] for(int x = -1; x <= 1; x++) {
+			lit += shadow_map.SampleCmpLevelZero(shadow_sampler, float3(uv + float2(x, y) * shadow_texel, cascade), saturate(pos.z));
+		}
+	}
+	return lit / 9;
+}
+
+uint cluster_index(float2 pixel, float view_depth) {
+	uint2 tile = min((uint2)(pixel * cluster_tile_scale), uint2(CLUSTER_TILES_X - 1, CLUSTER_TILES_Y - 1));
+	
+	// the first slice goes from the camera to CLUSTER_NEAR, the others grow exponentially
+	uint slice = 0;
+	if(view_depth >= CLUSTER_NEAR) {
+		slice = min((uint)(log2(view_depth) * cluster_depth_scale + cluster_depth_bias) + 1, CLUSTER_SLICES - 1);
+	}
+	
+	return (slice * CLUSTER_TILES_Y + tile.y) * CLUSTER_TILES_X + tile.x;
+}
+
+float3 light_pixel(PS_INPUT input) {
+	// no normals in the vertex format yet, the face normal comes from the derivatives
+	float3 normal = normalize(cross(ddx(input.world_pos), ddy(input.world_pos)));
+	if(dot(normal, camera_pos - input.world_pos) < 0) normal = -normal;
+	
+	float sun = saturate(dot(normal, -sun_direction));
+	float3 total = ambient;
+	if(sun > 0) total += sun_color * (sun * sun_shadow(input.world_pos, input.view_depth));
+	if(light_count == 0) return total;
+	
+	uint2 cluster = clusters[cluster_index(input.pos.xy, input.view_depth)];
+	for(uint i = 0; i < cluster.y; i++) {
+		light_source light = lights[cluster_lights[cluster.x + i]];
+		
+		float3 to_light = light.pos - input.world_pos;
+		float distance_sq = dot(to_light, to_light);
+		float falloff = saturate(1 - distance_sq / (light.radius * light.radius));
+		float diffuse = saturate(dot(normal, to_light * rsqrt(max(distance_sq, 1e-6))));
+		
+		total += light.color * (light.intensity * falloff * falloff * diffuse);
+	}
+	
+	return total;
+}
+#endif
 
 PS_INPUT vs(VS_INPUT input) {
 	PS_INPUT output;
 	
+	// same operations as the depth prepass (shadow.hlsl), precise so both land on the exact same depth
+	precise float4 pos = float4(input.pos, 1);
+	
+#if FEATURE_SKINNED
+	float4 skinned = 0;
+	[unroll] for(uint i = 0; i < 4; i++) {
+		skinned += mul(pos, bones[input.bone_indices[i]]) * input.bone_weights[i];
+	}
+	pos = float4(skinned.xyz, 1);
+#endif
+
+#if FEATURE_INSTANCED
+	// rows are laid out like raylib's Matrix (m0 m4 m8 m12...)
+	pos = float4(dot(pos, input.world0), dot(pos, input.world1), dot(pos, input.world2), dot(pos, input.world3));
+	output.slice = input.material_slice;
+#else
+	pos = mul(pos, world);
+	output.slice = material_slice;
+#endif
+	
+#if FEATURE_LIT
+	output.world_pos = pos.xyz;
+	output.view_depth = -mul(pos, view).z; // the camera looks down -z
+#endif
+	
 	// rotation + pos transform
-    output.pos = mul(float4(input.pos, 1), view_projection);
+	precise float4 clip = mul(pos, view_projection);
+    output.pos = clip;
 	
 	output.uv = input.uv;
     output.color = input.color;
@@ -42,6 +239,23 @@ PS_INPUT vs(VS_INPUT input) {
 }
 
 float4 ps(PS_INPUT input) : SV_TARGET {
-	float4 tex = texture0.Sample(sampler0, input.uv);
-    return input.color * tex;
-}   
\ No newline at end of file
+	float4 color = float4(1, 1, 1, 1);
+	
+#if FEATURE_TEXTURED
+	color *= texture0.Sample(sampler0, float3(input.uv, input.slice));
+#endif
+
+#if FEATURE_VIRTUAL
+	color *= vt_sample(input.uv);
+#endif
+
+#if FEATURE_VERTEX_COLOR
+	color *= input.color;
+#endif
+
+#if FEATURE_LIT
+	color.rgb *= light_pixel(input);
+#endif
+
+    return color;
+}
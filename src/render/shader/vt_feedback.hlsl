@@ -0,0 +1,90 @@
+// ------- virtual texture feedback
+// the meshes using a virtual texture are drawn again in a small R32_UINT target, every pixel writes
+// the tile and the mip it samples. The cpu reads it back a few frames later (see render/virtual_texture.h)
+// the vertex side is the same as triangle.hlsl, every feature permutation is compiled for it too
+
+struct VS_INPUT {
+	float3 pos   : POSITION;
+    float2 uv    : TEXCOORD;
+    float4 color : COLOR;
+#if FEATURE_INSTANCED
+	float4 world0 : WORLD0;
+	float4 world1 : WORLD1;
+	float4 world2 : WORLD2;
+	float4 world3 : WORLD3;
+	uint material_slice : MATERIAL;
+#endif
+#if FEATURE_SKINNED
+	uint4 bone_indices  : BLENDINDICES;
+	float4 bone_weights : BLENDWEIGHT;
+#endif
+};
+
+struct PS_INPUT {
+	float4 pos : SV_POSITION;
+    float2 uv  : TEXCOORD;
+};
+
+cbuffer cbuffer0 : register(b0)	{
+	float4x4 view_projection;
+}
+
+cbuffer cbuffer1 : register(b1)	{
+	float4x4 world;
+	uint material_slice;
+	uint vt_id;
+	uint vt_tiles; // tiles per side at mip 0
+	uint vt_mips;
+	float2 vt_uv_scale;
+}
+
+#if FEATURE_SKINNED
+cbuffer cbuffer2 : register(b2)	{
+	float4x4 bones[64]; // SHADER_MAX_BONES
+}
+#endif
+
+// must match render/virtual_texture.h
+#define VT_TILE_SIZE 128
+#define VT_FEEDBACK_DIVISOR 8
+#define VT_FEEDBACK_VALID 0x80000000
+
+PS_INPUT vs(VS_INPUT input) {
+	PS_INPUT output;
+
+	float4 pos = float4(input.pos, 1);
+
+#if FEATURE_SKINNED
+	float4 skinned = 0;
+	[unroll] for(uint i = 0; i < 4; i++) {
+		skinned += mul(pos, bones[input.bone_indices[i]]) * input.bone_weights[i];
+	}
+	pos = float4(skinned.xyz, 1);
+#endif
+
+#if FEATURE_INSTANCED
+	pos = float4(dot(pos, input.world0), dot(pos, input.world1), dot(pos, input.world2), dot(pos, input.world3));
+#else
+	pos = mul(pos, world);
+#endif
+
+    output.pos = mul(pos, view_projection);
+	output.uv = input.uv;
+    return output;
+}
+
+uint ps(PS_INPUT input) : SV_TARGET {
+	float2 uv = saturate(input.uv * vt_uv_scale);
+
+	// the target is smaller than the screen, so are the derivatives : scale them back
+	float2 texel = uv * (vt_tiles * VT_TILE_SIZE);
+	float2 dx = ddx(texel) / VT_FEEDBACK_DIVISOR;
+	float2 dy = ddy(texel) / VT_FEEDBACK_DIVISOR;
+	float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy)));
+	uint mip = (uint)clamp(floor(lod), 0.0, (float)(vt_mips - 1));
+
+	uint tiles = vt_tiles >> mip;
+	uint2 tile = min((uint2)(uv * tiles), tiles - 1);
+
+	return VT_FEEDBACK_VALID | (vt_id << 28) | (mip << 24) | (tile.y << 12) | tile.x;
+}
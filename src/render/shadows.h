@@ -0,0 +1,242 @@
+/*  ----------------------------------- SHADOWS
+	This header file contains the cascaded shadow maps of the sun (one directional light).
+
+	The view frustum is split in SHADOW_CASCADES pieces, each one gets its own orthographic depth map
+	in a slice of a texture array. Cascades are bounding spheres of their frustum piece, their size
+	does not change when the camera turns and their center is snapped to whole texels (no shimmering).
+
+	Re-drawing every caster in every cascade each frame is what makes shadows expensive, so the static
+	casters are drawn into a second array (the cache) and only again when their cascade moved, the sun
+	moved or the static casters themselves changed. Every frame the cached depth is copied into the array
+	the shaders sample and only the dynamic casters are drawn on top of it. To keep cascades from moving
+	every time the center crosses a texel, the center is snapped to a coarser grid
+	(SHADOW_CACHE_MARGIN texels) and the cascade is made that much bigger.
+
+*/
+
+#ifndef _SHADOWSH_
+#define _SHADOWSH_
+
+#include <d3d11.h>
+
+#define SHADOW_CASCADES 4 // float4 of splits in the shaders
+#define SHADOW_MAP_SIZE 1024
+#define SHADOW_CACHE_MARGIN 64 // texels on each side, the cascade center moves this much before static casters are drawn again
+#define SHADOW_DISTANCE 150.0f // view units, nothing is shadowed past this
+#define SHADOW_SPLIT_NEAR 1.0f // CLUSTER_NEAR
+#define SHADOW_SPLIT_LAMBDA 0.8f // 0 = linear splits, 1 = logarithmic splits
+#define SHADOW_MAX_CASTERS 4096 // per cascade and per frame
+
+// ------------------------------- structs
+
+struct shadow_cascade {
+	mx view_projection; // world -> shadow map, depth in [0, 1]
+	cull_frustum frustum; // no near plane, casters between the sun and the cascade still cast
+	f32 split_far; // view depth where the next cascade takes over
+
+	// cache state
+	ui64 static_hash; // static casters + matrix the cache was drawn with
+	bool cache_valid;
+	bool live_has_dynamic; // the live slice is not a plain copy of the cache
+
+	ID3D11Buffer* buffer; // cbuffer0 of shadow.hlsl
+	ID3D11DepthStencilView* live_view;
+	ID3D11DepthStencilView* cache_view;
+};
+
+struct shadow_system {
+	shadow_cascade cascades[SHADOW_CASCADES];
+
+	// the array the scene samples & the one holding static casters only
+	ID3D11Texture2D* live;
+	ID3D11Texture2D* cache;
+	ID3D11ShaderResourceView* live_view;
+	ID3D11SamplerState* sampler; // comparison sampler, outside the map = lit
+
+	ui64 static_version; // bumped when static casters change without moving (edited vertices...)
+	ui32* casters; // scratch, indices of the meshes drawn in a cascade
+
+	// stats, for the last frame
+	ui32 static_redraws; // cascades whose cache was drawn again
+	ui32 cached; // cascades that did not need any draw nor copy
+	ui32 caster_draws;
+};
+
+// ------------------------------- functions
+
+HRESULT shadows_init(shadow_system* shadows, ID3D11Device* device) {
+	HRESULT hr;
+	memset(shadows, 0, sizeof(shadow_system));
+
+	shadows->casters = (ui32*)VirtualAlloc(0, sizeof(ui32) * SHADOW_MAX_CASTERS, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+	// typeless so it can be a depth target & a texture
+	D3D11_TEXTURE2D_DESC desc =
+	{
+		.Width = SHADOW_MAP_SIZE,
+		.Height = SHADOW_MAP_SIZE,
+		.MipLevels = 1,
+		.ArraySize = SHADOW_CASCADES,
+		.Format = DXGI_FORMAT_R32_TYPELESS,
+		.SampleDesc = { 1, 0 },
+		.Usage = D3D11_USAGE_DEFAULT,
+		.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE,
+	};
+	hr = device->CreateTexture2D(&desc, NULL, &shadows->live);
+	if(FAILED(hr)) return hr;
+
+	desc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
+	hr = device->CreateTexture2D(&desc, NULL, &shadows->cache);
+	if(FAILED(hr)) return hr;
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC view = {};
+	view.Format = DXGI_FORMAT_R32_FLOAT;
+	view.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+	view.Texture2DArray.MipLevels = 1;
+	view.Texture2DArray.ArraySize = SHADOW_CASCADES;
+	hr = device->CreateShaderResourceView((ID3D11Resource*)shadows->live, &view, &shadows->live_view);
+	if(FAILED(hr)) return hr;
+
+	// one depth view per slice
+	D3D11_DEPTH_STENCIL_VIEW_DESC depth = {};
+	depth.Format = DXGI_FORMAT_D32_FLOAT;
+	depth.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2DARRAY;
+	depth.Texture2DArray.ArraySize = 1;
+
+	D3D11_BUFFER_DESC buffer =
+	{
+		.ByteWidth = sizeof(mx),
+		.Usage = D3D11_USAGE_DYNAMIC,
+		.BindFlags = D3D11_BIND_CONSTANT_BUFFER,
+		.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE,
+	};
+
+	for(ui32 i = 0; i < SHADOW_CASCADES; i++) {
+		shadow_cascade* cascade = &shadows->cascades[i];
+		depth.Texture2DArray.FirstArraySlice = i;
+
+		hr = device->CreateDepthStencilView((ID3D11Resource*)shadows->live, &depth, &cascade->live_view);
+		if(FAILED(hr)) return hr;
+		hr = device->CreateDepthStencilView((ID3D11Resource*)shadows->cache, &depth, &cascade->cache_view);
+		if(FAILED(hr)) return hr;
+		hr = device->CreateBuffer(&buffer, NULL, &cascade->buffer);
+		if(FAILED(hr)) return hr;
+	};
+
+	// 2x2 pcf in hardware, depth <= map = lit
+	D3D11_SAMPLER_DESC sampler =
+	{
+		.Filter = D3D11_FILTER_COMPARISON_MIN_MAG_LINEAR_MIP_POINT,
+		.AddressU = D3D11_TEXTURE_ADDRESS_BORDER,
+		.AddressV = D3D11_TEXTURE_ADDRESS_BORDER,
+		.AddressW = D3D11_TEXTURE_ADDRESS_BORDER,
+		.MaxAnisotropy = 1,
+		.ComparisonFunc = D3D11_COMPARISON_LESS_EQUAL,
+		.BorderColor = { 1, 1, 1, 1 },
+		.MaxLOD = D3D11_FLOAT32_MAX,
+	};
+	hr = device->CreateSamplerState(&sampler, &shadows->sampler);
+
+	return hr;
+};
+
+/*
+	Cascade matrices for a camera. view is the world -> view matrix (any uniform scale), projection its perspective,
+	sun the direction the light travels in, in world space.
+	Each cascade is the smallest sphere around its piece of the frustum : it only depends on the split distances
+	and the field of view, so its radius stays the same however the camera moves.
+*/
+void shadows_update(shadow_system* shadows, ID3D11DeviceContext* context, mx* view, mx* projection, v3 sun) {
+	f32 view_scale = Vector3Length({ view->m0, view->m1, view->m2 });
+	mx inverse_view = MatrixInvert(*view);
+
+	// tan of the half angles squared, summed : how far the corners are from the axis per unit of depth
+	f32 tan_x = 1.0f / projection->m0;
+	f32 tan_y = 1.0f / projection->m5;
+	f32 corner = tan_x * tan_x + tan_y * tan_y;
+
+	v3 up = fabsf(sun.y) > 0.99f ? v3{ 0, 0, 1 } : v3{ 0, 1, 0 };
+	mx light_rotation = MatrixLookAt({ 0, 0, 0 }, sun, up);
+
+	f32 split_near = 0.0f;
+	for(ui32 i = 0; i < SHADOW_CASCADES; i++) {
+		shadow_cascade* cascade = &shadows->cascades[i];
+
+		// practical split scheme, a blend of linear & logarithmic
+		f32 t = (f32)(i + 1) / SHADOW_CASCADES;
+		f32 split_log = SHADOW_SPLIT_NEAR * powf(SHADOW_DISTANCE / SHADOW_SPLIT_NEAR, t);
+		f32 split_linear = SHADOW_SPLIT_NEAR + (SHADOW_DISTANCE - SHADOW_SPLIT_NEAR) * t;
+		f32 split_far = SHADOW_SPLIT_LAMBDA * split_log + (1.0f - SHADOW_SPLIT_LAMBDA) * split_linear;
+		cascade->split_far = split_far;
+
+		// center on the view axis where the near & far corners are as far away, or the far plane if that is past it
+		f32 center_depth = fminf((split_near + split_far) * (1.0f + corner) * 0.5f, split_far);
+		f32 radius = sqrtf(split_far * split_far * corner + (split_far - center_depth) * (split_far - center_depth));
+		split_near = split_far;
+
+		v3 center = Vector3Transform({ 0, 0, -center_depth }, inverse_view);
+		radius /= view_scale;
+
+		// radius in 1/8 octave steps so float noise in the view matrix does not resize the cascade
+		radius = exp2f(ceilf(log2f(radius) * 8.0f) / 8.0f);
+
+		// room for the coarse snapping, a multiple of the texel size so texels stay where they are
+		f32 extent = radius * SHADOW_MAP_SIZE / (SHADOW_MAP_SIZE - 2 * SHADOW_CACHE_MARGIN);
+		f32 texel = 2.0f * extent / SHADOW_MAP_SIZE;
+		f32 step = 2.0f * SHADOW_CACHE_MARGIN * texel;
+
+		v3 light_center = Vector3Transform(center, light_rotation);
+		light_center.x = floorf(light_center.x / step + 0.5f) * step;
+		light_center.y = floorf(light_center.y / step + 0.5f) * step;
+		light_center.z = floorf(light_center.z / step + 0.5f) * step;
+
+		// the sun looks down -z, depth = (-z - z_near) / (z_far - z_near)
+		f32 z_near = -light_center.z - extent;
+		f32 z_far = -light_center.z + extent;
+		mx ortho = {};
+		ortho.m0 = 1.0f / extent;
+		ortho.m12 = -light_center.x / extent;
+		ortho.m5 = 1.0f / extent;
+		ortho.m13 = -light_center.y / extent;
+		ortho.m10 = -1.0f / (z_far - z_near);
+		ortho.m14 = -z_near / (z_far - z_near);
+		ortho.m15 = 1.0f;
+
+		mx view_projection = MatrixMultiply(light_rotation, ortho);
+		if(memcmp(&view_projection, &cascade->view_projection, sizeof(mx)) != 0) {
+			cascade->view_projection = view_projection;
+
+			D3D11_MAPPED_SUBRESOURCE mapped;
+			context->Map((ID3D11Resource*)cascade->buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+			memcpy(mapped.pData, &view_projection, sizeof(mx));
+			context->Unmap((ID3D11Resource*)cascade->buffer, 0);
+		};
+
+		// depth is clamped when drawing casters, the ones in front of the near plane land on it
+		cascade->frustum = cull_frustum_from_matrix(&cascade->view_projection);
+		cascade->frustum.plane_count = CULL_PLANE_NEAR;
+	};
+};
+
+// static casters changed in a way the cascades cannot see (same position, other vertices...)
+void shadows_invalidate(shadow_system* shadows) {
+	shadows->static_version++;
+};
+
+void shadows_release(shadow_system* shadows) {
+	for(ui32 i = 0; i < SHADOW_CASCADES; i++) {
+		shadow_cascade* cascade = &shadows->cascades[i];
+		if(cascade->live_view) cascade->live_view->Release();
+		if(cascade->cache_view) cascade->cache_view->Release();
+		if(cascade->buffer) cascade->buffer->Release();
+	};
+	if(shadows->live_view) shadows->live_view->Release();
+	if(shadows->live) shadows->live->Release();
+	if(shadows->cache) shadows->cache->Release();
+	if(shadows->sampler) shadows->sampler->Release();
+
+	VirtualFree(shadows->casters, 0, MEM_RELEASE);
+	memset(shadows, 0, sizeof(shadow_system));
+};
+
+#endif /* _SHADOWSH_ */
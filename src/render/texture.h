@@ -1,9 +1,18 @@
 // ------------------------------------ TEXTURES TRANSFORMATIONS
 
-internal v2 texture_convertTexposMinToNDC(rtpAtlasSprite sprite) {
-	return { sprite.positionX / 1024.f, sprite.positionY / 1024.f};
+// sprite placement inside an atlas page, same layout as rTexPacker's
+typedef struct rtpAtlasSprite {
+	const char *nameId;
+	int originX, originY;           // pivot, relative to the sprite
+	int positionX, positionY;       // top left corner in the page (padding excluded)
+	int sourceWidth, sourceHeight;
+	int padding;
+} rtpAtlasSprite;
+
+internal v2 texture_convertTexposMinToNDC(rtpAtlasSprite sprite, v2 page_size) {
+	return { sprite.positionX / page_size.x, sprite.positionY / page_size.y};
 };
 
-internal v2 texture_convertTexposMaxToNDC(rtpAtlasSprite sprite) {
-	return { (sprite.positionX + sprite.sourceWidth) / 1024.f, (sprite.positionY + sprite.sourceHeight) / 1024.f};
+internal v2 texture_convertTexposMaxToNDC(rtpAtlasSprite sprite, v2 page_size) {
+	return { (sprite.positionX + sprite.sourceWidth) / page_size.x, (sprite.positionY + sprite.sourceHeight) / page_size.y};
 };
\ No newline at end of file
@@ -0,0 +1,417 @@
+/*  ----------------------------------- TEXTURE TABLE
+	This header file contains the texture table, every texture the renderer knows about.
+
+	D3D11 has no descriptor tables and shader model 5.0 cannot index an array of textures with a
+	runtime value, so the table is made of texture arrays instead : one bucket per texture size, each
+	bucket being a single Texture2DArray. A texture is identified by its material id, which gives the
+	bucket and the slice. Draws only need a new SRV bind when they switch bucket, the slice travels
+	with the draw (object buffer) or the instance (instance stream).
+
+	Pixels get in through staging textures : an upload maps one, the cpu writes the top mip there
+	(decoders can write into it directly) and it is copied into the slice once done.
+
+*/
+
+#ifndef _TEXTURETABLEH_
+#define _TEXTURETABLEH_
+
+#include <d3d11.h>
+
+#define TEXTURE_TABLE_MAX_TEXTURES 256
+#define TEXTURE_TABLE_MAX_BUCKETS 8
+#define TEXTURE_BUCKET_INITIAL_SLICES 8
+#define TEXTURE_INVALID 0xffffffff
+#define TEXTURE_TABLE_MAX_STAGING 16 // uploads in flight at once
+
+// ------------------------------- structs
+
+struct texture_bucket {
+	ui32 width;
+	ui32 height;
+	ui32 mip_levels;
+
+	ID3D11Texture2D* array;
+	ID3D11ShaderResourceView* view;
+	ui32 slice_capacity;
+	ui32 slice_count;
+
+	// slices given back when a texture moves to another bucket
+	ui32 free_slices[TEXTURE_TABLE_MAX_TEXTURES];
+	ui32 free_count;
+};
+
+struct texture_entry {
+	ui32 bucket;
+	ui32 slice;
+	char path[MAX_PATH];
+};
+
+// cpu writable copy of a top mip, kept around and reused by the next upload of the same size
+struct texture_staging {
+	ID3D11Texture2D* texture;
+	ui32 width;
+	ui32 height;
+	bool busy;
+};
+
+// one texture being written by the cpu, between texture_table_begin_* and texture_table_end_upload
+struct texture_upload {
+	ui32 material; // TEXTURE_INVALID for a new texture
+	ui32 bucket;
+	ui32 slice;
+	ui32 staging;
+
+	void* memory; // mapped, rgba rows
+	ui32 row_pitch;
+};
+
+struct texture_table {
+	texture_bucket buckets[TEXTURE_TABLE_MAX_BUCKETS];
+	ui32 bucket_count;
+
+	texture_entry entries[TEXTURE_TABLE_MAX_TEXTURES]; // indexed by material id
+	ui32 entry_count;
+
+	texture_staging staging[TEXTURE_TABLE_MAX_STAGING];
+
+	// a bucket got a new array (and view) since the last time the renderer looked
+	bool views_changed;
+};
+
+// ------------------------------- buckets
+
+internal ui32 texture_mip_count(ui32 width, ui32 height) {
+	ui32 levels = 1;
+	while(width > 1 || height > 1) {
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+		levels++;
+	};
+	return levels;
+};
+
+// (re)creates the array of a bucket with room for slice_capacity slices, the slices already there are kept
+internal HRESULT texture_bucket_grow(texture_bucket* bucket, ID3D11Device* device, ID3D11DeviceContext* context, ui32 slice_capacity) {
+	HRESULT hr;
+
+	D3D11_TEXTURE2D_DESC desc =
+	{
+		.Width = bucket->width,
+		.Height = bucket->height,
+		.MipLevels = bucket->mip_levels,
+		.ArraySize = slice_capacity,
+		.Format = DXGI_FORMAT_R8G8B8A8_UNORM,
+		.SampleDesc = { 1, 0 },
+		.Usage = D3D11_USAGE_DEFAULT,
+		.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET, // render target is needed by GenerateMips
+		.MiscFlags = D3D11_RESOURCE_MISC_GENERATE_MIPS,
+	};
+
+	ID3D11Texture2D* array;
+	hr = device->CreateTexture2D(&desc, NULL, &array);
+	if(FAILED(hr)) return hr;
+
+	ID3D11ShaderResourceView* view;
+	hr = device->CreateShaderResourceView((ID3D11Resource*)array, NULL, &view);
+	if(FAILED(hr)) {
+		array->Release();
+		return hr;
+	};
+
+	if(bucket->array) {
+		// copy every mip of every slice over, then drop the old array
+		for(ui32 slice = 0; slice < bucket->slice_count; slice++) {
+			for(ui32 mip = 0; mip < bucket->mip_levels; mip++) {
+				UINT dst = D3D11CalcSubresource(mip, slice, bucket->mip_levels);
+				UINT src = D3D11CalcSubresource(mip, slice, bucket->mip_levels);
+				context->CopySubresourceRegion(array, dst, 0, 0, 0, bucket->array, src, NULL);
+			};
+		};
+		bucket->view->Release();
+		bucket->array->Release();
+	};
+
+	bucket->array = array;
+	bucket->view = view;
+	bucket->slice_capacity = slice_capacity;
+
+	return S_OK;
+};
+
+internal ui32 texture_find_bucket(texture_table* table, ui32 width, ui32 height) {
+	for(ui32 i = 0; i < table->bucket_count; i++) {
+		if(table->buckets[i].width == width && table->buckets[i].height == height) {
+			return i;
+		};
+	};
+
+	if(table->bucket_count == TEXTURE_TABLE_MAX_BUCKETS) {
+		return TEXTURE_INVALID;
+	};
+
+	texture_bucket* bucket = &table->buckets[table->bucket_count];
+	bucket->width = width;
+	bucket->height = height;
+	bucket->mip_levels = texture_mip_count(width, height);
+	return table->bucket_count++;
+};
+
+internal ui32 texture_bucket_alloc_slice(texture_bucket* bucket, ID3D11Device* device, ID3D11DeviceContext* context) {
+	if(bucket->free_count) {
+		return bucket->free_slices[--bucket->free_count];
+	};
+
+	if(bucket->slice_count == bucket->slice_capacity) {
+		ui32 capacity = bucket->slice_capacity ? bucket->slice_capacity * 2 : TEXTURE_BUCKET_INITIAL_SLICES;
+		if(FAILED(texture_bucket_grow(bucket, device, context, capacity))) {
+			return TEXTURE_INVALID;
+		};
+	};
+
+	return bucket->slice_count++;
+};
+
+// copies the top mip of a slice from a staging texture and rebuilds the others
+internal void texture_bucket_upload(texture_bucket* bucket, ID3D11DeviceContext* context, ui32 slice, ID3D11Texture2D* staging) {
+	UINT subresource = D3D11CalcSubresource(0, slice, bucket->mip_levels);
+	context->CopySubresourceRegion(bucket->array, subresource, 0, 0, 0, staging, 0, NULL);
+
+	// GenerateMips works on the whole view, a slice only view keeps the other slices untouched
+	D3D11_SHADER_RESOURCE_VIEW_DESC desc = {};
+	desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	desc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+	desc.Texture2DArray.MostDetailedMip = 0;
+	desc.Texture2DArray.MipLevels = bucket->mip_levels;
+	desc.Texture2DArray.FirstArraySlice = slice;
+	desc.Texture2DArray.ArraySize = 1;
+
+	ID3D11Device* device;
+	context->GetDevice(&device);
+	ID3D11ShaderResourceView* view;
+	if(SUCCEEDED(device->CreateShaderResourceView((ID3D11Resource*)bucket->array, &desc, &view))) {
+		context->GenerateMips(view);
+		view->Release();
+	};
+	device->Release();
+};
+
+// ------------------------------- staging
+
+// a free staging texture of that size, reusing one if possible
+internal ui32 texture_staging_acquire(texture_table* table, ID3D11Device* device, ui32 width, ui32 height) {
+	ui32 slot = TEXTURE_INVALID;
+	for(ui32 i = 0; i < TEXTURE_TABLE_MAX_STAGING; i++) {
+		texture_staging* staging = &table->staging[i];
+		if(staging->busy) continue;
+
+		if(staging->texture && staging->width == width && staging->height == height) {
+			staging->busy = true;
+			return i;
+		};
+		// an empty slot is better than throwing away a texture of another size
+		if(slot == TEXTURE_INVALID || !staging->texture) slot = i;
+	};
+	if(slot == TEXTURE_INVALID) return TEXTURE_INVALID;
+
+	texture_staging* staging = &table->staging[slot];
+	if(staging->texture) staging->texture->Release();
+	staging->texture = NULL;
+
+	D3D11_TEXTURE2D_DESC desc =
+	{
+		.Width = width,
+		.Height = height,
+		.MipLevels = 1,
+		.ArraySize = 1,
+		.Format = DXGI_FORMAT_R8G8B8A8_UNORM,
+		.SampleDesc = { 1, 0 },
+		.Usage = D3D11_USAGE_STAGING,
+		.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE,
+	};
+	if(FAILED(device->CreateTexture2D(&desc, NULL, &staging->texture))) return TEXTURE_INVALID;
+
+	staging->width = width;
+	staging->height = height;
+	staging->busy = true;
+	return slot;
+};
+
+// maps a staging texture for the upload, waits if the gpu still copies from it
+internal bool texture_upload_map(texture_table* table, ID3D11Device* device, ID3D11DeviceContext* context, ui32 width, ui32 height, texture_upload* upload) {
+	upload->staging = texture_staging_acquire(table, device, width, height);
+	if(upload->staging == TEXTURE_INVALID) return false;
+
+	texture_staging* staging = &table->staging[upload->staging];
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if(FAILED(context->Map(staging->texture, 0, D3D11_MAP_WRITE, 0, &mapped))) {
+		staging->busy = false;
+		return false;
+	};
+
+	upload->memory = mapped.pData;
+	upload->row_pitch = mapped.RowPitch;
+	return true;
+};
+
+// ------------------------------- uploads
+
+// reserves a slice for a new texture and maps memory for its pixels (upload->memory, upload->row_pitch)
+bool texture_table_begin_add(texture_table* table, ID3D11Device* device, ID3D11DeviceContext* context, ui32 width, ui32 height, texture_upload* upload) {
+	memset(upload, 0, sizeof(texture_upload));
+	upload->material = TEXTURE_INVALID;
+	if(table->entry_count == TEXTURE_TABLE_MAX_TEXTURES) return false;
+
+	ui32 bucket_index = texture_find_bucket(table, width, height);
+	if(bucket_index == TEXTURE_INVALID) return false;
+
+	texture_bucket* bucket = &table->buckets[bucket_index];
+	ID3D11Texture2D* array = bucket->array;
+	ui32 slice = texture_bucket_alloc_slice(bucket, device, context);
+	if(slice == TEXTURE_INVALID) return false;
+	table->views_changed |= bucket->array != array;
+
+	upload->bucket = bucket_index;
+	upload->slice = slice;
+
+	if(!texture_upload_map(table, device, context, width, height, upload)) {
+		bucket->free_slices[bucket->free_count++] = slice;
+		return false;
+	};
+	return true;
+};
+
+// same for new content of a material (hot reload), it moves to another bucket if the size changed
+bool texture_table_begin_replace(texture_table* table, ID3D11Device* device, ID3D11DeviceContext* context, ui32 material, ui32 width, ui32 height, texture_upload* upload) {
+	Assert(material < table->entry_count);
+	memset(upload, 0, sizeof(texture_upload));
+	upload->material = material;
+
+	texture_entry* entry = &table->entries[material];
+	texture_bucket* bucket = &table->buckets[entry->bucket];
+	upload->bucket = entry->bucket;
+	upload->slice = entry->slice;
+
+	if(bucket->width != width || bucket->height != height) {
+		ui32 bucket_index = texture_find_bucket(table, width, height);
+		if(bucket_index == TEXTURE_INVALID) return false;
+
+		bucket = &table->buckets[bucket_index];
+		ID3D11Texture2D* array = bucket->array;
+		ui32 slice = texture_bucket_alloc_slice(bucket, device, context);
+		if(slice == TEXTURE_INVALID) return false;
+		table->views_changed |= bucket->array != array;
+
+		upload->bucket = bucket_index;
+		upload->slice = slice;
+	};
+
+	if(!texture_upload_map(table, device, context, width, height, upload)) {
+		if(upload->slice != entry->slice || upload->bucket != entry->bucket) {
+			bucket->free_slices[bucket->free_count++] = upload->slice;
+		};
+		return false;
+	};
+	return true;
+};
+
+/*
+	Sends what the cpu wrote to the gpu. ok = false drops the upload (the decode failed...), a replaced
+	texture keeps its old content then.
+	Returns the material id, TEXTURE_INVALID when dropped. path names new textures.
+*/
+ui32 texture_table_end_upload(texture_table* table, ID3D11DeviceContext* context, texture_upload* upload, char* path, bool ok) {
+	texture_staging* staging = &table->staging[upload->staging];
+	texture_bucket* bucket = &table->buckets[upload->bucket];
+	context->Unmap(staging->texture, 0);
+
+	ui32 material = upload->material;
+	if(ok && material == TEXTURE_INVALID && table->entry_count == TEXTURE_TABLE_MAX_TEXTURES) ok = false;
+
+	texture_entry* entry = material != TEXTURE_INVALID ? &table->entries[material] : NULL;
+	bool new_slice = !entry || entry->bucket != upload->bucket || entry->slice != upload->slice;
+
+	if(!ok) {
+		if(new_slice) bucket->free_slices[bucket->free_count++] = upload->slice;
+		staging->busy = false;
+		return TEXTURE_INVALID;
+	};
+
+	if(!entry) {
+		material = table->entry_count++;
+		entry = &table->entries[material];
+		strncpy(entry->path, path, MAX_PATH - 1);
+	} else if(new_slice) {
+		// moved to another bucket, give the old slice back
+		texture_bucket* old_bucket = &table->buckets[entry->bucket];
+		old_bucket->free_slices[old_bucket->free_count++] = entry->slice;
+	};
+	entry->bucket = upload->bucket;
+	entry->slice = upload->slice;
+
+	texture_bucket_upload(bucket, context, upload->slice, staging->texture);
+	staging->busy = false;
+	return material;
+};
+
+// ------------------------------- table
+
+internal void texture_copy_rows(texture_upload* upload, complete_img* img) {
+	for(ui32 row = 0; row < img->y; row++) {
+		memcpy((ui8*)upload->memory + (size_t)row * upload->row_pitch, (ui8*)img->memory + (size_t)row * img->x * 4, img->x * 4);
+	};
+};
+
+// returns the material id of a decoded image (always rgba), TEXTURE_INVALID if the table is full
+ui32 texture_table_add(texture_table* table, ID3D11Device* device, ID3D11DeviceContext* context, complete_img* img, char* path) {
+	texture_upload upload;
+	if(!texture_table_begin_add(table, device, context, img->x, img->y, &upload)) return TEXTURE_INVALID;
+
+	texture_copy_rows(&upload, img);
+	return texture_table_end_upload(table, context, &upload, path, true);
+};
+
+// replaces the content of a material in place (hot reload), moving it to another bucket if the size changed
+bool texture_table_replace(texture_table* table, ID3D11Device* device, ID3D11DeviceContext* context, ui32 material, complete_img* img) {
+	texture_upload upload;
+	if(!texture_table_begin_replace(table, device, context, material, img->x, img->y, &upload)) return false;
+
+	texture_copy_rows(&upload, img);
+	return texture_table_end_upload(table, context, &upload, NULL, true) != TEXTURE_INVALID;
+};
+
+ui32 texture_table_find(texture_table* table, char* path) {
+	for(ui32 i = 0; i < table->entry_count; i++) {
+		if(_stricmp(table->entries[i].path, path) == 0) return i;
+	};
+	return TEXTURE_INVALID;
+};
+
+ID3D11ShaderResourceView* texture_table_view(texture_table* table, ui32 material) {
+	Assert(material < table->entry_count);
+	return table->buckets[table->entries[material].bucket].view;
+};
+
+// materials in the same bucket share a view
+ui32 texture_table_bucket(texture_table* table, ui32 material) {
+	Assert(material < table->entry_count);
+	return table->entries[material].bucket;
+};
+
+ui32 texture_table_slice(texture_table* table, ui32 material) {
+	Assert(material < table->entry_count);
+	return table->entries[material].slice;
+};
+
+void texture_table_release(texture_table* table) {
+	for(ui32 i = 0; i < table->bucket_count; i++) {
+		texture_bucket* bucket = &table->buckets[i];
+		if(bucket->view) bucket->view->Release();
+		if(bucket->array) bucket->array->Release();
+	};
+	for(ui32 i = 0; i < TEXTURE_TABLE_MAX_STAGING; i++) {
+		if(table->staging[i].texture) table->staging[i].texture->Release();
+	};
+	memset(table, 0, sizeof(texture_table));
+};
+
+#endif /* _TEXTURETABLEH_ */
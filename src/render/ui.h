@@ -6,12 +6,79 @@
 #ifndef _UIH_
 #define _UIH_
 
+#define UI_PANEL_MARGIN 16.0f // a cached panel is rebuilt once the mouse is this close, so it is live before the cursor gets in
+#define UI_TELEMETRY_FRAMES 16384
 
 // ----------------------- STATES
+
+// what the last frame of ui looked like on the gpu, so an unchanged frame costs a hash and the draws
+struct ui_draw_cache {
+	ui64 hash; // vertices, indices and commands of every list
+	ring_alloc vertices;
+	ring_alloc indices;
+	ImVec2 display_pos; // projection currently in the constant buffer
+	ImVec2 display_size;
+	const pipeline_state* pipeline;
+	
+	ui32 uploads; // stats
+	ui32 uploads_skipped;
+};
+
+/*
+	A panel keeps the draw list of the last time it was built. As long as the values it shows hash the same
+	and nobody interacts with it, the window is not submitted to imgui at all and the copy is drawn instead.
+	Cached panels are drawn over regular windows and must not have child windows (scrolling regions,
+	tables with ScrollX/ScrollY) since those live in their own draw lists.
+*/
+struct ui_panel {
+	const char* name;
+	ui64 values_hash; // what the cached draw list was built from
+	ImDrawList* cached; // NULL until the first build
+	ImVec2 pos; // last rect on screen
+	ImVec2 size;
+	ImVec2 display_size; // clip rects are only valid for the display they were built on
+	bool building; // submitted to imgui this frame
+	
+	ui32 builds; // stats
+	ui32 reuses;
+};
+
+struct ui_frame_stats {
+	ui64 frame;
+	f32 frame_ms;
+	ui32 binds_issued;
+	ui32 binds_filtered;
+	ui32 pipelines;
+	ui32 vt_uploads; // virtual texture tiles streamed in
+	ui32 vt_missing; // tiles the feedback asked for that were not there yet
+	ui32 lights_visible; // lights binned into at least one cluster
+	ui32 light_indices; // entries of every cluster light list
+	ui32 shadow_casters; // draws into the shadow cascades (static redraws + dynamic casters)
+	ui32 shadow_cached; // cascades that came straight from the cache
+	ui32 hiz_tested; // meshes in the frustum tested against the hi-z readback
+	ui32 hiz_occluded; // of those, the ones that were hidden
+	ui32 sw_tested; // meshes in the frustum tested against the occluders of the frame
+	ui32 sw_occluded;
+	ui32 ui_uploads; // since the start, frames whose ui went through the rings again
+	ui32 ui_uploads_skipped;
+	f32 gpu_wait_ms; // the cpu got FRAMES_IN_FLIGHT frames ahead and waited
+	ui32 ring_discards; // since the start, the gpu was a whole ring behind
+};
+
+// history of the last frames, oldest entries get overwritten
+struct ui_telemetry {
+	ui_frame_stats* frames; // UI_TELEMETRY_FRAMES entries
+	ui32 head; // next slot written
+	ui32 count;
+	ui64 frame;
+};
+
 struct ui_context {
 	f32 fps;
 	f32 fps_display_delay; // this should be in seconds
 	f64 last_update; // last timestamp fps was updated (in seconds)
+	
+	ui_telemetry telemetry;
 };
 
 void update_ui_context(ui_context* uiContext, f32 fps, f64 time) {
@@ -46,4 +113,364 @@ void imgui_render() {
 	ImGui::NewFrame();
 }
 
+// ----------------------- RETAINED PANELS
+/*
+	usage :
+		if(ui_panel_begin(&panel, values_hash)) { ...widgets... }
+		ui_panel_end(&panel);
+		...
+		ImGui::Render();
+		ui_panel_submit(&panel, ImGui::GetDrawData());
+*/
+
+// returns true when the content has to be submitted, ui_panel_end must be called either way
+bool ui_panel_begin(ui_panel* panel, ui64 values_hash) {
+	ImGuiContext& g = *GImGui;
+	ImGuiIO& io = ImGui::GetIO();
+	ImGuiWindow* window = ImGui::FindWindowByName(panel->name);
+	
+	ImVec2 margin(UI_PANEL_MARGIN, UI_PANEL_MARGIN);
+	ImRect rect(panel->pos - margin, panel->pos + panel->size + margin);
+	
+	bool near_mouse = rect.Contains(io.MousePos);
+	bool interacting = window && (g.ActiveIdWindow == window || g.MovingWindow == window);
+	bool resized = panel->display_size.x != io.DisplaySize.x || panel->display_size.y != io.DisplaySize.y;
+	
+	panel->building = !panel->cached || panel->values_hash != values_hash || near_mouse || interacting || resized;
+	if(!panel->building) {
+		panel->reuses++;
+		return false;
+	};
+	
+	panel->values_hash = values_hash;
+	panel->builds++;
+	return ImGui::Begin(panel->name);
+}
+
+void ui_panel_end(ui_panel* panel) {
+	if(!panel->building) return;
+	
+	panel->pos = ImGui::GetWindowPos();
+	panel->size = ImGui::GetWindowSize();
+	ImGui::End();
+}
+
+// after ImGui::Render() : keeps what was just built, or puts the cached copy back in the frame
+void ui_panel_submit(ui_panel* panel, ImDrawData* draw_data) {
+	if(panel->building) {
+		if(panel->cached) IM_DELETE(panel->cached);
+		panel->cached = NULL;
+		
+		// a hidden window (first frame of an auto resize...) has nothing worth keeping, build it again next frame
+		ImGuiWindow* window = ImGui::FindWindowByName(panel->name);
+		if(window && window->Active && !window->Hidden) {
+			panel->cached = window->DrawList->CloneOutput();
+		};
+		panel->display_size = ImGui::GetIO().DisplaySize;
+	} else if(panel->cached) {
+		draw_data->AddDrawList(panel->cached);
+	};
+}
+
+void ui_panel_release(ui_panel* panel) {
+	if(panel->cached) IM_DELETE(panel->cached);
+	panel->cached = NULL;
+}
+
+// ----------------------- TELEMETRY
+
+void ui_telemetry_init(ui_telemetry* telemetry) {
+	memset(telemetry, 0, sizeof(ui_telemetry));
+	telemetry->frames = (ui_frame_stats*)VirtualAlloc(0, sizeof(ui_frame_stats) * UI_TELEMETRY_FRAMES, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+}
+
+// call once the frame is presented, before the tracker counters are reset
+ui_frame_stats ui_collect_frame_stats(render_context* rContext, ui_draw_cache* cache, f32 frame_ms) {
+	return {
+		.frame_ms = frame_ms,
+		.binds_issued = rContext->tracker.binds_issued,
+		.binds_filtered = rContext->tracker.binds_filtered,
+		.pipelines = rContext->psoCache.count,
+		.vt_uploads = rContext->vt.uploads,
+		.vt_missing = rContext->vt.missing,
+		.lights_visible = rContext->clusters.visible,
+		.light_indices = rContext->clusters.index_count,
+		.shadow_casters = rContext->shadows.caster_draws,
+		.shadow_cached = rContext->shadows.cached,
+		.hiz_tested = rContext->hiz.tested,
+		.hiz_occluded = rContext->hiz.occluded,
+		.sw_tested = rContext->occlusion.tested,
+		.sw_occluded = rContext->occlusion.occluded,
+		.ui_uploads = cache->uploads,
+		.ui_uploads_skipped = cache->uploads_skipped,
+		.gpu_wait_ms = rContext->fences.wait_ms,
+		.ring_discards = rContext->vertex_ring.discards + rContext->index_ring.discards,
+	};
+}
+
+// stats collected on the render thread, the history belongs to the thread drawing the window
+void ui_telemetry_record(ui_telemetry* telemetry, ui_frame_stats* stats) {
+	if(!telemetry->frames) return;
+	
+	telemetry->frames[telemetry->head] = *stats;
+	telemetry->frames[telemetry->head].frame = telemetry->frame++;
+	telemetry->head = (telemetry->head + 1) % UI_TELEMETRY_FRAMES;
+	if(telemetry->count < UI_TELEMETRY_FRAMES) telemetry->count++;
+}
+
+// newest frame first, the clipper only submits the rows that are visible
+void ui_telemetry_window(ui_context* uiContext) {
+	ui_telemetry* telemetry = &uiContext->telemetry;
+	
+	if(ImGui::Begin("telemetry") && telemetry->count) {
+		ui_frame_stats* newest = &telemetry->frames[(telemetry->head + UI_TELEMETRY_FRAMES - 1) % UI_TELEMETRY_FRAMES];
+		ImGui::Text("[UI uploads] uploaded: %u skipped: %u", newest->ui_uploads, newest->ui_uploads_skipped);
+		
+		ImGuiTableFlags flags = ImGuiTableFlags_ScrollY | ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersOuter | ImGuiTableFlags_BordersV;
+		if(ImGui::BeginTable("frames", 17, flags)) {
+			ImGui::TableSetupScrollFreeze(0, 1);
+			ImGui::TableSetupColumn("frame");
+			ImGui::TableSetupColumn("ms");
+			ImGui::TableSetupColumn("binds issued");
+			ImGui::TableSetupColumn("binds filtered");
+			ImGui::TableSetupColumn("pipelines");
+			ImGui::TableSetupColumn("vt tiles");
+			ImGui::TableSetupColumn("vt missing");
+			ImGui::TableSetupColumn("lights");
+			ImGui::TableSetupColumn("light indices");
+			ImGui::TableSetupColumn("shadow casters");
+			ImGui::TableSetupColumn("cascades cached");
+			ImGui::TableSetupColumn("hiz tested");
+			ImGui::TableSetupColumn("hiz occluded");
+			ImGui::TableSetupColumn("sw tested");
+			ImGui::TableSetupColumn("sw culled %");
+			ImGui::TableSetupColumn("gpu wait ms");
+			ImGui::TableSetupColumn("ring discards");
+			ImGui::TableHeadersRow();
+			
+			ImGuiListClipper clipper;
+			clipper.Begin(telemetry->count);
+			while(clipper.Step()) {
+				for(int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+					ui32 index = (telemetry->head + UI_TELEMETRY_FRAMES - 1 - row) % UI_TELEMETRY_FRAMES;
+					ui_frame_stats* stats = &telemetry->frames[index];
+					
+					ImGui::TableNextRow();
+					ImGui::TableNextColumn(); ImGui::Text("%llu", stats->frame);
+					ImGui::TableNextColumn(); ImGui::Text("%.2f", stats->frame_ms);
+					ImGui::TableNextColumn(); ImGui::Text("%u", stats->binds_issued);
+					ImGui::TableNextColumn(); ImGui::Text("%u", stats->binds_filtered);
+					ImGui::TableNextColumn(); ImGui::Text("%u", stats->pipelines);
+					ImGui::TableNextColumn(); ImGui::Text("%u", stats->vt_uploads);
+					ImGui::TableNextColumn(); ImGui::Text("%u", stats->vt_missing);
+					ImGui::TableNextColumn(); ImGui::Text("%u", stats->lights_visible);
+					ImGui::TableNextColumn(); ImGui::Text("%u", stats->light_indices);
+					ImGui::TableNextColumn(); ImGui::Text("%u", stats->shadow_casters);
+					ImGui::TableNextColumn(); ImGui::Text("%u", stats->shadow_cached);
+					ImGui::TableNextColumn(); ImGui::Text("%u", stats->hiz_tested);
+					ImGui::TableNextColumn(); ImGui::Text("%u", stats->hiz_occluded);
+					ImGui::TableNextColumn(); ImGui::Text("%u", stats->sw_tested);
+					ImGui::TableNextColumn(); ImGui::Text("%.1f", stats->sw_tested ? 100.0f * stats->sw_occluded / stats->sw_tested : 0.0f);
+					ImGui::TableNextColumn(); ImGui::Text("%.2f", stats->gpu_wait_ms);
+					ImGui::TableNextColumn(); ImGui::Text("%u", stats->ring_discards);
+				};
+			};
+			ImGui::EndTable();
+		};
+	};
+	ImGui::End();
+}
+
+// ----------------------- DRAWING
+/*
+	Replaces ImGui_ImplDX11_RenderDrawData. The backend still owns the shaders, the font texture and
+	the projection buffer, but the vertices go through the renderer's rings and the states through
+	the pipeline cache and the state tracker. Nothing is saved or restored, the tracker knows what is bound.
+*/
+
+// same states as ImGui_ImplDX11_CreateDeviceObjects
+internal const pipeline_state* ui_get_pipeline(render_context* rContext, ImGui_ImplDX11_Data* bd) {
+	pipeline_desc desc;
+	memset(&desc, 0, sizeof(desc));
+	
+	desc.vshader = bd->pVertexShader;
+	desc.pshader = bd->pPixelShader;
+	desc.layout = bd->pInputLayout;
+	desc.topology = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	
+	desc.rasterizer.FillMode = D3D11_FILL_SOLID;
+	desc.rasterizer.CullMode = D3D11_CULL_NONE;
+	desc.rasterizer.ScissorEnable = TRUE;
+	desc.rasterizer.DepthClipEnable = TRUE;
+	
+	desc.depth_stencil.DepthEnable = FALSE;
+	desc.depth_stencil.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
+	desc.depth_stencil.DepthFunc = D3D11_COMPARISON_ALWAYS;
+	desc.depth_stencil.StencilEnable = FALSE;
+	desc.depth_stencil.FrontFace.StencilFailOp = desc.depth_stencil.FrontFace.StencilDepthFailOp = desc.depth_stencil.FrontFace.StencilPassOp = D3D11_STENCIL_OP_KEEP;
+	desc.depth_stencil.FrontFace.StencilFunc = D3D11_COMPARISON_ALWAYS;
+	desc.depth_stencil.BackFace = desc.depth_stencil.FrontFace;
+	
+	desc.blend.RenderTarget[0].BlendEnable = TRUE;
+	desc.blend.RenderTarget[0].SrcBlend = D3D11_BLEND_SRC_ALPHA;
+	desc.blend.RenderTarget[0].DestBlend = D3D11_BLEND_INV_SRC_ALPHA;
+	desc.blend.RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD;
+	desc.blend.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ONE;
+	desc.blend.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_INV_SRC_ALPHA;
+	desc.blend.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
+	desc.blend.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+	
+	return pipeline_get(&rContext->psoCache, rContext->device, &desc);
+}
+
+internal void ui_setup_render_state(ui_draw_cache* cache, render_context* rContext, ImGui_ImplDX11_Data* bd, ImDrawData* draw_data) {
+	state_tracker* tracker = &rContext->tracker;
+	ID3D11DeviceContext* context = rContext->context;
+	
+	D3D11_VIEWPORT viewport =
+	{
+		.TopLeftX = 0,
+		.TopLeftY = 0,
+		.Width = draw_data->DisplaySize.x,
+		.Height = draw_data->DisplaySize.y,
+		.MinDepth = 0,
+		.MaxDepth = 1,
+	};
+	
+	tracker_bind_pipeline(tracker, context, cache->pipeline);
+	tracker_bind_vertex_buffer(tracker, context, 0, rContext->vertex_ring.buffer, sizeof(ImDrawVert), 0);
+	tracker_bind_index_buffer(tracker, context, rContext->index_ring.buffer, sizeof(ImDrawIdx) == 2 ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT, 0);
+	tracker_bind_vs_cbuffer(tracker, context, 0, bd->pVertexConstantBuffer);
+	tracker_bind_sampler(tracker, context, 0, bd->pFontSampler);
+	tracker_bind_viewport(tracker, context, &viewport);
+}
+
+internal ui64 ui_hash_draw_data(ImDrawData* draw_data) {
+	ui64 hash = hash_fast64(&draw_data->CmdListsCount, sizeof(int), 0);
+	for(int n = 0; n < draw_data->CmdListsCount; n++) {
+		const ImDrawList* list = draw_data->CmdLists[n];
+		hash = hash_fast64(list->VtxBuffer.Data, list->VtxBuffer.Size * sizeof(ImDrawVert), hash);
+		hash = hash_fast64(list->IdxBuffer.Data, list->IdxBuffer.Size * sizeof(ImDrawIdx), hash);
+		hash = hash_fast64(list->CmdBuffer.Data, list->CmdBuffer.Size * sizeof(ImDrawCmd), hash);
+	};
+	return hash;
+}
+
+// copies every list into the rings, one range for the whole frame
+internal bool ui_upload_draw_data(ui_draw_cache* cache, render_context* rContext, ImDrawData* draw_data) {
+	ID3D11DeviceContext* context = rContext->context;
+	
+	if(!ring_map(&rContext->vertex_ring, context, draw_data->TotalVtxCount * sizeof(ImDrawVert), sizeof(ImDrawVert), &cache->vertices)) return false;
+	ImDrawVert* vtx_dst = (ImDrawVert*)cache->vertices.memory;
+	for(int n = 0; n < draw_data->CmdListsCount; n++) {
+		const ImDrawList* list = draw_data->CmdLists[n];
+		memcpy(vtx_dst, list->VtxBuffer.Data, list->VtxBuffer.Size * sizeof(ImDrawVert));
+		vtx_dst += list->VtxBuffer.Size;
+	};
+	ring_unmap(&rContext->vertex_ring, context);
+	
+	if(!ring_map(&rContext->index_ring, context, draw_data->TotalIdxCount * sizeof(ImDrawIdx), sizeof(ImDrawIdx), &cache->indices)) return false;
+	ImDrawIdx* idx_dst = (ImDrawIdx*)cache->indices.memory;
+	for(int n = 0; n < draw_data->CmdListsCount; n++) {
+		const ImDrawList* list = draw_data->CmdLists[n];
+		memcpy(idx_dst, list->IdxBuffer.Data, list->IdxBuffer.Size * sizeof(ImDrawIdx));
+		idx_dst += list->IdxBuffer.Size;
+	};
+	ring_unmap(&rContext->index_ring, context);
+	
+	return true;
+}
+
+internal void ui_upload_projection(ui_draw_cache* cache, render_context* rContext, ImGui_ImplDX11_Data* bd, ImDrawData* draw_data) {
+	if(cache->display_pos.x == draw_data->DisplayPos.x && cache->display_pos.y == draw_data->DisplayPos.y &&
+	   cache->display_size.x == draw_data->DisplaySize.x && cache->display_size.y == draw_data->DisplaySize.y) {
+		return;
+	};
+	
+	f32 L = draw_data->DisplayPos.x;
+	f32 R = draw_data->DisplayPos.x + draw_data->DisplaySize.x;
+	f32 T = draw_data->DisplayPos.y;
+	f32 B = draw_data->DisplayPos.y + draw_data->DisplaySize.y;
+	f32 mvp[4][4] =
+	{
+		{ 2.0f/(R-L),   0.0f,           0.0f,       0.0f },
+		{ 0.0f,         2.0f/(T-B),     0.0f,       0.0f },
+		{ 0.0f,         0.0f,           0.5f,       0.0f },
+		{ (R+L)/(L-R),  (T+B)/(B-T),    0.5f,       1.0f },
+	};
+	
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if(FAILED(rContext->context->Map(bd->pVertexConstantBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped))) return;
+	memcpy(mapped.pData, mvp, sizeof(mvp));
+	rContext->context->Unmap(bd->pVertexConstantBuffer, 0);
+	
+	cache->display_pos = draw_data->DisplayPos;
+	cache->display_size = draw_data->DisplaySize;
+}
+
+void ui_render_draw_data(ui_draw_cache* cache, render_context* rContext, ImDrawData* draw_data) {
+	// avoid rendering when minimized
+	if(draw_data->DisplaySize.x <= 0.0f || draw_data->DisplaySize.y <= 0.0f || draw_data->TotalVtxCount == 0) return;
+	
+	ImGui_ImplDX11_Data* bd = ImGui_ImplDX11_GetBackendData();
+	ID3D11DeviceContext* context = rContext->context;
+	
+	if(!cache->pipeline || cache->pipeline->desc.vshader != bd->pVertexShader) {
+		cache->pipeline = ui_get_pipeline(rContext, bd);
+		if(!cache->pipeline) return;
+	};
+	
+	// same lists as last frame and still in the rings : draw from there
+	ui64 hash = ui_hash_draw_data(draw_data);
+	bool alive = ring_alloc_alive(&rContext->vertex_ring, &cache->vertices) && ring_alloc_alive(&rContext->index_ring, &cache->indices);
+	if(hash == cache->hash && alive) {
+		ring_keep(&rContext->vertex_ring, &cache->vertices);
+		ring_keep(&rContext->index_ring, &cache->indices);
+		cache->uploads_skipped++;
+	} else {
+		if(!ui_upload_draw_data(cache, rContext, draw_data)) {
+			cache->hash = 0;
+			return;
+		};
+		cache->hash = hash;
+		cache->uploads++;
+	};
+	
+	ui_upload_projection(cache, rContext, bd, draw_data);
+	ui_setup_render_state(cache, rContext, bd, draw_data);
+	
+	ui32 global_vtx_offset = cache->vertices.offset / sizeof(ImDrawVert);
+	ui32 global_idx_offset = cache->indices.offset / sizeof(ImDrawIdx);
+	ImVec2 clip_off = draw_data->DisplayPos;
+	for(int n = 0; n < draw_data->CmdListsCount; n++) {
+		const ImDrawList* list = draw_data->CmdLists[n];
+		for(int cmd_i = 0; cmd_i < list->CmdBuffer.Size; cmd_i++) {
+			const ImDrawCmd* pcmd = &list->CmdBuffer[cmd_i];
+			
+			if(pcmd->UserCallback != NULL) {
+				// a callback can bind anything, the tracker cannot trust what it saw before
+				if(pcmd->UserCallback != ImDrawCallback_ResetRenderState) {
+					pcmd->UserCallback(list, pcmd);
+				};
+				tracker_reset(&rContext->tracker);
+				ui_setup_render_state(cache, rContext, bd, draw_data);
+				continue;
+			};
+			
+			ImVec2 clip_min(pcmd->ClipRect.x - clip_off.x, pcmd->ClipRect.y - clip_off.y);
+			ImVec2 clip_max(pcmd->ClipRect.z - clip_off.x, pcmd->ClipRect.w - clip_off.y);
+			if(clip_max.x <= clip_min.x || clip_max.y <= clip_min.y) continue;
+			
+			// scissor only matters while the ui pipeline is bound, it is not tracked
+			const D3D11_RECT rect = { (LONG)clip_min.x, (LONG)clip_min.y, (LONG)clip_max.x, (LONG)clip_max.y };
+			context->RSSetScissorRects(1, &rect);
+			
+			tracker_bind_srv(&rContext->tracker, context, 0, (ID3D11ShaderResourceView*)pcmd->GetTexID());
+			context->DrawIndexed(pcmd->ElemCount, pcmd->IdxOffset + global_idx_offset, pcmd->VtxOffset + global_vtx_offset);
+		};
+		global_idx_offset += list->IdxBuffer.Size;
+		global_vtx_offset += list->VtxBuffer.Size;
+	};
+}
+
 #endif /* _UIH_ */
\ No newline at end of file
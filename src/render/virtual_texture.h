@@ -0,0 +1,842 @@
+/*  ----------------------------------- VIRTUAL TEXTURE
+	This header file contains virtual texturing, for textures too big to live in video memory.
+
+	tools/vt_bake.cpp cuts a texture and all its mips into tiles and writes them into a .vt file.
+	At runtime only the tiles the screen needs are in memory, in the pages of a fixed size cache
+	texture. Each virtual texture has an indirection texture, one texel per tile and one mip per mip,
+	giving the shader the page holding that tile. A tile that is not there yet points to the page of
+	its closest resident parent, so the shader always has something to sample (the coarsest tile
+	never leaves the cache).
+
+	What the screen needs comes from the feedback pass : the virtual textured meshes are drawn again
+	in a small uint target where each pixel writes the tile and mip it would sample. The target is
+	read back a few frames later so nothing waits on the gpu. Missing tiles are read from the file
+	a budget of them per frame, into the least recently used pages : the whole budget goes to the
+	completion port at once (platform/async_io.h, unbuffered), or is read on the job system without it.
+
+*/
+
+#ifndef _VIRTUALTEXTUREH_
+#define _VIRTUALTEXTUREH_
+
+#include <d3d11.h>
+
+// ------------------------------- file format
+/*
+	vt_file_header
+	ui64 tile_offsets[tile_count] (from the start of the file)
+	ui32 tile_sizes[tile_count] (in the file)
+	tiles (rgba rows of VT_TILE_PADDED pixels)
+
+	The image is padded to a square of tiles_per_side² tiles (a power of two) so every mip is exactly
+	half of the previous one, down to a single tile. Tiles are stored mip 0 first, then row by row.
+	Each tile is an lz chunk (see lz.h), or raw when that is no smaller : its size is VT_TILE_BYTES.
+	They are decompressed on the job system right into the upload memory, as many at once as were read.
+*/
+
+#define VT_FILE_MAGIC 0x31545656 // "VVT1"
+#define VT_FILE_VERSION 2
+
+#define VT_TILE_SIZE 128
+#define VT_TILE_BORDER 4 // pixels of the neighbour tiles around each tile, filtering does not see the seams
+#define VT_TILE_PADDED (VT_TILE_SIZE + VT_TILE_BORDER * 2)
+#define VT_TILE_BYTES (VT_TILE_PADDED * VT_TILE_PADDED * 4)
+#define VT_MAX_MIPS 13 // 4096 tiles per side, tile coordinates get 12 bits in the feedback
+
+struct vt_file_header {
+	ui32 magic;
+	ui32 version;
+	ui32 width; // of the source image, in pixels
+	ui32 height;
+	ui32 tiles_per_side; // at mip 0
+	ui32 mip_count;
+	ui32 tile_count; // of every mip
+	ui32 pad;
+};
+
+// fills the index of the first tile of each mip, returns the tile count
+ui32 vt_mip_layout(ui32 tiles_per_side, ui32 mip_count, ui32* mip_first) {
+	ui32 count = 0;
+	for(ui32 mip = 0; mip < mip_count; mip++) {
+		mip_first[mip] = count;
+		ui32 side = tiles_per_side >> mip;
+		count += side * side;
+	};
+	return count;
+};
+
+// ------------------------------- runtime
+
+#define VT_NONE 0 // ids start at 1, a zeroed mesh does not use a virtual texture
+#define VT_MAX_TEXTURES 8 // ids get 3 bits in the feedback
+
+#define VT_PAGES_PER_SIDE 16
+#define VT_PAGE_COUNT (VT_PAGES_PER_SIDE * VT_PAGES_PER_SIDE)
+#define VT_CACHE_SIZE (VT_PAGES_PER_SIDE * VT_TILE_PADDED) // in pixels, 2176² rgba is about 18MB
+#define VT_NO_PAGE 0xffff
+#define VT_LOADING_PAGE 0xfffe // the tile is being read, do not ask for it again
+
+#define VT_FEEDBACK_DIVISOR 8 // the feedback target is that much smaller than the screen on each axis
+#define VT_FEEDBACK_LATENCY 3 // readback copies in flight, the one read was written that many frames ago
+#define VT_FEEDBACK_VALID 0x80000000 // the target is cleared to 0, written pixels have this bit
+
+#define VT_UPLOAD_BUDGET 16 // tiles read and uploaded per frame
+#define VT_MAX_REQUESTS 4096
+#define VT_REQUEST_HASH (VT_MAX_REQUESTS * 2) // must be a power of two
+
+// ------- structs
+
+struct vt_texture {
+	HANDLE file; // NULL when the slot is free
+	async_io_file stream; // the same file for streamed tiles, handle NULL without async io
+	vt_file_header header;
+	ui32 mip_first[VT_MAX_MIPS];
+	char path[MAX_PATH];
+
+	void* memory; // everything below sized by the tile count, one allocation
+	ui64* tile_offsets;
+	ui32* tile_sizes;
+	ui16* pages; // page holding each tile, VT_NO_PAGE / VT_LOADING_PAGE when it is not there
+
+	// what the shader reads, one texel per tile : r,g = page, b = mip of the tile in the page, a = 1
+	ui32* indirection[VT_MAX_MIPS];
+	D3D11_BOX dirty[VT_MAX_MIPS]; // changed since the last upload, right == 0 when clean
+	ID3D11Texture2D* indirection_texture;
+	ID3D11ShaderResourceView* indirection_view;
+};
+
+struct vt_page {
+	ui32 texture; // VT_NONE when free
+	ui32 tile;
+	ui16 x;
+	ui16 y;
+	ui32 mip;
+
+	// least recently used list, most recent first (pinned pages are not in it)
+	ui16 prev;
+	ui16 next;
+	ui64 last_used; // vt_system frame
+	bool pinned;
+	bool loading;
+};
+
+// one tile read on the job system, uploaded by the next vt_update
+struct vt_load {
+	HANDLE file;
+	ui64 offset;
+	ui32 size; // in the file
+	ui8* pixels; // VT_TILE_BYTES, where compressed tiles are decompressed
+	ui8* packed; // VT_TILE_BYTES, where tiles read by a job land
+	ui8* data; // the tile once ok, in pixels or still where it was read (raw tiles)
+	bool ok;
+	async_io_request* read; // NULL when read on the job system
+
+	ui32 texture;
+	ui32 tile;
+	ui32 mip;
+	ui32 x;
+	ui32 y;
+	ui16 page;
+};
+
+struct vt_request {
+	ui32 key; // same packing as the feedback pixels
+	ui32 count; // pixels asking for it, its children add theirs
+};
+
+struct vt_system {
+	vt_texture textures[VT_MAX_TEXTURES]; // indexed by id, 0 unused
+	ui32 texture_count;
+
+	// physical pages, every resident tile of every virtual texture
+	ID3D11Texture2D* cache;
+	ID3D11ShaderResourceView* cache_view;
+	vt_page pages[VT_PAGE_COUNT];
+	ui16 lru_head;
+	ui16 lru_tail;
+
+	// feedback target and its readback copies
+	ID3D11Texture2D* feedback;
+	ID3D11RenderTargetView* feedback_view;
+	ID3D11DepthStencilView* feedback_depth;
+	ui32 feedback_width;
+	ui32 feedback_height;
+	ID3D11Texture2D* readback[VT_FEEDBACK_LATENCY];
+	ui64 readback_written;
+
+	// what the last feedback asked for, the hash finds a request from its key
+	vt_request* requests;
+	ui32 request_count;
+	ui32* request_keys;
+	ui32* request_index;
+
+	// tiles being read
+	vt_load loads[VT_UPLOAD_BUDGET];
+	ui32 load_count;
+	volatile LONG load_counter;
+	void* load_memory;
+	async_io* io; // NULL : tiles are read by jobs
+
+	ui64 frame;
+
+	// stats
+	ui32 uploads; // this frame
+	ui32 missing; // tiles the last feedback asked for that were not resident
+	ui32 resident;
+	ui32 evicted;
+	ui32 failed;
+	ui32 feedback_late; // readbacks still not done after VT_FEEDBACK_LATENCY frames
+};
+
+// ------- keys
+
+internal ui32 vt_key(ui32 texture, ui32 mip, ui32 x, ui32 y) {
+	return VT_FEEDBACK_VALID | (texture << 28) | (mip << 24) | (y << 12) | x;
+};
+
+// checks a key against the textures open now (feedback can be older than a texture), gives its tile
+internal bool vt_key_tile(vt_system* vt, ui32 key, ui32* texture, ui32* mip, ui32* x, ui32* y, ui32* tile) {
+	*texture = (key >> 28) & 0x7;
+	*mip = (key >> 24) & 0xf;
+	*y = (key >> 12) & 0xfff;
+	*x = key & 0xfff;
+
+	vt_texture* tex = &vt->textures[*texture];
+	if(!tex->file || *mip >= tex->header.mip_count) return false;
+
+	ui32 side = tex->header.tiles_per_side >> *mip;
+	if(*x >= side || *y >= side) return false;
+
+	*tile = tex->mip_first[*mip] + *y * side + *x;
+	return true;
+};
+
+// ------- least recently used list
+
+internal void vt_lru_unlink(vt_system* vt, ui16 index) {
+	vt_page* page = &vt->pages[index];
+
+	if(page->prev != VT_NO_PAGE) vt->pages[page->prev].next = page->next;
+	else vt->lru_head = page->next;
+	if(page->next != VT_NO_PAGE) vt->pages[page->next].prev = page->prev;
+	else vt->lru_tail = page->prev;
+
+	page->prev = VT_NO_PAGE;
+	page->next = VT_NO_PAGE;
+};
+
+internal void vt_lru_push_front(vt_system* vt, ui16 index) {
+	vt_page* page = &vt->pages[index];
+	page->prev = VT_NO_PAGE;
+	page->next = vt->lru_head;
+
+	if(vt->lru_head != VT_NO_PAGE) vt->pages[vt->lru_head].prev = index;
+	else vt->lru_tail = index;
+	vt->lru_head = index;
+};
+
+internal void vt_lru_push_back(vt_system* vt, ui16 index) {
+	vt_page* page = &vt->pages[index];
+	page->prev = vt->lru_tail;
+	page->next = VT_NO_PAGE;
+
+	if(vt->lru_tail != VT_NO_PAGE) vt->pages[vt->lru_tail].next = index;
+	else vt->lru_head = index;
+	vt->lru_tail = index;
+};
+
+internal void vt_touch(vt_system* vt, ui16 index) {
+	vt_page* page = &vt->pages[index];
+	page->last_used = vt->frame;
+	if(page->pinned || vt->lru_head == index) return;
+
+	vt_lru_unlink(vt, index);
+	vt_lru_push_front(vt, index);
+};
+
+// ------- indirection
+
+internal void vt_mark_dirty(vt_texture* tex, ui32 mip, ui32 left, ui32 top, ui32 right, ui32 bottom) {
+	D3D11_BOX* box = &tex->dirty[mip];
+	if(box->right == 0) {
+		*box = { left, top, 0, right, bottom, 1 };
+		return;
+	};
+
+	if(left < box->left) box->left = left;
+	if(top < box->top) box->top = top;
+	if(right > box->right) box->right = right;
+	if(bottom > box->bottom) box->bottom = bottom;
+};
+
+/*
+	Rebuilds the indirection under a tile whose residency changed, that tile and all its children down
+	to mip 0 : a resident tile points to its own page, the others copy the entry of their parent.
+	Coarse tiles cover a lot of mip 0, but they are also the ones staying in the cache.
+*/
+internal void vt_refresh_indirection(vt_texture* tex, ui32 mip, ui32 x, ui32 y) {
+	ui32 mip_count = tex->header.mip_count;
+
+	for(i32 level = (i32)mip; level >= 0; level--) {
+		ui32 span = 1 << (mip - level);
+		ui32 side = tex->header.tiles_per_side >> level;
+		ui32* entries = tex->indirection[level];
+		ui16* pages = tex->pages + tex->mip_first[level];
+
+		for(ui32 ty = y * span; ty < (y + 1) * span; ty++) {
+			for(ui32 tx = x * span; tx < (x + 1) * span; tx++) {
+				ui16 page = pages[ty * side + tx];
+				ui32 entry = 0; // nothing resident, only until the coarsest tile is in
+
+				if(page < VT_PAGE_COUNT) {
+					entry = (page % VT_PAGES_PER_SIDE) | ((page / VT_PAGES_PER_SIDE) << 8) | (level << 16) | (1 << 24);
+				} else if((ui32)level + 1 < mip_count) {
+					entry = tex->indirection[level + 1][(ty >> 1) * (side >> 1) + (tx >> 1)];
+				};
+				entries[ty * side + tx] = entry;
+			};
+		};
+
+		vt_mark_dirty(tex, level, x * span, y * span, (x + 1) * span, (y + 1) * span);
+	};
+};
+
+internal void vt_upload_indirection(vt_texture* tex, ID3D11DeviceContext* context) {
+	for(ui32 mip = 0; mip < tex->header.mip_count; mip++) {
+		D3D11_BOX* box = &tex->dirty[mip];
+		if(box->right == 0) continue;
+
+		ui32 side = tex->header.tiles_per_side >> mip;
+		ui32* first = tex->indirection[mip] + box->top * side + box->left;
+		context->UpdateSubresource(tex->indirection_texture, mip, box, first, side * sizeof(ui32), 0);
+
+		*box = {};
+	};
+};
+
+// ------- pages
+
+// frees the least recently used page, VT_NO_PAGE when every page is still on screen (the cache is too small for this view)
+internal ui16 vt_evict_lru(vt_system* vt) {
+	ui16 index = vt->lru_tail;
+	if(index == VT_NO_PAGE) return VT_NO_PAGE;
+
+	vt_page* page = &vt->pages[index];
+	Assert(!page->loading); // loads are done before anything gets evicted
+
+	if(page->texture != VT_NONE) {
+		if(page->last_used == vt->frame) return VT_NO_PAGE;
+
+		vt_texture* tex = &vt->textures[page->texture];
+		tex->pages[page->tile] = VT_NO_PAGE;
+		vt_refresh_indirection(tex, page->mip, page->x, page->y);
+
+		page->texture = VT_NONE;
+		vt->resident--;
+		vt->evicted++;
+	};
+
+	vt_touch(vt, index);
+	return index;
+};
+
+internal void vt_free_page(vt_system* vt, ui16 index) {
+	vt_page* page = &vt->pages[index];
+	if(!page->pinned) vt_lru_unlink(vt, index);
+
+	page->texture = VT_NONE;
+	page->pinned = false;
+	page->loading = false;
+	page->last_used = 0;
+
+	// first in line for the next tile
+	vt_lru_push_back(vt, index);
+};
+
+internal void vt_begin_load(vt_system* vt, vt_load* load, ui32 texture, ui32 mip, ui32 x, ui32 y, ui32 tile, ui16 index) {
+	vt_texture* tex = &vt->textures[texture];
+	vt_page* page = &vt->pages[index];
+
+	page->texture = texture;
+	page->tile = tile;
+	page->mip = mip;
+	page->x = (ui16)x;
+	page->y = (ui16)y;
+	page->loading = true;
+	tex->pages[tile] = VT_LOADING_PAGE;
+
+	load->file = tex->file;
+	load->offset = tex->tile_offsets[tile];
+	load->size = tex->tile_sizes[tile];
+	load->data = NULL;
+	load->ok = false;
+	load->read = NULL;
+	load->texture = texture;
+	load->tile = tile;
+	load->mip = mip;
+	load->x = x;
+	load->y = y;
+	load->page = index;
+};
+
+// runs on the job system once the tile is read into memory
+internal void vt_unpack_tile(vt_load* load, ui8* memory, bool read) {
+	if(!read) {
+		load->ok = false;
+	} else if(load->size == VT_TILE_BYTES) {
+		load->data = memory;
+		load->ok = true;
+	} else {
+		load->data = load->pixels;
+		load->ok = lz_decompress(load->pixels, VT_TILE_BYTES, memory, load->size);
+	};
+};
+
+internal void vt_load_tile(void* data) {
+	vt_load* load = (vt_load*)data;
+	bool read = io_file_read_at(load->file, load->offset, load->packed, load->size);
+	vt_unpack_tile(load, load->packed, read);
+};
+
+internal void vt_tile_read(async_io_request* request) {
+	vt_unpack_tile((vt_load*)request->user, request->data, request->ok);
+};
+
+internal void vt_end_load(vt_system* vt, ID3D11DeviceContext* context, vt_load* load) {
+	vt_texture* tex = &vt->textures[load->texture];
+	vt_page* page = &vt->pages[load->page];
+	page->loading = false;
+
+	// read through the port, a raw tile is still in its pool buffer
+	async_io_request* read = load->read;
+	load->read = NULL;
+
+	if(!load->ok) {
+		OutputDebugStringA("VIRTUAL TEXTURE TILE READ ERROR\n");
+		if(read) async_io_release(vt->io, read);
+		tex->pages[load->tile] = VT_NO_PAGE;
+		vt_free_page(vt, load->page);
+		vt->failed++;
+		return;
+	};
+
+	ui32 left = (load->page % VT_PAGES_PER_SIDE) * VT_TILE_PADDED;
+	ui32 top = (load->page / VT_PAGES_PER_SIDE) * VT_TILE_PADDED;
+	D3D11_BOX box = { left, top, 0, left + VT_TILE_PADDED, top + VT_TILE_PADDED, 1 };
+	context->UpdateSubresource(vt->cache, 0, &box, load->data, VT_TILE_PADDED * 4, 0);
+	if(read) async_io_release(vt->io, read);
+
+	tex->pages[load->tile] = load->page;
+	vt_refresh_indirection(tex, load->mip, load->x, load->y);
+
+	vt->resident++;
+	vt->uploads++;
+};
+
+// ------- feedback
+
+internal void vt_request_add(vt_system* vt, ui32 key, ui32 count) {
+	ui32 mask = VT_REQUEST_HASH - 1;
+	ui32 slot = (key * 2654435761u) & mask;
+
+	for(;;) {
+		if(vt->request_keys[slot] == 0) {
+			// full, whatever did not fit comes back in a later feedback
+			if(vt->request_count == VT_MAX_REQUESTS) return;
+
+			vt->request_keys[slot] = key;
+			vt->request_index[slot] = vt->request_count;
+			vt->requests[vt->request_count++] = { key, count };
+			return;
+		};
+		if(vt->request_keys[slot] == key) {
+			vt->requests[vt->request_index[slot]].count += count;
+			return;
+		};
+		slot = (slot + 1) & mask;
+	};
+};
+
+// reads the oldest feedback copy into the request list, with the parents of every tile asked for
+internal void vt_read_feedback(vt_system* vt, ID3D11DeviceContext* context) {
+	vt->request_count = 0;
+	if(!vt->feedback || vt->readback_written < VT_FEEDBACK_LATENCY) return;
+
+	// the copy written VT_FEEDBACK_LATENCY frames ago, overwritten next
+	ID3D11Texture2D* readback = vt->readback[vt->readback_written % VT_FEEDBACK_LATENCY];
+
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	HRESULT hr = context->Map(readback, 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mapped);
+	if(hr == DXGI_ERROR_WAS_STILL_DRAWING) {
+		vt->feedback_late++;
+		return;
+	};
+	if(FAILED(hr)) return;
+
+	memset(vt->request_keys, 0, sizeof(ui32) * VT_REQUEST_HASH);
+
+	ui32 last_key = 0;
+	ui32 last_count = 0;
+	for(ui32 y = 0; y < vt->feedback_height; y++) {
+		ui32* row = (ui32*)((ui8*)mapped.pData + y * mapped.RowPitch);
+		for(ui32 x = 0; x < vt->feedback_width; x++) {
+			// neighbour pixels mostly ask for the same tile
+			if(row[x] == last_key) {
+				last_count++;
+				continue;
+			};
+			if(last_key & VT_FEEDBACK_VALID) vt_request_add(vt, last_key, last_count);
+			last_key = row[x];
+			last_count = 1;
+		};
+	};
+	if(last_key & VT_FEEDBACK_VALID) vt_request_add(vt, last_key, last_count);
+
+	context->Unmap(readback, 0);
+
+	// the parents are what the shader falls back to, they are needed too (the list grows while we walk it)
+	for(ui32 i = 0; i < vt->request_count; i++) {
+		ui32 texture, mip, x, y, tile;
+		if(!vt_key_tile(vt, vt->requests[i].key, &texture, &mip, &x, &y, &tile)) continue;
+		if(mip + 1 >= vt->textures[texture].header.mip_count) continue;
+
+		vt_request_add(vt, vt_key(texture, mip + 1, x >> 1, y >> 1), vt->requests[i].count);
+	};
+};
+
+// coarse tiles first (everything finer falls back to them), then the ones covering the most pixels
+internal int vt_request_compare(const void* a, const void* b) {
+	const vt_request* left = (const vt_request*)a;
+	const vt_request* right = (const vt_request*)b;
+
+	ui32 left_mip = (left->key >> 24) & 0xf;
+	ui32 right_mip = (right->key >> 24) & 0xf;
+	if(left_mip != right_mip) return left_mip > right_mip ? -1 : 1;
+	if(left->count != right->count) return left->count > right->count ? -1 : 1;
+	return 0;
+};
+
+// marks the resident tiles as used, then starts reading the missing ones within the budget
+internal void vt_stream_requests(vt_system* vt, job_system* jobs) {
+	ui32 missing = 0;
+	for(ui32 i = 0; i < vt->request_count; i++) {
+		ui32 texture, mip, x, y, tile;
+		if(!vt_key_tile(vt, vt->requests[i].key, &texture, &mip, &x, &y, &tile)) continue;
+
+		ui16 page = vt->textures[texture].pages[tile];
+		if(page < VT_PAGE_COUNT) {
+			vt_touch(vt, page);
+		} else if(page == VT_NO_PAGE) {
+			// compacted in place, the hash is not used anymore
+			vt->requests[missing++] = vt->requests[i];
+		};
+	};
+	vt->missing = missing;
+
+	qsort(vt->requests, missing, sizeof(vt_request), vt_request_compare);
+
+	for(ui32 i = 0; i < missing && vt->load_count < VT_UPLOAD_BUDGET; i++) {
+		ui32 texture, mip, x, y, tile;
+		vt_key_tile(vt, vt->requests[i].key, &texture, &mip, &x, &y, &tile);
+
+		ui16 page = vt_evict_lru(vt);
+		if(page == VT_NO_PAGE) break;
+
+		vt_load* load = &vt->loads[vt->load_count++];
+		vt_begin_load(vt, load, texture, mip, x, y, tile, page);
+
+		// decompressed on the job system once read (a full pool falls back to a job doing both)
+		vt_texture* tex = &vt->textures[texture];
+		if(tex->stream.handle) load->read = async_io_read(vt->io, &tex->stream, load->offset, load->size, vt_tile_read, load, &vt->load_counter);
+		if(!load->read) jobs_push(jobs, vt_load_tile, load, &vt->load_counter);
+	};
+
+	// the reads of the frame go to the disk together
+	if(vt->io) async_io_submit(vt->io);
+};
+
+// ------------------------------- functions
+
+// io can be NULL, tiles are then read by blocking jobs
+HRESULT vt_init(vt_system* vt, ID3D11Device* device, async_io* io) {
+	HRESULT hr;
+	memset(vt, 0, sizeof(vt_system));
+	vt->io = io;
+
+	D3D11_TEXTURE2D_DESC desc =
+	{
+		.Width = VT_CACHE_SIZE,
+		.Height = VT_CACHE_SIZE,
+		.MipLevels = 1,
+		.ArraySize = 1,
+		.Format = DXGI_FORMAT_R8G8B8A8_UNORM,
+		.SampleDesc = { 1, 0 },
+		.Usage = D3D11_USAGE_DEFAULT,
+		.BindFlags = D3D11_BIND_SHADER_RESOURCE,
+	};
+
+	hr = device->CreateTexture2D(&desc, NULL, &vt->cache);
+	if(FAILED(hr)) return hr;
+	hr = device->CreateShaderResourceView((ID3D11Resource*)vt->cache, NULL, &vt->cache_view);
+	if(FAILED(hr)) return hr;
+
+	// every page free, in order
+	vt->lru_head = VT_NO_PAGE;
+	vt->lru_tail = VT_NO_PAGE;
+	for(ui16 i = 0; i < VT_PAGE_COUNT; i++) {
+		vt_lru_push_back(vt, i);
+	};
+
+	vt->requests = (vt_request*)VirtualAlloc(0, sizeof(vt_request) * VT_MAX_REQUESTS, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	vt->request_keys = (ui32*)VirtualAlloc(0, sizeof(ui32) * VT_REQUEST_HASH * 2, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	vt->request_index = vt->request_keys + VT_REQUEST_HASH;
+
+	vt->load_memory = VirtualAlloc(0, VT_TILE_BYTES * 2 * VT_UPLOAD_BUDGET, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	for(ui32 i = 0; i < VT_UPLOAD_BUDGET; i++) {
+		vt->loads[i].pixels = (ui8*)vt->load_memory + VT_TILE_BYTES * 2 * i;
+		vt->loads[i].packed = vt->loads[i].pixels + VT_TILE_BYTES;
+	};
+
+	return S_OK;
+};
+
+// the feedback target follows the screen size, what was in flight for the old size is dropped
+HRESULT vt_resize_feedback(vt_system* vt, ID3D11Device* device, ui32 screen_width, ui32 screen_height) {
+	HRESULT hr;
+
+	if(vt->feedback) {
+		vt->feedback->Release();
+		vt->feedback_view->Release();
+		vt->feedback_depth->Release();
+		for(ui32 i = 0; i < VT_FEEDBACK_LATENCY; i++) {
+			vt->readback[i]->Release();
+		};
+		vt->feedback = NULL;
+	};
+	vt->readback_written = 0;
+
+	vt->feedback_width = screen_width / VT_FEEDBACK_DIVISOR > 0 ? screen_width / VT_FEEDBACK_DIVISOR : 1;
+	vt->feedback_height = screen_height / VT_FEEDBACK_DIVISOR > 0 ? screen_height / VT_FEEDBACK_DIVISOR : 1;
+
+	D3D11_TEXTURE2D_DESC desc =
+	{
+		.Width = vt->feedback_width,
+		.Height = vt->feedback_height,
+		.MipLevels = 1,
+		.ArraySize = 1,
+		.Format = DXGI_FORMAT_R32_UINT,
+		.SampleDesc = { 1, 0 },
+		.Usage = D3D11_USAGE_DEFAULT,
+		.BindFlags = D3D11_BIND_RENDER_TARGET,
+	};
+
+	hr = device->CreateTexture2D(&desc, NULL, &vt->feedback);
+	if(FAILED(hr)) return hr;
+	hr = device->CreateRenderTargetView((ID3D11Resource*)vt->feedback, NULL, &vt->feedback_view);
+	if(FAILED(hr)) return hr;
+
+	// cpu copies, read a few frames later
+	desc.Usage = D3D11_USAGE_STAGING;
+	desc.BindFlags = 0;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	for(ui32 i = 0; i < VT_FEEDBACK_LATENCY; i++) {
+		hr = device->CreateTexture2D(&desc, NULL, &vt->readback[i]);
+		if(FAILED(hr)) return hr;
+	};
+
+	// its own depth, only the closest surface asks for tiles
+	desc.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
+	desc.CPUAccessFlags = 0;
+
+	ID3D11Texture2D* depth;
+	hr = device->CreateTexture2D(&desc, NULL, &depth);
+	if(FAILED(hr)) return hr;
+	hr = device->CreateDepthStencilView((ID3D11Resource*)depth, NULL, &vt->feedback_depth);
+	depth->Release();
+
+	return hr;
+};
+
+// call once the feedback pass is drawn
+void vt_copy_feedback(vt_system* vt, ID3D11DeviceContext* context) {
+	ID3D11Texture2D* readback = vt->readback[vt->readback_written % VT_FEEDBACK_LATENCY];
+	context->CopyResource((ID3D11Resource*)readback, (ID3D11Resource*)vt->feedback);
+	vt->readback_written++;
+};
+
+/*
+	Opens a .vt file, returns its id (VT_NONE on failure).
+	Only the header and the tile offsets are read, plus the coarsest tile which stays in the cache.
+*/
+ui32 vt_open(vt_system* vt, ID3D11Device* device, ID3D11DeviceContext* context, char* location) {
+	if(vt->texture_count + 1 >= VT_MAX_TEXTURES) return VT_NONE;
+
+	ui32 id = vt->texture_count + 1;
+	vt_texture* tex = &vt->textures[id];
+	memset(tex, 0, sizeof(vt_texture));
+
+	HANDLE file = io_create_handle(location);
+	if(file == INVALID_HANDLE_VALUE) return VT_NONE;
+
+	vt_file_header* header = &tex->header;
+	bool ok = io_file_read_at(file, 0, header, sizeof(vt_file_header));
+	ok = ok && header->magic == VT_FILE_MAGIC && header->version == VT_FILE_VERSION;
+	ok = ok && header->mip_count > 0 && header->mip_count <= VT_MAX_MIPS && header->tiles_per_side == (1u << (header->mip_count - 1));
+	ok = ok && vt_mip_layout(header->tiles_per_side, header->mip_count, tex->mip_first) == header->tile_count;
+	if(!ok) {
+		OutputDebugStringA("VIRTUAL TEXTURE VERSION MISMATCH\n");
+		CloseHandle(file);
+		return VT_NONE;
+	};
+
+	ui32 count = header->tile_count;
+	tex->memory = VirtualAlloc(0, (sizeof(ui64) + sizeof(ui32) * 2 + sizeof(ui16)) * count, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	tex->tile_offsets = (ui64*)tex->memory;
+	tex->tile_sizes = (ui32*)(tex->tile_offsets + count);
+	ui32* indirection = tex->tile_sizes + count;
+	tex->pages = (ui16*)(indirection + count);
+
+	memset(tex->pages, 0xff, sizeof(ui16) * count);
+	for(ui32 mip = 0; mip < header->mip_count; mip++) {
+		tex->indirection[mip] = indirection + tex->mip_first[mip];
+	};
+
+	D3D11_TEXTURE2D_DESC desc =
+	{
+		.Width = header->tiles_per_side,
+		.Height = header->tiles_per_side,
+		.MipLevels = header->mip_count,
+		.ArraySize = 1,
+		.Format = DXGI_FORMAT_R8G8B8A8_UINT,
+		.SampleDesc = { 1, 0 },
+		.Usage = D3D11_USAGE_DEFAULT,
+		.BindFlags = D3D11_BIND_SHADER_RESOURCE,
+	};
+
+	ok = io_file_read_at(file, sizeof(vt_file_header), tex->tile_offsets, sizeof(ui64) * count);
+	ok = ok && io_file_read_at(file, sizeof(vt_file_header) + sizeof(ui64) * count, tex->tile_sizes, sizeof(ui32) * count);
+	for(ui32 i = 0; ok && i < count; i++) {
+		ok = tex->tile_sizes[i] > 0 && tex->tile_sizes[i] <= VT_TILE_BYTES;
+	};
+	ok = ok && SUCCEEDED(device->CreateTexture2D(&desc, NULL, &tex->indirection_texture));
+	ok = ok && SUCCEEDED(device->CreateShaderResourceView((ID3D11Resource*)tex->indirection_texture, NULL, &tex->indirection_view));
+
+	// the coarsest tile covers the whole texture, read right now and never evicted
+	ui16 page = ok ? vt_evict_lru(vt) : VT_NO_PAGE;
+	if(page != VT_NO_PAGE) {
+		tex->file = file;
+
+		vt_lru_unlink(vt, page);
+		vt->pages[page].pinned = true;
+
+		vt_load load = {};
+		load.pixels = (ui8*)VirtualAlloc(0, VT_TILE_BYTES * 2, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+		load.packed = load.pixels + VT_TILE_BYTES;
+		ui32 top = header->mip_count - 1;
+		vt_begin_load(vt, &load, id, top, 0, 0, tex->mip_first[top], page);
+		vt_load_tile(&load);
+		vt_end_load(vt, context, &load);
+		VirtualFree(load.pixels, 0, MEM_RELEASE);
+
+		ok = load.ok;
+	} else {
+		ok = false;
+	};
+
+	if(!ok) {
+		if(tex->indirection_view) tex->indirection_view->Release();
+		if(tex->indirection_texture) tex->indirection_texture->Release();
+		VirtualFree(tex->memory, 0, MEM_RELEASE);
+		CloseHandle(file);
+		memset(tex, 0, sizeof(vt_texture));
+		return VT_NONE;
+	};
+
+	vt_upload_indirection(tex, context);
+	strncpy(tex->path, location, MAX_PATH - 1);
+
+	// tiles are read once and cached in video memory, the os cache would only keep a second copy
+	if(vt->io) {
+		tex->stream = async_io_open(vt->io, location, true);
+		if(tex->stream.handle == INVALID_HANDLE_VALUE) tex->stream = {};
+	};
+	vt->texture_count++;
+
+	return id;
+};
+
+/*
+	Call once per frame, before the feedback pass.
+	Uploads the tiles read since the last call, reads the oldest feedback, starts reading what is missing.
+*/
+void vt_update(vt_system* vt, ID3D11DeviceContext* context, job_system* jobs) {
+	vt->frame++;
+	vt->uploads = 0;
+
+	// started last frame, they are usually done by now
+	if(vt->load_count) {
+		jobs_wait(jobs, &vt->load_counter);
+		for(ui32 i = 0; i < vt->load_count; i++) {
+			vt_end_load(vt, context, &vt->loads[i]);
+		};
+		vt->load_count = 0;
+	};
+
+	if(vt->texture_count == 0) return;
+
+	vt_read_feedback(vt, context);
+	vt_stream_requests(vt, jobs);
+
+	for(ui32 id = 1; id <= vt->texture_count; id++) {
+		vt_upload_indirection(&vt->textures[id], context);
+	};
+};
+
+// what the shaders need to sample texture id (see object_constants)
+void vt_texture_constants(vt_system* vt, ui32 id, ui32* tiles_per_side, ui32* mip_count, v2* uv_scale) {
+	vt_texture* tex = &vt->textures[id];
+	f32 size = (f32)(tex->header.tiles_per_side * VT_TILE_SIZE);
+
+	*tiles_per_side = tex->header.tiles_per_side;
+	*mip_count = tex->header.mip_count;
+
+	// meshes use uvs of the source image, the padding is on the right and bottom
+	*uv_scale = { (f32)tex->header.width / size, (f32)tex->header.height / size };
+};
+
+void vt_release(vt_system* vt, job_system* jobs) {
+	if(vt->load_count) jobs_wait(jobs, &vt->load_counter);
+	for(ui32 i = 0; i < vt->load_count; i++) {
+		if(vt->loads[i].read) async_io_release(vt->io, vt->loads[i].read);
+	};
+
+	for(ui32 id = 1; id <= vt->texture_count; id++) {
+		vt_texture* tex = &vt->textures[id];
+		tex->indirection_view->Release();
+		tex->indirection_texture->Release();
+		VirtualFree(tex->memory, 0, MEM_RELEASE);
+		CloseHandle(tex->file);
+		if(tex->stream.handle) async_io_close(&tex->stream);
+	};
+
+	if(vt->feedback) {
+		vt->feedback->Release();
+		vt->feedback_view->Release();
+		vt->feedback_depth->Release();
+		for(ui32 i = 0; i < VT_FEEDBACK_LATENCY; i++) {
+			vt->readback[i]->Release();
+		};
+	};
+
+	if(vt->cache_view) vt->cache_view->Release();
+	if(vt->cache) vt->cache->Release();
+
+	VirtualFree(vt->requests, 0, MEM_RELEASE);
+	VirtualFree(vt->request_keys, 0, MEM_RELEASE);
+	VirtualFree(vt->load_memory, 0, MEM_RELEASE);
+	memset(vt, 0, sizeof(vt_system));
+};
+
+#endif /* _VIRTUALTEXTUREH_ */
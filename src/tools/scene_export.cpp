@@ -0,0 +1,396 @@
+/*  ----------------------------------- SCENE EXPORT
+	Offline step of the scene files (see render/scene_format.h).
+	Reads a scene description and the .obj files it uses, writes a .scene file the renderer maps and
+	uses in place. Only the standard library : builds on Linux (buildscene.sh) as well as with cl.
+
+	description, one object per line, # for comments :
+	object <mesh .obj> <x> <y> <z> <texture> [occluder] [dynamic]
+
+	Objects using the same .obj share its vertices & indices in the file, the same texture is one
+	material. Faces are fanned into triangles, one vertex per distinct position / uv pair (at most
+	65536 of them per .obj, indices are 16 bits).
+
+	usage: scene_export <description> <output .scene>
+*/
+
+#define internal static
+
+// std
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+
+// raylib (for the math types)
+#include "raylib/raymath.h"
+
+// Custom
+#include "types.h"
+#include "render/scene_format.h"
+
+#define EXPORT_MAX_LINE 1024
+#define EXPORT_MAX_CORNERS 64 // of a face
+#define EXPORT_HASH_SIZE (1 << 17) // position / uv pairs of one .obj, twice the most there can be
+
+struct export_geometry {
+	char path[SCENE_MATERIAL_PATH];
+	ui32 vertex_first;
+	ui32 vertex_count;
+	ui32 index_first;
+	ui32 index_count;
+	f32 radius; // around the origin of the .obj, the position of its objects
+};
+
+struct export_state {
+	scene_file_mesh* meshes;
+	ui32 mesh_count;
+	ui32 mesh_capacity;
+
+	scene_file_material* materials;
+	ui32 material_count;
+	ui32 material_capacity;
+
+	export_geometry* geometries;
+	ui32 geometry_count;
+	ui32 geometry_capacity;
+
+	scene_file_vertex* vertices;
+	ui32 vertex_count;
+	ui32 vertex_capacity;
+
+	ui16* indices;
+	ui32 index_count;
+	ui32 index_capacity;
+};
+
+// room for one more element
+internal void* export_grow(void* array, ui32* capacity, ui32 count, size_t size) {
+	if(count < *capacity) return array;
+
+	*capacity = *capacity ? *capacity * 2 : 64;
+	array = realloc(array, *capacity * size);
+	if(!array) {
+		printf("out of memory\n");
+		exit(1);
+	};
+	return array;
+};
+
+// ------------------------------- obj
+
+// position / uv pairs already made into a vertex, keys are position index << 32 | uv index (+ 1, 0 = free)
+struct export_vertex_hash {
+	ui64* keys;
+	ui16* values;
+};
+
+internal bool export_load_obj(export_state* state, export_geometry* geometry) {
+	FILE* file = fopen(geometry->path, "rb");
+	if(!file) {
+		printf("could not read %s\n", geometry->path);
+		return false;
+	};
+
+	v3* positions = NULL;
+	ui32 position_count = 0, position_capacity = 0;
+	v2* uvs = NULL;
+	ui32 uv_count = 0, uv_capacity = 0;
+
+	export_vertex_hash hash = {
+		.keys = (ui64*)calloc(EXPORT_HASH_SIZE, sizeof(ui64)),
+		.values = (ui16*)calloc(EXPORT_HASH_SIZE, sizeof(ui16)),
+	};
+
+	geometry->vertex_first = state->vertex_count;
+	geometry->index_first = state->index_count;
+	geometry->radius = 0.0f;
+
+	bool ok = true;
+	ui32 line_number = 0;
+	char line[EXPORT_MAX_LINE];
+	while(ok && fgets(line, sizeof(line), file)) {
+		line_number++;
+
+		if(line[0] == 'v' && line[1] == ' ') {
+			positions = (v3*)export_grow(positions, &position_capacity, position_count, sizeof(v3));
+			v3* p = &positions[position_count++];
+			*p = {};
+			sscanf(line + 2, "%f %f %f", &p->x, &p->y, &p->z);
+		} else if(line[0] == 'v' && line[1] == 't') {
+			uvs = (v2*)export_grow(uvs, &uv_capacity, uv_count, sizeof(v2));
+			v2* uv = &uvs[uv_count++];
+			*uv = {};
+			sscanf(line + 3, "%f %f", &uv->x, &uv->y);
+		} else if(line[0] == 'f' && line[1] == ' ') {
+			ui16 corners[EXPORT_MAX_CORNERS];
+			ui32 corner_count = 0;
+
+			char* cursor = line + 2;
+			for(;;) {
+				while(*cursor == ' ' || *cursor == '\t') cursor++;
+				if(*cursor == '\0' || *cursor == '\r' || *cursor == '\n') break;
+
+				// p, p/t, p//n or p/t/n, negative indices count from the last one read
+				long p = strtol(cursor, &cursor, 10);
+				long t = 0;
+				if(*cursor == '/') {
+					cursor++;
+					if(*cursor != '/') t = strtol(cursor, &cursor, 10);
+					if(*cursor == '/') {
+						cursor++;
+						strtol(cursor, &cursor, 10);
+					};
+				};
+				while(*cursor && *cursor != ' ' && *cursor != '\t' && *cursor != '\r' && *cursor != '\n') cursor++;
+
+				if(p < 0) p += position_count + 1;
+				if(t < 0) t += uv_count + 1;
+				if(p < 1 || p > (long)position_count || t < 0 || t > (long)uv_count) {
+					printf("%s:%u: face refers to a vertex that does not exist\n", geometry->path, line_number);
+					ok = false;
+					break;
+				};
+
+				ui64 key = ((ui64)p << 32) | (ui64)t;
+				ui32 slot = (ui32)(hash_fnv64(&key, sizeof(key), 0) & (EXPORT_HASH_SIZE - 1));
+				while(hash.keys[slot] && hash.keys[slot] != key) slot = (slot + 1) & (EXPORT_HASH_SIZE - 1);
+
+				if(!hash.keys[slot]) {
+					ui32 index = state->vertex_count - geometry->vertex_first;
+					if(index > 0xffff) {
+						printf("%s: more than 65536 vertices\n", geometry->path);
+						ok = false;
+						break;
+					};
+
+					// obj uvs start at the bottom, d3d ones at the top
+					v3 pos = positions[p - 1];
+					v2 uv = t ? uvs[t - 1] : v2{ 0.0f, 0.0f };
+					state->vertices = (scene_file_vertex*)export_grow(state->vertices, &state->vertex_capacity, state->vertex_count, sizeof(scene_file_vertex));
+					state->vertices[state->vertex_count++] = {
+						.pos = pos,
+						.uv = { uv.x, 1.0f - uv.y },
+						.color = { 1.0f, 1.0f, 1.0f, 1.0f },
+					};
+
+					f32 distance = sqrtf(pos.x * pos.x + pos.y * pos.y + pos.z * pos.z);
+					if(distance > geometry->radius) geometry->radius = distance;
+
+					hash.keys[slot] = key;
+					hash.values[slot] = (ui16)index;
+				};
+
+				if(corner_count < EXPORT_MAX_CORNERS) corners[corner_count++] = hash.values[slot];
+			};
+
+			// counter clockwise like the obj, the rasterizer state has front faces counter clockwise
+			for(ui32 i = 2; ok && i < corner_count; i++) {
+				if(state->index_count + 3 - geometry->index_first > 0xffff) {
+					printf("%s: more than 65535 indices\n", geometry->path);
+					ok = false;
+					break;
+				};
+				ui16 triangle[3] = { corners[0], corners[i - 1], corners[i] };
+				for(ui32 corner = 0; corner < 3; corner++) {
+					state->indices = (ui16*)export_grow(state->indices, &state->index_capacity, state->index_count, sizeof(ui16));
+					state->indices[state->index_count++] = triangle[corner];
+				};
+			};
+		};
+	};
+
+	fclose(file);
+	free(positions);
+	free(uvs);
+	free(hash.keys);
+	free(hash.values);
+
+	geometry->vertex_count = state->vertex_count - geometry->vertex_first;
+	geometry->index_count = state->index_count - geometry->index_first;
+	if(ok && geometry->index_count == 0) {
+		printf("%s: no faces\n", geometry->path);
+		ok = false;
+	};
+	return ok;
+};
+
+// ------------------------------- description
+
+// index of the geometry read from path, loading it the first time, ~0 on failure
+internal ui32 export_find_geometry(export_state* state, char* path) {
+	for(ui32 i = 0; i < state->geometry_count; i++) {
+		if(strcmp(state->geometries[i].path, path) == 0) return i;
+	};
+
+	size_t length = strlen(path);
+	if(length >= SCENE_MATERIAL_PATH) {
+		printf("%s: path longer than %u characters\n", path, SCENE_MATERIAL_PATH - 1);
+		return ~0u;
+	};
+
+	state->geometries = (export_geometry*)export_grow(state->geometries, &state->geometry_capacity, state->geometry_count, sizeof(export_geometry));
+	export_geometry* geometry = &state->geometries[state->geometry_count];
+	memset(geometry, 0, sizeof(export_geometry));
+	memcpy(geometry->path, path, length);
+
+	if(!export_load_obj(state, geometry)) return ~0u;
+	return state->geometry_count++;
+};
+
+// index of the texture in the material table, adding it the first time, ~0 when the path does not fit
+internal ui32 export_find_material(export_state* state, char* path) {
+	for(ui32 i = 0; i < state->material_count; i++) {
+		if(strcmp(state->materials[i].path, path) == 0) return i;
+	};
+
+	size_t length = strlen(path);
+	if(length >= SCENE_MATERIAL_PATH) {
+		printf("%s: path longer than %u characters\n", path, SCENE_MATERIAL_PATH - 1);
+		return ~0u;
+	};
+
+	state->materials = (scene_file_material*)export_grow(state->materials, &state->material_capacity, state->material_count, sizeof(scene_file_material));
+	scene_file_material* material = &state->materials[state->material_count];
+	memset(material, 0, sizeof(scene_file_material));
+	memcpy(material->path, path, length);
+	return state->material_count++;
+};
+
+internal bool export_read_description(export_state* state, char* location) {
+	FILE* file = fopen(location, "rb");
+	if(!file) {
+		printf("could not read %s\n", location);
+		return false;
+	};
+
+	bool ok = true;
+	ui32 line_number = 0;
+	char line[EXPORT_MAX_LINE];
+	while(ok && fgets(line, sizeof(line), file)) {
+		line_number++;
+
+		char* cursor = line;
+		while(*cursor == ' ' || *cursor == '\t') cursor++;
+		if(*cursor == '#' || *cursor == '\0' || *cursor == '\r' || *cursor == '\n') continue;
+
+		char keyword[32];
+		char obj[EXPORT_MAX_LINE]; // a whole line, paths too long for the file are read whole and rejected
+		char texture[EXPORT_MAX_LINE];
+		char flags[2][32] = {};
+		v3 pos;
+		int read = sscanf(cursor, "%31s %s %f %f %f %s %31s %31s", keyword, obj, &pos.x, &pos.y, &pos.z, texture, flags[0], flags[1]);
+		if(read < 6 || strcmp(keyword, "object") != 0) {
+			printf("%s:%u: expected object <mesh .obj> <x> <y> <z> <texture> [occluder] [dynamic]\n", location, line_number);
+			ok = false;
+			break;
+		};
+
+		ui32 geometry_index = export_find_geometry(state, obj);
+		ui32 material_index = export_find_material(state, texture);
+		if(geometry_index == ~0u || material_index == ~0u) {
+			ok = false;
+			break;
+		};
+		export_geometry* geometry = &state->geometries[geometry_index];
+
+		// offsets are relative to the vertex & index data for now, the file layout is known at the end
+		state->meshes = (scene_file_mesh*)export_grow(state->meshes, &state->mesh_capacity, state->mesh_count, sizeof(scene_file_mesh));
+		scene_file_mesh* m = &state->meshes[state->mesh_count++];
+		memset(m, 0, sizeof(scene_file_mesh));
+		m->pos = pos;
+		m->vertex_count = geometry->vertex_count;
+		m->vertices = (ui64)geometry->vertex_first * sizeof(scene_file_vertex);
+		m->index_count = (ui16)geometry->index_count;
+		m->indices = (ui64)geometry->index_first * sizeof(ui16);
+		m->material = material_index;
+		m->radius = geometry->radius;
+
+		for(int i = 0; i < read - 6; i++) {
+			if(strcmp(flags[i], "occluder") == 0) m->occluder = 1;
+			else if(strcmp(flags[i], "dynamic") == 0) m->dynamic = 1;
+			else printf("%s:%u: unknown flag %s, ignored\n", location, line_number, flags[i]);
+		};
+	};
+
+	fclose(file);
+	if(ok && state->mesh_count == 0) {
+		printf("%s: no objects\n", location);
+		ok = false;
+	};
+	return ok;
+};
+
+// ------------------------------- output
+
+internal void export_pad(FILE* out, ui64* offset) {
+	static const ui8 zeros[SCENE_FILE_ALIGNMENT] = {};
+	ui64 aligned = scene_file_align(*offset);
+	fwrite(zeros, 1, (size_t)(aligned - *offset), out);
+	*offset = aligned;
+};
+
+int main(int argc, char** argv) {
+	if(argc < 3) {
+		printf("usage: scene_export <description> <output .scene>\n");
+		return 1;
+	};
+
+	export_state state = {};
+	if(!export_read_description(&state, argv[1])) return 1;
+
+	scene_file_header header = {};
+	header.magic = SCENE_FILE_MAGIC;
+	header.version = SCENE_FILE_VERSION;
+	header.mesh_count = state.mesh_count;
+	header.material_count = state.material_count;
+	header.mesh_offset = scene_file_align(sizeof(scene_file_header));
+	header.material_offset = scene_file_align(header.mesh_offset + sizeof(scene_file_mesh) * (ui64)state.mesh_count);
+	header.vertex_offset = scene_file_align(header.material_offset + sizeof(scene_file_material) * (ui64)state.material_count);
+	header.vertex_bytes = sizeof(scene_file_vertex) * (ui64)state.vertex_count;
+	header.index_offset = scene_file_align(header.vertex_offset + header.vertex_bytes);
+	header.index_bytes = sizeof(ui16) * (ui64)state.index_count;
+	header.file_size = header.index_offset + header.index_bytes;
+
+	for(ui32 i = 0; i < state.mesh_count; i++) {
+		state.meshes[i].vertices += header.vertex_offset;
+		state.meshes[i].indices += header.index_offset;
+	};
+
+	FILE* out = fopen(argv[2], "wb");
+	if(!out) {
+		printf("could not write %s\n", argv[2]);
+		return 1;
+	};
+
+	ui64 offset = 0;
+	fwrite(&header, sizeof(header), 1, out);
+	offset += sizeof(header);
+	export_pad(out, &offset);
+	fwrite(state.meshes, sizeof(scene_file_mesh), state.mesh_count, out);
+	offset += sizeof(scene_file_mesh) * (ui64)state.mesh_count;
+	export_pad(out, &offset);
+	fwrite(state.materials, sizeof(scene_file_material), state.material_count, out);
+	offset += sizeof(scene_file_material) * (ui64)state.material_count;
+	export_pad(out, &offset);
+	fwrite(state.vertices, sizeof(scene_file_vertex), state.vertex_count, out);
+	offset += header.vertex_bytes;
+	export_pad(out, &offset);
+	fwrite(state.indices, sizeof(ui16), state.index_count, out);
+	free(state.meshes);
+	free(state.materials);
+	free(state.geometries);
+	free(state.vertices);
+	free(state.indices);
+
+	bool ok = ferror(out) == 0;
+	fclose(out);
+	if(!ok) {
+		printf("could not write %s\n", argv[2]);
+		return 1;
+	};
+
+	printf("%s: %u objects, %u meshes, %u materials, %u vertices, %u indices\n", argv[2], state.mesh_count, state.geometry_count, state.material_count, state.vertex_count, state.index_count);
+	return 0;
+};
@@ -0,0 +1,245 @@
+/*  ----------------------------------- SHADER BAKE
+	Offline step of the shader permutation system (see render/shader.h).
+	Compiles every permutation of every program (over the features it reads) and writes them into a single cache file.
+	Identical bytecode is only stored once, and variants whose key did not change since the
+	last cache are copied over instead of being recompiled.
+
+	usage: shader_bake.exe <shader source dir> <output cache>
+*/
+
+#define COBJMACROS
+#define WIN32_LEAN_AND_MEAN
+
+#pragma comment (lib, "d3dcompiler")
+
+// std
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// os stuff
+#include <windows.h>
+#include <d3d11.h>
+#include <d3dcompiler.h>
+
+// raylib (for the math types)
+#include "raylib/raymath.h"
+
+// Custom
+#include "types.h"
+#include "platform/io.h"
+#include "render/shader.h"
+
+#define BAKE_MAX_VARIANTS (SHADER_PROGRAM_COUNT * SHADER_PERMUTATION_COUNT * SHADER_STAGE_COUNT)
+
+struct bake_blob {
+	ui64 hash; // of the bytecode itself, for deduplication
+	ui32 offset;
+	ui32 size;
+};
+
+struct bake_state {
+	shader_cache_entry entries[BAKE_MAX_VARIANTS];
+	ui32 entry_count;
+
+	bake_blob blobs[BAKE_MAX_VARIANTS];
+	ui32 blob_count;
+
+	ui8* bytecode;
+	ui32 bytecode_size;
+	ui32 bytecode_capacity;
+
+	// previous cache, used to skip compiling variants that did not change
+	complete_file old_file;
+	shader_cache_header* old_header;
+	shader_cache_entry* old_entries;
+	shader_cache_blob* old_blobs;
+	ui8* old_bytecode;
+
+	ui32 compiled;
+	ui32 reused;
+};
+
+void bake_load_previous(bake_state* state, char* location) {
+	io_file_fullread(location, &state->old_file);
+	if(!state->old_file.memory || state->old_file.size < sizeof(shader_cache_header)) {
+		state->old_file = {0};
+		return;
+	};
+
+	ui8* cursor = (ui8*)state->old_file.memory;
+	shader_cache_header* header = (shader_cache_header*)cursor;
+	if(header->magic != SHADER_CACHE_MAGIC || header->version != SHADER_CACHE_VERSION || !shader_cache_check(&state->old_file)) {
+		return;
+	};
+
+	state->old_header = header;
+	cursor += sizeof(shader_cache_header);
+	state->old_entries = (shader_cache_entry*)cursor;
+	cursor += sizeof(shader_cache_entry) * header->entry_count;
+	state->old_blobs = (shader_cache_blob*)cursor;
+	cursor += sizeof(shader_cache_blob) * header->blob_count;
+	state->old_bytecode = cursor;
+};
+
+bool bake_find_previous(bake_state* state, ui64 key, void** code, ui32* size) {
+	if(!state->old_header) return false;
+
+	for(ui32 i = 0; i < state->old_header->entry_count; i++) {
+		if(state->old_entries[i].key == key) {
+			shader_cache_blob blob = state->old_blobs[state->old_entries[i].blob];
+			*code = state->old_bytecode + blob.offset;
+			*size = blob.size;
+			return true;
+		};
+	};
+	return false;
+};
+
+// returns the index of the blob holding this bytecode, adding it if nobody had it yet
+ui32 bake_add_blob(bake_state* state, void* code, ui32 size) {
+	ui64 hash = hash_fnv64(code, size, 0);
+
+	for(ui32 i = 0; i < state->blob_count; i++) {
+		bake_blob* blob = &state->blobs[i];
+		if(blob->hash == hash && blob->size == size && memcmp(state->bytecode + blob->offset, code, size) == 0) {
+			return i;
+		};
+	};
+
+	if(state->bytecode_size + size > state->bytecode_capacity) {
+		state->bytecode_capacity = (state->bytecode_size + size) * 2;
+		state->bytecode = (ui8*)realloc(state->bytecode, state->bytecode_capacity);
+	};
+
+	bake_blob* blob = &state->blobs[state->blob_count];
+	blob->hash = hash;
+	blob->offset = state->bytecode_size;
+	blob->size = size;
+	memcpy(state->bytecode + blob->offset, code, size);
+	state->bytecode_size += size;
+
+	return state->blob_count++;
+};
+
+bool bake_variant(bake_state* state, ui32 program, char* path, complete_file* source, ui32 features, ui32 stage) {
+	ui64 key = shader_variant_key(source->memory, source->size, features, stage);
+
+	void* code;
+	ui32 size;
+	ID3DBlob* compiled = NULL;
+
+	if(bake_find_previous(state, key, &code, &size)) {
+		state->reused++;
+	} else {
+		ID3DBlob* errors = NULL;
+		HRESULT hr = shader_compile_variant(source->memory, source->size, path, features, stage, &compiled, &errors);
+
+		if(FAILED(hr)) {
+			printf("%s (features 0x%x, %s) failed to compile:\n", path, features, shader_stage_entries[stage]);
+			if(errors) {
+				printf("%s\n", (char*)errors->GetBufferPointer());
+				errors->Release();
+			};
+			return false;
+		};
+		if(errors) errors->Release();
+
+		code = compiled->GetBufferPointer();
+		size = (ui32)compiled->GetBufferSize();
+		state->compiled++;
+	};
+
+	shader_cache_entry* entry = &state->entries[state->entry_count++];
+	entry->key = key;
+	entry->program = program;
+	entry->features = features;
+	entry->stage = stage;
+	entry->blob = bake_add_blob(state, code, size);
+
+	if(compiled) compiled->Release();
+
+	return true;
+};
+
+bool bake_write(bake_state* state, char* location) {
+	shader_cache_header header = {
+		.magic = SHADER_CACHE_MAGIC,
+		.version = SHADER_CACHE_VERSION,
+		.entry_count = state->entry_count,
+		.blob_count = state->blob_count,
+	};
+
+	ui32 size = sizeof(header) + sizeof(shader_cache_entry) * state->entry_count + sizeof(shader_cache_blob) * state->blob_count + state->bytecode_size;
+	ui8* memory = (ui8*)malloc(size);
+	ui8* cursor = memory;
+
+	memcpy(cursor, &header, sizeof(header));
+	cursor += sizeof(header);
+
+	memcpy(cursor, state->entries, sizeof(shader_cache_entry) * state->entry_count);
+	cursor += sizeof(shader_cache_entry) * state->entry_count;
+
+	for(ui32 i = 0; i < state->blob_count; i++) {
+		shader_cache_blob blob = { state->blobs[i].offset, state->blobs[i].size };
+		memcpy(cursor, &blob, sizeof(blob));
+		cursor += sizeof(blob);
+	};
+
+	memcpy(cursor, state->bytecode, state->bytecode_size);
+
+	bool ok = io_file_fullwrite(location, memory, size);
+	free(memory);
+	return ok;
+};
+
+int main(int argc, char** argv) {
+	if(argc < 3) {
+		printf("usage: shader_bake <shader source dir> <output cache>\n");
+		return 1;
+	};
+
+	char* source_dir = argv[1];
+	char* output = argv[2];
+
+	bake_state* state = (bake_state*)calloc(1, sizeof(bake_state));
+	bake_load_previous(state, output);
+
+	for(ui32 program = 0; program < SHADER_PROGRAM_COUNT; program++) {
+		char path[MAX_PATH];
+		snprintf(path, sizeof(path), "%s/%s", source_dir, shader_program_sources[program]);
+
+		complete_file source = {0};
+		io_file_fullread(path, &source);
+		if(!source.memory) {
+			printf("could not read %s\n", path);
+			return 1;
+		};
+
+		// every subset of the features the program reads, 0 included
+		ui32 mask = shader_program_features[program];
+		ui32 features = 0;
+		do {
+			for(ui32 stage = 0; stage < SHADER_STAGE_COUNT; stage++) {
+				if(!(shader_program_stages[program] & (1 << stage))) continue;
+				if(!bake_variant(state, program, path, &source, features, stage)) {
+					return 1;
+				};
+			};
+			features = (features - mask) & mask;
+		} while(features != 0);
+
+		io_file_fullfree(&source);
+	};
+
+	// the old cache memory is still referenced until the new one is written
+	if(!bake_write(state, output)) {
+		printf("could not write %s\n", output);
+		return 1;
+	};
+
+	printf("%s: %u variants, %u unique blobs (%u compiled, %u reused)\n", output, state->entry_count, state->blob_count, state->compiled, state->reused);
+	return 0;
+};
@@ -0,0 +1,251 @@
+/*  ----------------------------------- VT BAKE
+	Offline step of virtual texturing (see render/virtual_texture.h).
+	Pads an image to a square power of two number of tiles, builds every mip down to a single tile
+	and writes them as bordered tiles into a .vt file. The runtime only ever reads tiles, the whole
+	texture goes through memory here one mip at a time.
+	Each tile is compressed on its own (lz.h), BAKE_BATCH at a time on the job system.
+
+	usage: vt_bake.exe <image> <output .vt>
+*/
+
+#define COBJMACROS
+#define WIN32_LEAN_AND_MEAN
+#define internal static
+
+// std
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <emmintrin.h>
+
+// os stuff
+#include <windows.h>
+#include <d3d11.h>
+
+// raylib (for the math types)
+#include "raylib/raymath.h"
+
+// stb
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb/stb_image.h"
+
+// Custom
+#include "types.h"
+#include "platform/io.h"
+#include "platform/jobs.h"
+#include "platform/async_io.h"
+#include "lz.h"
+#include "render/virtual_texture.h"
+
+#define BAKE_BATCH 64 // tiles cut & compressed at once
+
+struct bake_job {
+	ui32* level;
+	ui32 size;
+	ui32 tx;
+	ui32 ty;
+	ui32* tile; // VT_TILE_BYTES
+	ui8* packed; // LZ_BOUND(VT_TILE_BYTES)
+	ui32 packed_size; // VT_TILE_BYTES : not worth it, the tile is stored raw
+};
+
+// copies the image in the top left corner, its last column and row are repeated over the padding
+void bake_pad(ui32* dst, ui32 size, ui32* src, ui32 width, ui32 height) {
+	for(ui32 y = 0; y < size; y++) {
+		ui32* src_row = src + (y < height ? y : height - 1) * width;
+		ui32* dst_row = dst + y * size;
+
+		memcpy(dst_row, src_row, width * sizeof(ui32));
+		for(ui32 x = width; x < size; x++) dst_row[x] = src_row[width - 1];
+	};
+};
+
+// 2 source pixels of each row -> 16 bit channels of the 2 destination pixels, rounded sum of the 4
+internal __m128i bake_sum_2x2(__m128i row0, __m128i row1) {
+	__m128i zero = _mm_setzero_si128();
+	__m128i low = _mm_add_epi16(_mm_unpacklo_epi8(row0, zero), _mm_unpacklo_epi8(row1, zero));
+	__m128i high = _mm_add_epi16(_mm_unpackhi_epi8(row0, zero), _mm_unpackhi_epi8(row1, zero));
+	__m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(low, high), _mm_unpackhi_epi64(low, high));
+	return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+};
+
+// 2x2 box filter, each channel on its own, 4 destination pixels at a time with SSE2
+void bake_downsample(ui32* dst, ui32* src, ui32 src_size) {
+	ui32 size = src_size / 2;
+
+	for(ui32 y = 0; y < size; y++) {
+		ui32* row0 = src + (y * 2) * src_size;
+		ui32* row1 = row0 + src_size;
+
+		ui32 x = 0;
+		for(; x + 4 <= size; x += 4) {
+			__m128i a = bake_sum_2x2(_mm_loadu_si128((__m128i*)(row0 + x * 2)), _mm_loadu_si128((__m128i*)(row1 + x * 2)));
+			__m128i b = bake_sum_2x2(_mm_loadu_si128((__m128i*)(row0 + x * 2 + 4)), _mm_loadu_si128((__m128i*)(row1 + x * 2 + 4)));
+			_mm_storeu_si128((__m128i*)(dst + y * size + x), _mm_packus_epi16(a, b));
+		};
+
+		for(; x < size; x++) {
+			ui32 a = row0[x * 2], b = row0[x * 2 + 1], c = row1[x * 2], d = row1[x * 2 + 1];
+			ui32 pixel = 0;
+			for(ui32 shift = 0; shift < 32; shift += 8) {
+				ui32 sum = ((a >> shift) & 0xff) + ((b >> shift) & 0xff) + ((c >> shift) & 0xff) + ((d >> shift) & 0xff);
+				pixel |= ((sum + 2) / 4) << shift;
+			};
+			dst[y * size + x] = pixel;
+		};
+	};
+};
+
+// one tile with its border, the border past the edges of the mip repeats the edge
+void bake_tile(ui32* dst, ui32* level, ui32 size, ui32 tx, ui32 ty) {
+	// columns of the padded tile that are inside the mip, one copy per row for those
+	i32 x0 = (i32)(tx * VT_TILE_SIZE) - VT_TILE_BORDER;
+	ui32 first = x0 < 0 ? (ui32)-x0 : 0;
+	ui32 last = x0 + VT_TILE_PADDED > (i32)size ? (ui32)((i32)size - x0) : VT_TILE_PADDED;
+
+	for(ui32 py = 0; py < VT_TILE_PADDED; py++) {
+		i32 y = (i32)(ty * VT_TILE_SIZE + py) - VT_TILE_BORDER;
+		y = y < 0 ? 0 : (y >= (i32)size ? size - 1 : y);
+		ui32* src_row = level + y * size;
+		ui32* dst_row = dst + py * VT_TILE_PADDED;
+
+		memcpy(dst_row + first, src_row + x0 + first, (last - first) * sizeof(ui32));
+		for(ui32 px = 0; px < first; px++) dst_row[px] = src_row[0];
+		for(ui32 px = last; px < VT_TILE_PADDED; px++) dst_row[px] = src_row[size - 1];
+	};
+};
+
+internal void bake_tile_job(void* data) {
+	bake_job* job = (bake_job*)data;
+	bake_tile(job->tile, job->level, job->size, job->tx, job->ty);
+
+	job->packed_size = lz_compress(job->packed, job->tile, VT_TILE_BYTES);
+	if(job->packed_size >= VT_TILE_BYTES) job->packed_size = VT_TILE_BYTES;
+};
+
+int main(int argc, char** argv) {
+	if(argc < 3) {
+		printf("usage: vt_bake <image> <output .vt>\n");
+		return 1;
+	};
+
+	int width, height, channels;
+	ui32* image = (ui32*)stbi_load(argv[1], &width, &height, &channels, 4);
+	if(!image) {
+		printf("could not read %s\n", argv[1]);
+		return 1;
+	};
+
+	ui32 tiles_per_side = 1;
+	ui32 mip_count = 1;
+	while(tiles_per_side * VT_TILE_SIZE < (ui32)(width > height ? width : height)) {
+		tiles_per_side *= 2;
+		mip_count++;
+	};
+	if(mip_count > VT_MAX_MIPS) {
+		printf("%s is too big, %u tiles per side at most\n", argv[1], 1 << (VT_MAX_MIPS - 1));
+		return 1;
+	};
+
+	vt_file_header header = {
+		.magic = VT_FILE_MAGIC,
+		.version = VT_FILE_VERSION,
+		.width = (ui32)width,
+		.height = (ui32)height,
+		.tiles_per_side = tiles_per_side,
+		.mip_count = mip_count,
+	};
+	ui32 mip_first[VT_MAX_MIPS];
+	header.tile_count = vt_mip_layout(tiles_per_side, mip_count, mip_first);
+
+	FILE* out = fopen(argv[2], "wb");
+	if(!out) {
+		printf("could not write %s\n", argv[2]);
+		return 1;
+	};
+
+	// the table is written again at the end, once the compressed sizes are known
+	ui64* offsets = (ui64*)calloc(header.tile_count, sizeof(ui64));
+	ui32* sizes = (ui32*)calloc(header.tile_count, sizeof(ui32));
+	fwrite(&header, sizeof(header), 1, out);
+	fwrite(offsets, sizeof(ui64), header.tile_count, out);
+	fwrite(sizes, sizeof(ui32), header.tile_count, out);
+	ui64 offset = sizeof(header) + (sizeof(ui64) + sizeof(ui32)) * (ui64)header.tile_count;
+	ui64 first_tile = offset;
+
+	ui32 size = tiles_per_side * VT_TILE_SIZE;
+	ui32* level = (ui32*)malloc((size_t)size * size * sizeof(ui32));
+	bake_pad(level, size, image, width, height);
+	stbi_image_free(image);
+
+	job_system jobs;
+	jobs_init(&jobs, 0);
+	bake_job batch[BAKE_BATCH];
+	ui8* memory = (ui8*)malloc((size_t)(VT_TILE_BYTES + LZ_BOUND(VT_TILE_BYTES)) * BAKE_BATCH);
+	ui32 tile_index = 0;
+
+	for(ui32 mip = 0; mip < mip_count; mip++) {
+		ui32 side = tiles_per_side >> mip;
+		ui32 mip_tiles = side * side;
+
+		for(ui32 first = 0; first < mip_tiles; first += BAKE_BATCH) {
+			ui32 count = mip_tiles - first < BAKE_BATCH ? mip_tiles - first : BAKE_BATCH;
+
+			volatile LONG counter = 0;
+			for(ui32 i = 0; i < count; i++) {
+				ui8* job_memory = memory + (size_t)(VT_TILE_BYTES + LZ_BOUND(VT_TILE_BYTES)) * i;
+				batch[i] = {
+					.level = level,
+					.size = size,
+					.tx = (first + i) % side,
+					.ty = (first + i) / side,
+					.tile = (ui32*)job_memory,
+					.packed = job_memory + VT_TILE_BYTES,
+				};
+				jobs_push(&jobs, bake_tile_job, &batch[i], &counter);
+			};
+			jobs_wait(&jobs, &counter);
+
+			// in order, the runtime expects mip 0 first then row by row
+			for(ui32 i = 0; i < count; i++) {
+				bake_job* job = &batch[i];
+				fwrite(job->packed_size == VT_TILE_BYTES ? (void*)job->tile : (void*)job->packed, job->packed_size, 1, out);
+				offsets[tile_index] = offset;
+				sizes[tile_index] = job->packed_size;
+				offset += job->packed_size;
+				tile_index++;
+			};
+		};
+
+		if(mip + 1 < mip_count) {
+			ui32* next = (ui32*)malloc((size_t)(size / 2) * (size / 2) * sizeof(ui32));
+			bake_downsample(next, level, size);
+			free(level);
+			level = next;
+			size /= 2;
+		};
+	};
+
+	jobs_shutdown(&jobs);
+	free(memory);
+	free(level);
+
+	fseek(out, sizeof(header), SEEK_SET);
+	fwrite(offsets, sizeof(ui64), header.tile_count, out);
+	fwrite(sizes, sizeof(ui32), header.tile_count, out);
+	free(offsets);
+	free(sizes);
+
+	bool ok = ferror(out) == 0;
+	fclose(out);
+	if(!ok) {
+		printf("could not write %s\n", argv[2]);
+		return 1;
+	};
+
+	ui64 raw = (ui64)VT_TILE_BYTES * header.tile_count;
+	printf("%s: %ux%u, %u mips, %u tiles, %.1f%% of raw\n", argv[2], width, height, mip_count, header.tile_count, 100.0 * (f64)(offset - first_tile) / (f64)raw);
+	return 0;
+};
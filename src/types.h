@@ -47,6 +47,40 @@ ui32 int_to_ui32(int x) {
 	return (ui32)x << 0;
 };
 
+//  ----------------------------------- hashing
+// FNV-1a 64 bits, seed with 0 to start a new hash or with a previous result to chain
+ui64 hash_fnv64(const void* data, size_t size, ui64 seed) {
+	const ui8* bytes = (const ui8*)data;
+	ui64 hash = seed ? seed : 0xcbf29ce484222325ull;
+	for(size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ull;
+	};
+	return hash;
+};
+
+// 8 bytes at a time, for big buffers (vertex data) where fnv is too slow. not stable across versions, do not store it
+ui64 hash_fast64(const void* data, size_t size, ui64 seed) {
+	const ui8* bytes = (const ui8*)data;
+	ui64 hash = seed ^ (size * 0x9e3779b97f4a7c15ull);
+	size_t i = 0;
+	for(; i + 8 <= size; i += 8) {
+		ui64 word;
+		memcpy(&word, bytes + i, 8);
+		hash ^= word * 0xff51afd7ed558ccdull;
+		hash = ((hash << 31) | (hash >> 33)) * 0xc4ceb9fe1a85ec53ull;
+	};
+	for(; i < size; i++) {
+		hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+	};
+
+	// final mix so close inputs end up far apart
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdull;
+	hash ^= hash >> 33;
+	return hash;
+};
+
 //  ----------------------------------- math
 float slope(float min, float max, float cap) {
 	return (max - min) / cap;